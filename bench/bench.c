@@ -0,0 +1,64 @@
+/*
+ * native benchmarks
+ *
+ * Copyright 2006-2009 Mike McCormack
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "ntapi.h"
+#include "log.h"
+#include "bench.h"
+
+static ULONG bench_failures;
+
+void bench_run( const char *name, bench_func_t func, ULONG count )
+{
+	LARGE_INTEGER start, end, freq;
+	ULONG warmup;
+	NTSTATUS r;
+
+	// fault in code and data, and let the kernel create its objects
+	warmup = count/10;
+	if (!warmup)
+		warmup = 1;
+	func( warmup );
+
+	r = NtQueryPerformanceCounter( &start, &freq );
+	if (r != STATUS_SUCCESS || !freq.QuadPart)
+	{
+		bench_fail( name, "NtQueryPerformanceCounter", r );
+		return;
+	}
+
+	func( count );
+
+	NtQueryPerformanceCounter( &end, NULL );
+
+	// report in 100ns units whatever the counter frequency is
+	dprintf( "bench %s %lu %lu\n", name, count,
+		 (ULONG) ((end.QuadPart - start.QuadPart) * 10000000LL / freq.QuadPart) );
+}
+
+void bench_fail( const char *name, const char *what, NTSTATUS r )
+{
+	dprintf( "bench %s failed: %s returned %08lx\n", name, what, r );
+	bench_failures++;
+}
+
+void bench_fini( void )
+{
+	NtTerminateProcess( NtCurrentProcess(), bench_failures ? 1 : 0 );
+}
@@ -0,0 +1,40 @@
+/*
+ * native benchmarks
+ *
+ * Copyright 2006-2009 Mike McCormack
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __RING3K_BENCH_H__
+#define __RING3K_BENCH_H__
+
+// a benchmark body runs its operation "count" times
+typedef void (*bench_func_t)( ULONG count );
+
+// Runs func once unmeasured to warm up, then measures "count" iterations
+// and reports a line that runbench.pl picks up:
+//
+//   bench <name> <iterations> <elapsed time in 100ns units>
+//
+void bench_run( const char *name, bench_func_t func, ULONG count );
+
+// prints an error and marks the run as failed
+void bench_fail( const char *name, const char *what, NTSTATUS r );
+
+// terminates the process, with a non-zero status if anything failed
+void bench_fini( void );
+
+#endif // __RING3K_BENCH_H__
@@ -0,0 +1,224 @@
+/*
+ * native benchmarks - win32k round trips
+ *
+ * Copyright 2006-2009 Mike McCormack
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "ntapi.h"
+#include "ntwin32.h"
+#include "log.h"
+#include "bench.h"
+
+////// callbacks
+
+// every callback just returns, including the window procedure callbacks
+void NTAPI bench_callback( void *arg )
+{
+	NtCallbackReturn( 0, 0, 0 );
+}
+
+void *callback_table[NUM_USER32_CALLBACKS];
+void *ucbN_funcs[9];
+void *ucbW_funcs[20];
+void *ucbA_funcs[20];
+
+static void fill_table( void **table, ULONG count )
+{
+	ULONG i;
+
+	for (i=0; i<count; i++)
+		table[i] = bench_callback;
+}
+
+void* get_peb( void )
+{
+	void **p;
+	__asm__ ( "movl %%fs:0x18, %%eax\n\t" : "=a" (p) );
+	return p[0x30/sizeof (*p)];
+}
+
+const int ofs_exe_base_in_peb = 0x08;
+const int ofs_callback_table_in_peb = 0x2c;
+
+void *get_exe_base( void )
+{
+	void** peb = get_peb();
+	return peb[ofs_exe_base_in_peb/4];
+}
+
+static USER_PROCESS_CONNECT_INFO user_info;
+
+static NTSTATUS become_gui_thread( void )
+{
+	void **peb = get_peb();
+	NTSTATUS r;
+
+	fill_table( callback_table, NUM_USER32_CALLBACKS );
+	fill_table( ucbN_funcs, 9 );
+	fill_table( ucbW_funcs, 20 );
+	fill_table( ucbA_funcs, 20 );
+	peb[ofs_callback_table_in_peb/4] = callback_table;
+
+	NtGdiInit();
+
+	memset( &user_info, 0, sizeof user_info );
+	user_info.Version = 0x00050000;
+	r = NtUserProcessConnect( NtCurrentProcess(), &user_info, sizeof user_info );
+	if (r != STATUS_SUCCESS)
+		return r;
+
+	NtUserInitializeClientPfnArrays( ucbN_funcs, ucbW_funcs, ucbA_funcs, get_exe_base() );
+	return STATUS_SUCCESS;
+}
+
+////// gdi blit
+
+#define BLIT_SIZE 64
+
+static HGDIOBJ blit_dest, blit_src;
+
+static void bench_blit( ULONG count )
+{
+	ULONG i;
+
+	for (i=0; i<count; i++)
+		NtGdiBitBlt( blit_dest, 0, 0, BLIT_SIZE, BLIT_SIZE,
+			     blit_src, 0, 0, SRCCOPY, 0, 0 );
+}
+
+static void run_blit( ULONG count )
+{
+	HANDLE bitmap;
+
+	blit_dest = NtUserGetDC( 0 );
+	if (!blit_dest)
+	{
+		bench_fail( "blit", "NtUserGetDC", 0 );
+		return;
+	}
+
+	blit_src = NtGdiCreateCompatibleDC( blit_dest );
+	bitmap = NtGdiCreateCompatibleBitmap( blit_dest, BLIT_SIZE, BLIT_SIZE );
+	if (blit_src && bitmap)
+	{
+		NtGdiSelectBitmap( blit_src, bitmap );
+		bench_run( "blit", bench_blit, count );
+	}
+	else
+		bench_fail( "blit", "NtGdiCreateCompatibleBitmap", 0 );
+
+	if (bitmap)
+		NtGdiDeleteObjectApp( bitmap );
+	if (blit_src)
+		NtGdiDeleteObjectApp( blit_src );
+	NtUserCallOneParam( (ULONG) blit_dest, NTUCOP_RELEASEDC );
+}
+
+////// window message round trip
+
+ULONG NTAPI bench_wndproc( HANDLE Window, UINT Message, UINT Wparam, ULONG Lparam )
+{
+	return 0;
+}
+
+static WCHAR bench_class_name[] = L"BENCHCLS";
+static HWND bench_window;
+
+static ATOM register_class( void )
+{
+	NTCLASSMENUNAMES menu;
+	UNICODE_STRING empty;
+	UNICODE_STRING name;
+	NTWNDCLASSEX wndcls;
+
+	memset( &wndcls, 0, sizeof wndcls );
+	memset( &menu, 0, sizeof menu );
+	memset( &empty, 0, sizeof empty );
+
+	init_us( &name, bench_class_name );
+	name.MaximumLength = name.Length + 2;
+
+	wndcls.Size = sizeof wndcls;
+	wndcls.WndProc = bench_wndproc;
+	wndcls.WndExtra = 4;
+	wndcls.Instance = get_exe_base();
+	wndcls.ClassName = bench_class_name;
+	menu.name_us = &empty;
+
+	return NtUserRegisterClassExWOW( &wndcls, &name, &menu, 0, 0x80, 0 );
+}
+
+static void bench_message( ULONG count )
+{
+	MSG msg;
+	ULONG i;
+
+	for (i=0; i<count; i++)
+	{
+		NtUserPostMessage( bench_window, WM_USER, i, 0 );
+		NtUserGetMessage( &msg, 0, 0, 0 );
+		NtUserDispatchMessage( &msg );
+	}
+}
+
+static void run_message( ULONG count )
+{
+	WCHAR title_str[] = L"bench";
+	USER32_UNICODE_STRING cls, title;
+
+	if (!register_class())
+	{
+		bench_fail( "message", "NtUserRegisterClassExWOW", 0 );
+		return;
+	}
+
+	cls.Buffer = bench_class_name;
+	cls.Length = sizeof bench_class_name - 2;
+	cls.MaximumLength = sizeof bench_class_name;
+
+	title.Buffer = title_str;
+	title.Length = sizeof title_str - 2;
+	title.MaximumLength = 0;
+
+	bench_window = NtUserCreateWindowEx( 0x80000000, &cls, &title, WS_CAPTION,
+		0, 0, 100, 100, 0, 0, get_exe_base(), 0, 0x400 );
+	if (!bench_window)
+	{
+		bench_fail( "message", "NtUserCreateWindowEx", 0 );
+		return;
+	}
+
+	bench_run( "message", bench_message, count );
+
+	NtUserDestroyWindow( bench_window );
+}
+
+void NtProcessStartup( void )
+{
+	NTSTATUS r;
+
+	log_init();
+	r = become_gui_thread();
+	if (r == STATUS_SUCCESS)
+	{
+		run_blit( 10000 );
+		run_message( 10000 );
+	}
+	else
+		bench_fail( "gui", "NtUserProcessConnect", r );
+	bench_fini();
+}
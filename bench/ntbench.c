@@ -0,0 +1,328 @@
+/*
+ * native benchmarks - kernel object round trips
+ *
+ * Copyright 2006-2009 Mike McCormack
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "ntapi.h"
+#include "rtlapi.h"
+#include "log.h"
+#include "bench.h"
+
+////// syscall round trip
+
+static void bench_syscall( ULONG count )
+{
+	ULONG i;
+
+	for (i=0; i<count; i++)
+		NtTestAlert();
+}
+
+////// LPC request/reply
+
+static WCHAR bench_portname[] = L"\\RPC Control\\benchport";
+static HANDLE lpc_client;
+
+static void lpc_server( void *param )
+{
+	HANDLE port = param, con_port = 0;
+	BYTE buffer[0x100];
+	LPC_MESSAGE *req = (void*) buffer;
+	HANDLE client = 0;
+	NTSTATUS r;
+
+	memset( buffer, 0, sizeof buffer );
+	r = NtListenPort( port, req );
+	if (r == STATUS_SUCCESS)
+		r = NtAcceptConnectPort( &con_port, 0, req, TRUE, NULL, NULL );
+	if (r == STATUS_SUCCESS)
+		r = NtCompleteConnectPort( con_port );
+	if (r != STATUS_SUCCESS)
+		NtTerminateThread( NtCurrentThread(), r );
+
+	// reply to each request while waiting for the next
+	r = NtReplyWaitReceivePort( con_port, &client, 0, req );
+	while (r == STATUS_SUCCESS && req->MessageType == LPC_REQUEST)
+	{
+		if (req->Data[0] == 'q')
+		{
+			NtReplyPort( con_port, req );
+			break;
+		}
+		r = NtReplyWaitReceivePort( con_port, &client, req, req );
+	}
+
+	NtClose( con_port );
+	NtTerminateThread( NtCurrentThread(), r );
+}
+
+static void lpc_request( char data )
+{
+	BYTE req_buffer[0x100], reply_buffer[0x100];
+	LPC_MESSAGE *req = (void*) req_buffer, *reply = (void*) reply_buffer;
+
+	memset( req_buffer, 0, FIELD_OFFSET(LPC_MESSAGE, Data) + 1 );
+	req->MessageType = LPC_NEW_MESSAGE;
+	req->MessageSize = FIELD_OFFSET(LPC_MESSAGE, Data) + 1;
+	req->DataSize = 1;
+	req->Data[0] = data;
+
+	NtRequestWaitReplyPort( lpc_client, req, reply );
+}
+
+static void bench_lpc( ULONG count )
+{
+	ULONG i;
+
+	for (i=0; i<count; i++)
+		lpc_request( '>' );
+}
+
+static void run_lpc( ULONG count )
+{
+	SECURITY_QUALITY_OF_SERVICE qos;
+	OBJECT_ATTRIBUTES oa;
+	UNICODE_STRING us;
+	HANDLE port = 0, thread = 0;
+	CLIENT_ID id;
+	NTSTATUS r;
+
+	init_oa( &oa, &us, bench_portname );
+	r = NtCreatePort( &port, &oa, 0x100, 0x100, NULL );
+	if (r != STATUS_SUCCESS)
+	{
+		bench_fail( "lpc", "NtCreatePort", r );
+		return;
+	}
+
+	r = RtlCreateUserThread( NtCurrentProcess(), NULL, FALSE,
+				 NULL, 0, 0, lpc_server, port, &thread, &id );
+	if (r != STATUS_SUCCESS)
+	{
+		bench_fail( "lpc", "RtlCreateUserThread", r );
+		NtClose( port );
+		return;
+	}
+
+	qos.Length = sizeof qos;
+	qos.ImpersonationLevel = SecurityAnonymous;
+	qos.ContextTrackingMode = SECURITY_DYNAMIC_TRACKING;
+	qos.EffectiveOnly = TRUE;
+
+	r = NtConnectPort( &lpc_client, &us, &qos, NULL, NULL, NULL, NULL, NULL );
+	if (r == STATUS_SUCCESS)
+	{
+		bench_run( "lpc", bench_lpc, count );
+		lpc_request( 'q' );
+		NtClose( lpc_client );
+	}
+	else
+		bench_fail( "lpc", "NtConnectPort", r );
+
+	NtWaitForSingleObject( thread, FALSE, NULL );
+	NtClose( thread );
+	NtClose( port );
+}
+
+////// event pair ping-pong
+
+static HANDLE eventpair;
+static volatile BOOLEAN eventpair_stop;
+
+static void eventpair_partner( void *param )
+{
+	NTSTATUS r;
+
+	r = NtWaitHighEventPair( eventpair );
+	while (r == STATUS_SUCCESS && !eventpair_stop)
+		r = NtSetLowWaitHighEventPair( eventpair );
+
+	NtTerminateThread( NtCurrentThread(), r );
+}
+
+static void bench_eventpair( ULONG count )
+{
+	ULONG i;
+
+	for (i=0; i<count; i++)
+		NtSetHighWaitLowEventPair( eventpair );
+}
+
+static void run_eventpair( ULONG count )
+{
+	HANDLE thread = 0;
+	CLIENT_ID id;
+	NTSTATUS r;
+
+	r = NtCreateEventPair( &eventpair, STANDARD_RIGHTS_ALL, NULL );
+	if (r != STATUS_SUCCESS)
+	{
+		bench_fail( "eventpair", "NtCreateEventPair", r );
+		return;
+	}
+
+	eventpair_stop = FALSE;
+	r = RtlCreateUserThread( NtCurrentProcess(), NULL, FALSE,
+				 NULL, 0, 0, eventpair_partner, NULL, &thread, &id );
+	if (r == STATUS_SUCCESS)
+	{
+		bench_run( "eventpair", bench_eventpair, count );
+
+		eventpair_stop = TRUE;
+		NtSetHighEventPair( eventpair );
+		NtWaitForSingleObject( thread, FALSE, NULL );
+		NtClose( thread );
+	}
+	else
+		bench_fail( "eventpair", "RtlCreateUserThread", r );
+
+	NtClose( eventpair );
+}
+
+////// registry value query
+
+static WCHAR bench_keyname[] = L"\\REGISTRY\\Machine\\SOFTWARE\\ntregbench";
+static WCHAR bench_valname[] = L"benchvalue";
+static HANDLE bench_key;
+
+static void bench_reg( ULONG count )
+{
+	BYTE buffer[0x100];
+	UNICODE_STRING us;
+	ULONG i, sz;
+
+	init_us( &us, bench_valname );
+	for (i=0; i<count; i++)
+		NtQueryValueKey( bench_key, &us, KeyValuePartialInformation,
+				 buffer, sizeof buffer, &sz );
+}
+
+static void run_reg( ULONG count )
+{
+	OBJECT_ATTRIBUTES oa;
+	UNICODE_STRING us;
+	ULONG dispos, val = 0x1234;
+	NTSTATUS r;
+
+	init_oa( &oa, &us, bench_keyname );
+	r = NtCreateKey( &bench_key, KEY_ALL_ACCESS, &oa, 0, NULL, 0, &dispos );
+	if (r != STATUS_SUCCESS)
+	{
+		bench_fail( "reg", "NtCreateKey", r );
+		return;
+	}
+
+	init_us( &us, bench_valname );
+	r = NtSetValueKey( bench_key, &us, 0, REG_DWORD, &val, sizeof val );
+	if (r == STATUS_SUCCESS)
+		bench_run( "reg", bench_reg, count );
+	else
+		bench_fail( "reg", "NtSetValueKey", r );
+
+	NtDeleteKey( bench_key );
+	NtClose( bench_key );
+}
+
+////// file read
+
+static WCHAR bench_filename[] = L"\\??\\c:\\benchfile.dat";
+static HANDLE bench_file;
+static BYTE file_buffer[0x1000];
+
+static void bench_file_read( ULONG count )
+{
+	IO_STATUS_BLOCK iosb;
+	LARGE_INTEGER pos;
+	ULONG i;
+
+	for (i=0; i<count; i++)
+	{
+		pos.QuadPart = (i & 0x0f) * sizeof file_buffer;
+		NtReadFile( bench_file, 0, 0, 0, &iosb, file_buffer,
+			    sizeof file_buffer, &pos, 0 );
+	}
+}
+
+static void run_file( ULONG count )
+{
+	OBJECT_ATTRIBUTES oa;
+	IO_STATUS_BLOCK iosb;
+	UNICODE_STRING us;
+	LARGE_INTEGER pos;
+	NTSTATUS r;
+	ULONG i;
+
+	init_oa( &oa, &us, bench_filename );
+	NtDeleteFile( &oa );
+
+	r = NtCreateFile( &bench_file, GENERIC_READ | GENERIC_WRITE | SYNCHRONIZE, &oa, &iosb,
+			0, FILE_ATTRIBUTE_NORMAL, FILE_SHARE_READ, FILE_CREATE,
+			FILE_SYNCHRONOUS_IO_NONALERT, 0, 0 );
+	if (r != STATUS_SUCCESS)
+	{
+		bench_fail( "file", "NtCreateFile", r );
+		return;
+	}
+
+	// 16 pages of data to read back
+	memset( file_buffer, 0x55, sizeof file_buffer );
+	for (i=0; i<0x10 && r == STATUS_SUCCESS; i++)
+	{
+		pos.QuadPart = i * sizeof file_buffer;
+		r = NtWriteFile( bench_file, 0, 0, 0, &iosb, file_buffer,
+				 sizeof file_buffer, &pos, 0 );
+	}
+
+	if (r == STATUS_SUCCESS)
+		bench_run( "file", bench_file_read, count );
+	else
+		bench_fail( "file", "NtWriteFile", r );
+
+	NtClose( bench_file );
+	NtDeleteFile( &oa );
+}
+
+////// virtual memory allocate/free
+
+static void bench_virtual( ULONG count )
+{
+	void *address;
+	ULONG i, size;
+
+	for (i=0; i<count; i++)
+	{
+		address = NULL;
+		size = 0x10000;
+		NtAllocateVirtualMemory( NtCurrentProcess(), &address, 0, &size,
+					 MEM_COMMIT, PAGE_READWRITE );
+		size = 0;
+		NtFreeVirtualMemory( NtCurrentProcess(), &address, &size, MEM_RELEASE );
+	}
+}
+
+void NtProcessStartup( void )
+{
+	log_init();
+	bench_run( "syscall", bench_syscall, 100000 );
+	run_lpc( 10000 );
+	run_eventpair( 10000 );
+	run_reg( 10000 );
+	run_file( 10000 );
+	bench_run( "virtual", bench_virtual, 10000 );
+	bench_fini();
+}
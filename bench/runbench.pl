@@ -0,0 +1,181 @@
+#!/usr/bin/perl
+#
+# Benchmark runner
+#
+# Copyright 2006-2009 Mike McCormack
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 2.1 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+#
+# Runs each benchmark executable under ring3k-bin several times,
+# discarding the warmup runs, and writes the results as JSON.
+# A benchmark given as a path, like kernel/fiberbench, is a host
+# program and is run directly.
+#
+# usage: runbench.pl [-n runs] [-w warmup] [-o output.json] bench...
+#
+
+use strict;
+
+my $kernel = "./kernel/ring3k-bin";
+my $runs = 5;
+my $warmup = 1;
+my $output;
+my @benchmarks;
+
+while (@ARGV)
+{
+	my $arg = shift @ARGV;
+	if ($arg eq "-n")
+	{
+		$runs = shift @ARGV;
+	}
+	elsif ($arg eq "-w")
+	{
+		$warmup = shift @ARGV;
+	}
+	elsif ($arg eq "-o")
+	{
+		$output = shift @ARGV;
+	}
+	else
+	{
+		push @benchmarks, $arg;
+	}
+}
+
+die("usage: $0 [-n runs] [-w warmup] [-o output.json] bench...\n")
+	unless (@benchmarks && $runs > 0);
+die("kernel binary (ring3k-bin) not present\n") unless (-x $kernel);
+
+system("sh ring3k-setup") unless (-d "drive");
+die("no drive directory\n") unless (-d "drive");
+
+system("cp -f tests/win2k/ntwin32.dll drive") == 0
+	or die("failed to copy ntwin32.dll\n");
+
+# name => { benchmark => exe, iterations => n, samples => [ ns per op ] }
+my %results;
+my @order;
+my $failed = 0;
+
+sub run_once
+{
+	my ($exe, $record) = @_;
+	my $ntexepath = "\\??\\c:\\tests\\$exe.exe";
+	my $cmd = "$kernel \"$ntexepath\"";
+
+	$cmd = "./$exe" if ($exe =~ m|/|);
+	open(RUN, "-|", "$cmd 2>&1")
+		or die("failed to run $cmd\n");
+	while (<RUN>)
+	{
+		if (/^bench (\S+) failed: (.*)$/)
+		{
+			print STDERR "$exe: $1 failed: $2\n";
+			$failed++;
+		}
+		elsif (/^bench (\S+) (\d+) (\d+)$/)
+		{
+			my ($name, $iterations, $elapsed) = ($1, $2, $3);
+			next unless ($record);
+			if (!exists $results{$name})
+			{
+				$results{$name} = {
+					benchmark => $exe,
+					iterations => $iterations,
+					samples => [],
+				};
+				push @order, $name;
+			}
+			# elapsed time is in 100ns units
+			push @{$results{$name}{samples}}, $elapsed * 100 / $iterations;
+		}
+	}
+	close(RUN);
+	if ($? != 0)
+	{
+		print STDERR "$exe: exited with status $?\n";
+		$failed++;
+	}
+}
+
+foreach my $exe (@benchmarks)
+{
+	$exe =~ s/\.exe$//;
+	if ($exe !~ m|/|)
+	{
+		system("cp -f bench/$exe.exe drive/tests") == 0
+			or die("failed to copy $exe.exe\n");
+	}
+
+	for (my $i = 0; $i < $warmup + $runs; $i++)
+	{
+		run_once($exe, $i >= $warmup);
+	}
+}
+
+sub median
+{
+	my @sorted = sort { $a <=> $b } @_;
+	my $n = scalar @sorted;
+	return $sorted[$n/2] if ($n % 2);
+	return ($sorted[$n/2 - 1] + $sorted[$n/2]) / 2;
+}
+
+sub number
+{
+	return sprintf("%.1f", $_[0]);
+}
+
+my @entries;
+foreach my $name (@order)
+{
+	my $r = $results{$name};
+	my @s = @{$r->{samples}};
+	my $sum = 0;
+	$sum += $_ foreach (@s);
+	my @sorted = sort { $a <=> $b } @s;
+
+	push @entries, "    {\n" .
+		"      \"name\": \"$name\",\n" .
+		"      \"benchmark\": \"$r->{benchmark}\",\n" .
+		"      \"iterations\": $r->{iterations},\n" .
+		"      \"ns_per_op\": [" . join(", ", map { number($_) } @s) . "],\n" .
+		"      \"min\": " . number($sorted[0]) . ",\n" .
+		"      \"median\": " . number(median(@s)) . ",\n" .
+		"      \"mean\": " . number($sum / scalar @s) . ",\n" .
+		"      \"max\": " . number($sorted[-1]) . "\n" .
+		"    }";
+}
+
+my $json = "{\n" .
+	"  \"runs\": $runs,\n" .
+	"  \"warmup\": $warmup,\n" .
+	"  \"failures\": $failed,\n" .
+	"  \"results\": [\n" . join(",\n", @entries) . "\n  ]\n" .
+	"}\n";
+
+if ($output)
+{
+	open(OUT, ">$output") or die("failed to open $output\n");
+	print OUT $json;
+	close(OUT);
+}
+else
+{
+	print $json;
+}
+
+exit($failed ? 1 : 0);
@@ -0,0 +1,365 @@
+/*
+ * nt loader
+ *
+ * Copyright 2006-2009 Mike McCormack
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdarg.h>
+#include <new>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "ntstatus.h"
+#define WIN32_NO_STATUS
+#include "windef.h"
+#include "winternl.h"
+
+#include "debug.h"
+#include "object.h"
+#include "object.inl"
+#include "mem.h"
+#include "ntcall.h"
+#include "thread.h"
+#include "process.h"
+#include "event.h"
+#include "file.h"
+#include "aio.h"
+
+// The kernel is single threaded, so a guest reading a slow file would stop
+// every other guest.  Requests on asynchronous file handles are handed to a
+// small pool of host threads instead.  The workers only touch the host file
+// and the request's own buffer, and signal completion through a pipe that the
+// sleepers wait on.  Everything else happens on the main thread.
+
+static const int num_aio_workers = 4;
+
+static pthread_t aio_workers[num_aio_workers];
+static pthread_mutex_t aio_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t aio_cond = PTHREAD_COND_INITIALIZER;
+static aio_request_list_t aio_queued;		// waiting for a worker
+static aio_request_list_t aio_finished;		// waiting for check_async_io
+static bool aio_started;
+static bool aio_stopping;
+static int aio_notify[2] = { -1, -1 };
+
+// finding the end of the file and writing there must not be interleaved
+static pthread_mutex_t aio_append_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// only touched by the main thread
+static ULONG aio_outstanding;
+
+aio_request_t::aio_request_t( file_t *_file, bool _write, bool _append, PVOID Buffer, ULONG Length, LONGLONG _offset ) :
+	thread( 0 ),
+	file( _file ),
+	event( 0 ),
+	apc_routine( 0 ),
+	apc_context( 0 ),
+	iosb( 0 ),
+	user_buffer( Buffer ),
+	write( _write ),
+	append( _append ),
+	offset( _offset ),
+	data( 0 ),
+	length( Length ),
+	result( 0 ),
+	error( 0 ),
+	notify_error( 0 )
+{
+	addref( file );
+}
+
+aio_request_t::~aio_request_t()
+{
+	delete[] data;
+	if (event)
+		release( event );
+	if (thread)
+		release( thread );
+	release( file );
+}
+
+// Called in the context of the requesting thread.
+NTSTATUS aio_request_t::prepare( event_t *_event, PIO_APC_ROUTINE ApcRoutine,
+	PVOID ApcContext, PIO_STATUS_BLOCK IoStatusBlock )
+{
+	// the length comes from the guest, so check the whole buffer is
+	// mapped before allocating that much, and fail rather than throw
+	NTSTATUS r = verify_for_write( user_buffer, length );
+	if (r < STATUS_SUCCESS)
+		return r;
+
+	if (length)
+	{
+		data = new (std::nothrow) BYTE[length];
+		if (!data)
+			return STATUS_NO_MEMORY;
+	}
+
+	if (write)
+	{
+		r = copy_from_user( data, user_buffer, length );
+		if (r < STATUS_SUCCESS)
+			return r;
+	}
+
+	if (_event)
+	{
+		addref( _event );
+		event = _event;
+	}
+	apc_routine = ApcRoutine;
+	apc_context = ApcContext;
+	iosb = IoStatusBlock;
+	addref( current );
+	thread = current;
+
+	return STATUS_SUCCESS;
+}
+
+// Called on a worker thread.  Must not touch anything shared with the kernel.
+void aio_request_t::run()
+{
+	int fd = file->get_fd();
+	ULONG done = 0;
+
+	// the end of the file when the write runs, not when it was queued
+	if (append)
+	{
+		pthread_mutex_lock( &aio_append_lock );
+		struct stat st;
+		if (0 > fstat( fd, &st ))
+		{
+			error = errno;
+			pthread_mutex_unlock( &aio_append_lock );
+			return;
+		}
+		offset = st.st_size;
+	}
+
+	while (done < length)
+	{
+		ssize_t ret;
+		if (write)
+			ret = ::pwrite( fd, data + done, length - done, offset + done );
+		else
+			ret = ::pread( fd, data + done, length - done, offset + done );
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			error = errno;
+			break;
+		}
+		if (ret == 0)
+			break;
+		done += ret;
+	}
+
+	if (append)
+		pthread_mutex_unlock( &aio_append_lock );
+
+	result = done;
+}
+
+// Called on the main thread once the worker is finished.
+void aio_request_t::complete()
+{
+	IO_STATUS_BLOCK status;
+
+	if (notify_error)
+		trace("notify failed %d\n", notify_error);
+
+	status.Status = STATUS_SUCCESS;
+	status.Information = result;
+	if (error)
+		status.Status = STATUS_IO_DEVICE_ERROR;
+	else if (!write && length && !result)
+		status.Status = STATUS_END_OF_FILE;
+
+	// the guest memory may be gone with the thread, but the
+	// event, file and completion port are still signalled
+	bool terminated = thread->is_terminated();
+	address_space *vm = terminated ? 0 : thread->process->vm;
+
+	if (!write && result && !terminated)
+	{
+		NTSTATUS r = vm->copy_to_user( user_buffer, data, result );
+		if (r < STATUS_SUCCESS)
+		{
+			status.Status = r;
+			status.Information = 0;
+		}
+	}
+
+	trace("%04lx %s %lu bytes -> %08lx %lu%s\n", thread->trace_id(),
+		write ? "write" : "read", length, status.Status, status.Information,
+		terminated ? " for terminated thread" : "");
+
+	if (!terminated)
+		vm->copy_to_user( iosb, &status, sizeof status );
+
+	if (write && result)
+		file->data_changed();
+
+	if (event)
+		event->set( 0 );
+	file->io_completed( apc_context, status.Status, status.Information );
+	if (apc_routine && !terminated)
+		thread->queue_apc_thread( (PKNORMAL_ROUTINE) apc_routine, apc_context, iosb, 0 );
+}
+
+static void *aio_worker_proc( void *arg )
+{
+	pthread_mutex_lock( &aio_lock );
+	while (1)
+	{
+		aio_request_t *req = aio_queued.head();
+		if (!req)
+		{
+			if (aio_stopping)
+				break;
+			pthread_cond_wait( &aio_cond, &aio_lock );
+			continue;
+		}
+		aio_queued.unlink( req );
+		pthread_mutex_unlock( &aio_lock );
+
+		req->run();
+
+		pthread_mutex_lock( &aio_lock );
+		aio_finished.append( req );
+
+		// wake the main thread, which traces any failure
+		char ch = 0;
+		if (0 > ::write( aio_notify[1], &ch, 1 ) && errno != EAGAIN)
+			req->notify_error = errno;
+	}
+	pthread_mutex_unlock( &aio_lock );
+	return NULL;
+}
+
+static bool start_async_io()
+{
+	if (aio_started)
+		return true;
+
+	if (0 > pipe( aio_notify ))
+		return false;
+	fcntl( aio_notify[0], F_SETFL, O_NONBLOCK );
+	fcntl( aio_notify[1], F_SETFL, O_NONBLOCK );
+
+	// leave the signals (SIGALRM in particular) to the main thread
+	sigset_t all, old;
+	sigfillset( &all );
+	pthread_sigmask( SIG_BLOCK, &all, &old );
+
+	int n;
+	for (n=0; n<num_aio_workers; n++)
+		if (0 != pthread_create( &aio_workers[n], NULL, &aio_worker_proc, NULL ))
+			break;
+
+	pthread_sigmask( SIG_SETMASK, &old, NULL );
+
+	if (n < num_aio_workers)
+		die("failed to start I/O thread %d\n", n);
+
+	aio_started = true;
+	return true;
+}
+
+NTSTATUS queue_async_io( aio_request_t *req )
+{
+	if (!start_async_io())
+		return STATUS_INSUFFICIENT_RESOURCES;
+
+	aio_outstanding++;
+
+	pthread_mutex_lock( &aio_lock );
+	aio_queued.append( req );
+	pthread_cond_signal( &aio_cond );
+	pthread_mutex_unlock( &aio_lock );
+
+	return STATUS_PENDING;
+}
+
+void check_async_io( void )
+{
+	if (!aio_outstanding)
+		return;
+
+	// drain the notifications before looking, so none are missed
+	char buffer[32];
+	while (::read( aio_notify[0], buffer, sizeof buffer ) > 0)
+		;
+
+	aio_request_list_t finished;
+	pthread_mutex_lock( &aio_lock );
+	while (aio_request_t *req = aio_finished.head())
+	{
+		aio_finished.unlink( req );
+		finished.append( req );
+	}
+	pthread_mutex_unlock( &aio_lock );
+
+	while (aio_request_t *req = finished.head())
+	{
+		finished.unlink( req );
+		aio_outstanding--;
+		req->complete();
+		delete req;
+	}
+}
+
+bool async_io_pending( void )
+{
+	return aio_outstanding != 0;
+}
+
+int get_async_io_fd( void )
+{
+	return aio_notify[0];
+}
+
+void stop_async_io( void )
+{
+	if (!aio_started)
+		return;
+
+	pthread_mutex_lock( &aio_lock );
+	aio_stopping = true;
+	pthread_cond_broadcast( &aio_cond );
+	pthread_mutex_unlock( &aio_lock );
+
+	for (int n=0; n<num_aio_workers; n++)
+		pthread_join( aio_workers[n], NULL );
+
+	// requests that finished after the last guest thread
+	while (aio_request_t *req = aio_finished.head())
+	{
+		aio_finished.unlink( req );
+		delete req;
+	}
+
+	close( aio_notify[0] );
+	close( aio_notify[1] );
+	aio_started = false;
+}
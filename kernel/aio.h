@@ -0,0 +1,84 @@
+/*
+ * nt loader
+ *
+ * Copyright 2006-2009 Mike McCormack
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __RING3K_AIO_H__
+#define __RING3K_AIO_H__
+
+#include "list.h"
+
+class thread_t;
+class file_t;
+class event_t;
+
+class aio_request_t;
+
+typedef list_anchor<aio_request_t,0> aio_request_list_t;
+typedef list_element<aio_request_t> aio_request_element_t;
+
+// aio_request_t is a read or write on a file opened without FILE_SYNCHRONOUS_IO_*.
+// A host worker thread moves the data between the file and a kernel buffer,
+// so the guest buffer is only touched on the main thread, when complete() copies
+// the data and status out and signals the event, APC and completion port.
+class aio_request_t
+{
+	friend class list_anchor<aio_request_t,0>;
+	friend class list_element<aio_request_t>;
+	aio_request_element_t entry[1];
+public:
+	thread_t *thread;
+	file_t *file;
+	event_t *event;
+	PIO_APC_ROUTINE apc_routine;
+	PVOID apc_context;
+	PIO_STATUS_BLOCK iosb;
+	PVOID user_buffer;
+	bool write;
+	bool append;		// FILE_WRITE_TO_END_OF_FILE, offset is found by the worker
+	LONGLONG offset;
+	BYTE *data;
+	ULONG length;
+
+	// set by the worker
+	ssize_t result;
+	int error;
+	int notify_error;
+public:
+	aio_request_t( file_t *file, bool write, bool append, PVOID Buffer, ULONG Length, LONGLONG offset );
+	~aio_request_t();
+	NTSTATUS prepare( event_t *event, PIO_APC_ROUTINE ApcRoutine, PVOID ApcContext, PIO_STATUS_BLOCK IoStatusBlock );
+	void run();
+	void complete();
+};
+
+// hands the request to a worker thread; it is deleted once complete
+NTSTATUS queue_async_io( aio_request_t *req );
+
+// completes finished requests on the main thread; called by the sleepers
+void check_async_io( void );
+
+// true while any request is queued or running
+bool async_io_pending( void );
+
+// readable when a request has finished, or -1 before the first request
+int get_async_io_fd( void );
+
+void stop_async_io( void );
+
+#endif // __RING3K_AIO_H__
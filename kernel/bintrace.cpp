@@ -0,0 +1,313 @@
+/*
+ * nt loader
+ *
+ * Copyright 2006-2008 Mike McCormack
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "ntstatus.h"
+#define WIN32_NO_STATUS
+#include "windef.h"
+#include "winternl.h"
+
+#include "debug.h"
+#include "ntcall.h"
+#include "thread.h"
+#include "bintrace.h"
+
+static const ULONG bintrace_records = 0x10000;
+
+static bintrace_header *header;
+static bintrace_record *ring;
+static size_t ring_size;
+static ULONGLONG start_time;
+
+// addresses of strings already written to the trace,
+// and the record their definition was written at
+static const ULONG string_table_size = 0x1000;
+static struct {
+	const char *str;
+	ULONGLONG defined;
+} string_table[string_table_size];
+static ULONG strings_seen;
+
+// an event's payload is gathered here, then copied into the ring
+struct bintrace_payload_t {
+	BYTE data[0x400];
+	ULONG length;
+	bintrace_payload_t() : length(0) {}
+	bool room( ULONG n ) { return length + n <= sizeof data; }
+	void word( ULONG w );
+	void bytes( const void *p, ULONG n );
+};
+
+void bintrace_payload_t::word( ULONG w )
+{
+	bytes( &w, sizeof w );
+}
+
+void bintrace_payload_t::bytes( const void *p, ULONG n )
+{
+	if (!room( n ))
+		n = sizeof data - length;
+	memcpy( data + length, p, n );
+	length += n;
+}
+
+bool bintrace_open( const char *filename )
+{
+	int fd = open( filename, O_RDWR | O_CREAT | O_TRUNC, 0666 );
+	if (fd < 0)
+		return false;
+
+	ring_size = BINTRACE_HEADER_SIZE + bintrace_records * sizeof (bintrace_record);
+	if (ftruncate( fd, ring_size ) < 0)
+	{
+		close( fd );
+		return false;
+	}
+
+	void *p = mmap( 0, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	close( fd );
+	if (p == MAP_FAILED)
+		return false;
+
+	header = (bintrace_header*) p;
+	header->magic = BINTRACE_MAGIC;
+	header->version = BINTRACE_VERSION;
+	header->record_size = sizeof (bintrace_record);
+	header->num_records = bintrace_records;
+	header->next = 0;
+	ring = (bintrace_record*) ((BYTE*) p + BINTRACE_HEADER_SIZE);
+
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	start_time = (ULONGLONG) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+	return true;
+}
+
+void bintrace_close()
+{
+	if (!header)
+		return;
+	msync( header, ring_size, MS_ASYNC );
+	munmap( header, ring_size );
+	header = 0;
+	ring = 0;
+}
+
+bool bintrace_enabled()
+{
+	return header != 0;
+}
+
+static void bintrace_emit( USHORT event, ULONG thread_id, bintrace_payload_t& payload )
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+
+	ULONGLONG n = header->next;
+	bintrace_record *rec = &ring[n % bintrace_records];
+	rec->timestamp = (ULONGLONG) ts.tv_sec * 1000000000ULL + ts.tv_nsec - start_time;
+	rec->thread_id = thread_id;
+	rec->event = event;
+	rec->length = payload.length;
+
+	ULONG ofs = 0;
+	while (1)
+	{
+		ULONG len = payload.length - ofs;
+		if (len > BINTRACE_PAYLOAD)
+			len = BINTRACE_PAYLOAD;
+		memcpy( rec->payload, payload.data + ofs, len );
+		ofs += len;
+		n++;
+		if (ofs >= payload.length)
+			break;
+		rec = &ring[n % bintrace_records];
+		rec->timestamp = 0;
+		rec->thread_id = 0;
+		rec->event = bintrace_ev_data;
+		rec->length = payload.length - ofs;
+	}
+
+	header->next = n;
+}
+
+// Write the text of a constant string the first time it's used, and
+// again once the ring has moved on far enough that the definition may be
+// overwritten before the events using it.  Every event then has the
+// definitions it refers to earlier in the ring.
+static ULONG bintrace_string_id( const char *str )
+{
+	ULONG hash = ((ULONG) str >> 2) % string_table_size;
+	ULONG i = hash;
+
+	do {
+		if (string_table[i].str == str)
+		{
+			if (header->next - string_table[i].defined < bintrace_records/2)
+				return (ULONG) str;
+			break;
+		}
+		if (!string_table[i].str)
+			break;
+		i = (i + 1) % string_table_size;
+	} while (i != hash);
+
+	// when the table is full, strings are just written every time
+	if (string_table[i].str == str)
+		string_table[i].defined = header->next;
+	else if (!string_table[i].str && strings_seen < string_table_size - 1)
+	{
+		string_table[i].str = str;
+		string_table[i].defined = header->next;
+		strings_seen++;
+	}
+
+	bintrace_payload_t payload;
+	payload.word( (ULONG) str );
+	payload.bytes( str, strlen( str ) + 1 );
+	bintrace_emit( bintrace_ev_string, 0, payload );
+
+	return (ULONG) str;
+}
+
+void bintrace_syscall_enter( ULONG id, const char *name, ULONG *args, ULONG numargs, ULONG retaddr )
+{
+	bintrace_payload_t payload;
+	payload.word( bintrace_string_id( name ) );
+	payload.word( retaddr );
+	payload.word( numargs );
+	payload.bytes( args, numargs * sizeof args[0] );
+	bintrace_emit( bintrace_ev_syscall_enter, id, payload );
+}
+
+void bintrace_syscall_exit( ULONG id, const char *name, ULONG r, ULONG retaddr )
+{
+	bintrace_payload_t payload;
+	payload.word( bintrace_string_id( name ) );
+	payload.word( r );
+	payload.word( retaddr );
+	bintrace_emit( bintrace_ev_syscall_exit, id, payload );
+}
+
+static void bintrace_text( bintrace_payload_t& payload, const char *text, ULONG len )
+{
+	payload.word( len );
+	payload.bytes( text, len );
+	payload.bytes( "\0\0\0", (4 - (len & 3)) & 3 );
+}
+
+// values are stored raw, strings are made printable now while they exist
+void bintrace_message( const char *func, const char *fmt, va_list va )
+{
+	bintrace_payload_t payload;
+	char str[0x100];
+	ULONG len;
+
+	payload.word( bintrace_string_id( func ) );
+	payload.word( bintrace_string_id( fmt ) );
+
+	while (*fmt)
+	{
+		if (*fmt++ != '%')
+			continue;
+		if (*fmt == '%')
+		{
+			fmt++;
+			continue;
+		}
+
+		if (*fmt == '-')
+			fmt++;
+		while (*fmt >= '0' && *fmt <= '9')
+			fmt++;
+
+		bool is_longlong = false;
+		if (*fmt == 'l')
+			fmt++;
+		if (*fmt == 'l')
+		{
+			fmt++;
+			is_longlong = true;
+		}
+
+		switch (*fmt)
+		{
+		case 'p':
+			if (fmt[1] == 'w' && fmt[2] == 's')
+			{
+				len = sprint_wide_string( str, sizeof str - 1, va_arg( va, unsigned short * ) );
+				bintrace_text( payload, str, len );
+				fmt += 2;
+			}
+			else if (fmt[1] == 'u' && fmt[2] == 's')
+			{
+				len = sprint_unicode_string( str, sizeof str - 1, va_arg( va, UNICODE_STRING* ) );
+				bintrace_text( payload, str, len );
+				fmt += 2;
+			}
+			else
+				payload.word( (ULONG) va_arg( va, void* ) );
+			break;
+		case 'x':
+		case 'd':
+		case 'u':
+		case 'o':
+			if (is_longlong)
+			{
+				ULONGLONG v = va_arg( va, long long );
+				payload.bytes( &v, sizeof v );
+			}
+			else
+				payload.word( va_arg( va, int ) );
+			break;
+		case 's':
+			{
+			const char *s = va_arg( va, char * );
+			if (!s)
+				s = "(null)";
+			len = strlen( s );
+			if (len > sizeof str)
+				len = sizeof str;
+			bintrace_text( payload, s, len );
+			}
+			break;
+		case 'S':
+			len = sprint_wide_string( str, sizeof str - 1, va_arg( va, unsigned short * ) );
+			bintrace_text( payload, str, len );
+			break;
+		case 0:
+			continue;
+		default:
+			payload.word( va_arg( va, unsigned int ) );
+			break;
+		}
+		fmt++;
+	}
+
+	bintrace_emit( bintrace_ev_message, current ? current->trace_id() : 0, payload );
+}
@@ -0,0 +1,88 @@
+/*
+ * nt loader
+ *
+ * Copyright 2006-2008 Mike McCormack
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __BINTRACE_H__
+#define __BINTRACE_H__
+
+#include <stdarg.h>
+#include <stdint.h>
+
+/*
+ * Binary trace file format, shared by the kernel and tracedump.
+ *
+ * The file is a header followed by a ring of fixed size records, and is
+ * written through a shared mapping so the kernel never blocks on it.
+ * Each event is a head record followed by as many data records as its
+ * payload needs.  Strings are not stored in events, only their address;
+ * a string definition event with the text is written the first time
+ * each address is seen, and written again every half ring after that,
+ * so a definition always precedes the events using it in the ring.
+ *
+ * Payloads, as 32 bit words unless noted:
+ *   syscall enter:  name id, return address, argument count, arguments
+ *   syscall exit:   name id, return value, return address
+ *   string:         id, NUL terminated text
+ *   message:        function name id, format id, then for each conversion
+ *                   in the format its value (two words for %ll), or for
+ *                   strings the length and text, padded to a word
+ */
+
+#define BINTRACE_MAGIC 0x5433524b	/* "KR3T" */
+#define BINTRACE_VERSION 1
+#define BINTRACE_HEADER_SIZE 0x1000
+#define BINTRACE_PAYLOAD 48
+
+enum bintrace_event {
+	bintrace_ev_data = 0,
+	bintrace_ev_syscall_enter = 1,
+	bintrace_ev_syscall_exit = 2,
+	bintrace_ev_string = 3,
+	bintrace_ev_message = 4,
+};
+
+typedef struct _bintrace_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t num_records;
+	uint64_t next;		/* records written so far, the ring position is next % num_records */
+} bintrace_header;
+
+typedef struct _bintrace_record {
+	uint64_t timestamp;	/* ns since the trace started */
+	uint32_t thread_id;
+	uint16_t event;
+	uint16_t length;	/* payload bytes, including following data records */
+	uint8_t payload[BINTRACE_PAYLOAD];
+} bintrace_record;
+
+#ifdef __cplusplus
+
+// from bintrace.cpp
+bool bintrace_open( const char *filename );
+void bintrace_close();
+bool bintrace_enabled();
+void bintrace_syscall_enter( ULONG id, const char *name, ULONG *args, ULONG numargs, ULONG retaddr );
+void bintrace_syscall_exit( ULONG id, const char *name, ULONG r, ULONG retaddr );
+void bintrace_message( const char *func, const char *fmt, va_list va );
+
+#endif
+
+#endif // __BINTRACE_H__
@@ -32,6 +32,7 @@
 #include "file.h"
 #include "debug.h"
 #include "object.inl"
+#include "slab.h"
 
 // completion_packet_t holds the data for one I/O completion
 class completion_packet_t;
@@ -47,6 +48,8 @@ public:
 	ULONG value;
 	NTSTATUS status;
 	ULONG info;
+	void *operator new(size_t sz);
+	void operator delete(void *ptr);
 	completion_packet_t(ULONG k, ULONG v, NTSTATUS s, ULONG i) :
 		key(k),
 		value(v),
@@ -56,6 +59,19 @@ public:
 	}
 };
 
+static slab_cache_t completion_packet_cache( "completion_packet_t", sizeof (completion_packet_t) );
+
+void *completion_packet_t::operator new(size_t sz)
+{
+	assert( sz == sizeof (completion_packet_t) );
+	return completion_packet_cache.alloc();
+}
+
+void completion_packet_t::operator delete(void *ptr)
+{
+	completion_packet_cache.free( ptr );
+}
+
 // completion_waiter_t is instantiated on the stack of a thread waiting on an I/O completion
 class completion_waiter_t;
 
@@ -142,9 +158,16 @@ public:
 	void start_waiter( completion_waiter_t *waiter );
 };
 
+static object_type_t completion_type( "IoCompletion",
+	STANDARD_RIGHTS_READ | IO_COMPLETION_QUERY_STATE,
+	STANDARD_RIGHTS_WRITE | IO_COMPLETION_MODIFY_STATE,
+	STANDARD_RIGHTS_EXECUTE | SYNCHRONIZE,
+	IO_COMPLETION_ALL_ACCESS );
+
 completion_port_impl_t::completion_port_impl_t( ULONG num ) :
 	num_threads(num)
 {
+	set_type( &completion_type );
 }
 
 BOOLEAN completion_port_impl_t::satisfy()
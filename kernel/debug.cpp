@@ -34,6 +34,7 @@
 #include "ntcall.h"
 #include "thread.h"
 #include "debug.h"
+#include "bintrace.h"
 
 #include "types.h"
 #include "extern.h"
@@ -68,14 +69,51 @@ int sprint_unicode_string( char *output, int len, UNICODE_STRING *us )
 	return n;
 }
 
+trace_category_t *trace_category_t::first;
+
+trace_category_t::trace_category_t( const char *filename ) :
+	enabled( 0 )
+{
+	const char *p = strrchr( filename, '/' );
+	if (p)
+		filename = p + 1;
+
+	unsigned int i;
+	for (i=0; i<sizeof name - 1 && filename[i] && filename[i] != '.'; i++)
+		name[i] = filename[i];
+	name[i] = 0;
+
+	next = first;
+	first = this;
+}
+
+trace_category_t *trace_category_t::find( const char *name, unsigned int len )
+{
+	for (trace_category_t *cat = first; cat; cat = cat->next)
+		if (!strncmp( cat->name, name, len ) && !cat->name[len])
+			return cat;
+	return 0;
+}
+
+void trace_category_t::enable_all( int enabled )
+{
+	for (trace_category_t *cat = first; cat; cat = cat->next)
+		cat->enabled = enabled;
+}
+
 void debugprintf(const char *file, const char *func, int line, const char *fmt, ...)
 {
 	char buffer[0x100], fstr[16], *p;
 	int sz, n, i, is_longlong;
 	va_list va;
 
-	if (!option_trace)
+	if (bintrace_enabled())
+	{
+		va_start( va, fmt );
+		bintrace_message( func, fmt, va );
+		va_end( va );
 		return;
+	}
 
 	va_start( va, fmt );
 
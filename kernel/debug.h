@@ -30,6 +30,8 @@ void dump_mem(void *p, unsigned int len);
 void die(const char *fmt, ...) __attribute__((format (printf,1,2))) __attribute__((noreturn));
 int dump_instruction(unsigned char *inst);
 void print_wide_string( unsigned short *str, int len );
+int sprint_wide_string( char *output, int len, unsigned short *str );
+int sprint_unicode_string( char *output, int len, UNICODE_STRING *us );
 
 extern int option_quiet;
 extern int option_debug;
@@ -45,6 +47,37 @@ void debugger_backtrace(PCONTEXT ctx);
 #define kalloc( size ) _kalloc( __FILE__, __LINE__, (size) )
 #define kfree( mem ) _kfree( __FILE__, __LINE__, (mem) )
 
-#define trace(...) debugprintf(__FILE__,__FUNCTION__,__LINE__,__VA_ARGS__)
+#ifdef __cplusplus
+
+// Each source file gets a trace category named after it, enabled with
+// --trace=<name>.  The enable bit is tested before the trace() arguments
+// are evaluated, so a disabled trace point costs one load and branch.
+struct trace_category_t
+{
+	trace_category_t *next;
+	char name[24];
+	int enabled;
+	static trace_category_t *first;
+	trace_category_t( const char *filename );
+	static trace_category_t *find( const char *name, unsigned int len );
+	static void enable_all( int enabled );
+};
+
+static trace_category_t trace_this_file( __BASE_FILE__ );
+
+#endif
+
+#if defined(NO_TRACE) || !defined(__cplusplus)
+// compiled out, but the arguments are still checked against the format
+#define trace(...) do { \
+	if (0) \
+		debugprintf(__FILE__,__FUNCTION__,__LINE__,__VA_ARGS__); \
+	} while (0)
+#else
+#define trace(...) do { \
+	if (__builtin_expect( trace_this_file.enabled, 0 )) \
+		debugprintf(__FILE__,__FUNCTION__,__LINE__,__VA_ARGS__); \
+	} while (0)
+#endif
 
 #endif // _DEBUG_H_
@@ -0,0 +1,501 @@
+/*
+ * nt loader
+ *
+ * Copyright 2006-2009 Mike McCormack
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "config.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "ntstatus.h"
+#define WIN32_NO_STATUS
+#include "windef.h"
+#include "winternl.h"
+
+#include "debug.h"
+#include "timer.h"
+#include "dentry.h"
+
+static const ULONG dentry_hash_size = 1024;
+static const ULONG max_dir_dentries = 256;		// each one holds an fd
+static const ULONG max_name_dentries = 4096;		// missing names and attributes
+
+#ifndef HAVE_FSTATAT
+
+// from file.cpp
+int fstatat( int dirfd, const char *path, struct stat *buf, int flags );
+
+// openat and mkdirat arrived in glibc with fstatat
+static int at_path( char *buffer, size_t len, int dirfd, const char *name )
+{
+	if (snprintf( buffer, len, "/proc/self/fd/%d/%s", dirfd, name ) < (int) len)
+		return 0;
+	errno = ENAMETOOLONG;
+	return -1;
+}
+
+int openat( int dirfd, const char *name, int flags, ... )
+{
+	char path[PATH_MAX];
+	va_list va;
+	int mode;
+
+	va_start( va, flags );
+	mode = va_arg( va, int );
+	va_end( va );
+
+	if (0 > at_path( path, sizeof path, dirfd, name ))
+		return -1;
+	return ::open( path, flags, mode );
+}
+
+int mkdirat( int dirfd, const char *name, mode_t mode )
+{
+	char path[PATH_MAX];
+
+	if (0 > at_path( path, sizeof path, dirfd, name ))
+		return -1;
+	return ::mkdir( path, mode );
+}
+
+#endif
+
+static dentry_t *dentry_hash[dentry_hash_size];
+static ULONG num_dir_dentries;
+static ULONG num_name_dentries;
+
+// bumped whenever the kernel changes a file
+static ULONG attr_generation_now = 1;
+
+dentry_t::dentry_t( dentry_t *_parent, const char *_name, ULONG _hash, int _fd ) :
+	hash_next( 0 ),
+	parent( _parent ),
+	name( 0 ),
+	hash( _hash ),
+	fd( _fd ),
+	expires( 0 ),
+	attr( 0 ),
+	attr_generation( 0 ),
+	attr_expires( 0 )
+{
+	if (_name)
+	{
+		name = new char[strlen( _name ) + 1];
+		strcpy( name, _name );
+	}
+}
+
+// the root's fd belongs to the directory it was created for
+dentry_t::~dentry_t()
+{
+	if (parent && fd >= 0)
+		::close( fd );
+	delete attr;
+	delete[] name;
+}
+
+dentry_t* dentry_t::create_root( int fd )
+{
+	return new dentry_t( 0, 0, 0, fd );
+}
+
+// other roots have entries in the same hash, so only this one's are freed
+void dentry_t::free_root( dentry_t *root )
+{
+	free_tree( root );
+	delete root;
+}
+
+ULONG dentry_t::hash_name( const dentry_t *parent, const char *name )
+{
+	ULONG hash = (ULONG) parent;
+	while (*name)
+		hash = (hash * 33) ^ (unsigned char) *name++;
+	return hash;
+}
+
+dentry_t* dentry_t::find( const char *str, ULONG h )
+{
+	dentry_t *d = dentry_hash[h % dentry_hash_size];
+	while (d)
+	{
+		if (d->parent == this && d->hash == h && !strcmp( d->name, str ))
+			return d;
+		d = d->hash_next;
+	}
+	return 0;
+}
+
+void dentry_t::add()
+{
+	dentry_t *&head = dentry_hash[hash % dentry_hash_size];
+	hash_next = head;
+	head = this;
+	if (fd >= 0)
+		num_dir_dentries++;
+	else
+		num_name_dentries++;
+}
+
+// unlinks and deletes this entry
+void dentry_t::remove()
+{
+	dentry_t **p = &dentry_hash[hash % dentry_hash_size];
+	while (*p != this)
+		p = &(*p)->hash_next;
+	*p = hash_next;
+	if (fd >= 0)
+		num_dir_dentries--;
+	else
+		num_name_dentries--;
+	delete this;
+}
+
+bool dentry_t::is_below( const dentry_t *dir ) const
+{
+	for (const dentry_t *d = parent; d; d = d->parent)
+		if (d == dir)
+			return true;
+	return false;
+}
+
+// Unlinks and deletes top and everything below it.  Nothing is deleted
+// until all are unlinked, as is_below needs the parents.
+void dentry_t::free_tree( dentry_t *top )
+{
+	dentry_t *doomed = 0;
+
+	for (ULONG i = 0; i < dentry_hash_size; i++)
+	{
+		dentry_t **p = &dentry_hash[i];
+		while (dentry_t *d = *p)
+		{
+			if (d != top && !d->is_below( top ))
+			{
+				p = &d->hash_next;
+				continue;
+			}
+			*p = d->hash_next;
+			if (d->fd >= 0)
+				num_dir_dentries--;
+			else
+				num_name_dentries--;
+			d->hash_next = doomed;
+			doomed = d;
+		}
+	}
+
+	while (dentry_t *d = doomed)
+	{
+		doomed = d->hash_next;
+		delete d;
+	}
+}
+
+void dentry_t::forget( const char *leaf )
+{
+	dentry_t *d = find( leaf, hash_name( this, leaf ) );
+	if (d)
+		free_tree( d );
+}
+
+// The same directory may be cached under several roots or paths, so every
+// entry for it is freed.  free_tree unlinks entries from the chains being
+// walked, so the walk starts again after each one.
+void dentry_t::forget_dir( int dir_fd )
+{
+	struct stat st, dst;
+
+	if (0 > fstat( dir_fd, &st ) || !S_ISDIR( st.st_mode ))
+		return;
+
+	// roots are not in the hash, so are never freed here
+	ULONG i = 0;
+	while (i < dentry_hash_size)
+	{
+		dentry_t *d;
+		for (d = dentry_hash[i]; d; d = d->hash_next)
+		{
+			if (d->fd < 0 || 0 > fstat( d->fd, &dst ))
+				continue;
+			if (dst.st_dev == st.st_dev && dst.st_ino == st.st_ino)
+				break;
+		}
+		if (!d)
+		{
+			i++;
+			continue;
+		}
+		free_tree( d );
+		i = 0;
+	}
+}
+
+// true if the name in the parent still leads to the directory held open
+bool dentry_t::revalidate()
+{
+	struct stat st, dst;
+
+	if (0 > fstatat( parent->fd, name, &st, 0 ) || 0 > fstat( fd, &dst ) ||
+		st.st_dev != dst.st_dev || st.st_ino != dst.st_ino)
+	{
+		trace("%s moved\n", name);
+		return false;
+	}
+	expires = time( NULL ) + lifetime;
+	return true;
+}
+
+void dentry_t::flush()
+{
+	trace("%lu directories, %lu names\n", num_dir_dentries, num_name_dentries);
+	for (ULONG i = 0; i < dentry_hash_size; i++)
+	{
+		while (dentry_t *d = dentry_hash[i])
+		{
+			dentry_hash[i] = d->hash_next;
+			delete d;
+		}
+	}
+	num_dir_dentries = 0;
+	num_name_dentries = 0;
+}
+
+// Only done before a walk, so the entries in use are never freed.
+void dentry_t::trim()
+{
+	if (num_dir_dentries > max_dir_dentries ||
+		num_name_dentries > max_name_dentries)
+		flush();
+}
+
+// True if the name was not found a moment ago.  Entries that have
+// expired, or are about to be created, are dropped.
+bool dentry_t::is_missing( const char *leaf, ULONG h, bool creating )
+{
+	dentry_t *d = find( leaf, h );
+	if (!d || d->fd >= 0 || d->attr)
+		return false;
+	if (!creating && d->expires > time( NULL ))
+	{
+		trace("%s missing\n", leaf);
+		errno = ENOENT;
+		return true;
+	}
+	d->remove();
+	return false;
+}
+
+void dentry_t::set_missing( const char *leaf, ULONG h )
+{
+	dentry_t *d = find( leaf, h );
+	if (d && d->fd >= 0)
+		return;
+	if (d)
+	{
+		delete d->attr;
+		d->attr = 0;
+	}
+	else
+	{
+		d = new dentry_t( this, leaf, h, -1 );
+		d->add();
+	}
+	d->expires = time( NULL ) + lifetime;
+}
+
+dentry_t* dentry_t::lookup_parent( char *path, char *&leaf )
+{
+	dentry_t *dir = this;
+	char *p = path;
+
+	trim();
+
+	while (1)
+	{
+		while (*p == '/')
+			p++;
+
+		char *end = strchr( p, '/' );
+		if (!end)
+			break;
+		*end = 0;
+
+		if (strcmp( p, "." ))
+		{
+			ULONG h = hash_name( dir, p );
+			if (dir->is_missing( p, h, false ))
+				return 0;
+
+			// a name with only attributes cached is not a directory yet
+			dentry_t *d = dir->find( p, h );
+			if (d && d->fd < 0)
+			{
+				d->remove();
+				d = 0;
+			}
+
+			// the directory may have been renamed or replaced on the host
+			if (d && d->expires <= time( NULL ) && !d->revalidate())
+			{
+				free_tree( d );
+				d = 0;
+			}
+
+			if (!d)
+			{
+				int r = ::openat( dir->fd, p, O_RDONLY | O_DIRECTORY );
+				if (r < 0)
+				{
+					if (errno == ENOENT)
+						dir->set_missing( p, h );
+					return 0;
+				}
+				d = new dentry_t( dir, p, h, r );
+				d->expires = time( NULL ) + lifetime;
+				d->add();
+			}
+			dir = d;
+		}
+
+		p = end + 1;
+	}
+
+	// a trailing slash names the directory itself
+	leaf = *p ? p : (char*) ".";
+	return dir;
+}
+
+int dentry_t::open( const char *leaf, int flags, bool& created )
+{
+	ULONG h = hash_name( this, leaf );
+	if (is_missing( leaf, h, flags & O_CREAT ))
+		return -1;
+
+	trace("open file : %s\n", leaf);
+	int r = ::openat( fd, leaf, flags & ~O_CREAT );
+	if (r < 0 && errno == ENOENT && (flags & O_CREAT))
+	{
+		trace("create file : %s\n", leaf);
+		r = ::openat( fd, leaf, flags, 0666 );
+		if (r >= 0)
+		{
+			created = true;
+			attributes_changed();
+		}
+	}
+
+	if (r < 0 && errno == ENOENT)
+		set_missing( leaf, h );
+	return r;
+}
+
+int dentry_t::open_dir( const char *leaf, int flags, bool& created )
+{
+	ULONG h = hash_name( this, leaf );
+	if (is_missing( leaf, h, flags & O_CREAT ))
+		return -1;
+
+	if (flags & O_CREAT)
+	{
+		trace("create dir : %s\n", leaf);
+		if (0 == ::mkdirat( fd, leaf, 0777 ))
+		{
+			created = true;
+			attributes_changed();
+		}
+	}
+
+	trace("open name : %s\n", leaf);
+	int r = ::openat( fd, leaf, flags & ~O_CREAT );
+	trace("r = %d\n", r);
+	if (r < 0 && errno == ENOENT)
+		set_missing( leaf, h );
+	return r;
+}
+
+void get_file_attributes( const struct stat& st, file_attributes_t& attr )
+{
+	memset( &attr, 0, sizeof attr );
+	attr.info.CreationTime = nt_time_from_unix( st.st_ctime, 0 );
+	attr.info.LastAccessTime = nt_time_from_unix( st.st_atime, 0 );
+	attr.info.LastWriteTime = nt_time_from_unix( st.st_mtime, 0 );
+	attr.info.ChangeTime = attr.info.LastWriteTime;
+	attr.info.AllocationSize.QuadPart = (st.st_size + 0x1ff) & ~0x1ff;
+	attr.info.EndOfFile.QuadPart = st.st_size;
+	attr.NumberOfLinks = st.st_nlink;
+	attr.Directory = S_ISDIR( st.st_mode );
+	if (attr.Directory)
+		attr.info.FileAttributes = FILE_ATTRIBUTE_DIRECTORY;
+	else
+		attr.info.FileAttributes = FILE_ATTRIBUTE_ARCHIVE;
+}
+
+void dentry_t::attributes_changed()
+{
+	attr_generation_now++;
+}
+
+ULONG dentry_t::attributes_generation()
+{
+	return attr_generation_now;
+}
+
+int dentry_t::get_attributes( const char *leaf, file_attributes_t& out )
+{
+	ULONG h = hash_name( this, leaf );
+	if (is_missing( leaf, h, false ))
+		return -1;
+
+	time_t now = time( NULL );
+	dentry_t *d = find( leaf, h );
+	if (d && d->attr && d->attr_generation == attr_generation_now && d->attr_expires > now)
+	{
+		out = *d->attr;
+		return 0;
+	}
+
+	struct stat st;
+	if (0 != fstatat( fd, leaf, &st, 0 ))
+	{
+		if (errno == ENOENT)
+			set_missing( leaf, h );
+		return -1;
+	}
+	get_file_attributes( st, out );
+
+	if (!d)
+	{
+		d = new dentry_t( this, leaf, h, -1 );
+		d->add();
+	}
+	if (!d->attr)
+		d->attr = new file_attributes_t;
+	*d->attr = out;
+	d->attr_generation = attr_generation_now;
+	d->attr_expires = now + lifetime;
+
+	return 0;
+}
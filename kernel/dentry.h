@@ -0,0 +1,98 @@
+/*
+ * nt loader
+ *
+ * Copyright 2006-2009 Mike McCormack
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __RING3K_DENTRY_H__
+#define __RING3K_DENTRY_H__
+
+#include <time.h>
+#include <sys/stat.h>
+
+// host attributes in the form the Nt*AttributesFile calls return them
+struct file_attributes_t {
+	FILE_NETWORK_OPEN_INFORMATION info;
+	ULONG NumberOfLinks;
+	BOOLEAN Directory;
+};
+
+void get_file_attributes( const struct stat& st, file_attributes_t& attr );
+
+// dentry_t caches the host directories on the way to a file, with an open
+// fd for each, so opens only hand the last path component to the host.
+// Names that were not found are remembered for a short while too, as the
+// loader probes for the same missing files over and over, and so are the
+// attributes of names that were queried.  Directories are checked against
+// their names again once that while is up, as they may move on the host.
+class dentry_t
+{
+	dentry_t *hash_next;
+	dentry_t *parent;
+	char *name;
+	ULONG hash;
+	int fd;			// -1 unless this is a directory
+	time_t expires;		// for names that do not exist, and directories
+	file_attributes_t *attr;
+	ULONG attr_generation;
+	time_t attr_expires;
+protected:
+	dentry_t( dentry_t *parent, const char *name, ULONG hash, int fd );
+	~dentry_t();
+	static ULONG hash_name( const dentry_t *parent, const char *name );
+	dentry_t* find( const char *name, ULONG hash );
+	bool is_missing( const char *leaf, ULONG hash, bool creating );
+	void set_missing( const char *leaf, ULONG hash );
+	void add();
+	void remove();
+	bool is_below( const dentry_t *dir ) const;
+	bool revalidate();
+	static void free_tree( dentry_t *top );
+	static void trim();
+public:
+	// seconds that missing names, directories and attributes are trusted for
+	static const time_t lifetime = 2;
+	static dentry_t* create_root( int fd );
+	static void free_root( dentry_t *root );
+	int get_fd() const { return fd; }
+
+	// walks all but the last component of path, which is returned in leaf
+	dentry_t* lookup_parent( char *path, char *&leaf );
+
+	// opens or creates a name in this directory
+	int open( const char *leaf, int flags, bool& created );
+	int open_dir( const char *leaf, int flags, bool& created );
+
+	// stats a name in this directory, unless it was done a moment ago
+	int get_attributes( const char *leaf, file_attributes_t& attr );
+
+	// called when the kernel changes a file, forgetting all attributes
+	static void attributes_changed();
+	static ULONG attributes_generation();
+
+	// called when a name in this directory is created, replaced or
+	// renamed, forgetting it and anything cached below it
+	void forget( const char *leaf );
+
+	// called when the directory open as fd is removed or renamed
+	static void forget_dir( int fd );
+
+	// forget everything below the roots
+	static void flush();
+};
+
+#endif // __RING3K_DENTRY_H__
@@ -32,6 +32,7 @@
 #include "unicode.h"
 #include "object.inl"
 #include "event.h"
+#include "thread.h"
 
 class event_impl_t : public event_t {
 protected:
@@ -64,9 +65,16 @@ public:
 	virtual void query(EVENT_BASIC_INFORMATION &info);
 };
 
+static object_type_t event_type( "Event",
+	STANDARD_RIGHTS_READ | EVENT_QUERY_STATE,
+	STANDARD_RIGHTS_WRITE | EVENT_MODIFY_STATE,
+	STANDARD_RIGHTS_EXECUTE | SYNCHRONIZE,
+	EVENT_ALL_ACCESS );
+
 event_impl_t::event_impl_t( BOOLEAN _state ) :
 	state( _state )
 {
+	set_type( &event_type );
 }
 
 bool event_impl_t::access_allowed( ACCESS_MASK required, ACCESS_MASK handle )
@@ -199,6 +207,14 @@ event_t* create_sync_event( PWSTR name, BOOL InitialState )
 	return event;
 }
 
+// an event used inside the kernel, without a name or handle
+event_t* create_unnamed_event( EVENT_TYPE type, BOOLEAN InitialState )
+{
+	if (type == NotificationEvent)
+		return new manual_event_t( InitialState );
+	return new auto_event_t( InitialState );
+}
+
 NTSTATUS NTAPI NtCreateEvent(
 	PHANDLE EventHandle,
 	ACCESS_MASK DesiredAccess,
@@ -239,11 +255,14 @@ NTSTATUS nteventfunc( HANDLE Handle, PULONG PreviousState, void (event_t::*fn)(P
 	if (r < STATUS_SUCCESS)
 		return r;
 
+	handoff_t handoff;
 	(event->*fn)( &prev );
 
 	if (PreviousState)
 		copy_to_user( PreviousState, &prev, sizeof prev );
 
+	handoff.switch_to_woken();
+
 	return r;
 }
 
@@ -341,9 +360,16 @@ public:
 	NTSTATUS wait_low();
 };
 
+static object_type_t event_pair_type( "EventPair",
+	STANDARD_RIGHTS_READ,
+	STANDARD_RIGHTS_WRITE,
+	STANDARD_RIGHTS_EXECUTE | SYNCHRONIZE,
+	STANDARD_RIGHTS_REQUIRED | SYNCHRONIZE );
+
 event_pair_t::event_pair_t() :
 	low(FALSE), high(FALSE)
 {
+	set_type( &event_pair_type );
 }
 
 NTSTATUS event_pair_t::set_low()
@@ -362,24 +388,15 @@ NTSTATUS event_pair_t::set_high()
 
 NTSTATUS event_pair_t::wait_high()
 {
-	/*wait_watch_t *ww = new wait_watch_t(&high, current, FALSE, NULL);
-	if (!ww)
-		return STATUS_NO_MEMORY;
-
-	return ww->notify();*/
-	return STATUS_NOT_IMPLEMENTED;
+	return wait_on_object( &high, FALSE, 0 );
 }
 
 NTSTATUS event_pair_t::wait_low()
 {
-	/*wait_watch_t *ww = new wait_watch_t(&low, current, FALSE, NULL);
-	if (!ww)
-		return STATUS_NO_MEMORY;
-
-	return ww->notify();*/
-	return STATUS_NOT_IMPLEMENTED;
+	return wait_on_object( &low, FALSE, 0 );
 }
 
+// blocking after the set switches straight to the woken thread
 NTSTATUS event_pair_t::set_low_wait_high()
 {
 	set_low();
@@ -400,7 +417,14 @@ NTSTATUS event_pair_operation( HANDLE handle, NTSTATUS (event_pair_t::*op)() )
 	if (r < STATUS_SUCCESS)
 		return r;
 
-	return (eventpair->*op)();
+	// hold a reference in case the handle is closed while we wait
+	addref( eventpair );
+	handoff_t handoff;
+	r = (eventpair->*op)();
+	handoff.switch_to_woken();
+	release( eventpair );
+
+	return r;
 }
 
 class event_pair_factory : public object_factory
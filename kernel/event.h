@@ -43,5 +43,6 @@ public:
 };
 
 event_t* create_sync_event( PWSTR name, BOOL InitialState = 0 );
+event_t* create_unnamed_event( EVENT_TYPE type, BOOLEAN InitialState );
 
 #endif // __EVENT_H__
@@ -55,34 +55,32 @@
 fiber_t* current_fiber;
 fiber_t* sleeping_fiber; // single linked list through prev
 
-extern "C" void switch_fiber(void);
+// switch_fiber( target ) saves the callee saved registers on the current
+// stack, makes target the current fiber and restores its registers.
+// eax, ecx and edx are caller saved, so the compiler already
+// assumes they are clobbered across the call.
+extern "C" void switch_fiber( fiber_t *target );
 __asm__ (
 "\n"
 ".globl " ASM_NAME_PREFIX "switch_fiber\n"
 ASM_NAME_PREFIX "switch_fiber:\n"
-	// ret addr
-	"\tpushl %eax\n"
+	"\tmovl 4(%esp), %eax\n"
 	"\tpushl %ebx\n"
-	"\tpushl %ecx\n"
-	"\tpushl %edx\n"
-	"\tpushl %esi\n"
 	"\tpushl %edi\n"
+	"\tpushl %esi\n"
 	"\tpushl %ebp\n"
-	"\tmovl " ASM_NAME_PREFIX "current_fiber, %eax\n"
-	"\tmovl %esp, 4(%eax)\n"
-	"\tmovl 8(%eax), %eax\n"
+	"\tmovl " ASM_NAME_PREFIX "current_fiber, %edx\n"
+	"\tmovl %esp, 4(%edx)\n"
 	"\tmovl %eax, " ASM_NAME_PREFIX "current_fiber\n"
 	"\tmovl 4(%eax), %esp\n"
 	"\tpopl %ebp\n"
-	"\tpopl %edi\n"
 	"\tpopl %esi\n"
-	"\tpopl %edx\n"
-	"\tpopl %ecx\n"
+	"\tpopl %edi\n"
 	"\tpopl %ebx\n"
-	"\tpopl %eax\n"
 	"\tret\n"
 );
 
+// ebx is the fiber, esi is the function to run
 extern "C" void fiber_init(void *arg);
 __asm__ (
 "\n"
@@ -90,7 +88,7 @@ __asm__ (
 ASM_NAME_PREFIX "fiber_init:\n"
 	"\tsub $12, %esp\n"
 	"\tpushl %ebx\n"
-	"\tcall *%eax\n"
+	"\tcall *%esi\n"
 	"\tpopl %ebx\n"
 	"\tpushl %eax\n"
 	"\tpushl %ebx\n"
@@ -103,7 +101,19 @@ void fiber_t::yield(void)
 		return;
 	if (current_fiber->next == current_fiber)
 		return;
-	switch_fiber();
+	switch_fiber( current_fiber->next );
+}
+
+// Switch directly to a fiber that is already on the run list,
+//  rather than to whatever is next in the round robin.
+// Used to hand off to a thread that was just woken up.
+void fiber_t::yield_to( fiber_t* target )
+{
+	assert( target->next );
+	assert( target->prev );
+	if (target == current_fiber)
+		return;
+	switch_fiber( target );
 }
 
 extern "C" void NORET fiber_exit(fiber_t *t, int ret)
@@ -172,12 +182,9 @@ fiber_t::fiber_t( unsigned sz ) :
 	fiber_stack_t *frame = (fiber_stack_t*) (stack_end - sizeof (fiber_stack_t));
 
 	frame->ebp = 0;
-	frame->esi = 0;
+	frame->esi = (long) &fiber_t::run_fiber;
 	frame->edi = 0;
-	frame->edx = 0;
-	frame->ecx = 0;
 	frame->ebx = (long) this;
-	frame->eax = (long) &fiber_t::run_fiber;
 	frame->eip = (long) &fiber_init;
 
 	// link it in to the circular list
@@ -29,14 +29,12 @@
 #define __FIBER_H__
 
 class fiber_t {
+	// only the registers a called function must preserve are saved
 	struct fiber_stack_t {
 		long ebp;
 		long esi;
 		long edi;
-		long edx;
-		long ecx;
 		long ebx;
-		long eax;
 		long eip;
 	};
 
@@ -63,7 +61,9 @@ public:
 	fiber_t( unsigned int size );
 	virtual ~fiber_t();
 	static void yield();
+	static void yield_to( fiber_t* target );
 	static bool last_fiber();
+	bool is_started() { return prev != 0; }
 	void start();
 	void stop();
 	virtual int run();
@@ -19,8 +19,12 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
 #include "fiber.h"
 
+#ifndef FIBER_BENCHMARK
+
 class fiber_test_t: public fiber_t
 {
 	int num;
@@ -64,3 +68,121 @@ int main(int argc, char **argv)
 	printf("done\n");
 	return 0;
 }
+
+#else // FIBER_BENCHMARK
+
+// Measures the cost of a fiber switch.
+// Each fiber loops a fixed number of times, switching away each time,
+//  either round robin with yield() or directly to a partner with yield_to().
+
+class fiber_bench_t: public fiber_t
+{
+	int loops;
+public:
+	fiber_t *partner;
+	fiber_bench_t(int n);
+	virtual int run();
+};
+
+fiber_bench_t::fiber_bench_t(int n) :
+	fiber_t( fiber_default_stack_size ),
+	loops(n),
+	partner(0)
+{
+}
+
+int fiber_bench_t::run()
+{
+	for (int i=0; i<loops; i++)
+	{
+		if (partner)
+			fiber_t::yield_to( partner );
+		else
+			fiber_t::yield();
+	}
+	return 0;
+}
+
+static double now()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec/1000000.0;
+}
+
+// the same line the native benchmarks print, for runbench.pl
+//   bench <name> <switches> <elapsed time in 100ns units>
+static void report( const char *name, unsigned long switches, double elapsed )
+{
+	printf("bench %s %lu %lu\n", name, switches, (unsigned long) (elapsed * 10000000.0) );
+}
+
+static void bench_yield( int num_fibers, int loops )
+{
+	fiber_bench_t **f = new fiber_bench_t*[num_fibers];
+
+	for (int i=0; i<num_fibers; i++)
+	{
+		f[i] = new fiber_bench_t( loops );
+		f[i]->start();
+	}
+
+	double start = now();
+	while (!fiber_t::last_fiber())
+		fiber_t::yield();
+	double elapsed = now() - start;
+
+	for (int i=0; i<num_fibers; i++)
+		delete f[i];
+	delete[] f;
+
+	// each fiber switches once per loop, the main fiber once per round
+	report( "fiber_yield", (unsigned long) (num_fibers + 1) * loops, elapsed );
+}
+
+static void bench_yield_to( int loops )
+{
+	fiber_bench_t *a = new fiber_bench_t( loops );
+	fiber_bench_t *b = new fiber_bench_t( loops );
+
+	a->partner = b;
+	b->partner = a;
+	a->start();
+	b->start();
+
+	double start = now();
+	fiber_t::yield_to( a );
+	while (!fiber_t::last_fiber())
+		fiber_t::yield();
+	double elapsed = now() - start;
+
+	delete a;
+	delete b;
+
+	report( "fiber_yield_to", (unsigned long) loops * 2, elapsed );
+}
+
+int main(int argc, char **argv)
+{
+	int loops = 1000000;
+	int num_fibers = 2;
+
+	if (argc > 1)
+		loops = atoi( argv[1] );
+	if (argc > 2)
+		num_fibers = atoi( argv[2] );
+	if (loops < 1 || num_fibers < 1)
+	{
+		fprintf(stderr, "usage: %s [loops] [fibers]\n", argv[0]);
+		return 1;
+	}
+
+	fiber_t::fibers_init();
+	bench_yield( num_fibers, loops );
+	bench_yield_to( loops );
+	fiber_t::fibers_finish();
+
+	return 0;
+}
+
+#endif // FIBER_BENCHMARK
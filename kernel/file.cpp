@@ -26,8 +26,11 @@
 #include <fcntl.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
 #include <unistd.h>
 #include <errno.h>
 #include <linux/types.h>
@@ -47,6 +50,9 @@
 #include "ntcall.h"
 #include "file.h"
 #include "symlink.h"
+#include "event.h"
+#include "aio.h"
+#include "dentry.h"
 
 // FIXME: use unicode tables
 WCHAR lowercase(const WCHAR ch)
@@ -56,21 +62,51 @@ WCHAR lowercase(const WCHAR ch)
 	return ch;
 }
 
+// special ByteOffset values
+#define FILE_WRITE_TO_END_OF_FILE 0xffffffff
+#define FILE_USE_FILE_POINTER_POSITION 0xfffffffe
+
+static object_type_t file_type( "File",
+	FILE_GENERIC_READ,
+	FILE_GENERIC_WRITE,
+	FILE_GENERIC_EXECUTE,
+	FILE_ALL_ACCESS );
+object_type_t device_type( "Device",
+	FILE_GENERIC_READ,
+	FILE_GENERIC_WRITE,
+	FILE_GENERIC_EXECUTE,
+	FILE_ALL_ACCESS );
+
 io_object_t::io_object_t() :
 	completion_port( 0 ),
 	completion_key( 0 )
 {
+	set_type( &file_type );
+}
+
+io_object_t::~io_object_t()
+{
+	if (completion_port)
+		release( completion_port );
 }
 
 void io_object_t::set_completion_port( completion_port_t *port, ULONG key )
 {
+	if (port)
+		addref( port );
 	if (completion_port)
 	{
 		release( completion_port );
 		completion_port = 0;
 	}
 	completion_port = port;
-	completion_key = 0;
+	completion_key = key;
+}
+
+void io_object_t::post_completion( ULONG value, NTSTATUS status, ULONG info )
+{
+	if (completion_port)
+		completion_port->set( completion_key, value, status, info );
 }
 
 NTSTATUS io_object_t::set_position( LARGE_INTEGER& ofs )
@@ -91,12 +127,98 @@ NTSTATUS io_object_t::set_pipe_info( FILE_PIPE_INFORMATION& pipe_info )
 
 file_t::~file_t()
 {
+	if (io_event)
+		release( io_event );
+	delete[] readahead;
 	close( fd );
 }
 
 file_t::file_t( int f ) :
-	fd( f )
+	fd( f ),
+	options( FILE_SYNCHRONOUS_IO_NONALERT ),
+	io_event( 0 ),
+	attr_generation( 0 ),
+	attr_expires( 0 ),
+	position( 0 ),
+	regular( -1 ),
+	write_slot( 0 ),
+	readahead( 0 ),
+	ra_start( 0 ),
+	ra_len( 0 ),
+	ra_eof( false ),
+	ra_window( 0 ),
+	ra_next( -1 ),
+	ra_generation( 0 ),
+	ra_expires( 0 )
+{
+}
+
+bool file_t::access_allowed( ACCESS_MASK required, ACCESS_MASK handle )
+{
+	return check_access( required, handle,
+			 FILE_GENERIC_READ,
+			 FILE_GENERIC_WRITE,
+			 FILE_ALL_ACCESS );
+}
+
+void file_t::set_options( ULONG CreateOptions )
+{
+	options = CreateOptions;
+}
+
+// true unless opened with FILE_SYNCHRONOUS_IO_ALERT or FILE_SYNCHRONOUS_IO_NONALERT
+bool file_t::is_async()
 {
+	return !(options & (FILE_SYNCHRONOUS_IO_ALERT | FILE_SYNCHRONOUS_IO_NONALERT));
+}
+
+// the file itself is signalled when an asynchronous request completes
+sync_object_t* file_t::get_sync_object()
+{
+	if (!io_event)
+		io_event = create_unnamed_event( SynchronizationEvent, FALSE );
+	return io_event;
+}
+
+NTSTATUS file_t::queue_io( bool write, event_t *event, PIO_APC_ROUTINE ApcRoutine, PVOID ApcContext,
+	PIO_STATUS_BLOCK IoStatusBlock, PVOID Buffer, ULONG Length, PLARGE_INTEGER offset )
+{
+	// there is no file pointer to use for asynchronous requests
+	if (!offset)
+		return STATUS_INVALID_PARAMETER;
+
+	// the worker finds the end of the file, as other writes may be queued
+	LONGLONG pos = offset->QuadPart;
+	bool append = (write && offset->HighPart == -1 && offset->LowPart == FILE_WRITE_TO_END_OF_FILE);
+	if (append)
+		pos = 0;
+	if (pos < 0)
+		return STATUS_INVALID_PARAMETER;
+
+	aio_request_t *req = new aio_request_t( this, write, append, Buffer, Length, pos );
+	if (!req)
+		return STATUS_NO_MEMORY;
+
+	NTSTATUS r = req->prepare( event, ApcRoutine, ApcContext, IoStatusBlock );
+	if (r < STATUS_SUCCESS)
+	{
+		delete req;
+		return r;
+	}
+
+	if (event)
+		event->reset( 0 );
+	get_sync_object();
+	io_event->reset( 0 );
+
+	return queue_async_io( req );
+}
+
+void file_t::io_completed( PVOID ApcContext, NTSTATUS status, ULONG info )
+{
+	if (io_event)
+		io_event->set( 0 );
+	post_completion( (ULONG) ApcContext, status, info );
 }
 
 class file_create_info_t : public open_info_t
@@ -105,6 +227,7 @@ public:
 	ULONG FileAttributes;
 	ULONG CreateOptions;
 	ULONG CreateDisposition;
+	ACCESS_MASK DesiredAccess;
 	bool created;
 public:
 	file_create_info_t( ULONG _Attributes, ULONG _CreateOptions, ULONG _CreateDisposition );
@@ -115,6 +238,7 @@ file_create_info_t::file_create_info_t( ULONG _Attributes, ULONG _CreateOptions,
 	FileAttributes( _Attributes ),
 	CreateOptions( _CreateOptions ),
 	CreateDisposition( _CreateDisposition ),
+	DesiredAccess( 0 ),
 	created( false )
 {
 }
@@ -127,140 +251,463 @@ NTSTATUS file_create_info_t::on_open( object_dir_t* dir, object_t*& obj, open_in
 	return STATUS_SUCCESS;
 }
 
-NTSTATUS file_t::read( PVOID Buffer, ULONG Length, ULONG *bytes_read )
+// asks a directory for the attributes of a file instead of opening it
+class file_attributes_info_t : public file_create_info_t
+{
+public:
+	file_attributes_t attr;
+	bool found;		// set if a directory filled in attr
+public:
+	file_attributes_info_t() : file_create_info_t( 0, 0, FILE_OPEN ), found( false )
+	{
+		memset( &attr, 0, sizeof attr );
+	}
+};
+
+// asks a directory to move an open file to a name in it
+class file_rename_info_t : public file_create_info_t
+{
+public:
+	file_t *file;
+	bool replace;
+public:
+	file_rename_info_t( file_t *_file, bool _replace ) :
+		file_create_info_t( 0, 0, FILE_OPEN ), file( _file ), replace( _replace ) {}
+};
+
+// the most guest memory runs passed to the host in one call
+static const int max_user_iov = 16;
+
+// Translates the start of a guest buffer to kernel addresses, one iovec
+// per run of contiguous memory.  Stops at the first inaccessible address
+// or when iov is full, and returns the number of bytes covered in mapped.
+static NTSTATUS map_user_buffer( BYTE *Buffer, ULONG Length, struct iovec *iov, int& count, ULONG& mapped )
 {
 	NTSTATUS r = STATUS_SUCCESS;
-	ULONG ofs = 0;
-	while (ofs < Length)
+
+	count = 0;
+	mapped = 0;
+	while (mapped < Length)
 	{
-		BYTE *p = (BYTE*)Buffer+ofs;
-		size_t len = Length - ofs;
+		BYTE *p = Buffer + mapped;
+		size_t len = Length - mapped;
 
 		r = current->process->vm->get_kernel_address( &p, &len );
 		if (r < STATUS_SUCCESS)
 			break;
 
-		int ret = ::read( fd, p, len );
-		if (ret < 0)
+		// blocks next to each other in the guest may be next to each other here too
+		if (count && (BYTE*) iov[count-1].iov_base + iov[count-1].iov_len == p)
+			iov[count-1].iov_len += len;
+		else if (count < max_user_iov)
 		{
-			r = STATUS_IO_DEVICE_ERROR;
-			break;
+			iov[count].iov_base = p;
+			iov[count].iov_len = len;
+			count++;
 		}
+		else
+			break;
 
-		ofs += len;
+		mapped += len;
 	}
 
-	*bytes_read = ofs;
-
 	return r;
 }
 
-NTSTATUS file_t::write( PVOID Buffer, ULONG Length, ULONG *written )
+// Reads or writes the guest buffer with one host call per max_user_iov runs.
+// If offset is set, transfers at that position instead of the file pointer.
+// Either way the file pointer ends up after the data, as on NT.
+NTSTATUS file_t::transfer( PVOID Buffer, ULONG Length, ULONG *transferred, PLARGE_INTEGER offset, bool write )
 {
+	struct iovec iov[max_user_iov];
 	NTSTATUS r = STATUS_SUCCESS;
 	ULONG ofs = 0;
-	while (ofs< Length)
+
+	*transferred = 0;
+	LONGLONG pos = offset ? offset->QuadPart : position;
+	if (pos < 0)
+		return STATUS_INVALID_PARAMETER;
+
+	while (ofs < Length)
 	{
-		BYTE *p = (BYTE*)Buffer+ofs;
-		size_t len = Length - ofs;
+		ULONG mapped = 0;
+		int count = 0;
 
-		NTSTATUS r = current->process->vm->get_kernel_address( &p, &len );
-		if (r < STATUS_SUCCESS)
+		r = map_user_buffer( (BYTE*)Buffer + ofs, Length - ofs, iov, count, mapped );
+		if (!count)
 			break;
 
-		int ret = ::write( fd, p, len );
+		ssize_t ret;
+		if (write)
+			ret = ::pwritev( fd, iov, count, pos + ofs );
+		else
+			ret = ::preadv( fd, iov, count, pos + ofs );
+
 		if (ret < 0)
 		{
+			if (errno == EINTR)
+				continue;
 			r = STATUS_IO_DEVICE_ERROR;
 			break;
 		}
 
-		ofs += len;
+		ofs += ret;
+
+		// end of file, or the disk is full
+		if ((ULONG) ret < mapped)
+		{
+			r = STATUS_SUCCESS;
+			break;
+		}
+
+		// the rest of the buffer is not accessible
+		if (r < STATUS_SUCCESS)
+			break;
 	}
 
-	*written = ofs;
+	*transferred = ofs;
+	position = pos + ofs;
 
 	return r;
 }
 
-NTSTATUS file_t::set_position( LARGE_INTEGER& ofs )
+// reads no bigger than this go through the readahead buffer
+static const ULONG max_cached_read = 0x1000;
+
+// the readahead window doubles while reads are sequential
+static const ULONG min_readahead = 0x2000;
+static const ULONG max_readahead = 0x10000;
+
+// Writes by the kernel through any handle to a file bump the generation
+// in the file's slot, which drops the readahead of the other handles.
+// Files sharing a slot only cost each other a refill.
+static const ULONG write_slots = 256;
+static ULONG write_generation[write_slots];
+
+bool file_t::is_regular()
 {
-	int ret;
+	if (regular < 0)
+	{
+		struct stat st;
+		regular = (0 == fstat( fd, &st ) && S_ISREG( st.st_mode ));
+		if (regular)
+			write_slot = (st.st_dev * 31 + st.st_ino) % write_slots;
+	}
+	return regular;
+}
 
-	ret = lseek( fd, ofs.QuadPart, SEEK_SET );
-	if (ret < 0)
+// called after the kernel writes to the file
+void file_t::data_changed()
+{
+	dentry_t::attributes_changed();
+	if (is_regular())
+		write_generation[write_slot]++;
+}
+
+// Serves a small read from the readahead buffer, refilling it from the
+// host when the read falls outside.  Writes through a shared section do
+// not bump the write generation, so the buffer is only trusted briefly.
+NTSTATUS file_t::cached_read( PVOID Buffer, ULONG Length, ULONG *transferred, LONGLONG pos )
+{
+	time_t now = time( NULL );
+	bool dropped = false;
+
+	*transferred = 0;
+
+	if (ra_len && (ra_generation != write_generation[write_slot] || ra_expires <= now))
+	{
+		ra_len = 0;
+		dropped = true;
+	}
+
+	bool hit = (pos >= ra_start && pos <= ra_start + ra_len &&
+		(pos + Length <= ra_start + ra_len || ra_eof));
+	if (!ra_len || !hit)
 	{
-		trace("seek failed\n");
-		return STATUS_UNSUCCESSFUL;
+		// a write in between says little about how the file is read
+		if (pos == ra_next && ra_window && !dropped)
+			ra_window = ra_window * 2 < max_readahead ? ra_window * 2 : max_readahead;
+		else
+			ra_window = min_readahead;
+
+		if (!readahead)
+		{
+			readahead = new BYTE[max_readahead];
+			if (!readahead)
+				return STATUS_NO_MEMORY;
+		}
+
+		ULONG len = 0;
+		while (len < ra_window)
+		{
+			ssize_t ret = ::pread( fd, readahead + len, ra_window - len, pos + len );
+			if (ret < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				ra_len = 0;
+				return STATUS_IO_DEVICE_ERROR;
+			}
+			if (ret == 0)
+				break;
+			len += ret;
+		}
+
+		trace("read ahead %lu bytes at %lld\n", len, pos);
+		ra_start = pos;
+		ra_len = len;
+		ra_eof = (len < ra_window);
+		ra_generation = write_generation[write_slot];
+		ra_expires = now + dentry_t::lifetime;
 	}
+
+	ULONG avail = ra_start + ra_len - pos;
+	ULONG n = Length < avail ? Length : avail;
+	NTSTATUS r = copy_to_user( Buffer, readahead + (pos - ra_start), n );
+	if (r < STATUS_SUCCESS)
+		return r;
+
+	*transferred = n;
+	ra_next = pos + n;
 	return STATUS_SUCCESS;
 }
 
-NTSTATUS file_t::remove()
+NTSTATUS file_t::read( PVOID Buffer, ULONG Length, ULONG *bytes_read, PLARGE_INTEGER offset )
+{
+	LONGLONG pos = offset ? offset->QuadPart : position;
+	NTSTATUS r;
+
+	if (pos < 0 || Length > max_cached_read || !is_regular())
+		r = transfer( Buffer, Length, bytes_read, offset, false );
+	else
+	{
+		r = cached_read( Buffer, Length, bytes_read, pos );
+		position = pos + *bytes_read;
+	}
+
+	// there was nothing left to read
+	if (r == STATUS_SUCCESS && Length && !*bytes_read)
+		r = STATUS_END_OF_FILE;
+
+	return r;
+}
+
+NTSTATUS file_t::write( PVOID Buffer, ULONG Length, ULONG *written, PLARGE_INTEGER offset )
+{
+	if (offset && offset->HighPart == -1 && offset->LowPart == FILE_WRITE_TO_END_OF_FILE)
+	{
+		struct stat st;
+		if (0 > fstat( fd, &st ))
+			return STATUS_UNSUCCESSFUL;
+		position = st.st_size;
+		offset = 0;
+	}
+	NTSTATUS r = transfer( Buffer, Length, written, offset, true );
+	if (*written)
+		data_changed();
+	return r;
+}
+
+NTSTATUS file_t::set_position( LARGE_INTEGER& ofs )
+{
+	if (ofs.QuadPart < 0)
+		return STATUS_INVALID_PARAMETER;
+	position = ofs.QuadPart;
+	return STATUS_SUCCESS;
+}
+
+// the host's name for an open file
+static bool host_path( int fd, char *path, size_t len )
 {
 	char name[40];
+
+	sprintf( name, "/proc/self/fd/%d", fd );
+	int r = readlink( name, path, len - 1 );
+	if (r < 0)
+		return false;
+	path[r] = 0;
+	return true;
+}
+
+NTSTATUS file_t::remove()
+{
 	char path[255];
-	int r;
 
 	// get the file's name
-	sprintf( name, "/proc/self/fd/%d", get_fd() );
-	r = readlink( name, path, sizeof path - 1 );
-	if (r < 0)
+	if (!host_path( get_fd(), path, sizeof path ))
 		return STATUS_ACCESS_DENIED;
-	path[r] = 0;
 
 	// remove it
-	if (0 > unlink( path ) &&
-		0 > rmdir( path ))
+	if (0 > unlink( path ))
 	{
-		fprintf(stderr, "Failed to delete %s\n", path);
-		// FIXME: check errno
-		return STATUS_ACCESS_DENIED;
+		if (0 > rmdir( path ))
+		{
+			fprintf(stderr, "Failed to delete %s\n", path);
+			// FIXME: check errno
+			return STATUS_ACCESS_DENIED;
+		}
+
+		// cached lookups may go through the directory
+		dentry_t::forget_dir( get_fd() );
 	}
+	dentry_t::attributes_changed();
+
+	return STATUS_SUCCESS;
+}
+
+// moves the file to leaf in the host directory dir
+NTSTATUS file_t::rename( dentry_t *dir, const char *leaf, bool replace )
+{
+	char from[PATH_MAX], to[PATH_MAX];
+	struct stat st;
+
+	if (!host_path( get_fd(), from, sizeof from ) ||
+		!host_path( dir->get_fd(), to, sizeof to ))
+		return STATUS_ACCESS_DENIED;
+	size_t len = strlen( to );
+	if (len + strlen( leaf ) + 2 > sizeof to)
+		return STATUS_OBJECT_NAME_INVALID;
+	to[len] = '/';
+	strcpy( to + len + 1, leaf );
+
+	trace("%s -> %s\n", from, to);
+
+	if (!replace && 0 == lstat( to, &st ))
+		return STATUS_OBJECT_NAME_COLLISION;
+	if (0 > ::rename( from, to ))
+		return STATUS_ACCESS_DENIED;
+
+	// the new name is no longer missing, and entries under a moved
+	// directory are stale; forget_dir may free dir, so it goes last
+	dir->forget( leaf );
+	dentry_t::forget_dir( get_fd() );
+	dentry_t::attributes_changed();
 
 	return STATUS_SUCCESS;
 }
 
-class directory_entry_t;
+// one name in a dir_listing_t
+struct dir_listing_entry_t {
+	ULONG name_ofs;		// into names, in bytes
+	ULONG wname_ofs;	// into wnames, in WCHARs
+	USHORT wname_len;	// in bytes
+};
 
-typedef list_anchor<directory_entry_t,0> dirlist_t;
-typedef list_iter<directory_entry_t,0> dirlist_iter_t;
-typedef list_element<directory_entry_t> dirlist_element_t;
+class dir_listing_t;
+
+typedef list_anchor<dir_listing_t,0> dir_listing_list_t;
+typedef list_iter<dir_listing_t,0> dir_listing_iter_t;
+typedef list_element<dir_listing_t> dir_listing_element_t;
+
+// The names in a host directory, shared by every handle open on it.
+// Reading a large directory is slow, so a listing is kept after the last
+// handle is closed and reused until the directory's mtime changes.
+class dir_listing_t {
+	friend class list_anchor<dir_listing_t,0>;
+	friend class list_iter<dir_listing_t,0>;
+	friend class list_element<dir_listing_t>;
+	dir_listing_element_t entry[1];
+	dev_t dev;
+	ino_t ino;
+	time_t mtime;
+	time_t scanned;
+	ULONG refcount;
+	ULONG count;
+	ULONG max_count;
+	dir_listing_entry_t *entries;
+	char *names;
+	ULONG names_len;
+	ULONG names_max;
+	WCHAR *wnames;
+	ULONG wnames_len;
+	ULONG wnames_max;
+protected:
+	dir_listing_t( const struct stat& st );
+	~dir_listing_t();
+	bool add( const char *name );
+	bool read( int fd );
+	bool is_current( const struct stat& st ) const;
+	static void trim_cache();
+public:
+	static dir_listing_t* get( int fd );
+	static void put( dir_listing_t *listing );
+	ULONG get_count() const { return count; }
+	const char *get_name( ULONG n ) const { return names + entries[n].name_ofs; }
+	void get_name( ULONG n, UNICODE_STRING& name ) const;
+};
 
 class directory_entry_t {
 public:
-	dirlist_element_t entry[1];
-	unicode_string_t name;
+	UNICODE_STRING name;
 	struct stat st;
 };
 
+// An NT wildcard mask, compiled once per scan into a list of operations
+// and run over each name in the directory.
+class wildcard_t {
+	enum op_t {
+		op_char,	// one character, compared case folded
+		op_any,		// ? matches one character
+		op_star,	// * matches any characters
+		op_dos_star,	// < matches up to the last dot
+		op_dos_qm,	// > matches one character, or nothing at a dot or the end
+		op_dos_dot,	// " matches a dot, or nothing at the end
+	};
+	struct wildcard_op_t {
+		op_t op;
+		WCHAR ch;
+	};
+	wildcard_op_t *ops;
+	ULONG num_ops;
+	ULONG prefix;		// literal characters before the first wildcard
+	ULONG suffix;		// literal characters after the last wildcard
+	bool match_all;
+	bool single_star;	// prefix * suffix
+	bool dots;		// . and .. match
+	bool *active;		// states for match
+	bool *next;
+protected:
+	void clear();
+	bool compare( const WCHAR *str, ULONG first, ULONG n ) const;
+	bool run( const WCHAR *str, ULONG len ) const;
+public:
+	wildcard_t();
+	~wildcard_t();
+	NTSTATUS compile( const UNICODE_STRING& mask );
+	bool match( const UNICODE_STRING& name ) const;
+};
+
 class directory_t : public file_t
 {
-	int count;
-	directory_entry_t *ptr;
-	dirlist_t entries;
+	int count;		// matching entries, -1 before the first scan
+	ULONG pos;
+	ULONG *matches;		// indexes into the listing
+	dir_listing_t *listing;
+	directory_entry_t current;
 	unicode_string_t mask;
+	wildcard_t wildcard;
+	dentry_t *dentries;	// for opening files below this directory
 protected:
 	void reset();
-	void add_entry(const char *name);
-	int open_unicode_file( const char *unix_path, int flags, bool& created );
-	int open_unicode_dir( const char *unix_path, int flags, bool& created );
+	dentry_t* lookup_parent( UNICODE_STRING& path, bool case_insensitive, char *&unix_path, char *&leaf );
+	NTSTATUS get_attributes( UNICODE_STRING& path, file_attributes_t& attr, bool case_insensitive );
 public:
 	directory_t( int fd );
 	~directory_t();
 	NTSTATUS query_directory_file();
-	NTSTATUS read( PVOID Buffer, ULONG Length, ULONG *bytes_read );
-	NTSTATUS write( PVOID Buffer, ULONG Length, ULONG *bytes_read );
+	NTSTATUS read( PVOID Buffer, ULONG Length, ULONG *bytes_read, PLARGE_INTEGER offset );
+	NTSTATUS write( PVOID Buffer, ULONG Length, ULONG *bytes_read, PLARGE_INTEGER offset );
 	virtual NTSTATUS query_information( FILE_ATTRIBUTE_TAG_INFORMATION& info );
 	directory_entry_t* get_next();
-	bool match(unicode_string_t &name) const;
+	void unget();
+	bool match(const UNICODE_STRING &name) const;
 	void scandir();
 	bool is_firstscan() const;
 	NTSTATUS set_mask(unicode_string_t *mask);
 	int get_num_entries() const;
 	virtual NTSTATUS open( object_t *&out, open_info_t& info );
 	NTSTATUS open_file( file_t *&file, UNICODE_STRING& path, ULONG Attributes,
-		ULONG Options, ULONG CreateDisposition, bool &created, bool case_insensitive );
+		ULONG Options, ULONG CreateDisposition, ACCESS_MASK access, bool &created, bool case_insensitive );
 };
 
 class directory_factory : public object_factory
@@ -288,20 +735,26 @@ NTSTATUS directory_factory::alloc_object(object_t** obj)
 directory_t::directory_t( int fd ) :
 	file_t(fd),
 	count(-1),
-	ptr(0)
+	pos(0),
+	matches(0),
+	listing(0),
+	dentries(0)
 {
 }
 
 directory_t::~directory_t()
 {
+	reset();
+	if (dentries)
+		dentry_t::free_root( dentries );
 }
 
-NTSTATUS directory_t::read( PVOID Buffer, ULONG Length, ULONG *bytes_read )
+NTSTATUS directory_t::read( PVOID Buffer, ULONG Length, ULONG *bytes_read, PLARGE_INTEGER offset )
 {
 	return STATUS_OBJECT_TYPE_MISMATCH;
 }
 
-NTSTATUS directory_t::write( PVOID Buffer, ULONG Length, ULONG *bytes_read )
+NTSTATUS directory_t::write( PVOID Buffer, ULONG Length, ULONG *bytes_read, PLARGE_INTEGER offset )
 {
 	return STATUS_OBJECT_TYPE_MISMATCH;
 }
@@ -383,110 +836,461 @@ int fstatat( int dirfd, const char *path, struct stat *buf, int flags )
 
 #endif
 
+// listings of directories that nobody has open
+static const ULONG max_cached_listings = 32;
+static dir_listing_list_t dir_listings;
+static ULONG num_dir_listings;
+
+template<class T> static bool grow_array( T*& array, ULONG used, ULONG& max, ULONG needed )
+{
+	if (used + needed <= max)
+		return true;
+
+	ULONG n = max ? max : 64;
+	while (n < used + needed)
+		n *= 2;
+
+	T *p = new T[n];
+	if (!p)
+		return false;
+	if (array)
+		memcpy( p, array, used * sizeof (T) );
+	delete[] array;
+	array = p;
+	max = n;
+	return true;
+}
+
+dir_listing_t::dir_listing_t( const struct stat& st ) :
+	dev( st.st_dev ),
+	ino( st.st_ino ),
+	mtime( st.st_mtime ),
+	scanned( 0 ),
+	refcount( 1 ),
+	count( 0 ),
+	max_count( 0 ),
+	entries( 0 ),
+	names( 0 ),
+	names_len( 0 ),
+	names_max( 0 ),
+	wnames( 0 ),
+	wnames_len( 0 ),
+	wnames_max( 0 )
+{
+}
+
+dir_listing_t::~dir_listing_t()
+{
+	delete[] entries;
+	delete[] names;
+	delete[] wnames;
+}
+
+bool dir_listing_t::add( const char *name )
+{
+	unicode_string_t wname;
+	if (wname.copy( name ) < STATUS_SUCCESS)
+		return false;
+
+	ULONG len = strlen( name ) + 1;
+	ULONG wlen = wname.Length / sizeof (WCHAR);
+	if (!grow_array( entries, count, max_count, 1 ) ||
+		!grow_array( names, names_len, names_max, len ) ||
+		!grow_array( wnames, wnames_len, wnames_max, wlen ))
+		return false;
+
+	dir_listing_entry_t *ent = &entries[count++];
+	ent->name_ofs = names_len;
+	ent->wname_ofs = wnames_len;
+	ent->wname_len = wname.Length;
+	memcpy( names + names_len, name, len );
+	names_len += len;
+	memcpy( wnames + wnames_len, wname.Buffer, wname.Length );
+	wnames_len += wlen;
+	return true;
+}
+
+void dir_listing_t::get_name( ULONG n, UNICODE_STRING& name ) const
+{
+	name.Buffer = wnames + entries[n].wname_ofs;
+	name.Length = entries[n].wname_len;
+	name.MaximumLength = name.Length;
+}
+
+// read every entry, in as many getdents64 calls as it takes
+bool dir_listing_t::read( int fd )
+{
+	const int size = 0x8000;
+	int r;
+
+	scanned = time( NULL );
+
+	r = lseek( fd, 0, SEEK_SET );
+	if (r == -1)
+	{
+		trace("lseek failed (%d)\n", errno);
+		return false;
+	}
+
+	// . and .. always come first
+	if (!add(".") || !add(".."))
+		return false;
+
+	unsigned char *buffer = new unsigned char[size];
+	if (!buffer)
+		return false;
+
+	bool ok = true;
+	while (ok)
+	{
+		r = ::getdents64( fd, buffer, size );
+		if (r < 0)
+		{
+			trace("getdents64 failed (%d)\n", errno);
+			ok = false;
+			break;
+		}
+
+		// end of the directory
+		if (r == 0)
+			break;
+
+		int ofs = 0;
+		while (ofs<r)
+		{
+			KERNEL_DIRENT64* de = (KERNEL_DIRENT64*) &buffer[ofs];
+			if (de->d_reclen <= 0)
+			{
+				ok = false;
+				break;
+			}
+			ofs += de->d_reclen;
+			if (!strcmp(de->d_name,".") || !strcmp(de->d_name, ".."))
+				continue;
+			if (!add(de->d_name))
+			{
+				ok = false;
+				break;
+			}
+		}
+	}
+
+	delete[] buffer;
+	trace("read %lu entries\n", count);
+	return ok;
+}
+
+// An entry added in the same second as the last scan leaves the mtime
+// unchanged, so only trust listings of directories modified before that.
+bool dir_listing_t::is_current( const struct stat& st ) const
+{
+	return dev == st.st_dev && ino == st.st_ino &&
+		mtime == st.st_mtime && mtime < scanned;
+}
+
+dir_listing_t* dir_listing_t::get( int fd )
+{
+	struct stat st;
+
+	if (0 > fstat( fd, &st ))
+		return 0;
+
+	for (dir_listing_iter_t i(dir_listings); i; i.next())
+	{
+		dir_listing_t *listing = i;
+		if (listing->dev != st.st_dev || listing->ino != st.st_ino)
+			continue;
+
+		// stale listings are deleted by the last handle using them
+		dir_listings.unlink( listing );
+		num_dir_listings--;
+		if (!listing->is_current( st ))
+		{
+			if (!listing->refcount)
+				delete listing;
+			break;
+		}
+
+		// most recently used last
+		dir_listings.append( listing );
+		num_dir_listings++;
+		listing->refcount++;
+		return listing;
+	}
+
+	dir_listing_t *listing = new dir_listing_t( st );
+	if (!listing)
+		return 0;
+
+	if (!listing->read( fd ))
+	{
+		delete listing;
+		return 0;
+	}
+
+	dir_listings.append( listing );
+	num_dir_listings++;
+	trim_cache();
+
+	return listing;
+}
+
+void dir_listing_t::put( dir_listing_t *listing )
+{
+	assert( listing->refcount > 0 );
+	if (--listing->refcount)
+		return;
+	if (listing->entry[0].is_linked())
+		trim_cache();
+	else
+		delete listing;
+}
+
+void dir_listing_t::trim_cache()
+{
+	dir_listing_iter_t i(dir_listings);
+	while (num_dir_listings > max_cached_listings && i)
+	{
+		dir_listing_t *listing = i;
+		i.next();
+		if (listing->refcount)
+			continue;
+		dir_listings.unlink( listing );
+		num_dir_listings--;
+		delete listing;
+	}
+}
+
 void directory_t::reset()
 {
-	ptr = 0;
+	pos = 0;
 	count = 0;
+	delete[] matches;
+	matches = 0;
+	if (listing)
+		dir_listing_t::put( listing );
+	listing = 0;
+}
+
+static WCHAR fold_table[0x80];
+
+static inline WCHAR fold( WCHAR ch )
+{
+	return ch < 0x80 ? fold_table[ch] : ch;
+}
+
+wildcard_t::wildcard_t() :
+	ops( 0 ),
+	num_ops( 0 ),
+	prefix( 0 ),
+	suffix( 0 ),
+	match_all( true ),
+	single_star( false ),
+	dots( true ),
+	active( 0 ),
+	next( 0 )
+{
+}
+
+wildcard_t::~wildcard_t()
+{
+	clear();
+}
 
-	while (!entries.empty())
+void wildcard_t::clear()
+{
+	delete[] ops;
+	delete[] active;
+	delete[] next;
+	ops = 0;
+	active = 0;
+	next = 0;
+	num_ops = 0;
+	prefix = 0;
+	suffix = 0;
+	match_all = true;
+	single_star = false;
+	dots = true;
+}
+
+NTSTATUS wildcard_t::compile( const UNICODE_STRING& mask )
+{
+	ULONG len = mask.Length / sizeof (WCHAR);
+	ULONG i, num_stars = 0;
+
+	clear();
+
+	if (!fold_table['A'])
+		for (i = 0; i < 0x80; i++)
+			fold_table[i] = lowercase( i );
+
+	ops = new wildcard_op_t[len + 1];
+	active = new bool[len + 1];
+	next = new bool[len + 1];
+	if (!ops || !active || !next)
+		return STATUS_NO_MEMORY;
+
+	for (i = 0; i < len; i++)
 	{
-		directory_entry_t *x = entries.head();
-		entries.unlink(x);
-		delete x;
+		wildcard_op_t& op = ops[num_ops];
+		op.ch = 0;
+		switch (mask.Buffer[i])
+		{
+		case '*':
+			// runs of stars are one star
+			if (num_ops && ops[num_ops - 1].op == op_star)
+				continue;
+			op.op = op_star;
+			num_stars++;
+			break;
+		case '?': op.op = op_any; break;
+		case '<': op.op = op_dos_star; break;
+		case '>': op.op = op_dos_qm; break;
+		case '"': op.op = op_dos_dot; break;
+		default:
+			op.op = op_char;
+			op.ch = fold( mask.Buffer[i] );
+		}
+		num_ops++;
 	}
+
+	while (prefix < num_ops && ops[prefix].op == op_char)
+		prefix++;
+	while (suffix < num_ops - prefix && ops[num_ops - 1 - suffix].op == op_char)
+		suffix++;
+
+	// the dot entries only match masks starting with a star
+	dots = (num_ops == 0 || ops[0].op == op_star);
+	match_all = (num_ops == 0 || (num_ops == 1 && ops[0].op == op_star));
+	single_star = (num_stars == 1 && prefix + suffix + 1 == num_ops);
+
+	return STATUS_SUCCESS;
+}
+
+bool wildcard_t::compare( const WCHAR *str, ULONG first, ULONG n ) const
+{
+	for (ULONG i = 0; i < n; i++)
+		if (fold( str[i] ) != ops[first + i].ch)
+			return false;
+	return true;
 }
 
-bool directory_t::match(unicode_string_t &name) const
+// Steps every possible position in the mask along the name at once,
+// so stars never need to backtrack.
+bool wildcard_t::run( const WCHAR *str, ULONG len ) const
 {
-	if (mask.Length == 0)
-		return true;
+	ULONG i, j, last_dot = len;
 
-	// check for dot pseudo files
-	bool pseudo_file = (name.Length == 2 && name.Buffer[0] == '.') ||
-		(name.Length == 4 && name.Buffer[0] == '.' && name.Buffer[1] == '.' );
+	for (j = 0; j < len; j++)
+		if (str[j] == '.')
+			last_dot = j;
 
-	int i = 0, j = 0;
-	while (i < mask.Length/2 && j < name.Length/2)
-	{
-		// asterisk matches everything
-		if (mask.Buffer[i] == '*')
-			return true;
+	memset( active, 0, (num_ops + 1) * sizeof (bool) );
+	active[0] = true;
 
-		// question mark matches one character
-		if (mask.Buffer[i] == '?')
+	for (j = 0; ; j++)
+	{
+		// follow the operations that can match nothing here
+		bool any = false;
+		for (i = 0; i < num_ops; i++)
 		{
-			if (pseudo_file)
-				return false;
-			i++;
-			j++;
-			continue;
+			if (!active[i])
+				continue;
+			any = true;
+			switch (ops[i].op)
+			{
+			case op_star:
+			case op_dos_star:
+				active[i + 1] = true;
+				break;
+			case op_dos_qm:
+				if (j == len || str[j] == '.')
+					active[i + 1] = true;
+				break;
+			case op_dos_dot:
+				if (j == len)
+					active[i + 1] = true;
+				break;
+			default:
+				break;
+			}
 		}
 
-		// double quote matches separator
-		if (mask.Buffer[i] == '"' && j != 0 && name.Buffer[j] == '.')
-		{
-			i++;
-			j++;
-			continue;
-		}
+		if (j == len)
+			return active[num_ops];
+		if (!any)
+			return false;
 
-		// right angle matches anything except a dot
-		if (mask.Buffer[i] == '>' && name.Buffer[j] != '.')
+		// then consume one character
+		WCHAR ch = str[j];
+		WCHAR folded = fold( ch );
+		memset( next, 0, (num_ops + 1) * sizeof (bool) );
+		for (i = 0; i < num_ops; i++)
 		{
-			i++;
-			j++;
-			continue;
+			if (!active[i])
+				continue;
+			switch (ops[i].op)
+			{
+			case op_char:
+				if (ops[i].ch == folded)
+					next[i + 1] = true;
+				break;
+			case op_any:
+				next[i + 1] = true;
+				break;
+			case op_star:
+				next[i] = true;
+				break;
+			case op_dos_star:
+				if (j != last_dot)
+					next[i] = true;
+				break;
+			case op_dos_qm:
+				if (ch != '.')
+					next[i + 1] = true;
+				break;
+			case op_dos_dot:
+				if (ch == '.')
+					next[i + 1] = true;
+				break;
+			}
 		}
+		memcpy( active, next, (num_ops + 1) * sizeof (bool) );
+	}
+}
 
-		// right angle matches strings without a dot
-		if (mask.Buffer[i] == '<')
-		{
-			while (name.Buffer[j] != '.' && j < name.Length)
-				j++;
-			i++;
-			continue;
-		}
+bool wildcard_t::match( const UNICODE_STRING& name ) const
+{
+	ULONG len = name.Length / sizeof (WCHAR);
 
-		if (pseudo_file)
-			return false;
+	if (match_all)
+		return true;
 
-		// match characters
-		//trace("%c <> %c\n", mask.Buffer[i], name.Buffer[j]);
-		if (lowercase(mask.Buffer[i]) != lowercase(name.Buffer[j]))
-			return false;
+	// check for dot pseudo files
+	if ((len == 1 && name.Buffer[0] == '.') ||
+		(len == 2 && name.Buffer[0] == '.' && name.Buffer[1] == '.'))
+		return dots;
 
-		i++;
-		j++;
-	}
+	// no wildcards
+	if (prefix == num_ops)
+		return len == num_ops && compare( name.Buffer, 0, len );
 
-	// left over characters are a mismatch
-	if (i != mask.Length/2 || j != name.Length/2)
+	// the literal ends of the mask must match the ends of the name
+	if (len < prefix + suffix)
 		return false;
+	if (!compare( name.Buffer, 0, prefix ))
+		return false;
+	if (!compare( name.Buffer + len - suffix, num_ops - suffix, suffix ))
+		return false;
+	if (single_star)
+		return true;
 
-	return true;
+	return run( name.Buffer, len );
 }
 
-void directory_t::add_entry(const char *name)
+bool directory_t::match(const UNICODE_STRING &name) const
 {
-	trace("adding dir entry: %s\n", name);
-	directory_entry_t *ent = new directory_entry_t;
-	ent->name.copy(name);
-	/* FIXME: Should symlinks be deferenced?
-	   AT_SYMLINK_NOFOLLOW */
-	if (0 != fstatat(get_fd(), name, &ent->st, 0))
-	{
-		delete ent;
-		return;
-	}
-	if (!match(ent->name))
-	{
-		delete ent;
-		return;
-	}
-	trace("matched mask %pus\n", &mask);
-	//trace("mode = %o\n", ent->st.st_mode);
-	entries.append(ent);
-	count++;
+	return wildcard.match( name );
 }
 
 int directory_t::get_num_entries() const
@@ -496,52 +1300,34 @@ int directory_t::get_num_entries() const
 
 void directory_t::scandir()
 {
-	unsigned char buffer[0x1000];
-	int r;
-
 	reset();
-	r = lseek( get_fd(), 0, SEEK_SET );
-	if (r == -1)
+
+	listing = dir_listing_t::get( get_fd() );
+	if (!listing)
 	{
-		trace("lseek failed (%d)\n", errno);
+		trace("failed to read directory\n");
 		return;
 	}
 
-	trace("reading entries:\n");
-	// . and .. always come first
-	add_entry(".");
-	add_entry("..");
+	ULONG n = listing->get_count();
+	matches = new ULONG[n];
+	if (!matches)
+		return;
 
-	do
+	for (ULONG i = 0; i < n; i++)
 	{
-		r = ::getdents64( get_fd(), buffer, sizeof buffer );
-		if (r < 0)
-		{
-			trace("getdents64 failed (%d)\n", r);
-			break;
-		}
-
-		int ofs = 0;
-		while (ofs<r)
-		{
-			KERNEL_DIRENT64* de = (KERNEL_DIRENT64*) &buffer[ofs];
-			//fprintf(stderr, "%ld %d %s\n", de->d_off, de->d_reclen, de->d_name);
-			if (de->d_off <= 0)
-				break;
-			if (de->d_reclen <=0 )
-				break;
-			ofs += de->d_reclen;
-			if (!strcmp(de->d_name,".") || !strcmp(de->d_name, ".."))
-				continue;
-			add_entry(de->d_name);
-		}
-	} while (0);
+		UNICODE_STRING name;
+		listing->get_name( i, name );
+		if (match( name ))
+			matches[count++] = i;
+	}
+	trace("%d of %lu entries match %pus\n", count, n, &mask);
 }
 
 NTSTATUS directory_t::set_mask(unicode_string_t *string)
 {
 	mask.copy(string);
-	return STATUS_SUCCESS;
+	return wildcard.compile( mask );
 }
 
 // scan for the first time after construction
@@ -550,20 +1336,30 @@ bool directory_t::is_firstscan() const
 	return (count == -1);
 }
 
+// Only the entries returned are stat'ed, as a mask often matches one name.
 directory_entry_t* directory_t::get_next()
 {
-	if (!ptr)
+	while (count > 0 && pos < (ULONG) count)
 	{
-		ptr = entries.head();
-		return ptr;
-	}
+		ULONG n = matches[pos++];
 
-	if (ptr == entries.tail())
-		return 0;
+		/* FIXME: Should symlinks be deferenced?
+		   AT_SYMLINK_NOFOLLOW */
+		if (0 != fstatat( get_fd(), listing->get_name( n ), &current.st, 0 ))
+			continue;
+
+		listing->get_name( n, current.name );
+		return &current;
+	}
 
-	ptr = ptr->entry[0].get_next();
+	return 0;
+}
 
-	return ptr;
+// the entry get_next returned will be returned again
+void directory_t::unget()
+{
+	if (pos)
+		pos--;
 }
 
 NTSTATUS directory_t::query_information( FILE_ATTRIBUTE_TAG_INFORMATION& info )
@@ -578,23 +1374,55 @@ int file_t::get_fd()
 	return fd;
 }
 
+NTSTATUS file_t::get_attributes( file_attributes_t& attr )
+{
+	if (attr_generation != dentry_t::attributes_generation() || attr_expires <= time( NULL ))
+	{
+		struct stat st;
+		if (0 > fstat( fd, &st ))
+			return STATUS_UNSUCCESSFUL;
+		get_file_attributes( st, cached_attr );
+		attr_generation = dentry_t::attributes_generation();
+		attr_expires = time( NULL ) + dentry_t::lifetime;
+	}
+	attr = cached_attr;
+	return STATUS_SUCCESS;
+}
+
 NTSTATUS file_t::query_information( FILE_BASIC_INFORMATION& info )
 {
-	info.FileAttributes = FILE_ATTRIBUTE_ARCHIVE;
+	file_attributes_t attr;
+	NTSTATUS r = get_attributes( attr );
+	if (r < STATUS_SUCCESS)
+		return r;
+	info.CreationTime = attr.info.CreationTime;
+	info.LastAccessTime = attr.info.LastAccessTime;
+	info.LastWriteTime = attr.info.LastWriteTime;
+	info.ChangeTime = attr.info.ChangeTime;
+	info.FileAttributes = attr.info.FileAttributes;
 	return STATUS_SUCCESS;
 }
 
 NTSTATUS file_t::query_information( FILE_STANDARD_INFORMATION& info )
 {
-	struct stat st;
-	if (0<fstat( fd, &st ))
-		return STATUS_UNSUCCESSFUL;
-	info.EndOfFile.QuadPart = st.st_size;
-	info.AllocationSize.QuadPart = (st.st_size+0x1ff)&~0x1ff;
-	if (S_ISDIR(st.st_mode))
-		info.Directory = TRUE;
-	else
-		info.Directory = FALSE;
+	file_attributes_t attr;
+	NTSTATUS r = get_attributes( attr );
+	if (r < STATUS_SUCCESS)
+		return r;
+	info.EndOfFile = attr.info.EndOfFile;
+	info.AllocationSize = attr.info.AllocationSize;
+	info.NumberOfLinks = attr.NumberOfLinks;
+	info.Directory = attr.Directory;
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS file_t::query_information( FILE_NETWORK_OPEN_INFORMATION& info )
+{
+	file_attributes_t attr;
+	NTSTATUS r = get_attributes( attr );
+	if (r < STATUS_SUCCESS)
+		return r;
+	info = attr.info;
 	return STATUS_SUCCESS;
 }
 
@@ -605,25 +1433,17 @@ NTSTATUS file_t::query_information( FILE_ATTRIBUTE_TAG_INFORMATION& info )
 	return STATUS_SUCCESS;
 }
 
-char *build_path( int fd, const UNICODE_STRING *us )
+char *build_path( const UNICODE_STRING *us )
 {
 	char *str, *p;
 	int i;
 	int len = us->Length/2 + 1;
-	const char fd_prefix[] = "/proc/self/fd/%d/";
-
-	if (fd >= 0)
-		len += sizeof fd_prefix + 10;
 
 	str = new char[ len ];
 	if (!str)
 		return str;
 
-	str[0] = 0;
-	if (fd >= 0)
-		sprintf( str, fd_prefix, fd );
-
-	p = &str[strlen( str )];
+	p = str;
 	for (i=0; i<us->Length/2; i++)
 		*p++ = us->Buffer[i];
 	*p = 0;
@@ -631,12 +1451,12 @@ char *build_path( int fd, const UNICODE_STRING *us )
 	return str;
 }
 
-char *get_unix_path( int fd, UNICODE_STRING& str, bool case_insensitive )
+char *get_unix_path( UNICODE_STRING& str, bool case_insensitive )
 {
 	char *file;
 	int i;
 
-	file = build_path( fd, &str );
+	file = build_path( &str );
 	if (!file)
 		return NULL;
 
@@ -657,37 +1477,64 @@ char *get_unix_path( int fd, UNICODE_STRING& str, bool case_insensitive )
 	return file;
 }
 
-int directory_t::open_unicode_file( const char *unix_path, int flags, bool &created )
+// The directories on the way are opened (and cached) one at a time.
+// unix_path must be freed if a directory is returned.
+dentry_t* directory_t::lookup_parent( UNICODE_STRING& path, bool case_insensitive, char *&unix_path, char *&leaf )
 {
-	int r = -1;
+	if (!dentries)
+	{
+		dentries = dentry_t::create_root( get_fd() );
+		if (!dentries)
+			return 0;
+	}
 
-	trace("open file : %s\n", unix_path);
-	r = ::open( unix_path, flags&~O_CREAT );
-	if (r < 0 && (flags & O_CREAT))
+	unix_path = get_unix_path( path, case_insensitive );
+	if (!unix_path)
+		return 0;
+
+	dentry_t *dir = dentries->lookup_parent( unix_path, leaf );
+	if (!dir)
 	{
-		trace("create file : %s\n", unix_path);
-		r = ::open( unix_path, flags, 0666 );
-		if (r >= 0)
-			created = true;
+		delete[] unix_path;
+		unix_path = 0;
 	}
-	return r;
+	return dir;
 }
 
-int directory_t::open_unicode_dir( const char *unix_path, int flags, bool &created )
+NTSTATUS directory_t::get_attributes( UNICODE_STRING& path, file_attributes_t& attr, bool case_insensitive )
 {
-	int r = -1;
+	char *unix_path = 0, *leaf = 0;
+	dentry_t *dir = lookup_parent( path, case_insensitive, unix_path, leaf );
+	if (!dir)
+		return STATUS_OBJECT_PATH_NOT_FOUND;
+
+	int r = dir->get_attributes( leaf, attr );
+	delete[] unix_path;
+	if (r < 0)
+		return STATUS_OBJECT_NAME_NOT_FOUND;
+	return STATUS_SUCCESS;
+}
 
-	if (flags & O_CREAT)
+// The directories on the way were found, so a missing name is the leaf.
+static NTSTATUS host_open_error( int err )
+{
+	switch (err)
 	{
-		trace("create dir : %s\n", unix_path);
-		r = ::mkdir( unix_path, 0777 );
-		if (r == 0)
-			created = true;
+	case ENOENT:
+		return STATUS_OBJECT_NAME_NOT_FOUND;
+	case EACCES:
+	case EROFS:
+		return STATUS_ACCESS_DENIED;
 	}
-	trace("open name : %s\n", unix_path);
-	r = ::open( unix_path, flags & ~O_CREAT );
-	trace("r = %d\n", r);
-	return r;
+	return STATUS_OBJECT_PATH_NOT_FOUND;
+}
+
+// the host file is only opened for writing if the handle can write
+static int host_access( ACCESS_MASK access )
+{
+	if (access & (GENERIC_WRITE | GENERIC_ALL | FILE_WRITE_DATA | FILE_APPEND_DATA))
+		return O_RDWR;
+	return O_RDONLY;
 }
 
 NTSTATUS directory_t::open_file(
@@ -696,6 +1543,7 @@ NTSTATUS directory_t::open_file(
 	ULONG Attributes,
 	ULONG Options,
 	ULONG CreateDisposition,
+	ACCESS_MASK access,
 	bool &created,
 	bool case_insensitive )
 {
@@ -720,16 +1568,18 @@ NTSTATUS directory_t::open_file(
 		return STATUS_NOT_IMPLEMENTED;
 	}
 
-	char *unix_path = get_unix_path( get_fd(), path, case_insensitive );
-	if (!unix_path)
+	char *unix_path = 0, *leaf = 0;
+	dentry_t *dir = lookup_parent( path, case_insensitive, unix_path, leaf );
+	if (!dir)
 		return STATUS_OBJECT_PATH_NOT_FOUND;
 
 	if (Options & FILE_DIRECTORY_FILE)
 	{
-		file_fd = open_unicode_dir( unix_path, mode, created );
+		file_fd = dir->open_dir( leaf, mode, created );
+		int err = errno;
 		delete[] unix_path;
 		if (file_fd == -1)
-			return STATUS_OBJECT_PATH_NOT_FOUND;
+			return host_open_error( err );
 
 		trace("file_fd = %d\n", file_fd );
 		file = new directory_t( file_fd );
@@ -741,10 +1591,14 @@ NTSTATUS directory_t::open_file(
 	}
 	else
 	{
-		file_fd = open_unicode_file( unix_path, mode, created );
+		// directories can still be opened without FILE_DIRECTORY_FILE to read
+		file_fd = dir->open( leaf, mode | host_access( access ), created );
+		if (file_fd == -1 && errno == EISDIR)
+			file_fd = dir->open( leaf, mode, created );
+		int err = errno;
 		delete[] unix_path;
 		if (file_fd == -1)
-			return STATUS_OBJECT_PATH_NOT_FOUND;
+			return host_open_error( err );
 
 		file = new file_t( file_fd );
 		if (!file)
@@ -752,6 +1606,7 @@ NTSTATUS directory_t::open_file(
 			::close( file_fd );
 			return STATUS_NO_MEMORY;
 		}
+		file->set_options( Options );
 	}
 
 	return STATUS_SUCCESS;
@@ -763,12 +1618,40 @@ NTSTATUS directory_t::open( object_t *&out, open_info_t& info )
 
 	trace("directory_t::open %pus\n", &info.path );
 
+	file_attributes_info_t *attr_info = dynamic_cast<file_attributes_info_t*>( &info );
+	if (attr_info)
+	{
+		NTSTATUS r = get_attributes( info.path, attr_info->attr, info.case_insensitive() );
+		if (r < STATUS_SUCCESS)
+			return r;
+		attr_info->found = true;
+		addref( this );
+		out = this;
+		return r;
+	}
+
+	file_rename_info_t *rename_info = dynamic_cast<file_rename_info_t*>( &info );
+	if (rename_info)
+	{
+		char *unix_path = 0, *leaf = 0;
+		dentry_t *dir = lookup_parent( info.path, info.case_insensitive(), unix_path, leaf );
+		if (!dir)
+			return STATUS_OBJECT_PATH_NOT_FOUND;
+		NTSTATUS r = rename_info->file->rename( dir, leaf, rename_info->replace );
+		delete[] unix_path;
+		if (r < STATUS_SUCCESS)
+			return r;
+		addref( this );
+		out = this;
+		return r;
+	}
+
 	file_create_info_t *file_info = dynamic_cast<file_create_info_t*>( &info );
 	if (!file_info)
 		return STATUS_OBJECT_TYPE_MISMATCH;
 
 	NTSTATUS r = open_file( file, info.path, file_info->Attributes, file_info->CreateOptions,
-		file_info->CreateDisposition, file_info->created, info.case_insensitive() );
+		file_info->CreateDisposition, file_info->DesiredAccess, file_info->created, info.case_insensitive() );
 	if (r < STATUS_SUCCESS)
 		return r;
 	out = file;
@@ -807,7 +1690,8 @@ void init_drives()
 	}
 
 	unicode_string_t c_link;
-	c_link.set( L"\\??\\c:" );
+	// upper case like NT's, so only case insensitive opens use c:
+	c_link.set( L"\\??\\C:" );
 	r = create_symlink( c_link, dirname );
 	if (r < STATUS_SUCCESS)
 	{
@@ -855,6 +1739,7 @@ NTSTATUS NTAPI NtCreateFile(
 		return STATUS_OBJECT_PATH_NOT_FOUND;
 
 	file_create_info_t info( Attributes, CreateOptions, CreateDisposition );
+	info.DesiredAccess = DesiredAccess;
 
 	info.path.set( *oa.ObjectName );
 	info.Attributes = oa.Attributes;
@@ -953,6 +1838,25 @@ NTSTATUS NTAPI NtDeviceIoControlFile(
 	return STATUS_SUCCESS;
 }
 
+// Copies in the ByteOffset of NtReadFile or NtWriteFile, leaving
+// offset null if the current file position should be used.
+static NTSTATUS copy_byte_offset( PLARGE_INTEGER ByteOffset, LARGE_INTEGER& pos, PLARGE_INTEGER& offset )
+{
+	offset = 0;
+	if (!ByteOffset)
+		return STATUS_SUCCESS;
+
+	NTSTATUS r = copy_from_user( &pos, ByteOffset, sizeof pos );
+	if (r < STATUS_SUCCESS)
+		return r;
+
+	if (pos.HighPart == -1 && pos.LowPart == FILE_USE_FILE_POINTER_POSITION)
+		return STATUS_SUCCESS;
+
+	offset = &pos;
+	return STATUS_SUCCESS;
+}
+
 NTSTATUS NTAPI NtWriteFile(
 	HANDLE FileHandle,
 	HANDLE Event,
@@ -971,7 +1875,7 @@ NTSTATUS NTAPI NtWriteFile(
 	io_object_t *io = 0;
 	NTSTATUS r;
 
-	r = object_from_handle( io, FileHandle, 0 );
+	r = object_from_handle( io, FileHandle, FILE_WRITE_DATA );
 	if (r < STATUS_SUCCESS)
 		return r;
 
@@ -979,8 +1883,28 @@ NTSTATUS NTAPI NtWriteFile(
 	if (r < STATUS_SUCCESS)
 		return r;
 
+	LARGE_INTEGER pos;
+	PLARGE_INTEGER offset = 0;
+	r = copy_byte_offset( ByteOffset, pos, offset );
+	if (r < STATUS_SUCCESS)
+		return r;
+
+	file_t *file = dynamic_cast<file_t*>( io );
+	if (file && file->is_async())
+	{
+		event_t *event = 0;
+		if (Event)
+		{
+			r = object_from_handle( event, Event, EVENT_MODIFY_STATE );
+			if (r < STATUS_SUCCESS)
+				return r;
+		}
+		return file->queue_io( true, event, ApcRoutine, ApcContext,
+				IoStatusBlock, Buffer, Length, offset );
+	}
+
 	ULONG ofs = 0;
-	r = io->write( Buffer, Length, &ofs );
+	r = io->write( Buffer, Length, &ofs, offset );
 	if (r < STATUS_SUCCESS)
 		return r;
 
@@ -993,15 +1917,11 @@ NTSTATUS NTAPI NtWriteFile(
 	return r;
 }
 
-NTSTATUS NTAPI NtQueryAttributesFile(
-	POBJECT_ATTRIBUTES ObjectAttributes,
-	PFILE_BASIC_INFORMATION FileInformation )
+// Looks up the attributes of a file by name, without opening it.
+static NTSTATUS query_attributes( POBJECT_ATTRIBUTES ObjectAttributes, file_attributes_t& attr )
 {
 	object_attributes_t oa;
 	NTSTATUS r;
-	FILE_BASIC_INFORMATION info;
-
-	trace("%p %p\n", ObjectAttributes, FileInformation);
 
 	r = oa.copy_from_user( ObjectAttributes );
 	if (r)
@@ -1015,27 +1935,51 @@ NTSTATUS NTAPI NtQueryAttributesFile(
 
 	// FIXME: use oa.RootDirectory
 	object_t *obj = 0;
-	file_create_info_t open_info( 0, 0, FILE_OPEN );
-	open_info.path.set( *oa.ObjectName );
-	open_info.Attributes = oa.Attributes;
-	r = open_root( obj, open_info );
+	file_attributes_info_t info;
+	info.path.set( *oa.ObjectName );
+	info.Attributes = oa.Attributes;
+	r = open_root( obj, info );
 	if (r < STATUS_SUCCESS)
 		return r;
 
-	file_t *file = dynamic_cast<file_t*>(obj );
-	if (file)
+	// the name may lead to a device or some other object, not a directory
+	if (!info.found)
 	{
-
-		memset( &info, 0, sizeof info );
-		r = file->query_information( info );
+		file_t *file = dynamic_cast<file_t*>( obj );
+		if (file)
+			r = file->get_attributes( info.attr );
+		else
+			info.attr.info.FileAttributes = FILE_ATTRIBUTE_NORMAL;
 	}
-	else
-		r = STATUS_OBJECT_TYPE_MISMATCH;
 	release( obj );
 
+	attr = info.attr;
 	return r;
 }
 
+NTSTATUS NTAPI NtQueryAttributesFile(
+	POBJECT_ATTRIBUTES ObjectAttributes,
+	PFILE_BASIC_INFORMATION FileInformation )
+{
+	FILE_BASIC_INFORMATION info;
+	file_attributes_t attr;
+	NTSTATUS r;
+
+	trace("%p %p\n", ObjectAttributes, FileInformation);
+
+	r = query_attributes( ObjectAttributes, attr );
+	if (r < STATUS_SUCCESS)
+		return r;
+
+	info.CreationTime = attr.info.CreationTime;
+	info.LastAccessTime = attr.info.LastAccessTime;
+	info.LastWriteTime = attr.info.LastWriteTime;
+	info.ChangeTime = attr.info.ChangeTime;
+	info.FileAttributes = attr.info.FileAttributes;
+
+	return copy_to_user( FileInformation, &info, sizeof info );
+}
+
 NTSTATUS NTAPI NtQueryVolumeInformationFile(
 	HANDLE FileHandle,
 	PIO_STATUS_BLOCK IoStatusBlock,
@@ -1066,7 +2010,7 @@ NTSTATUS NTAPI NtReadFile(
 	NTSTATUS r;
 	io_object_t *io = 0;
 
-	r = object_from_handle( io, FileHandle, GENERIC_READ );
+	r = object_from_handle( io, FileHandle, FILE_READ_DATA );
 	if (r < STATUS_SUCCESS)
 		return r;
 
@@ -1074,18 +2018,38 @@ NTSTATUS NTAPI NtReadFile(
 	if (r < STATUS_SUCCESS)
 		return r;
 
-	ULONG ofs = 0;
-	r = io->read( Buffer, Length, &ofs );
+	LARGE_INTEGER pos;
+	PLARGE_INTEGER offset = 0;
+	r = copy_byte_offset( ByteOffset, pos, offset );
 	if (r < STATUS_SUCCESS)
 		return r;
 
+	file_t *file = dynamic_cast<file_t*>( io );
+	if (file && file->is_async())
+	{
+		event_t *event = 0;
+		if (EventHandle)
+		{
+			r = object_from_handle( event, EventHandle, EVENT_MODIFY_STATE );
+			if (r < STATUS_SUCCESS)
+				return r;
+		}
+		return file->queue_io( false, event, ApcRoutine, ApcContext,
+				IoStatusBlock, Buffer, Length, offset );
+	}
+
+	ULONG ofs = 0;
+	r = io->read( Buffer, Length, &ofs, offset );
+	if (r < STATUS_SUCCESS && r != STATUS_END_OF_FILE)
+		return r;
+
 	IO_STATUS_BLOCK iosb;
 	iosb.Status = r;
 	iosb.Information = ofs;
 
-	r = copy_to_user( IoStatusBlock, &iosb, sizeof iosb );
+	copy_to_user( IoStatusBlock, &iosb, sizeof iosb );
 
-	return STATUS_SUCCESS;
+	return r;
 }
 
 NTSTATUS NTAPI NtDeleteFile(
@@ -1140,6 +2104,50 @@ NTSTATUS NTAPI NtCancelIoFile(
 	return STATUS_NOT_IMPLEMENTED;
 }
 
+// the new name follows the fixed part of FILE_RENAME_INFORMATION
+static NTSTATUS set_rename_information( io_object_t *io, PVOID FileInformation, ULONG FileInformationLength )
+{
+	FILE_RENAME_INFORMATION info;
+	const ULONG ofs = offsetof( FILE_RENAME_INFORMATION, FileName );
+	NTSTATUS r;
+
+	if (FileInformationLength < ofs)
+		return STATUS_INFO_LENGTH_MISMATCH;
+
+	r = copy_from_user( &info, FileInformation, ofs );
+	if (r < STATUS_SUCCESS)
+		return r;
+
+	if (!info.FileNameLength || (info.FileNameLength & 1) ||
+		info.FileNameLength > 0xfffe ||
+		info.FileNameLength > FileInformationLength - ofs)
+		return STATUS_INVALID_PARAMETER;
+
+	// FIXME: names relative to RootDir
+	if (info.RootDir)
+		return STATUS_NOT_IMPLEMENTED;
+
+	file_t *file = dynamic_cast<file_t*>( io );
+	if (!file)
+		return STATUS_OBJECT_TYPE_MISMATCH;
+
+	object_t *obj = 0;
+	file_rename_info_t rename_info( file, info.Replace );
+	rename_info.Attributes = OBJ_CASE_INSENSITIVE;
+	r = rename_info.path.copy_wstr_from_user( (PWSTR) ((BYTE*) FileInformation + ofs), info.FileNameLength );
+	if (r < STATUS_SUCCESS)
+		return r;
+
+	trace("replace = %d name = %pus\n", info.Replace, &rename_info.path);
+
+	r = open_root( obj, rename_info );
+	if (r < STATUS_SUCCESS)
+		return r;
+	release( obj );
+
+	return r;
+}
+
 NTSTATUS NTAPI NtSetInformationFile(
 	HANDLE FileHandle,
 	PIO_STATUS_BLOCK IoStatusBlock,
@@ -1161,6 +2169,9 @@ NTSTATUS NTAPI NtSetInformationFile(
 	if (r < STATUS_SUCCESS)
 		return r;
 
+	if (FileInformationClass == FileRenameInformation)
+		return set_rename_information( file, FileInformation, FileInformationLength );
+
 	switch (FileInformationClass)
 	{
 	case FileDispositionInformation:
@@ -1190,6 +2201,7 @@ NTSTATUS NTAPI NtSetInformationFile(
 	{
 	case FileDispositionInformation:
 		trace("delete = %d\n", info.dispos.DeleteFile);
+		dentry_t::attributes_changed();
 		break;
 	case FileCompletionInformation:
 		r = object_from_handle( completion_port, info.completion.CompletionPort, IO_COMPLETION_MODIFY_STATE );
@@ -1231,6 +2243,7 @@ NTSTATUS NTAPI NtQueryInformationFile(
 		FILE_BASIC_INFORMATION basic_info;
 		FILE_STANDARD_INFORMATION std_info;
 		FILE_ATTRIBUTE_TAG_INFORMATION attrib_info;
+		FILE_NETWORK_OPEN_INFORMATION network_info;
 	} info;
 	ULONG len;
 	memset( &info, 0, sizeof info );
@@ -1249,6 +2262,10 @@ NTSTATUS NTAPI NtQueryInformationFile(
 		len = sizeof info.attrib_info;
 		r = file->query_information( info.attrib_info );
 		break;
+	case FileNetworkOpenInformation:
+		len = sizeof info.network_info;
+		r = file->query_information( info.network_info );
+		break;
 	default:
 		trace("Unknown information class %d\n", FileInformationClass );
 		r = STATUS_INVALID_PARAMETER;
@@ -1358,34 +2375,69 @@ NTSTATUS NTAPI NtQueryDirectoryFile(
 	if (dir->get_num_entries() == 0)
 		return STATUS_NO_SUCH_FILE;
 
+	const ULONG ofs = FIELD_OFFSET(FILE_BOTH_DIRECTORY_INFORMATION, FileName);
+	if (FileInformationLength < ofs)
+		return STATUS_INFO_LENGTH_MISMATCH;
+
 	directory_entry_t *de = dir->get_next();
 	if (!de)
 		return STATUS_NO_MORE_FILES;
 
-	FILE_BOTH_DIRECTORY_INFORMATION info;
-	memset( &info, 0, sizeof info );
+	// entries are 8 byte aligned, each pointing to the next
+	BYTE *buffer = (BYTE*) FileInformation;
+	ULONG used = 0, last = 0, end = 0;
+	r = STATUS_SUCCESS;
+	while (de)
+	{
+		ULONG name_len = de->name.Length;
+		if (used + ofs + name_len > FileInformationLength)
+		{
+			// it goes in the next call
+			if (used)
+			{
+				dir->unget();
+				break;
+			}
 
-	if (S_ISDIR(de->st.st_mode))
-		info.FileAttributes = FILE_ATTRIBUTE_DIRECTORY;
-	else
-		info.FileAttributes = FILE_ATTRIBUTE_ARCHIVE;
-	info.FileNameLength = de->name.Length;
-	info.EndOfFile.QuadPart = de->st.st_size;
-	info.AllocationSize.QuadPart = de->st.st_blocks * 512;
+			// only part of the name fits
+			name_len = (FileInformationLength - ofs) & ~1;
+			r = STATUS_BUFFER_OVERFLOW;
+		}
 
-	r = copy_to_user( FileInformation, &info, sizeof info );
-	if (r < STATUS_SUCCESS)
-		return r;
+		FILE_BOTH_DIRECTORY_INFORMATION info;
+		memset( &info, 0, sizeof info );
 
-	const ULONG ofs = FIELD_OFFSET(FILE_BOTH_DIRECTORY_INFORMATION, FileName);
-	PWSTR p = (PWSTR)((PBYTE)FileInformation + ofs);
-	r = copy_to_user( p, de->name.Buffer, de->name.Length );
-	if (r < STATUS_SUCCESS)
-		return r;
+		if (S_ISDIR(de->st.st_mode))
+			info.FileAttributes = FILE_ATTRIBUTE_DIRECTORY;
+		else
+			info.FileAttributes = FILE_ATTRIBUTE_ARCHIVE;
+		info.FileNameLength = de->name.Length;
+		info.EndOfFile.QuadPart = de->st.st_size;
+		info.AllocationSize.QuadPart = de->st.st_blocks * 512;
+
+		NTSTATUS copied = copy_to_user( buffer + used, &info, ofs );
+		if (copied == STATUS_SUCCESS)
+			copied = copy_to_user( buffer + used + ofs, de->name.Buffer, name_len );
+		if (copied == STATUS_SUCCESS && used)
+		{
+			ULONG next = used - last;
+			copied = copy_to_user( buffer + last, &next, sizeof next );
+		}
+		if (copied < STATUS_SUCCESS)
+			return copied;
+
+		last = used;
+		end = used + ofs + name_len;
+		used = (end + 7) & ~7;
+
+		if (ReturnSingleEntry || r == STATUS_BUFFER_OVERFLOW)
+			break;
+		de = dir->get_next();
+	}
 
 	IO_STATUS_BLOCK iosb;
 	iosb.Status = r;
-	iosb.Information = ofs + de->name.Length;
+	iosb.Information = end;
 
 	copy_to_user( IoStatusBlock, &iosb, sizeof iosb );
 
@@ -1396,14 +2448,14 @@ NTSTATUS NTAPI NtQueryFullAttributesFile(
 	POBJECT_ATTRIBUTES ObjectAttributes,
 	PFILE_NETWORK_OPEN_INFORMATION FileInformation)
 {
-	object_attributes_t oa;
+	file_attributes_t attr;
 	NTSTATUS r;
 
-	r = oa.copy_from_user( ObjectAttributes );
+	trace("%p %p\n", ObjectAttributes, FileInformation);
+
+	r = query_attributes( ObjectAttributes, attr );
 	if (r < STATUS_SUCCESS)
 		return r;
 
-	trace("name = %pus\n", oa.ObjectName);
-
-	return STATUS_NOT_IMPLEMENTED;
+	return copy_to_user( FileInformation, &attr.info, sizeof attr.info );
 }
@@ -27,6 +27,7 @@
 
 #include "object.h"
 #include "event.h"
+#include "dentry.h"
 
 class completion_port_t : public sync_object_t
 {
@@ -41,14 +42,19 @@ public:
 
 void check_completions( void );
 
+// from file.cpp
+extern object_type_t device_type;
+
 class io_object_t : virtual public object_t {
 	completion_port_t *completion_port;
 	ULONG completion_key;
 public:
 	io_object_t();
-	virtual NTSTATUS read( PVOID buffer, ULONG length, ULONG *read ) = 0;
-	virtual NTSTATUS write( PVOID buffer, ULONG length, ULONG *written ) = 0;
+	~io_object_t();
+	virtual NTSTATUS read( PVOID buffer, ULONG length, ULONG *read, PLARGE_INTEGER offset ) = 0;
+	virtual NTSTATUS write( PVOID buffer, ULONG length, ULONG *written, PLARGE_INTEGER offset ) = 0;
 	void set_completion_port( completion_port_t *port, ULONG key );
+	void post_completion( ULONG value, NTSTATUS status, ULONG info );
 	virtual NTSTATUS set_position( LARGE_INTEGER& ofs );
 	virtual NTSTATUS fs_control( event_t* event, IO_STATUS_BLOCK iosb, ULONG FsControlCode,
 		 PVOID InputBuffer, ULONG InputBufferLength, PVOID OutputBuffer, ULONG OutputBufferLength );
@@ -57,17 +63,48 @@ public:
 
 class file_t : public io_object_t {
 	int fd;
+	ULONG options;
+	event_t *io_event;
+	file_attributes_t cached_attr;
+	ULONG attr_generation;
+	time_t attr_expires;
+	LONGLONG position;	// the file pointer; the host's is not used
+	int regular;		// -1 until checked
+	ULONG write_slot;	// which write generation the file uses
+	BYTE *readahead;	// data following recent small reads
+	LONGLONG ra_start;
+	ULONG ra_len;
+	bool ra_eof;		// readahead ends at the end of the file
+	ULONG ra_window;	// how much to read next time
+	LONGLONG ra_next;	// where a sequential read would start
+	ULONG ra_generation;	// write generation the readahead was read at
+	time_t ra_expires;
+protected:
+	NTSTATUS transfer( PVOID Buffer, ULONG Length, ULONG *transferred, PLARGE_INTEGER offset, bool write );
+	bool is_regular();
+	NTSTATUS cached_read( PVOID Buffer, ULONG Length, ULONG *transferred, LONGLONG pos );
 public:
 	file_t( int fd );
 	~file_t();
+	virtual bool access_allowed( ACCESS_MASK required, ACCESS_MASK handle );
 	virtual NTSTATUS query_information( FILE_STANDARD_INFORMATION& std_info );
-	virtual NTSTATUS read( PVOID Buffer, ULONG Length, ULONG *read );
-	virtual NTSTATUS write( PVOID Buffer, ULONG Length, ULONG *written );
+	virtual NTSTATUS read( PVOID Buffer, ULONG Length, ULONG *read, PLARGE_INTEGER offset );
+	virtual NTSTATUS write( PVOID Buffer, ULONG Length, ULONG *written, PLARGE_INTEGER offset );
 	virtual NTSTATUS query_information( FILE_BASIC_INFORMATION& info );
 	virtual NTSTATUS query_information( FILE_ATTRIBUTE_TAG_INFORMATION& info );
+	virtual NTSTATUS query_information( FILE_NETWORK_OPEN_INFORMATION& info );
+	NTSTATUS get_attributes( file_attributes_t& attr );
 	virtual NTSTATUS set_position( LARGE_INTEGER& ofs );
 	virtual NTSTATUS remove();
+	NTSTATUS rename( dentry_t *dir, const char *leaf, bool replace );
+	void data_changed();
+	virtual sync_object_t* get_sync_object();
 	int get_fd();
+	void set_options( ULONG CreateOptions );
+	bool is_async();
+	NTSTATUS queue_io( bool write, event_t *event, PIO_APC_ROUTINE ApcRoutine, PVOID ApcContext,
+		PIO_STATUS_BLOCK IoStatusBlock, PVOID Buffer, ULONG Length, PLARGE_INTEGER offset );
+	void io_completed( PVOID ApcContext, NTSTATUS status, ULONG info );
 };
 
 NTSTATUS open_file( file_t *&file, UNICODE_STRING& us );
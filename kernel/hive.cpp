@@ -0,0 +1,399 @@
+/*
+ * nt loader
+ *
+ * Copyright 2006-2009 Mike McCormack
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+#include <new>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "ntstatus.h"
+#define WIN32_NO_STATUS
+#include "windef.h"
+#include "winternl.h"
+
+#include "debug.h"
+#include "hive.h"
+
+// the cell layouts come from libntreg; its reader is not used, as it
+// trusts every offset in the file
+#include "ntreg.h"
+
+// cell offsets count from the first hbin, after the regf header
+static const ULONG hive_data_start = 0x1000;
+
+// the hive is copied into memory, so refuse anything much bigger
+// than the system hives
+static const ULONG max_hive_size = 0x4000000;
+
+static const USHORT nk_id = 0x6b6e;	// "nk"
+static const USHORT vk_id = 0x6b76;	// "vk"
+static const USHORT lf_id = 0x666c;	// "lf"
+static const USHORT lh_id = 0x686c;	// "lh"
+static const USHORT li_id = 0x696c;	// "li"
+static const USHORT ri_id = 0x6972;	// "ri"
+static const USHORT db_id = 0x6264;	// "db"
+
+static const USHORT nk_compressed_name = 0x20;
+static const USHORT vk_compressed_name = 0x01;
+
+// values bigger than this are split into segments in newer hives
+static const ULONG max_data_segment = 16344;
+
+// "db" big data record
+struct db_key {
+	short id;
+	USHORT no_segments;
+	int32_t ofs_segments;
+};
+
+hive_t::hive_t( BYTE *_base, ULONG _size, ULONG _root ) :
+	base( _base ),
+	size( _size ),
+	root( _root ),
+	refcount( 1 )
+{
+}
+
+hive_t::~hive_t()
+{
+	delete[] base;
+}
+
+void hive_t::release()
+{
+	assert( refcount > 0 );
+	if (!--refcount)
+		delete this;
+}
+
+NTSTATUS hive_t::open( int fd, hive_t *&hive )
+{
+	struct stat st;
+
+	if (0 > fstat( fd, &st ))
+		return STATUS_REGISTRY_IO_FAILED;
+
+	if (st.st_size < (off_t) (hive_data_start * 2))
+		return STATUS_NOT_REGISTRY_FILE;
+	if (st.st_size > (off_t) max_hive_size)
+		return STATUS_INSUFFICIENT_RESOURCES;
+
+	// a mapping would fault if the guest truncated the file, so copy it
+	ULONG len = st.st_size;
+	BYTE *p = new (std::nothrow) BYTE[len];
+	if (!p)
+		return STATUS_NO_MEMORY;
+	ULONG done = 0;
+	while (done < len)
+	{
+		ssize_t r = pread( fd, p + done, len - done, done );
+		if (r <= 0)
+			break;
+		done += r;
+	}
+	if (done != len)
+	{
+		delete[] p;
+		return STATUS_REGISTRY_IO_FAILED;
+	}
+
+	const regf_header *hdr = (const regf_header*) p;
+	if (hdr->id != 0x66676572)
+	{
+		delete[] p;
+		return STATUS_NOT_REGISTRY_FILE;
+	}
+
+	hive = new hive_t( p, len, hdr->ofs_rootkey );
+	if (!hive->get_cell( hive->root, offsetof( nk_key, keyname ), nk_id ))
+	{
+		trace("bad root key %08lx\n", hive->root);
+		hive->release();
+		hive = 0;
+		return STATUS_REGISTRY_CORRUPT;
+	}
+
+	trace("read hive, %lu bytes\n", hive->size);
+	return STATUS_SUCCESS;
+}
+
+// returns the data of a cell if len bytes of it are inside the hive
+const BYTE *hive_t::get_cell( ULONG cell, ULONG len, USHORT id ) const
+{
+	if (cell >= size - hive_data_start - sizeof (int32_t))
+		return 0;
+
+	ULONG pos = hive_data_start + cell;
+	int32_t cell_size = *(const int32_t*) (base + pos);
+
+	// allocated cells have a negative size
+	ULONG avail = cell_size < 0 ? -cell_size : cell_size;
+	if (avail < sizeof (int32_t) || avail > size - pos)
+		return 0;
+	avail -= sizeof (int32_t);
+	if (len > avail || (id && len < sizeof id))
+		return 0;
+
+	const BYTE *data = base + pos + sizeof (int32_t);
+	if (id && *(const USHORT*) data != id)
+		return 0;
+	return data;
+}
+
+bool hive_t::get_name( const char *name, ULONG len, bool compressed, unicode_string_t& str ) const
+{
+	UNICODE_STRING us;
+
+	if (compressed)
+	{
+		// one Latin-1 byte per character
+		WCHAR *buffer = new WCHAR[len + 1];
+		for (ULONG i = 0; i < len; i++)
+			buffer[i] = (BYTE) name[i];
+		us.Buffer = buffer;
+		us.Length = len * sizeof (WCHAR);
+		us.MaximumLength = us.Length;
+		NTSTATUS r = str.copy( &us );
+		delete[] buffer;
+		return r == STATUS_SUCCESS;
+	}
+
+	if (len & 1)
+		return false;
+
+	us.Buffer = (WCHAR*) name;
+	us.Length = len;
+	us.MaximumLength = len;
+	return str.copy( &us ) == STATUS_SUCCESS;
+}
+
+bool hive_t::get_key( ULONG cell, hive_key_t& key ) const
+{
+	const nk_key *nk = (const nk_key*) get_cell( cell, offsetof( nk_key, keyname ), nk_id );
+	if (!nk)
+		return false;
+
+	ULONG name_len = (USHORT) nk->len_name;
+	if (!get_cell( cell, offsetof( nk_key, keyname ) + name_len ))
+		return false;
+	if (!get_name( nk->keyname, name_len, nk->type & nk_compressed_name, key.name ))
+		return false;
+
+	key.cls.clear();
+	ULONG class_len = (USHORT) nk->len_classnam;
+	if (class_len && nk->ofs_classnam != -1)
+	{
+		const char *cls = (const char*) get_cell( nk->ofs_classnam, class_len );
+		if (!cls || !get_name( cls, class_len, false, key.cls ))
+			return false;
+	}
+
+	// the counts come from the guest, so hold them to what the lists hold
+	key.num_subkeys = 0;
+	key.subkeys = nk->ofs_lf;
+	if (nk->no_subkeys > 0)
+		key.num_subkeys = min( (ULONG) nk->no_subkeys, count_subkeys( key.subkeys ) );
+
+	key.num_values = 0;
+	key.values = nk->ofs_vallist;
+	if (nk->no_values > 0)
+		key.num_values = min( (ULONG) nk->no_values, size / sizeof (int32_t) );
+
+	return true;
+}
+
+// returns the nk cell of a subkey, or 0 if there is none
+// returns the number of keys in a subkey list, adding up the lists of an ri
+ULONG hive_t::count_subkeys( ULONG list ) const
+{
+	const BYTE *p = get_cell( list, sizeof (int32_t) );
+	if (!p)
+		return 0;
+
+	if (*(const USHORT*) p != ri_id)
+		return (USHORT) ((const lf_key*) p)->no_keys;
+
+	const ri_key *ri = (const ri_key*) p;
+	ULONG n = *(const USHORT*) &ri->no_lis;
+	if (!get_cell( list, offsetof( ri_key, hash ) + n * sizeof ri->hash[0] ))
+		return 0;
+
+	ULONG count = 0;
+	for (ULONG i = 0; i < n; i++)
+	{
+		const lf_key *sub = (const lf_key*) get_cell( ri->hash[i].ofs_li, sizeof (int32_t) );
+		if (!sub)
+			break;
+		count += (USHORT) sub->no_keys;
+	}
+	return count;
+}
+
+ULONG hive_t::get_subkey( const hive_key_t& key, ULONG index ) const
+{
+	if (index >= key.num_subkeys)
+		return 0;
+
+	const BYTE *p = get_cell( key.subkeys, sizeof (int32_t) );
+	if (!p)
+		return 0;
+
+	// an ri is a list of lists, so find the one holding the index
+	ULONG list = key.subkeys;
+	if (*(const USHORT*) p == ri_id)
+	{
+		const ri_key *ri = (const ri_key*) p;
+		ULONG n = *(const USHORT*) &ri->no_lis;
+		if (!get_cell( key.subkeys, offsetof( ri_key, hash ) + n * sizeof ri->hash[0] ))
+			return 0;
+
+		ULONG i;
+		for (i = 0; i < n; i++)
+		{
+			const lf_key *sub = (const lf_key*) get_cell( ri->hash[i].ofs_li, sizeof (int32_t) );
+			if (!sub)
+				return 0;
+			ULONG count = (USHORT) sub->no_keys;
+			if (index < count)
+				break;
+			index -= count;
+		}
+		if (i == n)
+			return 0;
+
+		list = ri->hash[i].ofs_li;
+		p = get_cell( list, sizeof (int32_t) );
+	}
+
+	const lf_key *lf = (const lf_key*) p;
+	if (index >= (USHORT) lf->no_keys)
+		return 0;
+
+	switch (*(const USHORT*) p)
+	{
+	case lf_id:
+	case lh_id:
+		if (!get_cell( list, offsetof( lf_key, hash ) + (index + 1) * sizeof lf->hash[0] ))
+			return 0;
+		return lf->hash[index].ofs_nk;
+	case li_id:
+		{
+		const li_key *li = (const li_key*) p;
+		if (!get_cell( list, offsetof( li_key, hash ) + (index + 1) * sizeof li->hash[0] ))
+			return 0;
+		return li->hash[index].ofs_nk;
+		}
+	}
+
+	trace("unknown subkey list %04x\n", *(const USHORT*) p);
+	return 0;
+}
+
+bool hive_t::get_data( const vk_key *vk, hive_value_t& val ) const
+{
+	ULONG len = vk->len_data;
+
+	val.data = 0;
+	val.size = 0;
+
+	// up to four bytes are kept in the offset itself
+	if (len & 0x80000000)
+	{
+		len &= 0x7fffffff;
+		if (len > sizeof vk->ofs_data)
+			return false;
+		val.data = new BYTE[len ? len : 1];
+		memcpy( val.data, &vk->ofs_data, len );
+		val.size = len;
+		return true;
+	}
+
+	if (!len)
+		return true;
+
+	const BYTE *data = 0;
+	const db_key *db = 0;
+	if (len > max_data_segment)
+		db = (const db_key*) get_cell( vk->ofs_data, sizeof *db, db_id );
+	if (!db)
+		data = get_cell( vk->ofs_data, len );
+	if (!db && !data)
+		return false;
+
+	val.data = new BYTE[len];
+	val.size = len;
+
+	if (data)
+	{
+		memcpy( val.data, data, len );
+		return true;
+	}
+
+	// big data is a list of segments
+	ULONG n = db->no_segments;
+	const int32_t *segments = (const int32_t*) get_cell( db->ofs_segments, n * sizeof (int32_t) );
+	ULONG done = 0;
+	for (ULONG i = 0; segments && i < n && done < len; i++)
+	{
+		ULONG chunk = len - done;
+		if (chunk > max_data_segment)
+			chunk = max_data_segment;
+		const BYTE *seg = get_cell( segments[i], chunk );
+		if (!seg)
+			break;
+		memcpy( val.data + done, seg, chunk );
+		done += chunk;
+	}
+
+	if (done == len)
+		return true;
+
+	delete[] val.data;
+	val.data = 0;
+	val.size = 0;
+	return false;
+}
+
+bool hive_t::get_value( const hive_key_t& key, ULONG index, hive_value_t& val ) const
+{
+	if (index >= key.num_values || key.num_values > size / sizeof (int32_t))
+		return false;
+
+	const int32_t *list = (const int32_t*) get_cell( key.values, key.num_values * sizeof (int32_t) );
+	if (!list)
+		return false;
+
+	ULONG cell = list[index];
+	const vk_key *vk = (const vk_key*) get_cell( cell, offsetof( vk_key, keyname ), vk_id );
+	if (!vk)
+		return false;
+
+	ULONG name_len = (USHORT) vk->len_name;
+	if (!get_cell( cell, offsetof( vk_key, keyname ) + name_len ))
+		return false;
+	if (!get_name( vk->keyname, name_len, vk->flag & vk_compressed_name, val.name ))
+		return false;
+
+	val.type = vk->val_type;
+	return get_data( vk, val );
+}
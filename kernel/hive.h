@@ -0,0 +1,69 @@
+/*
+ * nt loader
+ *
+ * Copyright 2006-2009 Mike McCormack
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __RING3K_HIVE_H__
+#define __RING3K_HIVE_H__
+
+#include "unicode.h"
+
+// a key node in a hive, as far as the registry needs it
+struct hive_key_t {
+	unicode_string_t name;
+	unicode_string_t cls;
+	ULONG num_subkeys;
+	ULONG subkeys;		// cell of the subkey list
+	ULONG num_values;
+	ULONG values;		// cell of the value list
+};
+
+struct hive_value_t {
+	unicode_string_t name;
+	ULONG type;
+	ULONG size;
+	BYTE *data;		// allocated with new[], owned by the caller
+};
+
+// hive_t is a native NT registry hive file, copied into memory whole when
+// it is loaded, so its size is capped.  The cells are only decoded when
+// asked for.  Every offset and count is checked against the size read, as
+// the file comes from the guest.
+class hive_t {
+	BYTE *base;
+	ULONG size;
+	ULONG root;
+	ULONG refcount;
+protected:
+	hive_t( BYTE *base, ULONG size, ULONG root );
+	~hive_t();
+	const BYTE *get_cell( ULONG cell, ULONG len, USHORT id = 0 ) const;
+	bool get_name( const char *name, ULONG len, bool compressed, unicode_string_t& str ) const;
+	bool get_data( const struct vk_key *vk, hive_value_t& val ) const;
+	ULONG count_subkeys( ULONG list ) const;
+public:
+	static NTSTATUS open( int fd, hive_t *&hive );
+	void addref() { refcount++; }
+	void release();
+	ULONG get_root() const { return root; }
+	bool get_key( ULONG cell, hive_key_t& key ) const;
+	ULONG get_subkey( const hive_key_t& key, ULONG index ) const;
+	bool get_value( const hive_key_t& key, ULONG index, hive_value_t& val ) const;
+};
+
+#endif // __RING3K_HIVE_H__
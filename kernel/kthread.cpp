@@ -38,38 +38,9 @@
 #include "ntcall.h"
 #include "section.h"
 #include "timer.h"
+#include "kthread.h"
 #include "file.h"
 
-class thread_impl_t;
-
-class kernel_thread_t :
-	public thread_t
-{
-public:
-	bool terminated;
-public:
-	kernel_thread_t( process_t *p );
-	virtual ~kernel_thread_t();
-	virtual void get_context( CONTEXT& c );
-	virtual bool win32k_init_complete();
-	virtual NTSTATUS do_user_callback( ULONG index, ULONG& length, PVOID& buffer);
-	virtual NTSTATUS terminate( NTSTATUS Status );
-	virtual bool is_terminated();
-	virtual void register_terminate_port( object_t *port );
-	//virtual void wait();
-	virtual NTSTATUS queue_apc_thread(PKNORMAL_ROUTINE ApcRoutine, PVOID Arg1, PVOID Arg2, PVOID Arg3);
-	virtual token_t* get_token();
-	virtual NTSTATUS resume( PULONG count );
-	virtual NTSTATUS copy_to_user( void *dest, const void *src, size_t count );
-	virtual NTSTATUS copy_from_user( void *dest, const void *src, size_t count );
-	virtual NTSTATUS verify_for_write( void *dest, size_t count );
-	virtual int run() = 0;
-	virtual BOOLEAN is_signalled( void );
-	virtual void* push( ULONG count );
-	virtual void pop( ULONG count );
-	virtual PTEB get_teb();
-};
-
 kernel_thread_t::kernel_thread_t( process_t *p ) :
 	thread_t( p ),
 	terminated( false )
@@ -0,0 +1,55 @@
+/*
+ * nt loader
+ *
+ * Copyright 2006-2008 Mike McCormack
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __KTHREAD_H__
+#define __KTHREAD_H__
+
+#include "thread.h"
+
+// a thread that runs kernel code in a fiber, with no user mode context
+class kernel_thread_t :
+	public thread_t
+{
+public:
+	bool terminated;
+public:
+	kernel_thread_t( process_t *p );
+	virtual ~kernel_thread_t();
+	virtual void get_context( CONTEXT& c );
+	virtual bool win32k_init_complete();
+	virtual NTSTATUS do_user_callback( ULONG index, ULONG& length, PVOID& buffer);
+	virtual NTSTATUS terminate( NTSTATUS Status );
+	virtual bool is_terminated();
+	virtual void register_terminate_port( object_t *port );
+	//virtual void wait();
+	virtual NTSTATUS queue_apc_thread(PKNORMAL_ROUTINE ApcRoutine, PVOID Arg1, PVOID Arg2, PVOID Arg3);
+	virtual token_t* get_token();
+	virtual NTSTATUS resume( PULONG count );
+	virtual NTSTATUS copy_to_user( void *dest, const void *src, size_t count );
+	virtual NTSTATUS copy_from_user( void *dest, const void *src, size_t count );
+	virtual NTSTATUS verify_for_write( void *dest, size_t count );
+	virtual int run() = 0;
+	virtual BOOLEAN is_signalled( void );
+	virtual void* push( ULONG count );
+	virtual void pop( ULONG count );
+	virtual PTEB get_teb();
+};
+
+#endif // __KTHREAD_H__
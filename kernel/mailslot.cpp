@@ -34,17 +34,17 @@
 class mailslot_t : public io_object_t
 {
 public:
-	virtual NTSTATUS read( PVOID Buffer, ULONG Length, ULONG *Read );
-	virtual NTSTATUS write( PVOID Buffer, ULONG Length, ULONG *Written );
+	virtual NTSTATUS read( PVOID Buffer, ULONG Length, ULONG *Read, PLARGE_INTEGER offset );
+	virtual NTSTATUS write( PVOID Buffer, ULONG Length, ULONG *Written, PLARGE_INTEGER offset );
 };
 
-NTSTATUS mailslot_t::read( PVOID Buffer, ULONG Length, ULONG *Read )
+NTSTATUS mailslot_t::read( PVOID Buffer, ULONG Length, ULONG *Read, PLARGE_INTEGER offset )
 {
 	trace("\n");
 	return STATUS_NOT_IMPLEMENTED;
 }
 
-NTSTATUS mailslot_t::write( PVOID Buffer, ULONG Length, ULONG *Written )
+NTSTATUS mailslot_t::write( PVOID Buffer, ULONG Length, ULONG *Written, PLARGE_INTEGER offset )
 {
 	trace("\n");
 	return STATUS_NOT_IMPLEMENTED;
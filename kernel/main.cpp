@@ -21,6 +21,7 @@
 #include "config.h"
 
 #include <stdio.h>
+#include <unistd.h>
 #include <stdarg.h>
 #include <limits.h>
 #include <fcntl.h>
@@ -47,10 +48,14 @@
 #include "timer.h"
 #include "unicode.h"
 #include "fiber.h"
+#include "aio.h"
 #include "file.h"
 #include "event.h"
 #include "symlink.h"
 #include "alloc_bitmap.h"
+#include "slab.h"
+#include "bintrace.h"
+#include "replay.h"
 
 process_list_t processes;
 thread_t *current;
@@ -82,16 +87,24 @@ bool default_sleeper_t::check_events( bool wait )
 	// check for expired timers
 	bool timers_left = timeout_t::check_timers(timeout);
 
+	// complete finished file I/O
+	check_async_io();
+
 	// Check for a deadlock and quit.
 	//  This happens if we're the only active thread,
-	//  there's no more timers, and we're asked to wait.
-	if (!timers_left && wait && fiber_t::last_fiber())
+	//  there's no more timers or I/O, and we're asked to wait.
+	if (!timers_left && !async_io_pending() && wait && fiber_t::last_fiber())
 		return true;
 	if (!wait)
 		return false;
 
-	int t = get_int_timeout( timeout );
-	int r = poll( 0, 0, t );
+	// wake up for a timer or an I/O completion
+	int t = timers_left ? get_int_timeout( timeout ) : -1;
+	struct pollfd pfd;
+	pfd.fd = get_async_io_fd();
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	int r = poll( &pfd, pfd.fd >= 0 ? 1 : 0, t );
 	if (r >= 0)
 		return false;
 	if (errno != EINTR)
@@ -102,6 +115,8 @@ bool default_sleeper_t::check_events( bool wait )
 default_sleeper_t default_sleeper;
 sleeper_t* sleeper = &default_sleeper;
 
+static void check_trace_control();
+
 int schedule(void)
 {
 	/* while there's still a thread running */
@@ -109,6 +124,7 @@ int schedule(void)
 	{
 		// check if any thing interesting has happened
 		sleeper->check_events( false );
+		check_trace_control();
 
 		// other fibers are active... schedule run them
 		if (!fiber_t::last_fiber())
@@ -296,6 +312,8 @@ trace_option trace_option_list[] = {
 	{ "csrdebug", false },
 	{ "ldrsnaps", false },
 	{ "core", false },
+	{ "slabstats", false },
+	{ "poison", false },
 	{ 0, false },
 };
 
@@ -306,11 +324,22 @@ void usage( void )
 	const char usage[] =
 		"Usage: %s [options] [native.exe]\n"
 		"Options:\n"
+		"  -c,--clock-interval=<ms>  shared user page clock update interval (0=off)\n"
 		"  -d,--debug    break into debugger on exceptions\n"
 		"  -g,--graphics select screen driver\n"
 		"  -h,--help     print this message\n"
 		"  -q,--quiet    quiet, suppress debug messages\n"
-		"  -t,--trace=<options>    enable tracing\n"
+		"  -s,--scheduler=<policy>  select time slice policy\n"
+		"  -S,--syscall-stats=<file>  write syscall statistics at exit or on SIGUSR2\n"
+		"                          (- for stderr, *.json for JSON)\n"
+		"  -t,--trace=<options>    enable tracing, comma separated trace options\n"
+		"                          or source file names, \"all\" for every file\n"
+		"  --trace-control=<file>  on SIGUSR1 read trace options from <file>,\n"
+		"                          a -<name> disables it\n"
+		"  -T,--trace-file=<file>  write the trace to a binary ring buffer file\n"
+		"                          (read it with tracedump)\n"
+		"  --record=<file>  record syscalls and the user memory they access\n"
+		"  --replay=<file>  replay recorded syscalls instead of running a program\n"
 		"  -v,--version  print version\n\n"
 		"  smss.exe is started by default\n\n";
 	printf( usage, PACKAGE_NAME );
@@ -321,11 +350,21 @@ void usage( void )
 		printf("%s ", trace_option_list[i].name );
 	printf("\n");
 
+	printf("  source files: ");
+	for (trace_category_t *cat = trace_category_t::first; cat; cat = cat->next)
+		printf("%s ", cat->name );
+	printf("\n");
+
 	// list the graphics drivers
 	printf("  graphics drivers: ");
 	list_graphics_drivers();
 	printf("\n");
 
+	// list the scheduler policies
+	printf("  scheduler policies: ");
+	list_scheduler_policies();
+	printf("\n");
+
 	printf("\n");
 
 	exit(0);
@@ -349,73 +388,171 @@ bool trace_is_enabled( const char *name )
 		if (!strcmp(name, trace_option_list[i].name))
 			return trace_option_list[i].enabled;
 
+	trace_category_t *cat = trace_category_t::find( name, strlen( name ) );
+	if (cat)
+		return cat->enabled;
+
 	return false;
 }
 
-void enable_trace( const char *name )
+// set when --trace names source files, otherwise tracing syscalls
+// traces every source file as it always has
+static bool trace_files_selected;
+
+// set by --trace-file, which records the trace of the selected source
+// files without tracing syscalls unless --trace asks for that too
+static bool trace_file_opened;
+
+// set a trace option or source file category, "all" means every source file
+static bool set_trace( const char *name, unsigned int len, int enabled )
 {
+	bool found = false;
+
+	if (len == 3 && !strncmp( name, "all", len ))
+	{
+		trace_category_t::enable_all( enabled );
+		trace_files_selected = true;
+		found = true;
+	}
+
 	for (int i=0; trace_option_list[i].name; i++)
 	{
 		const char *optname = trace_option_list[i].name;
-		if ( strcmp( optname, name ))
+		if (strncmp( optname, name, len ) || optname[len])
 			continue;
-		trace_option_list[i].enabled = true;
-		return;
+		trace_option_list[i].enabled = enabled;
+		found = true;
+	}
+
+	trace_category_t *cat = trace_category_t::find( name, len );
+	if (cat)
+	{
+		cat->enabled = enabled;
+		trace_files_selected = true;
+		found = true;
 	}
 
-	fprintf(stderr, "unknown trace: %s\n\n", name);
-	usage();
+	return found;
+}
+
+// apply a list of names separated by commas or whitespace,
+// a name prefixed with - is disabled
+static const char *apply_trace_options( const char *p )
+{
+	while (*p)
+	{
+		while (*p == ',' || *p == ' ' || *p == '\t' || *p == '\n')
+			p++;
+		if (!*p)
+			break;
+
+		int enabled = 1;
+		if (*p == '-')
+		{
+			enabled = 0;
+			p++;
+		}
+
+		unsigned int len = 0;
+		while (p[len] && p[len] != ',' && p[len] != ' ' && p[len] != '\t' && p[len] != '\n')
+			len++;
+
+		if (!set_trace( p, len, enabled ))
+			return p;
+		p += len;
+	}
+	return 0;
 }
 
 void parse_trace_options( const char *options )
 {
+	// plain --trace traces syscalls and every source file
 	if (!options)
+		options = "syscall,all";
+
+	const char *bad = apply_trace_options( options );
+	if (bad)
 	{
-		enable_trace( "syscall" );
-		return;
+		fprintf(stderr, "unknown trace: %s\n\n", bad);
+		usage();
 	}
+}
 
-	const char *x, *p = options;
-	unsigned int len;
-	char str[10];
-	while (*p)
+static const char *trace_control_file;
+static volatile sig_atomic_t trace_control_requested;
+
+static void request_trace_control( int )
+{
+	trace_control_requested = 1;
+}
+
+// re-read the trace options from the control file after a SIGUSR1
+static void check_trace_control()
+{
+	if (!trace_control_requested)
+		return;
+	trace_control_requested = 0;
+
+	char buffer[0x400];
+	int fd = open( trace_control_file, O_RDONLY );
+	if (fd < 0)
 	{
-		x = strchr( p, ',' );
-		if (x)
-			len = x - p;
-		else
-			len = strlen( p );
-
-		len = min( len, sizeof str );
-		memcpy( str, p, len );
-		str[len] = 0;
-		enable_trace( str );
-		p += len;
-		if ( *p == ',')
-			p++;
+		fprintf(stderr, "can't open trace control file %s\n", trace_control_file);
+		return;
 	}
+	int len = read( fd, buffer, sizeof buffer - 1 );
+	close( fd );
+	if (len < 0)
+		return;
+	buffer[len] = 0;
+
+	const char *bad = apply_trace_options( buffer );
+	if (bad)
+		fprintf(stderr, "unknown trace in control file: %s\n", bad);
 }
 
+void set_trace_control( const char *filename )
+{
+	trace_control_file = filename;
+	signal( SIGUSR1, request_trace_control );
+}
+
+static const char *replay_file;
+
 void parse_options(int argc, char **argv)
 {
 	while (1)
 	{
 		int option_index;
 		static struct option long_options[] = {
+			{"clock-interval", required_argument, NULL, 'c' },
 			{"debug", no_argument, NULL, 'd' },
 			{"graphics", required_argument, NULL, 'g' },
 			{"help", no_argument, NULL, 'h' },
+			{"scheduler", required_argument, NULL, 's' },
+			{"syscall-stats", required_argument, NULL, 'S' },
 			{"trace", optional_argument, NULL, 't' },
+			{"trace-file", required_argument, NULL, 'T' },
+			{"trace-control", required_argument, NULL, 'C' },
+			{"record", required_argument, NULL, 'R' },
+			{"replay", required_argument, NULL, 'P' },
 			{"version", no_argument, NULL, 'v' },
 			{NULL, 0, 0, 0 },
 		};
 
-		int ch = getopt_long(argc, argv, "g:dhqt::v?", long_options, &option_index );
+		int ch = getopt_long(argc, argv, "c:g:dhqs:S:t::T:v?", long_options, &option_index );
 		if (ch == -1)
 			break;
 
 		switch (ch)
 		{
+		case 'c':
+			if (!set_clock_interval( optarg ))
+			{
+				fprintf(stderr, "invalid clock interval %s\n", optarg);
+				usage();
+			}
+			break;
 		case 'd':
 			option_debug = 1;
 			break;
@@ -430,13 +567,50 @@ void parse_options(int argc, char **argv)
 		case 'h':
 			usage();
 			break;
+		case 's':
+			if (!set_scheduler_policy( optarg ))
+			{
+				fprintf(stderr, "unknown scheduler policy %s\n", optarg);
+				usage();
+			}
+			break;
+		case 'S':
+			if (!set_syscall_stats( optarg ))
+				usage();
+			break;
 		case 't':
 			parse_trace_options( optarg );
 			break;
+		case 'C':
+			set_trace_control( optarg );
+			break;
+		case 'R':
+			if (!record_syscalls( optarg ))
+			{
+				fprintf(stderr, "can't create %s\n", optarg);
+				usage();
+			}
+			break;
+		case 'P':
+			replay_file = optarg;
+			break;
+		case 'T':
+			if (!bintrace_open( optarg ))
+			{
+				fprintf(stderr, "can't create trace file %s\n", optarg);
+				usage();
+			}
+			trace_file_opened = true;
+			break;
 		case 'v':
 			version();
 		}
 	}
+
+	// --trace=syscall and --trace-file trace every source file,
+	// unless particular ones were picked
+	if ((option_trace || trace_file_opened) && !trace_files_selected)
+		trace_category_t::enable_all( 1 );
 }
 
 int main(int argc, char **argv)
@@ -475,6 +649,10 @@ int main(int argc, char **argv)
 	// quick sanity test
 	allocation_bitmap_t::test();
 
+	// catch use of freed kernel objects
+	if (trace_is_enabled("poison"))
+		slab_cache_t::enable_poison();
+
 	// initialize boottime
 	SYSTEM_TIME_OF_DAY_INFORMATION dummy;
 	get_system_time_of_day( dummy );
@@ -504,19 +682,41 @@ int main(int argc, char **argv)
 	init_ntdll();
 	create_kthread();
 
-	us.copy( exename );
+	int r;
+	if (replay_file)
+	{
+		// benchmark the kernel alone, without guest code
+		r = replay_syscalls( replay_file );
+	}
+	else
+	{
+		us.copy( exename );
+
+		r = create_initial_process( &initial_thread, us );
+		if (r < STATUS_SUCCESS)
+			die("create_initial_process() failed (%08x)\n", r);
 
-	int r = create_initial_process( &initial_thread, us );
-	if (r < STATUS_SUCCESS)
-		die("create_initial_process() failed (%08x)\n", r);
+		// keep the time in the shared user page up to date
+		start_clock_thread();
 
-	// run the main loop
-	schedule();
+		// run the main loop
+		schedule();
+
+		stop_async_io();
+		stop_clock_thread();
+	}
+
+	dump_syscall_stats();
+	bintrace_close();
+	close_syscall_record();
 
 	ntgdi_fini();
-	r = initial_thread->process->ExitStatus;
-	//fprintf(stderr, "process exited (%08x)\n", r);
-	release( initial_thread );
+	if (initial_thread)
+	{
+		r = initial_thread->process->ExitStatus;
+		//fprintf(stderr, "process exited (%08x)\n", r);
+		release( initial_thread );
+	}
 
 	shutdown_kthread();
 	do_cleanup();
@@ -526,5 +726,8 @@ int main(int argc, char **argv)
 	free_registry();
 	free_ntdll();
 
+	if (trace_is_enabled("slabstats"))
+		slab_cache_t::dump_stats();
+
 	return r;
 }
@@ -48,17 +48,24 @@ mutant_t *mutant_from_obj( object_t *obj )
 	return dynamic_cast<mutant_t*>( obj );
 }
 
+static object_type_t mutant_type( "Mutant",
+	STANDARD_RIGHTS_READ | MUTANT_QUERY_STATE,
+	STANDARD_RIGHTS_WRITE,
+	STANDARD_RIGHTS_EXECUTE | SYNCHRONIZE,
+	MUTANT_ALL_ACCESS );
+
 mutant_t::mutant_t(BOOLEAN InitialOwner) :
 	owner(0),
 	count(0)
 {
+	set_type( &mutant_type );
 	if (InitialOwner)
 		take_ownership();
 }
 
 BOOLEAN mutant_t::is_signalled()
 {
-	return current != NULL;
+	return owner == 0 || owner == current;
 }
 
 BOOLEAN mutant_t::satisfy()
@@ -82,7 +89,10 @@ NTSTATUS mutant_t::release_ownership(ULONG& prev)
 		return STATUS_MUTANT_NOT_OWNED;
 	prev = count;
 	if (!--count)
+	{
 		owner = 0;
+		notify_watchers();
+	}
 	return STATUS_SUCCESS;
 }
 
@@ -137,10 +147,13 @@ NTSTATUS NTAPI NtReleaseMutant(
 			return r;
 	}
 
+	handoff_t handoff;
 	r = mutant->release_ownership( prev );
 	if (r == STATUS_SUCCESS && PreviousState)
 		r = copy_to_user( PreviousState, &prev, sizeof prev );
 
+	handoff.switch_to_woken();
+
 	return r;
 }
 
@@ -32,6 +32,7 @@
 #include "file.h"
 #include "objdir.h"
 #include "debug.h"
+#include "slab.h"
 
 class pipe_server_t;
 class pipe_client_t;
@@ -48,14 +49,20 @@ typedef list_iter<pipe_client_t,0> pipe_client_iter_t;
 class pipe_device_t : public object_dir_impl_t, public io_object_t
 {
 public:
-	virtual NTSTATUS read( PVOID buffer, ULONG length, ULONG *read );
-	virtual NTSTATUS write( PVOID buffer, ULONG length, ULONG *written );
+	pipe_device_t();
+	virtual NTSTATUS read( PVOID buffer, ULONG length, ULONG *read, PLARGE_INTEGER offset );
+	virtual NTSTATUS write( PVOID buffer, ULONG length, ULONG *written, PLARGE_INTEGER offset );
 	virtual NTSTATUS open( object_t *&out, open_info_t& info );
 	virtual NTSTATUS fs_control( event_t* event, IO_STATUS_BLOCK iosb, ULONG FsControlCode,
 		 PVOID InputBuffer, ULONG InputBufferLength, PVOID OutputBuffer, ULONG OutputBufferLength );
 	NTSTATUS wait_server_available( PFILE_PIPE_WAIT_FOR_BUFFER pwfb, ULONG Length );
 };
 
+pipe_device_t::pipe_device_t()
+{
+	set_type( &device_type );
+}
+
 // factory to create the pipe device at startup
 class pipe_device_factory : public object_factory
 {
@@ -93,6 +100,7 @@ protected:
 	void *operator new(unsigned int count, void*&ptr) { assert( count == sizeof (pipe_message_t)); return ptr; }
 	pipe_message_t(ULONG _Length);
 public:
+	void operator delete(void *ptr) { slab_free( ptr ); }
 	pipe_message_element_t entry[1];
 	ULONG Length;
 	static pipe_message_t* alloc_pipe_message( ULONG _Length );
@@ -121,8 +129,8 @@ public:
 public:
 	pipe_server_t( pipe_container_t *container );
 	~pipe_server_t();
-	virtual NTSTATUS read( PVOID buffer, ULONG length, ULONG *read );
-	virtual NTSTATUS write( PVOID buffer, ULONG length, ULONG *written );
+	virtual NTSTATUS read( PVOID buffer, ULONG length, ULONG *read, PLARGE_INTEGER offset );
+	virtual NTSTATUS write( PVOID buffer, ULONG length, ULONG *written, PLARGE_INTEGER offset );
 	NTSTATUS open( object_t *&out, open_info_t& info );
 	virtual NTSTATUS fs_control( event_t* event, IO_STATUS_BLOCK iosb, ULONG FsControlCode,
 		 PVOID InputBuffer, ULONG InputBufferLength, PVOID OutputBuffer, ULONG OutputBufferLength );
@@ -147,8 +155,8 @@ public:
 	thread_t *thread;
 public:
 	pipe_client_t( pipe_container_t *container );
-	virtual NTSTATUS read( PVOID buffer, ULONG length, ULONG *read );
-	virtual NTSTATUS write( PVOID buffer, ULONG length, ULONG *written );
+	virtual NTSTATUS read( PVOID buffer, ULONG length, ULONG *read, PLARGE_INTEGER offset );
+	virtual NTSTATUS write( PVOID buffer, ULONG length, ULONG *written, PLARGE_INTEGER offset );
 	NTSTATUS set_pipe_info( FILE_PIPE_INFORMATION& pipe_info );
 	virtual NTSTATUS fs_control( event_t* event, IO_STATUS_BLOCK iosb, ULONG FsControlCode,
 		 PVOID InputBuffer, ULONG InputBufferLength, PVOID OutputBuffer, ULONG OutputBufferLength );
@@ -214,12 +222,12 @@ void init_pipe_device()
 		die("failed to create named pipe\n");
 }
 
-NTSTATUS pipe_device_t::read( PVOID buffer, ULONG length, ULONG *read )
+NTSTATUS pipe_device_t::read( PVOID buffer, ULONG length, ULONG *read, PLARGE_INTEGER offset )
 {
 	return STATUS_ACCESS_DENIED;
 }
 
-NTSTATUS pipe_device_t::write( PVOID buffer, ULONG length, ULONG *written )
+NTSTATUS pipe_device_t::write( PVOID buffer, ULONG length, ULONG *written, PLARGE_INTEGER offset )
 {
 	return STATUS_ACCESS_DENIED;
 }
@@ -232,7 +240,7 @@ pipe_message_t::pipe_message_t( ULONG _Length ) :
 pipe_message_t *pipe_message_t::alloc_pipe_message( ULONG _Length )
 {
 	ULONG sz = _Length + sizeof (pipe_message_t);
-	void *mem = (void*) new unsigned char[sz];
+	void *mem = slab_alloc( sz );
 	return new(mem) pipe_message_t(_Length);
 }
 
@@ -420,7 +428,7 @@ NTSTATUS pipe_server_t::open( object_t *&out, open_info_t& info )
 	return STATUS_NOT_IMPLEMENTED;
 }
 
-NTSTATUS pipe_server_t::read( PVOID buffer, ULONG length, ULONG *read )
+NTSTATUS pipe_server_t::read( PVOID buffer, ULONG length, ULONG *read, PLARGE_INTEGER offset )
 {
 	pipe_message_t *msg;
 
@@ -459,7 +467,7 @@ NTSTATUS pipe_server_t::read( PVOID buffer, ULONG length, ULONG *read )
 	return STATUS_SUCCESS;
 }
 
-NTSTATUS pipe_server_t::write( PVOID buffer, ULONG length, ULONG *written )
+NTSTATUS pipe_server_t::write( PVOID buffer, ULONG length, ULONG *written, PLARGE_INTEGER offset )
 {
 	pipe_message_t *msg = pipe_message_t::alloc_pipe_message( length );
 
@@ -569,7 +577,7 @@ pipe_client_t::pipe_client_t( pipe_container_t *container ) :
 {
 }
 
-NTSTATUS pipe_client_t::read( PVOID buffer, ULONG length, ULONG *read )
+NTSTATUS pipe_client_t::read( PVOID buffer, ULONG length, ULONG *read, PLARGE_INTEGER offset )
 {
 	pipe_message_t *msg;
 
@@ -608,7 +616,7 @@ NTSTATUS pipe_client_t::read( PVOID buffer, ULONG length, ULONG *read )
 	return STATUS_SUCCESS;
 }
 
-NTSTATUS pipe_client_t::write( PVOID buffer, ULONG length, ULONG *written )
+NTSTATUS pipe_client_t::write( PVOID buffer, ULONG length, ULONG *written, PLARGE_INTEGER offset )
 {
 	pipe_message_t *msg = pipe_message_t::alloc_pipe_message( length );
 
@@ -645,11 +653,11 @@ NTSTATUS pipe_client_t::transceive(
 {
 	NTSTATUS r;
 	ULONG out = 0;
-	r = write( InputBuffer, InputBufferLength, &out );
+	r = write( InputBuffer, InputBufferLength, &out, 0 );
 	if (r < STATUS_SUCCESS)
 		return r;
 
-	r = read( OutputBuffer, OutputBufferLength, &out );
+	r = read( OutputBuffer, OutputBufferLength, &out, 0 );
 	if (r < STATUS_SUCCESS)
 		return r;
 
@@ -33,15 +33,22 @@
 #include "mem.h"
 #include "ntcall.h"
 #include "timer.h"
+#include "replay.h"
 
 NTSTATUS copy_to_user( void *dest, const void *src, size_t len )
 {
-	return current->copy_to_user( dest, src, len );
+	NTSTATUS r = current->copy_to_user( dest, src, len );
+	if (recording_syscalls && r == STATUS_SUCCESS)
+		record_user_write( dest, src, len );
+	return r;
 }
 
 NTSTATUS copy_from_user( void *dest, const void *src, size_t len )
 {
-	return current->copy_from_user( dest, src, len );
+	NTSTATUS r = current->copy_from_user( dest, src, len );
+	if (recording_syscalls)
+		record_user_read( src, dest, len, r );
+	return r;
 }
 
 NTSTATUS verify_for_write( void *dest, size_t len )
@@ -307,14 +314,16 @@ NTSTATUS NTAPI NtQueryPerformanceCounter(
 	PLARGE_INTEGER PerformanceCount,
 	PLARGE_INTEGER PerformanceFrequency)
 {
-	LARGE_INTEGER now = timeout_t::current_time();
+	// counts 100ns ticks of a clock that is never set back
+	LARGE_INTEGER now = timeout_t::monotonic_time();
 	LARGE_INTEGER freq;
 	NTSTATUS r;
-	freq.QuadPart = 1000LL;
+	freq.QuadPart = 10000000LL;
 	r = copy_to_user( PerformanceCount, &now, sizeof now );
 	if (r < STATUS_SUCCESS)
 		return r;
-	r = copy_to_user( PerformanceFrequency, &freq, sizeof freq );
+	if (PerformanceFrequency)
+		r = copy_to_user( PerformanceFrequency, &freq, sizeof freq );
 	return r;
 }
 
@@ -25,6 +25,10 @@
 
 void init_syscalls(bool xp);
 NTSTATUS do_nt_syscall(ULONG id, ULONG func, ULONG *uargs, ULONG retaddr);
+bool set_syscall_stats( const char *file );
+void dump_syscall_stats();
+const char *get_syscall_name( ULONG func );
+NTSTATUS call_nt_syscall( ULONG func, ULONG *args );
 NTSTATUS copy_to_user( void *dest, const void *src, size_t len );
 NTSTATUS copy_from_user( void *dest, const void *src, size_t len );
 NTSTATUS verify_for_write( void *dest, size_t len );
@@ -121,6 +125,10 @@ bool set_graphics_driver( const char *driver );
 NTSTATUS win32k_process_init(process_t *p);
 NTSTATUS win32k_thread_init(thread_t *t);
 
+// from thread.cpp
+bool set_scheduler_policy( const char *policy );
+void list_scheduler_policies();
+
 // from kthread.cpp
 void create_kthread(void);
 void shutdown_kthread(void);
@@ -21,6 +21,8 @@
 
 #include <stdarg.h>
 #include <assert.h>
+#include <ctype.h>
+#include <string.h>
 
 #include "ntstatus.h"
 #define WIN32_NO_STATUS
@@ -49,8 +51,18 @@ void object_dir_t::set_obj_parent( object_t *child, object_dir_t *dir )
 	child->parent = dir;
 }
 
-object_dir_impl_t::object_dir_impl_t()
+static object_type_t directory_type( "Directory",
+	STANDARD_RIGHTS_READ | DIRECTORY_QUERY | DIRECTORY_TRAVERSE,
+	STANDARD_RIGHTS_WRITE | DIRECTORY_CREATE_OBJECT | DIRECTORY_CREATE_SUBDIRECTORY,
+	STANDARD_RIGHTS_EXECUTE | DIRECTORY_QUERY | DIRECTORY_TRAVERSE,
+	DIRECTORY_ALL_ACCESS );
+
+object_dir_impl_t::object_dir_impl_t() :
+	hash_table(0),
+	hash_size(0),
+	num_entries(0)
 {
+	set_type( &directory_type );
 }
 
 object_dir_impl_t::~object_dir_impl_t()
@@ -63,11 +75,73 @@ object_dir_impl_t::~object_dir_impl_t()
 		i.next();
 		unlink( obj );
 	}
+	delete[] hash_table;
+}
+
+// case folded the same way as unicode_string_t::compare, so names
+// that compare equal ignoring case always land in the same bucket
+ULONG object_dir_impl_t::hash_name( const UNICODE_STRING& name )
+{
+	ULONG hash = 2166136261U;
+	for (ULONG i = 0; i < name.Length/2; i++)
+	{
+		hash ^= (WCHAR) tolower( name.Buffer[i] );
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+void object_dir_impl_t::hash_grow()
+{
+	ULONG new_size = hash_size ? hash_size * 2 : 16;
+	object_t **new_table = new object_t*[new_size];
+	memset( new_table, 0, new_size * sizeof new_table[0] );
+
+	for (ULONG i = 0; i < hash_size; i++)
+	{
+		while (hash_table[i])
+		{
+			object_t *obj = hash_table[i];
+			hash_table[i] = obj->hash_next;
+			ULONG n = obj->name_hash & (new_size - 1);
+			obj->hash_next = new_table[n];
+			new_table[n] = obj;
+		}
+	}
+
+	delete[] hash_table;
+	hash_table = new_table;
+	hash_size = new_size;
+}
+
+void object_dir_impl_t::hash_insert( object_t *obj )
+{
+	if (num_entries >= hash_size)
+		hash_grow();
+	obj->name_hash = hash_name( obj->name );
+	ULONG n = obj->name_hash & (hash_size - 1);
+	obj->hash_next = hash_table[n];
+	hash_table[n] = obj;
+	num_entries++;
+}
+
+void object_dir_impl_t::hash_remove( object_t *obj )
+{
+	object_t **p = &hash_table[obj->name_hash & (hash_size - 1)];
+	while (*p != obj)
+	{
+		assert( *p );
+		p = &(*p)->hash_next;
+	}
+	*p = obj->hash_next;
+	obj->hash_next = 0;
+	num_entries--;
 }
 
 void object_dir_impl_t::unlink( object_t *obj )
 {
 	assert( obj );
+	hash_remove( obj );
 	object_list.unlink( obj );
 	set_obj_parent( obj, 0 );
 }
@@ -76,6 +150,7 @@ void object_dir_impl_t::append( object_t *obj )
 {
 	assert( obj );
 	object_list.append( obj );
+	hash_insert( obj );
 	set_obj_parent( obj, this );
 }
 
@@ -90,9 +165,14 @@ bool object_dir_impl_t::access_allowed( ACCESS_MASK required, ACCESS_MASK handle
 object_t *object_dir_impl_t::lookup( UNICODE_STRING& name, bool ignore_case )
 {
 	//trace("searching for %pus\n", &name );
-	for( object_iter_t i(object_list); i; i.next() )
+	if (!num_entries)
+		return 0;
+
+	ULONG hash = hash_name( name );
+	for (object_t *obj = hash_table[hash & (hash_size - 1)]; obj; obj = obj->hash_next)
 	{
-		object_t *obj = i;
+		if (obj->name_hash != hash)
+			continue;
 		unicode_string_t& entry_name  = obj->get_name();
 		//trace("checking %pus\n", &entry_name );
 		if (!entry_name.compare( &name, ignore_case ))
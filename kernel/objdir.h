@@ -38,7 +38,16 @@ public:
 
 class object_dir_impl_t : public object_dir_t
 {
+	// object_list keeps creation order for enumeration,
+	// the hash table is used for lookups by name
 	object_list_t object_list;
+	object_t **hash_table;
+	ULONG hash_size;
+	ULONG num_entries;
+	static ULONG hash_name( const UNICODE_STRING& name );
+	void hash_insert( object_t *obj );
+	void hash_remove( object_t *obj );
+	void hash_grow();
 public:
 	object_dir_impl_t();
 	virtual ~object_dir_impl_t();
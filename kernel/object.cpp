@@ -26,6 +26,8 @@
 #include <fcntl.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
+#include <typeinfo>
 
 #include "ntstatus.h"
 #define WIN32_NO_STATUS
@@ -77,6 +79,48 @@ NTSTATUS object_t::open( object_t *&out, open_info_t& info )
 	return STATUS_SUCCESS;
 }
 
+object_type_t *object_type_t::registry[object_type_t::max_types];
+ULONG object_type_t::num_types;
+
+object_type_t generic_object_type( "Object", 0, 0, 0, 0 );
+
+// types are static objects, so the counts are zero before construction
+// and anything that was counted during static initialization is kept
+object_type_t::object_type_t( const char *_name, ACCESS_MASK read, ACCESS_MASK write, ACCESS_MASK execute, ACCESS_MASK all ) :
+	name( _name )
+{
+	mapping.GenericRead = read;
+	mapping.GenericWrite = write;
+	mapping.GenericExecute = execute;
+	mapping.GenericAll = all;
+	assert( num_types < max_types );
+	index = num_types;
+	registry[num_types++] = this;
+}
+
+void object_type_t::add_object()
+{
+	num_objects++;
+	if (num_objects > peak_objects)
+		peak_objects = num_objects;
+}
+
+void object_type_t::add_handle()
+{
+	num_handles++;
+	if (num_handles > peak_handles)
+		peak_handles = num_handles;
+}
+
+handle_table_t::handle_table_t() :
+	page(0),
+	num_pages(0),
+	free_head(no_entry),
+	free_tail(no_entry),
+	count(0)
+{
+}
+
 HANDLE handle_table_t::index_to_handle( ULONG index )
 {
 	return (HANDLE)((index+1)*4);
@@ -87,45 +131,95 @@ ULONG handle_table_t::handle_to_index( HANDLE handle )
 	return ((ULONG)handle)/4 - 1;
 }
 
-HANDLE handle_table_t::alloc_handle( object_t *obj, ACCESS_MASK access )
+object_info_t& handle_table_t::entry_at( ULONG index )
 {
-	ULONG i;
+	return page[index / entries_per_page][index % entries_per_page];
+}
 
-	for (i=0; i<max_handles; i++)
+object_info_t *handle_table_t::lookup( HANDLE handle )
+{
+	ULONG n = (ULONG) handle;
+	if (!n)
+		return NULL;
+	if (n&3)
+		return NULL;
+	n = handle_to_index( handle );
+	if (n >= num_pages * entries_per_page)
+		return NULL;
+	object_info_t *x = &entry_at( n );
+	if (!x->object)
+		return NULL;
+	return x;
+}
+
+void handle_table_t::append_free( ULONG index )
+{
+	object_info_t& x = entry_at( index );
+	x.object = NULL;
+	x.next_free = no_entry;
+	if (free_tail == no_entry)
+		free_head = index;
+	else
+		entry_at( free_tail ).next_free = index;
+	free_tail = index;
+}
+
+bool handle_table_t::grow()
+{
+	if (num_pages >= max_pages)
+		return false;
+
+	// the page directory doubles, pages themselves are never moved
+	if ((num_pages & (num_pages - 1)) == 0)
 	{
-		if (!info[i].object)
-		{
-			info[i].object = obj;
-			info[i].access = access;
-			addref( obj );
-			return index_to_handle( i );
-		}
+		ULONG n = num_pages ? num_pages * 2 : 1;
+		object_info_t **p = new object_info_t*[n];
+		if (num_pages)
+			memcpy( p, page, num_pages * sizeof page[0] );
+		delete[] page;
+		page = p;
 	}
-	return 0;
+
+	page[num_pages] = new object_info_t[entries_per_page];
+	num_pages++;
+
+	ULONG first = (num_pages - 1) * entries_per_page;
+	for (ULONG i = 0; i < entries_per_page; i++)
+		append_free( first + i );
+
+	return true;
 }
 
-NTSTATUS handle_table_t::free_handle( HANDLE handle )
+HANDLE handle_table_t::alloc_handle( object_t *obj, ACCESS_MASK access )
 {
-	object_t *obj;
-	ULONG n;
+	if (free_head == no_entry && !grow())
+		return 0;
 
-	n = (ULONG) handle;
-	if (!n)
-		return STATUS_INVALID_HANDLE;
-	if (n&3)
-		return STATUS_INVALID_HANDLE;
+	ULONG n = free_head;
+	object_info_t& x = entry_at( n );
+	free_head = x.next_free;
+	if (free_head == no_entry)
+		free_tail = no_entry;
 
-	n = handle_to_index( handle );
-	if (n >= max_handles)
-		return STATUS_INVALID_HANDLE;
+	x.object = obj;
+	x.access = access;
+	addref( obj );
+	obj->get_type()->add_handle();
+	count++;
+	return index_to_handle( n );
+}
 
-	obj = info[n].object;
-	if (!obj)
+NTSTATUS handle_table_t::free_handle( HANDLE handle )
+{
+	object_info_t *x = lookup( handle );
+	if (!x)
 		return STATUS_INVALID_HANDLE;
 
+	object_t *obj = x->object;
+	append_free( handle_to_index( handle ) );
+	count--;
+	obj->get_type()->remove_handle();
 	release( obj );
-	info[n].object = NULL;
-	info[n].access = 0;
 
 	return STATUS_SUCCESS;
 }
@@ -142,19 +236,12 @@ NTSTATUS handle_table_t::object_from_handle( object_t*& obj, HANDLE handle, ACCE
 		obj = current->process;
 		return STATUS_SUCCESS;
 	}
-	ULONG n = (ULONG) handle;
-	if (!n)
-		return STATUS_INVALID_HANDLE;
-	if (n&3)
-		return STATUS_INVALID_HANDLE;
-	n = handle_to_index( handle );
-	if (n >= max_handles)
+	object_info_t *x = lookup( handle );
+	if (!x)
 		return STATUS_INVALID_HANDLE;
-	if (!info[n].object)
-		return STATUS_INVALID_HANDLE;
-	if (!info[n].object->access_allowed( access, info[n].access ))
+	if (!x->object->access_allowed( access, x->access ))
 		return STATUS_ACCESS_DENIED;
-	obj = info[n].object;
+	obj = x->object;
 	return STATUS_SUCCESS;
 }
 
@@ -166,17 +253,33 @@ handle_table_t::~handle_table_t()
 void handle_table_t::free_all_handles()
 {
 	object_t *obj;
-	ULONG i;
+	ULONG i, j;
 
-	for ( i=0; i<max_handles; i++ )
+	for (i=0; i<num_pages; i++)
 	{
-		obj = info[i].object;
-		if (!obj)
-			continue;
-
-		release( obj );
-		info[i].object = NULL;
+		for (j=0; j<entries_per_page; j++)
+		{
+			obj = page[i][j].object;
+			if (!obj)
+				continue;
+
+			append_free( i*entries_per_page + j );
+			count--;
+			obj->get_type()->remove_handle();
+			release( obj );
+		}
 	}
+
+	// releasing an object may close other handles, so free pages last
+	for (i=0; i<num_pages; i++)
+		delete[] page[i];
+	delete[] page;
+
+	page = 0;
+	num_pages = 0;
+	free_head = no_entry;
+	free_tail = no_entry;
+	count = 0;
 }
 
 NTSTATUS object_factory::on_open( object_dir_t* dir, object_t*& obj, open_info_t& info )
@@ -263,15 +366,35 @@ object_factory::~object_factory()
 
 object_t::object_t() :
 	refcount( 1 ),
+	hash_next( 0 ),
+	name_hash( 0 ),
+	type( &generic_object_type ),
 	attr( 0 ),
 	parent( 0 )
 {
+	type->add_object();
 }
 
 object_t::~object_t()
 {
 	if (parent)
 		parent->unlink( this );
+	type->remove_object();
+}
+
+// identifies the most derived class, for object_cast
+const void *object_t::get_class()
+{
+	return &typeid(*this);
+}
+
+// called from the constructor of each class that has its own type,
+// so the most derived class's type is the one that sticks
+void object_t::set_type( object_type_t *t )
+{
+	type->remove_object();
+	type = t;
+	type->add_object();
 }
 
 bool object_t::check_access( ACCESS_MASK required, ACCESS_MASK handle, ACCESS_MASK read, ACCESS_MASK write, ACCESS_MASK all )
@@ -351,6 +474,7 @@ NTSTATUS NTAPI NtQueryObject(
 
 	union {
 		OBJECT_HANDLE_ATTRIBUTE_INFORMATION handle_info;
+		OBJECT_TYPE_INFORMATION type_info;
 	} info;
 	ULONG sz = 0;
 
@@ -358,37 +482,78 @@ NTSTATUS NTAPI NtQueryObject(
 	{
 	case ObjectHandleInformation:
 		sz = sizeof info.handle_info;
+		if (ObjectInformationLength != sz)
+			return STATUS_INFO_LENGTH_MISMATCH;
+		break;
+	case ObjectTypeInformation:
+		sz = sizeof info.type_info;
 		break;
 	case ObjectBasicInformation:
 	case ObjectNameInformation:
-	case ObjectTypeInformation:
 	case ObjectAllTypesInformation:
 	default:
 		return STATUS_INVALID_INFO_CLASS;
 	}
 
-	if (ObjectInformationLength != sz)
-		return STATUS_INFO_LENGTH_MISMATCH;
-
 	NTSTATUS r;
 	object_t *obj = 0;
 	r = object_from_handle( obj, Object, 0 );
 	if (r < STATUS_SUCCESS)
 		return r;
 
+	memset( &info, 0, sizeof info );
+
+	unicode_string_t type_name;
 	switch (ObjectInformationClass)
 	{
 	case ObjectHandleInformation:
 		info.handle_info.Inherit = 0;
 		info.handle_info.ProtectFromClose = 0;
 		break;
+	case ObjectTypeInformation:
+		{
+		// the type's name follows the structure
+		object_type_t *type = obj->get_type();
+		type_name.copy( type->name );
+		ULONG len = sz + type_name.Length + sizeof (WCHAR);
+		if (ObjectInformationLength < len)
+		{
+			if (ReturnLength)
+				copy_to_user( ReturnLength, &len, sizeof len );
+			return STATUS_INFO_LENGTH_MISMATCH;
+		}
+		info.type_info.TypeName.Length = type_name.Length;
+		info.type_info.TypeName.MaximumLength = type_name.Length + sizeof (WCHAR);
+		info.type_info.TypeName.Buffer = (WCHAR*) ((BYTE*) ObjectInformation + sz);
+		info.type_info.TotalNumberOfObjects = type->num_objects;
+		info.type_info.TotalNumberOfHandles = type->num_handles;
+		info.type_info.HighWaterNumberOfObjects = type->peak_objects;
+		info.type_info.HighWaterNumberOfHandles = type->peak_handles;
+		info.type_info.GenericMapping = type->mapping;
+		info.type_info.ValidAccessMask = type->mapping.GenericAll;
+		info.type_info.MaintainHandleCount = TRUE;
+		r = copy_to_user( info.type_info.TypeName.Buffer, type_name.Buffer, type_name.Length );
+		if (r == STATUS_SUCCESS)
+		{
+			WCHAR nul = 0;
+			r = copy_to_user( info.type_info.TypeName.Buffer + type_name.Length/2, &nul, sizeof nul );
+		}
+		if (r < STATUS_SUCCESS)
+			return r;
+		}
+		break;
 	default:
 		assert(0);
 	}
 
 	r = copy_to_user( ObjectInformation, &info, sz );
 	if (r == STATUS_SUCCESS && ReturnLength)
-		r = copy_to_user( ReturnLength, &sz, sizeof sz );
+	{
+		ULONG len = sz;
+		if (ObjectInformationClass == ObjectTypeInformation)
+			len += info.type_info.TypeName.MaximumLength;
+		r = copy_to_user( ReturnLength, &len, sizeof len );
+	}
 
 	return r;
 }
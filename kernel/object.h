@@ -26,6 +26,7 @@
 
 class object_t;
 class object_dir_t;
+class sync_object_t;
 
 typedef list_anchor<object_t, 0> object_list_t;
 typedef list_element<object_t> object_entry_t;
@@ -34,6 +35,32 @@ typedef list_iter<object_t, 0> object_iter_t;
 class object_factory;
 class open_info_t;
 
+// describes one kind of kernel object, as reported by NtQueryObject
+class object_type_t {
+	static object_type_t *registry[];
+	static ULONG num_types;
+public:
+	static const ULONG max_types = 32;
+	const char *name;
+	GENERIC_MAPPING mapping;
+	ULONG index;
+	ULONG num_objects;
+	ULONG num_handles;
+	ULONG peak_objects;
+	ULONG peak_handles;
+public:
+	object_type_t( const char *name, ACCESS_MASK read, ACCESS_MASK write, ACCESS_MASK execute, ACCESS_MASK all );
+	void add_object();
+	void remove_object() { num_objects--; }
+	void add_handle();
+	void remove_handle() { num_handles--; }
+	static ULONG count() { return num_types; }
+	static object_type_t *get( ULONG index ) { return index < num_types ? registry[index] : 0; }
+};
+
+// objects whose class has not registered a type of its own
+extern object_type_t generic_object_type;
+
 class open_info_t {
 public:
 	ULONG Attributes;
@@ -52,13 +79,22 @@ class object_t {
 	friend class list_iter<object_t, 0>;
 	object_entry_t entry[1];
 	ULONG refcount;
+	// hash chain within the parent directory
+	object_t *hash_next;
+	ULONG name_hash;
+	object_type_t *type;
+protected:
+	void set_type( object_type_t *t );
 public:
 	ULONG attr;
 	object_dir_t *parent;
 	unicode_string_t name;
 	friend class object_dir_t;
+	friend class object_dir_impl_t;
 	void set_parent( object_dir_t *dir );
 	unicode_string_t& get_name() { return name; }
+	object_type_t *get_type() { return type; }
+	const void *get_class();
 public:
 	object_t();
 	virtual bool access_allowed( ACCESS_MASK required, ACCESS_MASK handle );
@@ -67,6 +103,8 @@ public:
 	static void addref( object_t *obj );
 	static void release( object_t *obj );
 	virtual NTSTATUS open( object_t *&out, open_info_t& info );
+	// cheaper than a dynamic_cast across the virtual base
+	virtual sync_object_t* get_sync_object() { return 0; }
 };
 
 class object_factory : public open_info_t
@@ -104,6 +142,7 @@ public:
 	virtual ~sync_object_t();
 	virtual BOOLEAN is_signalled( void ) = 0;
 	virtual BOOLEAN satisfy( void );
+	virtual sync_object_t* get_sync_object() { return this; }
 	void add_watch( watch_t* watcher );
 	void remove_watch( watch_t* watcher );
 	void notify_watchers();
@@ -112,23 +151,40 @@ public:
 class object_info_t {
 public:
 	object_t *object;
-	ACCESS_MASK access;
+	union {
+		ACCESS_MASK access;
+		ULONG next_free;	// index of the next free entry when object is NULL
+	};
 };
 
+// Handles index a two level table.  Pages of entries are allocated on demand,
+// and free entries are chained through the table itself, oldest first, so a
+// closed handle value is not handed out again straight away.
 class handle_table_t {
-	static const unsigned int max_handles = 0x100;
-
-	//int num_objects;
-	object_info_t info[max_handles];
+	static const ULONG entries_per_page = 0x100;
+	static const ULONG max_pages = 0x1000;
+	static const ULONG no_entry = ~0UL;
+
+	object_info_t **page;
+	ULONG num_pages;
+	ULONG free_head;
+	ULONG free_tail;
+	ULONG count;
 protected:
 	static HANDLE index_to_handle( ULONG index );
 	static ULONG handle_to_index( HANDLE handle );
+	object_info_t *lookup( HANDLE handle );
+	object_info_t& entry_at( ULONG index );
+	void append_free( ULONG index );
+	bool grow();
 public:
+	handle_table_t();
 	~handle_table_t();
 	void free_all_handles();
 	HANDLE alloc_handle( object_t *obj, ACCESS_MASK access );
 	NTSTATUS free_handle( HANDLE handle );
 	NTSTATUS object_from_handle( object_t*& obj, HANDLE handle, ACCESS_MASK access );
+	ULONG handle_count() { return count; }
 };
 
 static inline void addref( object_t *obj )
@@ -3,6 +3,44 @@
 
 #include "ntcall.h"
 
+// dynamic_cast across the virtual object_t base is slow, but the offset
+// from the object_t to its T part is the same for every object of a given
+// class.  Remember it per class, in a few slots under the object's type,
+// as several classes can share a type (files and directories, say).
+template<typename T> T* object_cast( object_t *obj )
+{
+	static const ULONG ways = 4;
+	static struct {
+		const void *cls;
+		bool match;
+		long offset;
+	} cache[object_type_t::max_types][ways];
+	static ULONG next_way[object_type_t::max_types];
+
+	if (!obj)
+		return 0;
+
+	const void *cls = obj->get_class();
+	ULONG n = obj->get_type()->index;
+
+	for (ULONG i = 0; i < ways; i++)
+	{
+		if (cache[n][i].cls != cls)
+			continue;
+		if (!cache[n][i].match)
+			return 0;
+		return reinterpret_cast<T*>( reinterpret_cast<char*>( obj ) + cache[n][i].offset );
+	}
+
+	T* out = dynamic_cast<T*>( obj );
+	ULONG i = next_way[n]++ % ways;
+	cache[n][i].cls = cls;
+	cache[n][i].match = (out != 0);
+	if (out)
+		cache[n][i].offset = reinterpret_cast<char*>( out ) - reinterpret_cast<char*>( obj );
+	return out;
+}
+
 template<class T> NTSTATUS nt_open_object(
 	PHANDLE Handle,
 	ACCESS_MASK DesiredAccess,
@@ -32,7 +70,7 @@ template<class T> NTSTATUS nt_open_object(
 	if (r != STATUS_SUCCESS)
 		return r;
 
-	if (dynamic_cast<T*>( object ))
+	if (object_cast<T>( object ))
 	{
 		r = alloc_user_handle( object, DesiredAccess, Handle );
 	}
@@ -53,7 +91,7 @@ template<typename T> NTSTATUS object_from_handle(T*& out, HANDLE handle, ACCESS_
 	if (r != STATUS_SUCCESS)
 		return r;
 
-	out = dynamic_cast<T*>(obj);
+	out = object_cast<T>(obj);
 	if (!out)
 		return STATUS_OBJECT_TYPE_MISMATCH;
 
@@ -33,6 +33,7 @@
 #include "ntcall.h"
 #include "section.h"
 #include "object.inl"
+#include "slab.h"
 
 class message_t;
 
@@ -124,12 +125,12 @@ static int unique_message_id = 0x101;
 
 void *message_t::operator new(size_t msg_size, size_t extra)
 {
-	return new unsigned char[msg_size + extra];
+	return slab_alloc( msg_size + extra );
 }
 
 void message_t::operator delete(void* ptr)
 {
-	delete[] (unsigned char*) ptr;
+	slab_free( ptr );
 }
 
 message_t::message_t() :
@@ -419,6 +420,12 @@ port_t::~port_t()
 	release( thread );
 }
 
+static object_type_t port_type( "Port",
+	STANDARD_RIGHTS_READ | PORT_CONNECT,
+	STANDARD_RIGHTS_WRITE | PORT_CONNECT,
+	STANDARD_RIGHTS_EXECUTE | SYNCHRONIZE,
+	PORT_ALL_ACCESS );
+
 port_t::port_t( BOOLEAN s, thread_t *t, port_queue_t *q ) :
 	queue(q),
 	server(s),
@@ -431,6 +438,7 @@ port_t::port_t( BOOLEAN s, thread_t *t, port_queue_t *q ) :
 	identifier(0),
 	received_msg(0)
 {
+	set_type( &port_type );
 	if (q)
 		addref(q);
 	addref(thread);
@@ -361,6 +361,12 @@ NTSTATUS process_t::create_exe_ppb( RTL_USER_PROCESS_PARAMETERS **pparams, UNICO
 	return r;
 }
 
+static object_type_t process_type( "Process",
+	STANDARD_RIGHTS_READ | PROCESS_VM_READ | PROCESS_QUERY_INFORMATION,
+	STANDARD_RIGHTS_WRITE | PROCESS_CREATE_THREAD | PROCESS_CREATE_PROCESS | PROCESS_VM_OPERATION | PROCESS_VM_WRITE | PROCESS_DUP_HANDLE | PROCESS_TERMINATE | PROCESS_SET_QUOTA | PROCESS_SET_INFORMATION,
+	STANDARD_RIGHTS_EXECUTE | SYNCHRONIZE,
+	PROCESS_ALL_ACCESS );
+
 process_t::process_t() :
 	exception_port(0),
 	priority(0),
@@ -368,9 +374,9 @@ process_t::process_t() :
 	win32k_info(0),
 	window_station(0)
 {
+	set_type( &process_type );
 	ExitStatus = STATUS_PENDING;
 	id = allocate_id();
-	memset( &handle_table, 0, sizeof handle_table );
 	processes.append( this );
 }
 
@@ -785,6 +791,7 @@ NTSTATUS NTAPI NtQueryInformationProcess(
 		PROCESS_SESSION_INFORMATION session;
 		ULONG hard_error_mode;
 		ULONG execute_flags;
+		ULONG handle_count;
 	} info;
 	ULONG len, sz = 0;
 	NTSTATUS r;
@@ -815,6 +822,10 @@ NTSTATUS NTAPI NtQueryInformationProcess(
 		sz = sizeof info.execute_flags;
 		break;
 
+	case ProcessHandleCount:
+		sz = sizeof info.handle_count;
+		break;
+
 	case ProcessExceptionPort:
 		return STATUS_INVALID_INFO_CLASS;
 
@@ -857,6 +868,10 @@ NTSTATUS NTAPI NtQueryInformationProcess(
 		info.execute_flags = p->execute_flags;
 		break;
 
+	case ProcessHandleCount:
+		info.handle_count = p->handle_table.handle_count();
+		break;
+
 	default:
 		assert(0);
 	}
@@ -44,6 +44,20 @@
 #include "win.h"
 #include "queue.h"
 #include "spy.h"
+#include "slab.h"
+
+static slab_cache_t msg_cache( "msg_tt", sizeof (msg_tt) );
+
+void *msg_tt::operator new(size_t sz)
+{
+	assert( sz == sizeof (msg_tt) );
+	return msg_cache.alloc();
+}
+
+void msg_tt::operator delete(void *ptr)
+{
+	msg_cache.free( ptr );
+}
 
 msg_tt::msg_tt( HWND _hwnd, UINT _message, WPARAM _wparam, LPARAM _lparam ) :
 	hwnd( _hwnd ),
@@ -193,13 +207,13 @@ win_timer_tt* thread_message_queue_tt::find_timer( HWND Window, UINT Identifier
 
 void win_timer_tt::reset()
 {
-	expiry = timeout_t::current_time();
+	expiry = timeout_t::monotonic_time();
 	expiry.QuadPart += period*10000LL;
 }
 
 bool win_timer_tt::expired() const
 {
-	LARGE_INTEGER now = timeout_t::current_time();
+	LARGE_INTEGER now = timeout_t::monotonic_time();
 	return (now.QuadPart >= expiry.QuadPart);
 }
 
@@ -222,7 +236,7 @@ void thread_message_queue_tt::timer_add( win_timer_tt* timer )
 
 bool thread_message_queue_tt::get_timer_message( HWND Window, MSG& msg )
 {
-	LARGE_INTEGER now = timeout_t::current_time();
+	LARGE_INTEGER now = timeout_t::monotonic_time();
 	win_timer_tt *t = NULL;
 	for (win_timer_iter_t i(timer_list); i; i.next())
 	{
@@ -55,6 +55,8 @@ public:
 	LPARAM lparam;
 	DWORD time;
 public:
+	void *operator new(size_t sz);
+	void operator delete(void *ptr);
 	msg_tt( HWND _hwnd, UINT Message, WPARAM Wparam, LPARAM Lparam );
 };
 
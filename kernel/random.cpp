@@ -33,21 +33,22 @@ class random_dev_t : public io_object_t
 {
 public:
 	random_dev_t();
-	virtual NTSTATUS read( PVOID Buffer, ULONG Length, ULONG *read );
-	virtual NTSTATUS write( PVOID Buffer, ULONG Length, ULONG *written );
+	virtual NTSTATUS read( PVOID Buffer, ULONG Length, ULONG *read, PLARGE_INTEGER offset );
+	virtual NTSTATUS write( PVOID Buffer, ULONG Length, ULONG *written, PLARGE_INTEGER offset );
 };
 
 random_dev_t::random_dev_t()
 {
+	set_type( &device_type );
 }
 
-NTSTATUS random_dev_t::read( PVOID Buffer, ULONG Length, ULONG *read )
+NTSTATUS random_dev_t::read( PVOID Buffer, ULONG Length, ULONG *read, PLARGE_INTEGER offset )
 {
 	trace("random_dev_t\n");
 	return STATUS_NOT_IMPLEMENTED;
 }
 
-NTSTATUS random_dev_t::write( PVOID Buffer, ULONG Length, ULONG *written )
+NTSTATUS random_dev_t::write( PVOID Buffer, ULONG Length, ULONG *written, PLARGE_INTEGER offset )
 {
 	trace("random_dev_t\n");
 	return STATUS_NOT_IMPLEMENTED;
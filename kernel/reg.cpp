@@ -21,7 +21,12 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <libxml/parser.h>
 #include <libxml/tree.h>
@@ -37,21 +42,36 @@
 #include "mem.h"
 #include "ntcall.h"
 #include "unicode.h"
-
-#include "list.h"
-
-struct regval_t;
-struct regkey_t;
-
-typedef list_anchor<regval_t,0> regval_anchor, regval_anchor_t;
-typedef list_anchor<regkey_t,0> regkey_anchor, regkey_anchor_t;
-typedef list_iter<regval_t,0> regval_iter, regval_iter_t;
-typedef list_iter<regkey_t,0> regkey_iter, regkey_iter_t;
-typedef list_element<regval_t> regval_element, regval_element_t;
-typedef list_element<regkey_t> regkey_element, regkey_element_t;
+#include "file.h"
+#include "hive.h"
+
+// The subkeys or values of a key in the order they were added, so they
+// can be enumerated by index.  Once there are more than a few, their case
+// folded names are hashed too, so long paths resolve without walking every
+// sibling along the way.
+template<class T> class reg_index_t {
+	T **items;
+	ULONG count;
+	ULONG allocated;
+	T **hash;
+	ULONG hash_size;	// 0 while the names are searched linearly
+	static const ULONG min_hashed = 8;
+protected:
+	void rehash( ULONG size );
+public:
+	reg_index_t();
+	~reg_index_t();
+	ULONG num() const { return count; }
+	T *get( ULONG n ) const { return n < count ? items[n] : 0; }
+	void append( T *item );
+	void remove( T *item );
+	void clear();
+	T *find( const UNICODE_STRING& name, bool case_insensitive ) const;
+};
 
 struct regval_t {
-	regval_element entry[1];
+	regval_t *hash_next;
+	ULONG hash;
 	unicode_string_t name;
 	ULONG type;
 	ULONG size;
@@ -65,12 +85,21 @@ struct regkey_t : public object_t {
 	regkey_t *parent;
 	unicode_string_t name;
 	unicode_string_t cls;
-	regkey_element entry[1];
-	regkey_anchor children;
-	regval_anchor values;
+	regkey_t *hash_next;
+	ULONG hash;
+	reg_index_t<regkey_t> children;
+	reg_index_t<regval_t> values;
+	ULONG image;	// contents still in the registry image, or 0
+	hive_t *hive;	// contents still in a loaded hive, or 0
+	ULONG hive_cell;
+	bool hive_root;	// where NtLoadKey mounted a hive
 public:
 	regkey_t( regkey_t *_parent, UNICODE_STRING *_name );
 	~regkey_t();
+	void expand();
+	void expand_hive();
+	void mount( hive_t *hive, ULONG cell );
+	void clear();
 	void query( KEY_FULL_INFORMATION& info, UNICODE_STRING& keycls );
 	void query( KEY_BASIC_INFORMATION& info, UNICODE_STRING& namestr );
 	ULONG num_values(ULONG& max_name_len, ULONG& max_data_len);
@@ -84,6 +113,11 @@ public:
 regkey_t *root_key;
 
 // FIXME: should use windows case table
+static inline WCHAR fold_wchar( WCHAR ch )
+{
+	return ch < 0x80 ? tolower( ch ) : ch;
+}
+
 INT strncmpW( WCHAR *a, WCHAR *b, ULONG n )
 {
 	ULONG i;
@@ -91,8 +125,8 @@ INT strncmpW( WCHAR *a, WCHAR *b, ULONG n )
 
 	for ( i = 0; i < n; i++ )
 	{
-		ai = tolower( a[i] );
-		bi = tolower( b[i] );
+		ai = fold_wchar( a[i] );
+		bi = fold_wchar( b[i] );
 		if (ai == bi)
 			continue;
 		return ai < bi ? -1 : 1;
@@ -100,6 +134,130 @@ INT strncmpW( WCHAR *a, WCHAR *b, ULONG n )
 	return 0;
 }
 
+// names that differ only in case hash the same
+static ULONG hash_name( const UNICODE_STRING& name )
+{
+	ULONG hash = 0;
+	for (ULONG i = 0; i < name.Length/sizeof (WCHAR); i++)
+		hash = hash * 31 + fold_wchar( name.Buffer[i] );
+	return hash;
+}
+
+template<class T> reg_index_t<T>::reg_index_t() :
+	items( 0 ),
+	count( 0 ),
+	allocated( 0 ),
+	hash( 0 ),
+	hash_size( 0 )
+{
+}
+
+template<class T> reg_index_t<T>::~reg_index_t()
+{
+	delete[] items;
+	delete[] hash;
+}
+
+template<class T> void reg_index_t<T>::rehash( ULONG size )
+{
+	delete[] hash;
+	hash = new T*[size];
+	hash_size = size;
+	memset( hash, 0, size * sizeof (T*) );
+	for (ULONG i = 0; i < count; i++)
+	{
+		T *item = items[i];
+		T *&head = hash[item->hash % hash_size];
+		item->hash_next = head;
+		head = item;
+	}
+}
+
+template<class T> void reg_index_t<T>::append( T *item )
+{
+	if (count == allocated)
+	{
+		ULONG n = allocated ? allocated * 2 : 4;
+		T **p = new T*[n];
+		if (count)
+			memcpy( p, items, count * sizeof (T*) );
+		delete[] items;
+		items = p;
+		allocated = n;
+	}
+	items[count++] = item;
+
+	item->hash = hash_name( item->name );
+	item->hash_next = 0;
+	if (count > hash_size * 2 && count > min_hashed)
+		rehash( count * 2 );
+	else if (hash_size)
+	{
+		T *&head = hash[item->hash % hash_size];
+		item->hash_next = head;
+		head = item;
+	}
+}
+
+template<class T> void reg_index_t<T>::remove( T *item )
+{
+	ULONG i = 0;
+	while (i < count && items[i] != item)
+		i++;
+	assert( i < count );
+	count--;
+	memmove( &items[i], &items[i + 1], (count - i) * sizeof (T*) );
+
+	if (hash_size)
+	{
+		T **p = &hash[item->hash % hash_size];
+		while (*p != item)
+			p = &(*p)->hash_next;
+		*p = item->hash_next;
+	}
+	item->hash_next = 0;
+}
+
+// forgets every item at once; the caller frees them
+template<class T> void reg_index_t<T>::clear()
+{
+	delete[] items;
+	delete[] hash;
+	items = 0;
+	count = 0;
+	allocated = 0;
+	hash = 0;
+	hash_size = 0;
+}
+
+template<class T> T *reg_index_t<T>::find( const UNICODE_STRING& name, bool case_insensitive ) const
+{
+	ULONG len = name.Length/sizeof (WCHAR);
+	T *item;
+
+	if (hash_size)
+		item = hash[hash_name( name ) % hash_size];
+	else
+		item = count ? items[0] : 0;
+
+	for (ULONG i = 0; item; )
+	{
+		if (item->name.Length == name.Length)
+		{
+			if (case_insensitive ?
+				!strncmpW( item->name.Buffer, name.Buffer, len ) :
+				!memcmp( item->name.Buffer, name.Buffer, name.Length ))
+				return item;
+		}
+
+		if (hash_size)
+			item = item->hash_next;
+		else
+			item = ++i < count ? items[i] : 0;
+	}
+	return 0;
+}
+
 BOOLEAN unicode_string_equal( PUNICODE_STRING a, PUNICODE_STRING b, BOOLEAN case_insensitive )
 {
 	if (a->Length != b->Length)
@@ -109,34 +267,56 @@ BOOLEAN unicode_string_equal( PUNICODE_STRING a, PUNICODE_STRING b, BOOLEAN case
 	return (0 == memcmp( a->Buffer, b->Buffer, a->Length ));
 }
 
+static object_type_t key_type( "Key",
+	KEY_READ,
+	KEY_WRITE,
+	KEY_EXECUTE,
+	KEY_ALL_ACCESS );
+
 regkey_t::regkey_t( regkey_t *_parent, UNICODE_STRING *_name ) :
-	parent( _parent)
+	parent( _parent),
+	hash_next( 0 ),
+	hash( 0 ),
+	image( 0 ),
+	hive( 0 ),
+	hive_cell( 0 ),
+	hive_root( false )
 {
+	set_type( &key_type );
 	name.copy( _name );
 	if (parent)
+	{
+		parent->expand();
 		parent->children.append( this );
+	}
 }
 
 regkey_t::~regkey_t()
 {
-	regkey_iter i(children);
-	while (i)
+	clear();
+}
+
+// forgets all subkeys and values, including those not expanded yet
+void regkey_t::clear()
+{
+	if (hive)
+		hive->release();
+	hive = 0;
+	image = 0;
+
+	// removing them one at a time from the front is quadratic
+	for (ULONG i = 0; i < children.num(); i++)
 	{
-		regkey_t *tmp = i;
-		i.next();
+		regkey_t *tmp = children.get( i );
 		tmp->parent = NULL;
-		children.unlink( tmp );
+		tmp->hash_next = 0;
 		release( tmp );
 	}
+	children.clear();
 
-	regval_iter j(values);
-	while (j)
-	{
-		regval_t *tmp = j;
-		j.next();
-		values.unlink( tmp );
-		delete tmp;
-	}
+	for (ULONG i = 0; i < values.num(); i++)
+		delete values.get( i );
+	values.clear();
 }
 
 bool regkey_t::access_allowed( ACCESS_MASK required, ACCESS_MASK handle )
@@ -149,33 +329,30 @@ bool regkey_t::access_allowed( ACCESS_MASK required, ACCESS_MASK handle )
 
 ULONG regkey_t::num_values(ULONG& max_name_len, ULONG& max_data_len)
 {
-	ULONG n = 0;
-	regval_iter i(values);
+	ULONG n;
+	expand();
 	max_name_len = 0;
 	max_data_len = 0;
-	while (i)
+	for (n = 0; n < values.num(); n++)
 	{
-		regval_t *val = i;
+		regval_t *val = values.get( n );
 		max_name_len = max(max_name_len, val->name.Length );
 		max_data_len = max(max_data_len, val->size );
-		i.next();
-		n++;
 	}
 	return n;
 }
 
 ULONG regkey_t::num_subkeys(ULONG& max_name_len, ULONG& max_class_len)
 {
-	ULONG n = 0;
-	regkey_iter i(children);
+	ULONG n;
+	expand();
 	max_name_len = 0;
-	while (i)
+	max_class_len = 0;
+	for (n = 0; n < children.num(); n++)
 	{
-		regkey_t *subkey = i;
+		regkey_t *subkey = children.get( n );
 		max_name_len = max(max_name_len, subkey->name.Length );
 		max_class_len = max(max_class_len, subkey->cls.Length );
-		i.next();
-		n++;
 	}
 	return n;
 }
@@ -207,7 +384,7 @@ void regkey_t::delkey()
 {
 	if ( parent )
 	{
-		parent->children.unlink( this );
+		parent->children.remove( this );
 		parent = NULL;
 		release( this );
 	}
@@ -215,17 +392,13 @@ void regkey_t::delkey()
 
 regkey_t *regkey_t::get_child( ULONG Index )
 {
-	regkey_iter_t i(children);
-	regkey_t *child;
-	while ((child = i) && Index)
-	{
-		i.next();
-		Index--;
-	}
-	return child;
+	expand();
+	return children.get( Index );
 }
 
 regval_t::regval_t( UNICODE_STRING *_name, ULONG _type, ULONG _size ) :
+	hash_next(0),
+	hash(0),
 	type(_type),
 	size(_size)
 {
@@ -273,30 +446,21 @@ ULONG do_open_subkey( regkey_t *&key, UNICODE_STRING *name, bool case_insensitiv
 	if (!len)
 		return len;
 
-	for (regkey_iter i(key->children); i; i.next())
-	{
-		regkey_t *subkey = i;
-		if (len != subkey->name.Length)
-			continue;
-		if (case_insensitive)
-		{
-			if (strncmpW( name->Buffer, subkey->name.Buffer, len/sizeof(WCHAR) ))
-				continue;
-		}
-		else
-		{
-			if (memcmp( name->Buffer, subkey->name.Buffer, len/sizeof(WCHAR) ))
-				continue;
-		}
+	UNICODE_STRING seg;
+	seg.Buffer = name->Buffer;
+	seg.Length = len;
+	seg.MaximumLength = len;
 
-		// advance
-		key = subkey;
-		name->Buffer += len/2;
-		name->Length -= len;
-		return len;
-	}
+	key->expand();
+	regkey_t *subkey = key->children.find( seg, case_insensitive );
+	if (!subkey)
+		return 0;
 
-	return 0;
+	// advance
+	key = subkey;
+	name->Buffer += len/2;
+	name->Length -= len;
+	return len;
 }
 
 NTSTATUS open_parse_key( regkey_t *&key, UNICODE_STRING *name, bool case_insensitive  )
@@ -396,15 +560,8 @@ NTSTATUS create_key( regkey_t **out, OBJECT_ATTRIBUTES *oa, bool& opened_existin
 
 regval_t *key_find_value( regkey_t *key, UNICODE_STRING *us )
 {
-
-	for (regval_iter i(key->values); i; i.next())
-	{
-		regval_t *val = i;
-		if (unicode_string_equal( &val->name, us, TRUE ))
-			return val;
-	}
-
-	return NULL;
+	key->expand();
+	return key->values.find( *us, true );
 }
 
 NTSTATUS delete_value( regkey_t *key, UNICODE_STRING *us )
@@ -418,7 +575,7 @@ NTSTATUS delete_value( regkey_t *key, UNICODE_STRING *us )
 		return STATUS_OBJECT_NAME_NOT_FOUND;
 
 	trace("deleting %pus\n", &val->name);
-	key->values.unlink( val );
+	key->values.remove( val );
 	delete val;
 	return STATUS_SUCCESS;
 }
@@ -737,14 +894,12 @@ NTSTATUS NTAPI NtEnumerateValueKey(
 	if (r < STATUS_SUCCESS)
 		return r;
 
-	regval_iter i(key->values);
-	for ( ; i && Index; i.next())
-		Index--;
-
-	if (!i)
+	key->expand();
+	regval_t *val = key->values.get( Index );
+	if (!val)
 		return STATUS_NO_MORE_ENTRIES;
 
-	r = reg_query_value( i, KeyValueInformationClass, KeyValueInformation,
+	r = reg_query_value( val, KeyValueInformationClass, KeyValueInformation,
 						 KeyValueInformationLength, len );
 
 	copy_to_user( ResultLength, &len, sizeof len );
@@ -816,28 +971,121 @@ NTSTATUS NTAPI NtSaveMergedKeys(
 	return STATUS_NOT_IMPLEMENTED;
 }
 
+// Replaces the contents of a key with those of a hive file.  Flags such as
+// REG_WHOLE_HIVE_VOLATILE make no difference, as nothing is written back.
 NTSTATUS NTAPI NtRestoreKey(
 	HANDLE KeyHandle,
 	HANDLE FileHandle,
 	ULONG Flags)
 {
 	trace("%p %p %08lx\n", KeyHandle, FileHandle, Flags);
-	return STATUS_NOT_IMPLEMENTED;
+
+	regkey_t *key = 0;
+	NTSTATUS r = object_from_handle( key, KeyHandle, KEY_SET_VALUE | KEY_CREATE_SUB_KEY );
+	if (r < STATUS_SUCCESS)
+		return r;
+
+	file_t *file = 0;
+	r = object_from_handle( file, FileHandle, 0 );
+	if (r < STATUS_SUCCESS)
+		return r;
+
+	hive_t *hive = 0;
+	r = hive_t::open( file->get_fd(), hive );
+	if (r < STATUS_SUCCESS)
+		return r;
+
+	key->clear();
+	key->mount( hive, hive->get_root() );
+	hive->release();
+
+	return STATUS_SUCCESS;
 }
 
+// Mounts a hive file as a new key.  Nothing is decoded from the hive
+// until its keys are opened.
 NTSTATUS NTAPI NtLoadKey(
 	POBJECT_ATTRIBUTES KeyObjectAttributes,
 	POBJECT_ATTRIBUTES FileObjectAttributes)
 {
+	object_attributes_t key_oa, file_oa;
+	NTSTATUS r;
+
 	trace("%p %p\n", KeyObjectAttributes, FileObjectAttributes);
-	return STATUS_NOT_IMPLEMENTED;
+
+	r = key_oa.copy_from_user( KeyObjectAttributes );
+	if (r < STATUS_SUCCESS)
+		return r;
+
+	r = file_oa.copy_from_user( FileObjectAttributes );
+	if (r < STATUS_SUCCESS)
+		return r;
+
+	if (!key_oa.ObjectName || !file_oa.ObjectName)
+		return STATUS_INVALID_PARAMETER;
+
+	trace("%pus <- %pus\n", key_oa.ObjectName, file_oa.ObjectName);
+
+	// FIXME: use file_oa.RootDirectory
+	file_t *file = 0;
+	r = open_file( file, *file_oa.ObjectName );
+	if (r < STATUS_SUCCESS)
+		return r;
+
+	hive_t *hive = 0;
+	r = hive_t::open( file->get_fd(), hive );
+	release( file );
+	if (r < STATUS_SUCCESS)
+		return r;
+
+	hive_key_t root;
+	if (!hive->get_key( hive->get_root(), root ))
+	{
+		hive->release();
+		return STATUS_REGISTRY_CORRUPT;
+	}
+
+	regkey_t *key = 0;
+	bool opened_existing = false;
+	r = create_key( &key, &key_oa, opened_existing );
+	if (r == STATUS_SUCCESS && opened_existing)
+		r = STATUS_OBJECT_NAME_COLLISION;
+	if (r == STATUS_SUCCESS)
+	{
+		key->cls.copy( &root.cls );
+		key->mount( hive, hive->get_root() );
+		key->hive_root = true;
+	}
+	hive->release();
+
+	return r;
 }
 
 NTSTATUS NTAPI NtUnloadKey(
 	POBJECT_ATTRIBUTES KeyObjectAttributes)
 {
+	object_attributes_t oa;
+	regkey_t *key = 0;
+	NTSTATUS r;
+
 	trace("%p\n", KeyObjectAttributes);
-	return STATUS_NOT_IMPLEMENTED;
+
+	r = oa.copy_from_user( KeyObjectAttributes );
+	if (r < STATUS_SUCCESS)
+		return r;
+
+	if (!oa.ObjectName)
+		return STATUS_INVALID_PARAMETER;
+
+	r = open_key( &key, &oa );
+	if (r < STATUS_SUCCESS)
+		return r;
+
+	if (!key->hive_root)
+		return STATUS_INVALID_PARAMETER;
+
+	key->delkey();
+	return STATUS_SUCCESS;
 }
 
 NTSTATUS NTAPI NtQueryOpenSubKeys(
@@ -1212,16 +1460,437 @@ void load_reg_key( regkey_t *parent, xmlNode *node )
 	}
 }
 
+// reg.xml is slow to parse, so the first boot after it changes saves the
+// tree it describes as a binary image, and later boots map the image
+// instead.  Everything in the image is found by its offset from the start,
+// and a key's values and subkeys are only copied out when it is first used.
+
+static const char reg_image_magic[8] = { 'r','3','k','r','e','g',0,0 };
+static const ULONG reg_image_version = 1;
+
+struct reg_image_header_t {
+	char magic[8];
+	ULONG version;
+	ULONG size;		// of the whole image
+	ULONG root;		// offset of the root key
+	ULONG reserved;
+	LONGLONG source_mtime;	// of the reg.xml it was made from
+	LONGLONG source_size;
+};
+
+struct reg_image_string_t {
+	ULONG Length;		// in bytes
+	WCHAR Buffer[1];
+};
+
+struct reg_image_value_t {
+	ULONG name;
+	ULONG type;
+	ULONG size;
+	ULONG data;
+};
+
+struct reg_image_key_t {
+	ULONG name;
+	ULONG cls;		// 0 if the key has no class
+	ULONG num_subkeys;
+	ULONG subkeys;		// array of reg_image_key_t offsets
+	ULONG num_values;
+	ULONG values;		// array of reg_image_value_t
+};
+
+static BYTE *reg_image;
+static ULONG reg_image_size;
+
+// returns null if the range is not inside the image
+static const void *image_ptr( ULONG ofs, ULONG len )
+{
+	if (ofs < sizeof (reg_image_header_t) || ofs > reg_image_size ||
+		len > reg_image_size - ofs || (ofs & 3))
+		return 0;
+	return reg_image + ofs;
+}
+
+static bool image_string( ULONG ofs, UNICODE_STRING& us )
+{
+	us.Length = 0;
+	us.MaximumLength = 0;
+	us.Buffer = 0;
+	if (!ofs)
+		return true;
+
+	const reg_image_string_t *str = (const reg_image_string_t*) image_ptr( ofs, sizeof (ULONG) );
+	if (!str || str->Length > 0xfffe || !image_ptr( ofs, sizeof (ULONG) + str->Length ))
+		return false;
+	us.Length = str->Length;
+	us.MaximumLength = str->Length;
+	us.Buffer = (WCHAR*) str->Buffer;
+	return true;
+}
+
+// deeper than the NT limit means the image loops
+static const ULONG max_image_depth = 512;
+
+// Keys are copied out of the image long after it is loaded, so every
+// offset in it is checked up front, while the XML can still be used
+// instead.  Each key is only visited once in a good image, so the number
+// of keys that fit limits the walk.
+static bool check_image_key( ULONG ofs, ULONG depth, ULONG& keys_left )
+{
+	UNICODE_STRING us;
+
+	const reg_image_key_t *k = (const reg_image_key_t*) image_ptr( ofs, sizeof *k );
+	if (!k || !keys_left || depth > max_image_depth)
+		return false;
+	keys_left--;
+
+	if (!image_string( k->name, us ) || !image_string( k->cls, us ))
+		return false;
+
+	if (k->num_values > reg_image_size / sizeof (reg_image_value_t) ||
+		k->num_subkeys > reg_image_size / sizeof (ULONG))
+		return false;
+
+	const reg_image_value_t *v = (const reg_image_value_t*) image_ptr( k->values, k->num_values * sizeof *v );
+	if (k->num_values && !v)
+		return false;
+	for (ULONG i = 0; i < k->num_values; i++)
+	{
+		if (!image_string( v[i].name, us ))
+			return false;
+		if (v[i].size && !image_ptr( v[i].data, v[i].size ))
+			return false;
+	}
+
+	const ULONG *sk = (const ULONG*) image_ptr( k->subkeys, k->num_subkeys * sizeof (ULONG) );
+	if (k->num_subkeys && !sk)
+		return false;
+	for (ULONG i = 0; i < k->num_subkeys; i++)
+		if (!check_image_key( sk[i], depth + 1, keys_left ))
+			return false;
+
+	return true;
+}
+
+// leaves the key's contents in the hive until it is expanded
+void regkey_t::mount( hive_t *_hive, ULONG cell )
+{
+	_hive->addref();
+	if (hive)
+		hive->release();
+	hive = _hive;
+	hive_cell = cell;
+}
+
+// Copies the values of a key in a hive, and creates its subkeys
+// to be expanded in turn.  Once done, the key no longer needs the hive.
+// A damaged list is only read up to its first bad entry.
+void regkey_t::expand_hive()
+{
+	hive_t *h = hive;
+	hive_key_t hk;
+	ULONG i;
+
+	hive = 0;
+	if (!h->get_key( hive_cell, hk ))
+	{
+		trace("bad key %08lx in hive\n", hive_cell);
+		h->release();
+		return;
+	}
+
+	for (i = 0; i < hk.num_values; i++)
+	{
+		hive_value_t hv;
+		if (!h->get_value( hk, i, hv ))
+		{
+			trace("bad value %lu in %pus, skipping the rest\n", i, &hk.name);
+			break;
+		}
+		regval_t *val = new regval_t( &hv.name, hv.type, hv.size );
+		memcpy( val->data, hv.data, hv.size );
+		delete[] hv.data;
+		values.append( val );
+	}
+
+	for (i = 0; i < hk.num_subkeys; i++)
+	{
+		hive_key_t child;
+		ULONG cell = h->get_subkey( hk, i );
+		if (!cell || !h->get_key( cell, child ))
+		{
+			trace("bad subkey %lu in %pus, skipping the rest\n", i, &hk.name);
+			break;
+		}
+		regkey_t *key = new regkey_t( this, &child.name );
+		key->cls.copy( &child.cls );
+		key->mount( h, cell );
+	}
+
+	h->release();
+}
+
+// Copies the values and subkeys of a key out of the image.
+// The subkeys are left unexpanded.  check_image_key checked the
+// whole image when it was mapped, so nothing is checked again here.
+void regkey_t::expand()
+{
+	if (hive)
+		expand_hive();
+	if (!image)
+		return;
+
+	const reg_image_key_t *k = (const reg_image_key_t*) image_ptr( image, sizeof *k );
+	image = 0;
+	assert( k );
+
+	const reg_image_value_t *v = (const reg_image_value_t*) image_ptr( k->values, k->num_values * sizeof *v );
+	for (ULONG i = 0; i < k->num_values; i++)
+	{
+		UNICODE_STRING valname;
+		const BYTE *data = (const BYTE*) image_ptr( v[i].data, v[i].size );
+		image_string( v[i].name, valname );
+
+		regval_t *val = new regval_t( &valname, v[i].type, v[i].size );
+		memcpy( val->data, data, v[i].size );
+		values.append( val );
+	}
+
+	const ULONG *sk = (const ULONG*) image_ptr( k->subkeys, k->num_subkeys * sizeof (ULONG) );
+	for (ULONG i = 0; i < k->num_subkeys; i++)
+	{
+		UNICODE_STRING keyname, keycls;
+		const reg_image_key_t *child = (const reg_image_key_t*) image_ptr( sk[i], sizeof *child );
+		image_string( child->name, keyname );
+		image_string( child->cls, keycls );
+
+		regkey_t *key = new regkey_t( this, &keyname );
+		key->cls.copy( &keycls );
+		key->image = sk[i];
+	}
+}
+
+static bool load_reg_image( const char *imagefile, const struct stat *source )
+{
+	struct stat st;
+	int fd;
+
+	fd = open( imagefile, O_RDONLY );
+	if (fd < 0)
+		return false;
+
+	if (0 > fstat( fd, &st ) || st.st_size < (off_t) sizeof (reg_image_header_t) ||
+		st.st_size > 0x7fffffff)
+	{
+		close( fd );
+		return false;
+	}
+
+	void *p = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+	if (p == MAP_FAILED)
+		return false;
+
+	const reg_image_header_t *hdr = (const reg_image_header_t*) p;
+	if (memcmp( hdr->magic, reg_image_magic, sizeof hdr->magic ) ||
+		hdr->version != reg_image_version ||
+		hdr->size != (ULONG) st.st_size ||
+		(source && (hdr->source_mtime != source->st_mtime ||
+			    hdr->source_size != source->st_size)))
+	{
+		trace("%s is out of date\n", imagefile);
+		munmap( p, st.st_size );
+		return false;
+	}
+
+	reg_image = (BYTE*) p;
+	reg_image_size = st.st_size;
+
+	ULONG keys_left = reg_image_size / sizeof (reg_image_key_t);
+	if (!check_image_key( hdr->root, 0, keys_left ))
+	{
+		trace("%s is corrupt\n", imagefile);
+		munmap( p, st.st_size );
+		reg_image = 0;
+		reg_image_size = 0;
+		return false;
+	}
+
+	root_key->image = hdr->root;
+	trace("mapped %s (%lu bytes)\n", imagefile, reg_image_size);
+	return true;
+}
+
+class reg_image_writer_t {
+	BYTE *buffer;
+	ULONG used;
+	ULONG allocated;
+protected:
+	ULONG reserve( ULONG len );
+	ULONG& at( ULONG ofs ) { return *(ULONG*) (buffer + ofs); }
+	ULONG add_string( const UNICODE_STRING& us );
+	ULONG add_key( regkey_t *key );
+public:
+	reg_image_writer_t();
+	~reg_image_writer_t();
+	bool save( const char *imagefile, regkey_t *root, const struct stat& source );
+};
+
+reg_image_writer_t::reg_image_writer_t() :
+	buffer( 0 ),
+	used( 0 ),
+	allocated( 0 )
+{
+}
+
+reg_image_writer_t::~reg_image_writer_t()
+{
+	delete[] buffer;
+}
+
+// returns the offset of len zeroed bytes, rounded up to keep records aligned
+ULONG reg_image_writer_t::reserve( ULONG len )
+{
+	len = (len + 3) & ~3;
+	if (used + len > allocated)
+	{
+		ULONG n = allocated ? allocated : 0x10000;
+		while (n < used + len)
+			n *= 2;
+		BYTE *p = new BYTE[n];
+		if (used)
+			memcpy( p, buffer, used );
+		delete[] buffer;
+		buffer = p;
+		allocated = n;
+	}
+	ULONG ofs = used;
+	memset( buffer + ofs, 0, len );
+	used += len;
+	return ofs;
+}
+
+ULONG reg_image_writer_t::add_string( const UNICODE_STRING& us )
+{
+	ULONG ofs = reserve( sizeof (ULONG) + us.Length );
+	reg_image_string_t *str = (reg_image_string_t*) (buffer + ofs);
+	str->Length = us.Length;
+	memcpy( str->Buffer, us.Buffer, us.Length );
+	return ofs;
+}
+
+// the buffer moves as it grows, so records are always found by offset
+ULONG reg_image_writer_t::add_key( regkey_t *key )
+{
+	ULONG ofs = reserve( sizeof (reg_image_key_t) );
+	ULONG n, name, cls = 0;
+
+	key->expand();
+
+	name = add_string( key->name );
+	if (key->cls.Length)
+		cls = add_string( key->cls );
+
+	ULONG values = reserve( key->values.num() * sizeof (reg_image_value_t) );
+	for (n = 0; n < key->values.num(); n++)
+	{
+		regval_t *val = key->values.get( n );
+		ULONG valname = add_string( val->name );
+		ULONG data = reserve( val->size );
+		memcpy( buffer + data, val->data, val->size );
+
+		reg_image_value_t *v = (reg_image_value_t*) (buffer + values) + n;
+		v->name = valname;
+		v->type = val->type;
+		v->size = val->size;
+		v->data = data;
+	}
+
+	reg_image_key_t *k = (reg_image_key_t*) (buffer + ofs);
+	k->name = name;
+	k->cls = cls;
+	k->num_values = n;
+	k->values = values;
+
+	ULONG subkeys = reserve( key->children.num() * sizeof (ULONG) );
+	for (n = 0; n < key->children.num(); n++)
+	{
+		ULONG child = add_key( key->children.get( n ) );
+		at( subkeys + n * sizeof (ULONG) ) = child;
+	}
+
+	k = (reg_image_key_t*) (buffer + ofs);
+	k->num_subkeys = n;
+	k->subkeys = subkeys;
+
+	return ofs;
+}
+
+bool reg_image_writer_t::save( const char *imagefile, regkey_t *root, const struct stat& source )
+{
+	char tmpfile[0x100];
+	int fd;
+
+	reserve( sizeof (reg_image_header_t) );
+	ULONG root_ofs = add_key( root );
+
+	reg_image_header_t *hdr = (reg_image_header_t*) buffer;
+	memcpy( hdr->magic, reg_image_magic, sizeof hdr->magic );
+	hdr->version = reg_image_version;
+	hdr->size = used;
+	hdr->root = root_ofs;
+	hdr->source_mtime = source.st_mtime;
+	hdr->source_size = source.st_size;
+
+	// write it under another name first so a partial image is never loaded
+	snprintf( tmpfile, sizeof tmpfile, "%s.tmp", imagefile );
+	fd = open( tmpfile, O_WRONLY | O_CREAT | O_TRUNC, 0666 );
+	if (fd < 0)
+		return false;
+
+	ULONG ofs = 0;
+	while (ofs < used)
+	{
+		ssize_t r = write( fd, buffer + ofs, used - ofs );
+		if (r <= 0)
+			break;
+		ofs += r;
+	}
+	close( fd );
+
+	if (ofs != used || 0 > rename( tmpfile, imagefile ))
+	{
+		unlink( tmpfile );
+		return false;
+	}
+
+	trace("saved %s (%lu bytes)\n", imagefile, used);
+	return true;
+}
+
 void init_registry( void )
 {
 	xmlDoc *doc;
 	xmlNode *root;
 	const char *regfile = "reg.xml";
+	const char *imagefile = "reg.bin";
 	UNICODE_STRING name;
+	struct stat st;
 
 	memset( &name, 0, sizeof name );
 	root_key = new regkey_t( NULL, &name );
 
+	if (0 > stat( regfile, &st ))
+	{
+		// the image alone will do
+		if (load_reg_image( imagefile, NULL ))
+			return;
+		die("failed to load registry (%s)\n", regfile );
+	}
+
+	if (load_reg_image( imagefile, &st ))
+		return;
+
 	doc = xmlReadFile( regfile, NULL, 0 );
 	if (!doc)
 		die("failed to load registry (%s)\n", regfile );
@@ -1230,10 +1899,18 @@ void init_registry( void )
 	load_reg_key( root_key, root );
 
 	xmlFreeDoc( doc );
+
+	reg_image_writer_t writer;
+	if (!writer.save( imagefile, root_key, st ))
+		trace("failed to save %s\n", imagefile);
 }
 
 void free_registry( void )
 {
 	release( root_key );
 	root_key = NULL;
+	if (reg_image)
+		munmap( reg_image, reg_image_size );
+	reg_image = 0;
+	reg_image_size = 0;
 }
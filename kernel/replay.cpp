@@ -0,0 +1,646 @@
+/*
+ * nt loader
+ *
+ * Copyright 2006-2008 Mike McCormack
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ntstatus.h"
+#define WIN32_NO_STATUS
+#include "windef.h"
+#include "winternl.h"
+
+#include "debug.h"
+#include "ntcall.h"
+#include "mem.h"
+#include "process.h"
+#include "kthread.h"
+#include "replay.h"
+
+bool recording_syscalls;
+static FILE *record_file;
+
+bool record_syscalls( const char *filename )
+{
+	record_file = fopen( filename, "wb" );
+	if (!record_file)
+		return false;
+
+	replay_file_header hdr;
+	hdr.magic = REPLAY_MAGIC;
+	hdr.version = REPLAY_VERSION;
+	fwrite( &hdr, sizeof hdr, 1, record_file );
+
+	recording_syscalls = true;
+	return true;
+}
+
+void close_syscall_record()
+{
+	if (!record_file)
+		return;
+	recording_syscalls = false;
+	fclose( record_file );
+	record_file = 0;
+}
+
+static void record( ULONG type, ULONG value, const void *data, ULONG length )
+{
+	replay_record rec;
+	rec.type = type;
+	rec.thread_id = current->trace_id();
+	rec.process_id = current->process->id;
+	rec.value = value;
+	rec.length = length;
+	fwrite( &rec, sizeof rec, 1, record_file );
+	if (data)
+		fwrite( data, length, 1, record_file );
+}
+
+void record_syscall_enter( ULONG func, ULONG *args, ULONG numargs )
+{
+	record( replay_enter, func, args, numargs * sizeof args[0] );
+}
+
+void record_syscall_exit( NTSTATUS r )
+{
+	record( replay_exit, r, 0, 0 );
+}
+
+void record_user_read( const void *addr, const void *data, size_t len, NTSTATUS r )
+{
+	if (r == STATUS_SUCCESS)
+		record( replay_read, (ULONG) addr, data, len );
+	else
+		record( replay_read_fault, (ULONG) addr, 0, len );
+}
+
+void record_user_write( void *addr, const void *data, size_t len )
+{
+	record( replay_write, (ULONG) addr, data, len );
+}
+
+// replay
+
+struct replay_copy_t {
+	ULONG type;
+	ULONG address;
+	ULONG length;
+	const BYTE *data;
+	ULONG next;
+};
+
+struct replay_call_t {
+	ULONG seq;
+	ULONG func;
+	ULONG numargs;
+	ULONG args[16];
+	NTSTATUS result;
+	bool nested;
+	bool complete;
+	ULONG first_copy;
+	ULONG last_copy;
+};
+
+static const ULONG no_copy = ~0;
+static const ULONG max_depth = 8;
+
+static replay_copy_t *copies;
+static ULONG num_copies;
+static replay_call_t *calls;
+static ULONG num_calls;
+
+// the sequence number of the next call to enter, across all threads
+static ULONG next_seq;
+static ULONG replay_progress;
+
+struct replay_stats_t {
+	ULONG replayed;
+	ULONG skipped;
+	ULONG result_mismatches;
+	ULONG data_mismatches;
+	ULONG missing_reads;
+	ULONG missing_writes;
+	ULONGLONG ns;
+};
+
+static replay_stats_t replay_stats;
+
+// calls that need guest code or a user mode thread to run
+static const char *const replay_unsupported[] = {
+	"NtAlertResumeThread",
+	"NtCallbackReturn",
+	"NtContinue",
+	"NtCreateProcess",
+	"NtCreateProcessEx",
+	"NtCreateThread",
+	"NtDelayExecution",
+	"NtGetContextThread",
+	"NtQueueApcThread",
+	"NtRaiseException",
+	"NtResumeThread",
+	"NtSetContextThread",
+	"NtSetHighWaitLowEventPair",
+	"NtSetLowWaitHighEventPair",
+	"NtSignalAndWaitForSingleObject",
+	"NtSuspendThread",
+	"NtTerminateProcess",
+	"NtTerminateThread",
+	"NtTestAlert",
+	"NtWaitForMultipleObjects",
+	"NtWaitForSingleObject",
+	"NtWaitHighEventPair",
+	"NtWaitLowEventPair",
+	"NtYieldExecution",
+	0,
+};
+
+static bool replay_supported( ULONG func )
+{
+	// win32k calls need user callbacks
+	const char *name = get_syscall_name( func );
+	if (name[0] != 'N' || name[1] != 't' || !strncmp( name, "NtUser", 6 ) || !strncmp( name, "NtGdi", 5 ))
+		return false;
+	for (ULONG i=0; replay_unsupported[i]; i++)
+		if (!strcmp( name, replay_unsupported[i] ))
+			return false;
+	return true;
+}
+
+// Handles the replayed calls got that differ from the recorded ones,
+// so later calls are given the handle the replay created.
+struct replay_handle_t {
+	process_t *process;
+	ULONG recorded;
+	ULONG replayed;
+};
+
+static replay_handle_t *handle_map;
+static ULONG num_handles;
+
+static ULONG map_handle( process_t *p, ULONG recorded )
+{
+	for (ULONG i = 0; i < num_handles; i++)
+		if (handle_map[i].process == p && handle_map[i].recorded == recorded)
+			return handle_map[i].replayed;
+	return recorded;
+}
+
+static void set_handle( process_t *p, ULONG recorded, ULONG replayed )
+{
+	ULONG i;
+	for (i = 0; i < num_handles; i++)
+		if (handle_map[i].process == p && handle_map[i].recorded == recorded)
+			break;
+
+	// the same value in both is not mapped, the handle may have been reused
+	if (recorded == replayed)
+	{
+		if (i < num_handles)
+			handle_map[i] = handle_map[--num_handles];
+		return;
+	}
+
+	if (i == num_handles)
+	{
+		if ((num_handles & (num_handles - 1)) == 0)
+			handle_map = (replay_handle_t*) realloc( handle_map, (num_handles ? num_handles * 2 : 1) * sizeof handle_map[0] );
+		num_handles++;
+	}
+	handle_map[i].process = p;
+	handle_map[i].recorded = recorded;
+	handle_map[i].replayed = replayed;
+}
+
+static bool is_handle( process_t *p, ULONG value )
+{
+	object_t *obj;
+	if (!value || (value & 3))
+		return false;
+	return p->handle_table.object_from_handle( obj, (HANDLE) value, 0 ) == STATUS_SUCCESS;
+}
+
+static ULONGLONG replay_now()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (ULONGLONG) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+class replay_thread_t : public kernel_thread_t
+{
+	ULONG *call_list;
+	ULONG call_count;
+	replay_call_t *active;
+	ULONG cursor;
+public:
+	replay_thread_t *next_thread;
+	ULONG recorded_thread;
+	ULONG recorded_process;
+	ULONG open_calls[max_depth];
+	ULONG depth;
+	bool finished;
+public:
+	replay_thread_t( process_t *p, ULONG tid, ULONG pid );
+	virtual ~replay_thread_t();
+	void add_call( ULONG n );
+	virtual int run();
+	virtual NTSTATUS copy_to_user( void *dest, const void *src, size_t count );
+	virtual NTSTATUS copy_from_user( void *dest, const void *src, size_t count );
+	virtual NTSTATUS verify_for_write( void *dest, size_t count );
+protected:
+	void wait_turn( ULONG seq );
+	replay_copy_t *find_copy( ULONG type, ULONG address, ULONG length );
+};
+
+replay_thread_t::replay_thread_t( process_t *p, ULONG tid, ULONG pid ) :
+	kernel_thread_t( p ),
+	call_list( 0 ),
+	call_count( 0 ),
+	active( 0 ),
+	cursor( no_copy ),
+	next_thread( 0 ),
+	recorded_thread( tid ),
+	recorded_process( pid ),
+	depth( 0 ),
+	finished( false )
+{
+}
+
+replay_thread_t::~replay_thread_t()
+{
+	free( call_list );
+}
+
+void replay_thread_t::add_call( ULONG n )
+{
+	if ((call_count & (call_count - 1)) == 0)
+		call_list = (ULONG*) realloc( call_list, (call_count ? call_count * 2 : 1) * sizeof call_list[0] );
+	call_list[call_count++] = n;
+}
+
+// calls are entered in the order they were recorded
+void replay_thread_t::wait_turn( ULONG seq )
+{
+	while (next_seq != seq && !terminated)
+	{
+		fiber_t::yield();
+		current = this;
+	}
+}
+
+int replay_thread_t::run()
+{
+	current = static_cast<thread_t*>( this );
+
+	for (ULONG i = 0; i < call_count && !terminated; i++)
+	{
+		replay_call_t *call = &calls[call_list[i]];
+
+		wait_turn( call->seq );
+		if (terminated)
+			break;
+		next_seq++;
+		replay_progress++;
+
+		if (call->nested || !call->complete || !replay_supported( call->func ))
+		{
+			replay_stats.skipped++;
+			continue;
+		}
+
+		active = call;
+		cursor = call->first_copy;
+
+		// pass the handles this replay created in place of the recorded ones
+		ULONG args[16];
+		for (ULONG j = 0; j < call->numargs; j++)
+			args[j] = map_handle( process, call->args[j] );
+
+		ULONGLONG start = replay_now();
+		NTSTATUS r = call_nt_syscall( call->func, args );
+		replay_stats.ns += replay_now() - start;
+
+		current = this;
+		active = 0;
+		replay_stats.replayed++;
+		replay_progress++;
+
+		if (r != call->result)
+		{
+			trace("%s returned %08lx, recorded %08lx\n",
+				get_syscall_name( call->func ), r, call->result);
+			replay_stats.result_mismatches++;
+		}
+	}
+
+	finished = true;
+	stop();
+	return 0;
+}
+
+// find the next recorded copy at this address, allowing for the kernel
+// reading part of what was read when the call was recorded
+replay_copy_t *replay_thread_t::find_copy( ULONG type, ULONG address, ULONG length )
+{
+	if (!active)
+		return 0;
+
+	for (ULONG n = cursor; n != no_copy; n = copies[n].next)
+	{
+		replay_copy_t *copy = &copies[n];
+		bool is_read = (copy->type == replay_read || copy->type == replay_read_fault);
+		if (is_read != (type == replay_read))
+			continue;
+		if (address < copy->address || address + length > copy->address + copy->length)
+			continue;
+		cursor = copy->next;
+		return copy;
+	}
+
+	return 0;
+}
+
+NTSTATUS replay_thread_t::copy_from_user( void *dest, const void *src, size_t count )
+{
+	replay_copy_t *copy = find_copy( replay_read, (ULONG) src, count );
+	if (!copy)
+	{
+		replay_stats.missing_reads++;
+		return STATUS_ACCESS_VIOLATION;
+	}
+	if (copy->type == replay_read_fault)
+		return STATUS_ACCESS_VIOLATION;
+	memcpy( dest, copy->data + ((ULONG) src - copy->address), count );
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS replay_thread_t::copy_to_user( void *dest, const void *src, size_t count )
+{
+	// the recorded call failed to write here, or never did
+	replay_copy_t *copy = find_copy( replay_write, (ULONG) dest, count );
+	if (!copy)
+	{
+		replay_stats.missing_writes++;
+		return STATUS_ACCESS_VIOLATION;
+	}
+
+	const BYTE *recorded = copy->data + ((ULONG) dest - copy->address);
+	if (count == sizeof (HANDLE) && is_handle( process, *(const ULONG*) src ))
+	{
+		// a handle returned to the guest, remember what it was recorded as
+		set_handle( process, *(const ULONG*) recorded, *(const ULONG*) src );
+	}
+	else if (memcmp( recorded, src, count ))
+		replay_stats.data_mismatches++;
+
+	// memory the replay has mapped holds what the guest saw when recorded
+	process->vm->copy_to_user( dest, recorded, count );
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS replay_thread_t::verify_for_write( void *dest, size_t count )
+{
+	return STATUS_SUCCESS;
+}
+
+static replay_thread_t *replay_threads;
+
+static process_t *get_replay_process( ULONG pid )
+{
+	for (replay_thread_t *t = replay_threads; t; t = t->next_thread)
+		if (t->recorded_process == pid)
+			return t->process;
+
+	// each recorded process gets its own handle table and address space
+	process_t *p = new process_t;
+	p->vm = create_address_space( (BYTE*) 0x80000000 );
+	if (!p->vm)
+		die("create_address_space failed\n");
+	return p;
+}
+
+static replay_thread_t *get_replay_thread( ULONG tid, ULONG pid )
+{
+	for (replay_thread_t *t = replay_threads; t; t = t->next_thread)
+		if (t->recorded_thread == tid && t->recorded_process == pid)
+			return t;
+
+	replay_thread_t *t = new replay_thread_t( get_replay_process( pid ), tid, pid );
+	replay_thread_t **p = &replay_threads;
+	while (*p)
+		p = &(*p)->next_thread;
+	*p = t;
+	return t;
+}
+
+static void add_copy( replay_thread_t *t, const replay_record *rec, const BYTE *data )
+{
+	// only copies made inside a syscall can be replayed
+	if (!t->depth)
+		return;
+
+	if ((num_copies & (num_copies - 1)) == 0)
+		copies = (replay_copy_t*) realloc( copies, (num_copies ? num_copies * 2 : 1) * sizeof copies[0] );
+
+	replay_copy_t *copy = &copies[num_copies];
+	copy->type = rec->type;
+	copy->address = rec->value;
+	copy->length = rec->length;
+	copy->data = data;
+	copy->next = no_copy;
+
+	replay_call_t *call = &calls[t->open_calls[t->depth - 1]];
+	if (call->last_copy == no_copy)
+		call->first_copy = num_copies;
+	else
+		copies[call->last_copy].next = num_copies;
+	call->last_copy = num_copies;
+	num_copies++;
+}
+
+static bool load_replay( BYTE *buffer, size_t size )
+{
+	replay_file_header *hdr = (replay_file_header*) buffer;
+	if (size < sizeof *hdr || hdr->magic != REPLAY_MAGIC || hdr->version != REPLAY_VERSION)
+		return false;
+
+	size_t ofs = sizeof *hdr;
+	while (ofs + sizeof (replay_record) <= size)
+	{
+		replay_record *rec = (replay_record*) (buffer + ofs);
+		BYTE *data = buffer + ofs + sizeof *rec;
+		ofs += sizeof *rec;
+		if (rec->type != replay_read_fault)
+		{
+			if (rec->length > size - ofs)
+				break;
+			ofs += rec->length;
+		}
+
+		replay_thread_t *t = get_replay_thread( rec->thread_id, rec->process_id );
+
+		switch (rec->type)
+		{
+		case replay_enter:
+			{
+			if ((num_calls & (num_calls - 1)) == 0)
+				calls = (replay_call_t*) realloc( calls, (num_calls ? num_calls * 2 : 1) * sizeof calls[0] );
+			replay_call_t *call = &calls[num_calls];
+			memset( call, 0, sizeof *call );
+			call->seq = num_calls;
+			call->func = rec->value;
+			call->numargs = min( rec->length / sizeof (ULONG), sizeof call->args / sizeof call->args[0] );
+			memcpy( call->args, data, call->numargs * sizeof (ULONG) );
+			call->nested = (t->depth != 0);
+			call->first_copy = no_copy;
+			call->last_copy = no_copy;
+			if (t->depth < max_depth)
+				t->open_calls[t->depth++] = num_calls;
+			t->add_call( num_calls );
+			num_calls++;
+			}
+			break;
+		case replay_exit:
+			if (t->depth)
+			{
+				replay_call_t *call = &calls[t->open_calls[--t->depth]];
+				call->result = rec->value;
+				call->complete = true;
+			}
+			break;
+		case replay_read:
+		case replay_read_fault:
+		case replay_write:
+			add_copy( t, rec, data );
+			break;
+		default:
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Run the syscalls in a recording against the kernel objects again,
+// without running any guest code.  Each recorded thread is replayed
+// by a kernel thread that serves user memory reads from the recording.
+int replay_syscalls( const char *filename )
+{
+	FILE *f = fopen( filename, "rb" );
+	if (!f)
+	{
+		fprintf(stderr, "failed to open %s\n", filename);
+		return 1;
+	}
+
+	fseek( f, 0, SEEK_END );
+	size_t size = ftell( f );
+	fseek( f, 0, SEEK_SET );
+	BYTE *buffer = new BYTE[size];
+	size_t n = fread( buffer, 1, size, f );
+	fclose( f );
+
+	if (n != size || !load_replay( buffer, size ))
+	{
+		fprintf(stderr, "%s is not a syscall recording\n", filename);
+		delete[] buffer;
+		return 1;
+	}
+
+	ULONGLONG start = replay_now();
+
+	replay_thread_t *t;
+	for (t = replay_threads; t; t = t->next_thread)
+		t->start();
+
+	// stop if the replay diverges so far that every thread is blocked
+	const ULONG max_idle = 100000;
+	ULONG idle = 0, last_progress = replay_progress;
+	while (idle < max_idle)
+	{
+		bool done = true;
+		for (t = replay_threads; t; t = t->next_thread)
+			if (!t->finished)
+				done = false;
+		if (done)
+			break;
+
+		sleeper->check_events( false );
+		fiber_t::yield();
+		if (replay_progress != last_progress)
+		{
+			last_progress = replay_progress;
+			idle = 0;
+		}
+		else
+			idle++;
+	}
+
+	ULONGLONG elapsed = replay_now() - start;
+
+	if (idle >= max_idle)
+		fprintf(stderr, "replay stalled at call %lu of %lu\n", next_seq, num_calls);
+
+	fprintf(stderr, "replayed %lu calls, skipped %lu, in %llu.%06llu s (%llu.%06llu s in syscalls)\n",
+		replay_stats.replayed, replay_stats.skipped,
+		elapsed / 1000000000ULL, (elapsed % 1000000000ULL) / 1000,
+		replay_stats.ns / 1000000000ULL, (replay_stats.ns % 1000000000ULL) / 1000);
+	fprintf(stderr, "%lu results differed, %lu writes differed, %lu reads and %lu writes not recorded\n",
+		replay_stats.result_mismatches, replay_stats.data_mismatches,
+		replay_stats.missing_reads, replay_stats.missing_writes);
+
+	// wake any thread still blocked, and let them all finish
+	for (t = replay_threads; t; t = t->next_thread)
+		t->terminate( 0 );
+	for (t = replay_threads; t; t = t->next_thread)
+		while (!t->finished)
+		{
+			fiber_t::yield();
+			current = t;
+		}
+
+	while (replay_threads)
+	{
+		t = replay_threads;
+		replay_threads = t->next_thread;
+
+		// the last thread of each process tears down the process
+		process_t *p = t->process;
+		bool last = true;
+		for (replay_thread_t *other = replay_threads; other; other = other->next_thread)
+			if (other->process == p)
+				last = false;
+		if (last)
+		{
+			p->terminate( 0 );
+			release( p );
+		}
+		release( t );
+	}
+
+	free( calls );
+	free( copies );
+	free( handle_map );
+	delete[] buffer;
+
+	return replay_stats.result_mismatches ? 1 : 0;
+}
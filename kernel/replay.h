@@ -0,0 +1,66 @@
+/*
+ * nt loader
+ *
+ * Copyright 2006-2008 Mike McCormack
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __REPLAY_H__
+#define __REPLAY_H__
+
+/*
+ * A syscall recording is a header followed by records, in the order
+ * the kernel saw them.  A syscall is an enter record with the arguments,
+ * the user memory it read and wrote, then an exit record with the result.
+ * Records from other threads may come between those of a blocked call.
+ */
+
+#define REPLAY_MAGIC 0x5233524b	/* "KR3R" */
+#define REPLAY_VERSION 1
+
+enum replay_record_type {
+	replay_enter = 1,	// value = syscall number, data = arguments
+	replay_read = 2,	// value = user address, data = bytes read
+	replay_read_fault = 3,	// value = user address, length of the failed read
+	replay_write = 4,	// value = user address, data = bytes written
+	replay_exit = 5,	// value = result
+};
+
+struct replay_file_header {
+	ULONG magic;
+	ULONG version;
+};
+
+struct replay_record {
+	ULONG type;
+	ULONG thread_id;
+	ULONG process_id;
+	ULONG value;
+	ULONG length;		// bytes of data following, except for replay_read_fault
+};
+
+extern bool recording_syscalls;
+
+bool record_syscalls( const char *filename );
+void record_syscall_enter( ULONG func, ULONG *args, ULONG numargs );
+void record_syscall_exit( NTSTATUS r );
+void record_user_read( const void *addr, const void *data, size_t len, NTSTATUS r );
+void record_user_write( void *addr, const void *data, size_t len );
+void close_syscall_record();
+
+int replay_syscalls( const char *filename );
+
+#endif // __REPLAY_H__
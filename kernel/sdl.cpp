@@ -39,6 +39,7 @@
 #include "win32mgr.h"
 #include "ntwin32.h"
 #include "sdl.h"
+#include "aio.h"
 
 #if defined (HAVE_SDL) && defined (HAVE_SDL_SDL_H)
 #include <SDL/SDL.h>
@@ -282,14 +283,17 @@ bool sdl_sleeper_t::check_events( bool wait )
 
 	bool timers_left = timeout_t::check_timers(timeout);
 
+	// complete finished file I/O
+	check_async_io();
+
 	// quit if we got an SDL_QUIT
 	if (SDL_PollEvent( &event ) && handle_sdl_event( event ))
 		return true;
 
 	// Check for a deadlock and quit.
 	//  This happens if we're the only active thread,
-	//  there's no more timers, nobody listening for input and we're asked to wait.
-	if (!timers_left && !active_window && wait && fiber_t::last_fiber())
+	//  there's no more timers or I/O, nobody listening for input and we're asked to wait.
+	if (!timers_left && !async_io_pending() && !active_window && wait && fiber_t::last_fiber())
 		return true;
 
 	// only wait if asked to
@@ -300,11 +304,18 @@ bool sdl_sleeper_t::check_events( bool wait )
 	SDL_TimerID id = 0;
 	Uint32 interval = 0;
 	if (timers_left)
-	{
 		interval = get_int_timeout( timeout );
-		id = SDL_AddTimer( interval, sdl_sleeper_t::timeout_callback, 0 );
+
+	// SDL can't wait on the I/O pipe, so poll for completions
+	if (async_io_pending() && (!timers_left || interval > 10))
+	{
+		timers_left = true;
+		interval = 10;
 	}
 
+	if (timers_left)
+		id = SDL_AddTimer( interval, sdl_sleeper_t::timeout_callback, 0 );
+
 	if (SDL_WaitEvent( &event ))
 	{
 		if (event.type == SDL_USEREVENT && event.user.code == 0)
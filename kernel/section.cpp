@@ -86,9 +86,16 @@ NTSTATUS section_t::mapit( address_space *vm, BYTE *&addr, ULONG ZeroBits, ULONG
 	return r;
 }
 
+static object_type_t section_type( "Section",
+	STANDARD_RIGHTS_READ | SECTION_QUERY | SECTION_MAP_READ,
+	STANDARD_RIGHTS_WRITE | SECTION_MAP_WRITE,
+	STANDARD_RIGHTS_EXECUTE | SECTION_MAP_EXECUTE,
+	SECTION_ALL_ACCESS );
+
 section_t::section_t( int _fd, BYTE *a, size_t l, ULONG attr, ULONG prot ) :
 	fd( _fd )
 {
+	set_type( &section_type );
 	len = l;
 	addr = a;
 	Attributes = attr;
@@ -167,7 +174,7 @@ NTSTATUS create_section( section_t **section, object_t *obj, PLARGE_INTEGER psz,
 	if (obj)
 	{
 		// FIXME: probably better to have a file_t passed in
-		file_t *file = dynamic_cast<file_t*>( obj );
+		file_t *file = object_cast<file_t>( obj );
 		if (!file)
 			return STATUS_OBJECT_TYPE_MISMATCH;
 
@@ -479,7 +486,7 @@ void *pe_section_t::virtual_addr_to_offset( DWORD virtual_ofs )
 // just to find LdrInitializeThunk
 DWORD get_proc_address( object_t *obj, const char *name )
 {
-	pe_section_t *sec = dynamic_cast<pe_section_t*>( obj );
+	pe_section_t *sec = object_cast<pe_section_t>( obj );
 	if (!sec)
 		return 0;
 	return sec->get_proc_address( name );
@@ -589,7 +596,7 @@ const char *get_section_symbol( object_t *object, ULONG address )
 	trace("%p %08lx\n", object, address);
 	if (!object)
 		return 0;
-	section_t *section = dynamic_cast<section_t*>( object );
+	section_t *section = object_cast<section_t>( object );
 	trace("%p %08lx\n", section, address);
 	return section->get_symbol( address );
 }
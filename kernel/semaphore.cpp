@@ -27,6 +27,7 @@
 #include "debug.h"
 #include "object.h"
 #include "ntcall.h"
+#include "thread.h"
 #include "object.inl"
 
 class semaphore_t : public sync_object_t {
@@ -41,10 +42,17 @@ public:
 	NTSTATUS release( ULONG count, ULONG& prev );
 };
 
+static object_type_t semaphore_type( "Semaphore",
+	STANDARD_RIGHTS_READ | SEMAPHORE_QUERY_STATE,
+	STANDARD_RIGHTS_WRITE | SEMAPHORE_MODIFY_STATE,
+	STANDARD_RIGHTS_EXECUTE | SYNCHRONIZE,
+	SEMAPHORE_ALL_ACCESS );
+
 semaphore_t::semaphore_t( ULONG Initial, ULONG Maximum ) :
 	count(Initial),
 	max_count(Maximum)
 {
+	set_type( &semaphore_type );
 }
 
 semaphore_t::~semaphore_t()
@@ -129,12 +137,15 @@ NTSTATUS NTAPI NtReleaseSemaphore(
 		return r;
 
 	ULONG prev;
+	handoff_t handoff;
 	r = semaphore->release( ReleaseCount, prev );
 	if (r == STATUS_SUCCESS && PreviousCount)
 	{
 		r = copy_to_user( PreviousCount, &prev, sizeof prev );
 	}
 
+	handoff.switch_to_woken();
+
 	return r;
 }
 
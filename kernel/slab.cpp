@@ -0,0 +1,205 @@
+/*
+ * nt loader
+ *
+ * Copyright 2006-2008 Mike McCormack
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "ntstatus.h"
+#define WIN32_NO_STATUS
+#include "windef.h"
+#include "winternl.h"
+
+#include "debug.h"
+#include "slab.h"
+
+static const unsigned char alloc_poison = 0xcd;
+static const unsigned char free_poison = 0xdb;
+
+slab_cache_t *slab_cache_t::cache_list;
+bool slab_cache_t::poison;
+
+// caches are static objects and register themselves for dump_stats
+slab_cache_t::slab_cache_t( const char *_name, size_t _size ) :
+	name( _name ),
+	free_list( 0 ),
+	num_chunks( 0 ),
+	in_use( 0 ),
+	peak( 0 ),
+	allocs( 0 ),
+	frees( 0 )
+{
+	// keep blocks aligned for LARGE_INTEGER and friends
+	size = (_size + 7) & ~7;
+	if (size < sizeof (block_t))
+		size = sizeof (block_t);
+	blocks_per_chunk = chunk_size / size;
+	if (blocks_per_chunk < 8)
+		blocks_per_chunk = 8;
+	next_cache = cache_list;
+	cache_list = this;
+}
+
+void slab_cache_t::grow()
+{
+	unsigned char *chunk = (unsigned char*) malloc( blocks_per_chunk * size );
+	if (!chunk)
+		return;
+
+	num_chunks++;
+
+	// thread the new blocks onto the free list in address order
+	for (size_t i = blocks_per_chunk; i > 0; i--)
+	{
+		block_t *block = (block_t*) (chunk + (i - 1) * size);
+		if (poison)
+			memset( block, free_poison, size );
+		block->next = free_list;
+		free_list = block;
+	}
+}
+
+void slab_cache_t::check_poison( block_t *block )
+{
+	unsigned char *p = (unsigned char*) block;
+	for (size_t i = sizeof (block_t); i < size; i++)
+		if (p[i] != free_poison)
+			die("slab %s: block %p modified after free at offset %zd\n", name, block, i);
+}
+
+void *slab_cache_t::alloc()
+{
+	if (!free_list)
+		grow();
+
+	block_t *block = free_list;
+	if (!block)
+		return 0;
+
+	free_list = block->next;
+	if (poison)
+	{
+		check_poison( block );
+		memset( block, alloc_poison, size );
+	}
+
+	allocs++;
+	in_use++;
+	if (in_use > peak)
+		peak = in_use;
+
+	return block;
+}
+
+void slab_cache_t::free( void *ptr )
+{
+	if (!ptr)
+		return;
+
+	assert( in_use > 0 );
+	block_t *block = (block_t*) ptr;
+	if (poison)
+		memset( block, free_poison, size );
+	block->next = free_list;
+	free_list = block;
+
+	frees++;
+	in_use--;
+}
+
+void slab_cache_t::dump_stats()
+{
+	fprintf(stderr, "%-24s %6s %8s %8s %10s %10s\n",
+		"slab", "size", "in use", "peak", "allocs", "chunks");
+	for (slab_cache_t *c = cache_list; c; c = c->next_cache)
+	{
+		if (!c->allocs)
+			continue;
+		fprintf(stderr, "%-24s %6zd %8lu %8lu %10lu %10lu\n",
+			c->name, c->size, c->in_use, c->peak, c->allocs, c->num_chunks);
+	}
+}
+
+// Variable sized allocations carry a header recording the size class
+// they came from, so slab_free doesn't need to be told the size.
+union slab_header_t {
+	ULONG size_class;
+	LARGE_INTEGER align;
+};
+
+static const ULONG large_size_class = ~0U;
+
+static slab_cache_t size_32( "size-32", 32 );
+static slab_cache_t size_64( "size-64", 64 );
+static slab_cache_t size_128( "size-128", 128 );
+static slab_cache_t size_256( "size-256", 256 );
+static slab_cache_t size_512( "size-512", 512 );
+static slab_cache_t size_1024( "size-1024", 1024 );
+static slab_cache_t size_2048( "size-2048", 2048 );
+static slab_cache_t size_4096( "size-4096", 4096 );
+
+static slab_cache_t *const size_class_cache[] = {
+	&size_32, &size_64, &size_128, &size_256,
+	&size_512, &size_1024, &size_2048, &size_4096,
+};
+
+static const ULONG num_size_classes = sizeof size_class_cache / sizeof size_class_cache[0];
+
+void *slab_alloc( size_t size )
+{
+	slab_header_t *hdr;
+	ULONG n;
+
+	size += sizeof *hdr;
+	for (n = 0; n < num_size_classes; n++)
+		if (size <= size_class_cache[n]->get_size())
+			break;
+
+	if (n < num_size_classes)
+		hdr = (slab_header_t*) size_class_cache[n]->alloc();
+	else
+	{
+		hdr = (slab_header_t*) malloc( size );
+		n = large_size_class;
+	}
+	if (!hdr)
+		return 0;
+
+	hdr->size_class = n;
+	return hdr + 1;
+}
+
+void slab_free( void *ptr )
+{
+	if (!ptr)
+		return;
+
+	slab_header_t *hdr = ((slab_header_t*) ptr) - 1;
+	if (hdr->size_class == large_size_class)
+	{
+		::free( hdr );
+		return;
+	}
+
+	assert( hdr->size_class < num_size_classes );
+	size_class_cache[hdr->size_class]->free( hdr );
+}
@@ -0,0 +1,64 @@
+/*
+ * nt loader
+ *
+ * Copyright 2006-2008 Mike McCormack
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __SLAB_H__
+#define __SLAB_H__
+
+#include <stddef.h>
+
+// A cache of equally sized blocks carved out of larger chunks.
+// Freed blocks are kept on a free list and reused before a new chunk
+// is allocated.  Chunks are never returned to the system.
+class slab_cache_t
+{
+	struct block_t {
+		block_t *next;
+	};
+	static const size_t chunk_size = 0x4000;
+	static slab_cache_t *cache_list;
+	static bool poison;
+	const char *name;
+	size_t size;
+	size_t blocks_per_chunk;
+	block_t *free_list;
+	slab_cache_t *next_cache;
+	// statistics
+	unsigned long num_chunks;
+	unsigned long in_use;
+	unsigned long peak;
+	unsigned long allocs;
+	unsigned long frees;
+protected:
+	void grow();
+	void check_poison( block_t *block );
+public:
+	slab_cache_t( const char *name, size_t size );
+	void *alloc();
+	void free( void *ptr );
+	size_t get_size() { return size; }
+	static void enable_poison() { poison = true; }
+	static void dump_stats();
+};
+
+// variable sized allocations, rounded up to a power of two size class
+void *slab_alloc( size_t size );
+void slab_free( void *ptr );
+
+#endif // __SLAB_H__
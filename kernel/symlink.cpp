@@ -34,8 +34,15 @@
 #include "ntcall.h"
 #include "symlink.h"
 
+static object_type_t symlink_type( "SymbolicLink",
+	STANDARD_RIGHTS_READ | SYMBOLIC_LINK_QUERY,
+	STANDARD_RIGHTS_WRITE,
+	STANDARD_RIGHTS_EXECUTE | SYMBOLIC_LINK_QUERY,
+	SYMBOLIC_LINK_ALL_ACCESS );
+
 symlink_t::symlink_t( const UNICODE_STRING& us )
 {
+	set_type( &symlink_type );
 	target.copy( &us );
 }
 
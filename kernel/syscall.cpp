@@ -22,6 +22,9 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
 
 #include "ntstatus.h"
 #define WIN32_NO_STATUS
@@ -31,16 +34,21 @@
 #include "debug.h"
 #include "ntcall.h"
 #include "ntwin32.h"
+#include "syscall_thunk.h"
+#include "process.h"
+#include "bintrace.h"
+#include "replay.h"
 
 typedef struct _ntcalldesc {
 	const char *name;
 	void *func;
 	unsigned int numargs;
+	syscall_thunk_t thunk;
 } ntcalldesc;
 
-#define NUL(x) { #x, NULL, 0 }	/* not even declared */
-#define DEC(x,n) { #x, NULL, n }  /* no stub implemented */
-#define IMP(x,n) { #x, (void*)x, n }	 /* entry point implemented */
+#define NUL(x) { #x, NULL, 0, NULL }	/* not even declared */
+#define DEC(x,n) { #x, NULL, n, NULL }  /* no stub implemented */
+#define IMP(x,n) { #x, (void*)x, n, get_syscall_thunk<n>( x ) }	 /* entry point implemented */
 
 ntcalldesc win2k_calls[] = {
 #define SYSCALL_WIN2K
@@ -92,12 +100,314 @@ void init_syscalls(bool xp)
 	}
 }
 
+// Per syscall accounting, enabled with --syscall-stats.
+// Latencies go in a log-linear histogram: values below 4ns are exact,
+// each power of two above that is split into 4 buckets.
+static const ULONG stat_buckets = 4*40;
+static const ULONG stat_statuses = 4;
+
+struct syscall_stat_t {
+	ULONG count;
+	ULONG failures;
+	ULONGLONG total_ns;
+	ULONGLONG max_ns;
+	ULONG histogram[stat_buckets];
+	struct {
+		NTSTATUS status;
+		ULONG count;
+	} status[stat_statuses];
+	ULONG other_status;
+};
+
+// calls made by one process, kept after the process exits
+struct process_stat_t {
+	process_stat_t *next;
+	ULONG id;
+	ULONG *count;
+};
+
+static const char *stats_file;
+static syscall_stat_t **call_stats;
+static process_stat_t *process_stats;
+static volatile sig_atomic_t stats_dump_requested;
+
+static ULONG number_of_calls()
+{
+	return number_of_ntcalls + number_of_uicalls;
+}
+
+static ntcalldesc *call_desc( ULONG n )
+{
+	if (n < number_of_ntcalls)
+		return &ntcalls[n];
+	return &ntuicalls[n - number_of_ntcalls];
+}
+
+static ULONG stat_bucket( ULONGLONG ns )
+{
+	if (ns < 4)
+		return ns;
+	ULONG e = 63 - __builtin_clzll( ns );
+	ULONG n = 4*(e - 1) + ((ns >> (e - 2)) & 3);
+	if (n >= stat_buckets)
+		n = stat_buckets - 1;
+	return n;
+}
+
+static ULONGLONG stat_bucket_value( ULONG n )
+{
+	if (n < 4)
+		return n;
+	return (ULONGLONG)(4 + (n & 3)) << (n/4 - 1);
+}
+
+static ULONGLONG stat_percentile( syscall_stat_t *st, ULONG percent )
+{
+	ULONGLONG want = ((ULONGLONG) st->count * percent + 99) / 100;
+	ULONGLONG seen = 0;
+	for (ULONG i = 0; i < stat_buckets; i++)
+	{
+		seen += st->histogram[i];
+		if (seen >= want)
+			return stat_bucket_value( i );
+	}
+	return st->max_ns;
+}
+
+static ULONGLONG stat_now()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (ULONGLONG) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static process_stat_t *get_process_stat( ULONG id )
+{
+	static process_stat_t *last;
+
+	if (last && last->id == id)
+		return last;
+
+	process_stat_t *ps;
+	for (ps = process_stats; ps; ps = ps->next)
+		if (ps->id == id)
+			break;
+
+	if (!ps)
+	{
+		ps = new process_stat_t;
+		ps->id = id;
+		ps->count = new ULONG[number_of_calls()];
+		memset( ps->count, 0, number_of_calls() * sizeof ps->count[0] );
+		ps->next = process_stats;
+		process_stats = ps;
+	}
+	last = ps;
+	return ps;
+}
+
+static void account_syscall( ULONG n, bool win32k_func, NTSTATUS r, ULONGLONG ns )
+{
+	if (!call_stats)
+	{
+		call_stats = new syscall_stat_t*[number_of_calls()];
+		memset( call_stats, 0, number_of_calls() * sizeof call_stats[0] );
+	}
+
+	syscall_stat_t *st = call_stats[n];
+	if (!st)
+	{
+		st = new syscall_stat_t;
+		memset( st, 0, sizeof *st );
+		call_stats[n] = st;
+	}
+
+	st->count++;
+	st->total_ns += ns;
+	if (ns > st->max_ns)
+		st->max_ns = ns;
+	st->histogram[stat_bucket( ns )]++;
+
+	// count error severity statuses, win32k calls don't return an NTSTATUS
+	if (!win32k_func && ((ULONG) r >> 30) == 3)
+	{
+		st->failures++;
+		ULONG i;
+		for (i = 0; i < stat_statuses; i++)
+		{
+			if (st->status[i].count && st->status[i].status != r)
+				continue;
+			st->status[i].status = r;
+			st->status[i].count++;
+			break;
+		}
+		if (i == stat_statuses)
+			st->other_status++;
+	}
+
+	if (current && current->process)
+		get_process_stat( current->process->id )->count[n]++;
+}
+
+static ULONG *sorted_calls( ULONG& num )
+{
+	ULONG *order = new ULONG[number_of_calls()];
+	num = 0;
+	for (ULONG i = 0; call_stats && i < number_of_calls(); i++)
+		if (call_stats[i])
+			order[num++] = i;
+
+	// most total time first
+	for (ULONG i = 1; i < num; i++)
+	{
+		ULONG t = order[i], j = i;
+		for (; j > 0 && call_stats[order[j-1]]->total_ns < call_stats[t]->total_ns; j--)
+			order[j] = order[j-1];
+		order[j] = t;
+	}
+	return order;
+}
+
+static void dump_stats_text( FILE *f )
+{
+	ULONG num;
+	ULONG *order = sorted_calls( num );
+
+	fprintf(f, "%-40s %9s %7s %12s %9s %9s %9s %9s\n",
+		"syscall", "count", "failed", "total(us)", "avg(ns)", "p50(ns)", "p99(ns)", "max(ns)");
+	for (ULONG i = 0; i < num; i++)
+	{
+		syscall_stat_t *st = call_stats[order[i]];
+		fprintf(f, "%-40s %9lu %7lu %12llu %9llu %9llu %9llu %9llu\n",
+			call_desc( order[i] )->name, st->count, st->failures,
+			st->total_ns/1000, st->total_ns/st->count,
+			stat_percentile( st, 50 ), stat_percentile( st, 99 ), st->max_ns);
+		for (ULONG j = 0; j < stat_statuses && st->status[j].count; j++)
+			fprintf(f, "    status %08lx: %lu\n", st->status[j].status, st->status[j].count);
+		if (st->other_status)
+			fprintf(f, "    other status: %lu\n", st->other_status);
+	}
+
+	for (process_stat_t *ps = process_stats; ps; ps = ps->next)
+	{
+		fprintf(f, "\nprocess %04lx:\n", ps->id);
+		for (ULONG i = 0; i < num; i++)
+			if (ps->count[order[i]])
+				fprintf(f, "  %-38s %9lu\n", call_desc( order[i] )->name, ps->count[order[i]]);
+	}
+
+	delete[] order;
+}
+
+static void dump_stats_json( FILE *f )
+{
+	ULONG num;
+	ULONG *order = sorted_calls( num );
+
+	fprintf(f, "{\n  \"syscalls\": [");
+	for (ULONG i = 0; i < num; i++)
+	{
+		syscall_stat_t *st = call_stats[order[i]];
+		fprintf(f, "%s\n    { \"name\": \"%s\", \"win32k\": %s, \"count\": %lu, \"failures\": %lu, "
+			"\"total_ns\": %llu, \"max_ns\": %llu, \"p50_ns\": %llu, \"p99_ns\": %llu,",
+			i ? "," : "", call_desc( order[i] )->name,
+			order[i] >= number_of_ntcalls ? "true" : "false",
+			st->count, st->failures, st->total_ns, st->max_ns,
+			stat_percentile( st, 50 ), stat_percentile( st, 99 ));
+
+		fprintf(f, " \"status\": {");
+		for (ULONG j = 0; j < stat_statuses && st->status[j].count; j++)
+			fprintf(f, "%s \"%08lx\": %lu", j ? "," : "", st->status[j].status, st->status[j].count);
+		fprintf(f, " }, \"other_status\": %lu,", st->other_status);
+
+		fprintf(f, " \"histogram\": [");
+		bool first = true;
+		for (ULONG j = 0; j < stat_buckets; j++)
+		{
+			if (!st->histogram[j])
+				continue;
+			fprintf(f, "%s [%llu, %lu]", first ? "" : ",", stat_bucket_value( j ), st->histogram[j]);
+			first = false;
+		}
+		fprintf(f, " ] }");
+	}
+	fprintf(f, "\n  ],\n  \"processes\": [");
+
+	for (process_stat_t *ps = process_stats; ps; ps = ps->next)
+	{
+		fprintf(f, "%s\n    { \"id\": %lu, \"calls\": {", ps == process_stats ? "" : ",", ps->id);
+		bool first = true;
+		for (ULONG i = 0; i < num; i++)
+		{
+			if (!ps->count[order[i]])
+				continue;
+			fprintf(f, "%s \"%s\": %lu", first ? "" : ",", call_desc( order[i] )->name, ps->count[order[i]]);
+			first = false;
+		}
+		fprintf(f, " } }");
+	}
+	fprintf(f, "\n  ]\n}\n");
+
+	delete[] order;
+}
+
+static void request_stats_dump( int )
+{
+	stats_dump_requested = 1;
+}
+
+// stats go to stderr for "-", as JSON if the name ends in .json
+bool set_syscall_stats( const char *file )
+{
+	if (!file || !file[0])
+		return false;
+	stats_file = file;
+	signal( SIGUSR2, request_stats_dump );
+	return true;
+}
+
+void dump_syscall_stats()
+{
+	if (!stats_file)
+		return;
+
+	bool json = false;
+	size_t len = strlen( stats_file );
+	if (len > 5 && !strcmp( stats_file + len - 5, ".json" ))
+		json = true;
+
+	FILE *f = stderr;
+	if (strcmp( stats_file, "-" ))
+	{
+		f = fopen( stats_file, "w" );
+		if (!f)
+		{
+			fprintf(stderr, "failed to open %s\n", stats_file);
+			return;
+		}
+	}
+
+	if (json)
+		dump_stats_json( f );
+	else
+		dump_stats_text( f );
+
+	if (f != stderr)
+		fclose( f );
+}
+
 void trace_syscall_enter(ULONG id, ntcalldesc *ntcall, ULONG *args, ULONG retaddr)
 {
 	/* print a relay style trace line */
 	if (!option_trace)
 		return;
 
+	if (bintrace_enabled())
+	{
+		bintrace_syscall_enter( id, ntcall->name, args, ntcall->numargs, retaddr );
+		return;
+	}
+
 	fprintf(stderr,"%04lx: %s(", id, ntcall->name);
 	if (ntcall->numargs)
 	{
@@ -114,18 +424,41 @@ void trace_syscall_exit(ULONG id, ntcalldesc *ntcall, ULONG r, ULONG retaddr)
 	if (!option_trace)
 		return;
 
+	if (bintrace_enabled())
+	{
+		bintrace_syscall_exit( id, ntcall->name, r, retaddr );
+		return;
+	}
+
 	fprintf(stderr, "%04lx: %s retval=%08lx ret=%08lx\n",
 			id, ntcall->name, r, retaddr);
 }
 
+static NTSTATUS invoke_ntcall( ntcalldesc *ntcall, ULONG func, BOOLEAN win32k_func, ULONG *args )
+{
+	if (!stats_file)
+		return ntcall->thunk( ntcall->func, args );
+
+	ULONGLONG start = stat_now();
+	NTSTATUS r = ntcall->thunk( ntcall->func, args );
+	ULONG n = win32k_func ? number_of_ntcalls + func - uicall_offset : func;
+	account_syscall( n, win32k_func, r, stat_now() - start );
+	if (stats_dump_requested)
+	{
+		stats_dump_requested = 0;
+		dump_syscall_stats();
+	}
+
+	return r;
+}
+
 NTSTATUS do_nt_syscall(ULONG id, ULONG func, ULONG *uargs, ULONG retaddr)
 {
 	NTSTATUS r = STATUS_INVALID_SYSTEM_SERVICE;
 	ntcalldesc *ntcall = 0;
 	ULONG args[16];
-	const int magic_val = 0xfedc1248;	// random unlikely value
-	int magic = magic_val;
 	BOOLEAN win32k_func = FALSE;
+	BOOLEAN recorded = FALSE;
 
 	/* check the call number is in range */
 	if (func >= 0 && func < number_of_ntcalls)
@@ -141,8 +474,13 @@ NTSTATUS do_nt_syscall(ULONG id, ULONG func, ULONG *uargs, ULONG retaddr)
 		return r;
 	}
 
+	// the ret instruction after the syscall tells us how many arguments
+	// an unknown call takes, and is only needed until that is learned
 	BYTE inst[4];
-	r = copy_from_user( inst, (const void*)retaddr, sizeof inst );
+	if ((!ntcall->func && !ntcall->numargs) || option_trace)
+		r = copy_from_user( inst, (const void*)retaddr, sizeof inst );
+	else
+		r = STATUS_UNSUCCESSFUL;
 	if (r == STATUS_SUCCESS && inst[0] == 0xc2)
 	{
 		// detect the number of args
@@ -176,6 +514,12 @@ NTSTATUS do_nt_syscall(ULONG id, ULONG func, ULONG *uargs, ULONG retaddr)
 
 	trace_syscall_enter(id, ntcall, args, retaddr );
 
+	if (recording_syscalls)
+	{
+		record_syscall_enter( func, args, ntcall->numargs );
+		recorded = TRUE;
+	}
+
 	// initialize the windows subsystem if necessary
 	if (win32k_func)
 		win32k_thread_init(current);
@@ -188,24 +532,43 @@ NTSTATUS do_nt_syscall(ULONG id, ULONG func, ULONG *uargs, ULONG retaddr)
 		goto end;
 	}
 
-	__asm__(
-		"pushl %%edx\n\t"
-		"subl %%ecx, %%esp\n\t"
-		"movl %%esp, %%edi\n\t"
-		"cld\n\t"
-		"repe\n\t"
-		"movsb\n\t"
-		"call *%%eax\n\t"
-		"popl %%edx\n\t"
-		: "=a"(r), "=d"(magic)   // output
-		: "a"(ntcall->func), "c"(ntcall->numargs*4), "d"(magic), "S"(args) // input
-		: "%edi"	// clobber
-	);
-
-	assert( magic == magic_val );
+	r = invoke_ntcall( ntcall, func, win32k_func, args );
 
 end:
+	if (recorded)
+		record_syscall_exit( r );
+
 	trace_syscall_exit(id, ntcall, r, retaddr);
 
 	return r;
 }
+
+static ntcalldesc *get_ntcall( ULONG func )
+{
+	if (func < number_of_ntcalls)
+		return &ntcalls[func];
+	if (func >= uicall_offset && func < (uicall_offset + number_of_uicalls))
+		return &ntuicalls[func - uicall_offset];
+	return 0;
+}
+
+const char *get_syscall_name( ULONG func )
+{
+	ntcalldesc *ntcall = get_ntcall( func );
+	if (!ntcall)
+		return "(invalid)";
+	return ntcall->name;
+}
+
+// call an nt syscall for a kernel thread, with arguments already in the kernel
+NTSTATUS call_nt_syscall( ULONG func, ULONG *args )
+{
+	if (func >= number_of_ntcalls)
+		return STATUS_INVALID_SYSTEM_SERVICE;
+
+	ntcalldesc *ntcall = &ntcalls[func];
+	if (!ntcall->func)
+		return STATUS_NOT_IMPLEMENTED;
+
+	return invoke_ntcall( ntcall, func, FALSE, args );
+}
@@ -0,0 +1,425 @@
+/*
+ * nt loader
+ *
+ * Copyright 2006-2008 Mike McCormack
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __SYSCALL_THUNK_H__
+#define __SYSCALL_THUNK_H__
+
+// Typed thunks used to call the syscall implementations.
+//
+// get_syscall_thunk<N>( func ) checks at compile time that func's
+// parameters take up exactly N words of the user's stack, so the
+// argument counts in ntsyscall.h and uisyscall.h are verified by the
+// compiler.  The thunk it returns reads each argument from the copied
+// stack as its real type and makes an ordinary call.
+
+typedef NTSTATUS (*syscall_thunk_t)( void *func, ULONG *args );
+
+// number of stack words a parameter occupies
+template<typename T> struct syscall_arg_size {
+	enum { words = (sizeof (T) + 3) / 4 };
+};
+
+// args is a copy of the user's stack, so this is how the caller laid it out
+template<typename T> inline T syscall_arg( ULONG *args )
+{
+	return *(T*) args;
+}
+
+// whatever the syscall returns is passed back in eax
+template<typename R> inline NTSTATUS syscall_result( R r )
+{
+	return (NTSTATUS) (ULONG_PTR) r;
+}
+
+template<typename R>
+NTSTATUS syscall_call0( void *func, ULONG *args )
+{
+	R (NTAPI *f)() = (R (NTAPI *)()) func;
+	return syscall_result( f() );
+}
+
+template<ULONG N, typename R>
+syscall_thunk_t get_syscall_thunk( R (NTAPI *)() )
+{
+	typedef char wrong_number_of_args[ (0 == N) ? 1 : -1 ] __attribute__((unused));
+	return &syscall_call0<R>;
+}
+
+template<typename R, typename A1>
+NTSTATUS syscall_call1( void *func, ULONG *args )
+{
+	R (NTAPI *f)(A1) = (R (NTAPI *)(A1)) func;
+	ULONG *p1 = args;
+	return syscall_result( f( syscall_arg<A1>( p1 ) ) );
+}
+
+template<ULONG N, typename R, typename A1>
+syscall_thunk_t get_syscall_thunk( R (NTAPI *)(A1) )
+{
+	typedef char wrong_number_of_args[ (syscall_arg_size<A1>::words == N) ? 1 : -1 ] __attribute__((unused));
+	return &syscall_call1<R, A1>;
+}
+
+template<typename R, typename A1, typename A2>
+NTSTATUS syscall_call2( void *func, ULONG *args )
+{
+	R (NTAPI *f)(A1, A2) = (R (NTAPI *)(A1, A2)) func;
+	ULONG *p1 = args;
+	ULONG *p2 = p1 + syscall_arg_size<A1>::words;
+	return syscall_result( f( syscall_arg<A1>( p1 ), syscall_arg<A2>( p2 ) ) );
+}
+
+template<ULONG N, typename R, typename A1, typename A2>
+syscall_thunk_t get_syscall_thunk( R (NTAPI *)(A1, A2) )
+{
+	typedef char wrong_number_of_args[ (syscall_arg_size<A1>::words + syscall_arg_size<A2>::words == N) ? 1 : -1 ] __attribute__((unused));
+	return &syscall_call2<R, A1, A2>;
+}
+
+template<typename R, typename A1, typename A2, typename A3>
+NTSTATUS syscall_call3( void *func, ULONG *args )
+{
+	R (NTAPI *f)(A1, A2, A3) = (R (NTAPI *)(A1, A2, A3)) func;
+	ULONG *p1 = args;
+	ULONG *p2 = p1 + syscall_arg_size<A1>::words;
+	ULONG *p3 = p2 + syscall_arg_size<A2>::words;
+	return syscall_result( f( syscall_arg<A1>( p1 ), syscall_arg<A2>( p2 ), syscall_arg<A3>( p3 ) ) );
+}
+
+template<ULONG N, typename R, typename A1, typename A2, typename A3>
+syscall_thunk_t get_syscall_thunk( R (NTAPI *)(A1, A2, A3) )
+{
+	typedef char wrong_number_of_args[ (syscall_arg_size<A1>::words + syscall_arg_size<A2>::words + syscall_arg_size<A3>::words == N) ? 1 : -1 ] __attribute__((unused));
+	return &syscall_call3<R, A1, A2, A3>;
+}
+
+template<typename R, typename A1, typename A2, typename A3, typename A4>
+NTSTATUS syscall_call4( void *func, ULONG *args )
+{
+	R (NTAPI *f)(A1, A2, A3, A4) = (R (NTAPI *)(A1, A2, A3, A4)) func;
+	ULONG *p1 = args;
+	ULONG *p2 = p1 + syscall_arg_size<A1>::words;
+	ULONG *p3 = p2 + syscall_arg_size<A2>::words;
+	ULONG *p4 = p3 + syscall_arg_size<A3>::words;
+	return syscall_result( f( syscall_arg<A1>( p1 ), syscall_arg<A2>( p2 ), syscall_arg<A3>( p3 ), syscall_arg<A4>( p4 ) ) );
+}
+
+template<ULONG N, typename R, typename A1, typename A2, typename A3, typename A4>
+syscall_thunk_t get_syscall_thunk( R (NTAPI *)(A1, A2, A3, A4) )
+{
+	typedef char wrong_number_of_args[ (syscall_arg_size<A1>::words + syscall_arg_size<A2>::words + syscall_arg_size<A3>::words + syscall_arg_size<A4>::words == N) ? 1 : -1 ] __attribute__((unused));
+	return &syscall_call4<R, A1, A2, A3, A4>;
+}
+
+template<typename R, typename A1, typename A2, typename A3, typename A4, typename A5>
+NTSTATUS syscall_call5( void *func, ULONG *args )
+{
+	R (NTAPI *f)(A1, A2, A3, A4, A5) = (R (NTAPI *)(A1, A2, A3, A4, A5)) func;
+	ULONG *p1 = args;
+	ULONG *p2 = p1 + syscall_arg_size<A1>::words;
+	ULONG *p3 = p2 + syscall_arg_size<A2>::words;
+	ULONG *p4 = p3 + syscall_arg_size<A3>::words;
+	ULONG *p5 = p4 + syscall_arg_size<A4>::words;
+	return syscall_result( f( syscall_arg<A1>( p1 ), syscall_arg<A2>( p2 ), syscall_arg<A3>( p3 ), syscall_arg<A4>( p4 ), syscall_arg<A5>( p5 ) ) );
+}
+
+template<ULONG N, typename R, typename A1, typename A2, typename A3, typename A4, typename A5>
+syscall_thunk_t get_syscall_thunk( R (NTAPI *)(A1, A2, A3, A4, A5) )
+{
+	typedef char wrong_number_of_args[ (syscall_arg_size<A1>::words + syscall_arg_size<A2>::words + syscall_arg_size<A3>::words + syscall_arg_size<A4>::words + syscall_arg_size<A5>::words == N) ? 1 : -1 ] __attribute__((unused));
+	return &syscall_call5<R, A1, A2, A3, A4, A5>;
+}
+
+template<typename R, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6>
+NTSTATUS syscall_call6( void *func, ULONG *args )
+{
+	R (NTAPI *f)(A1, A2, A3, A4, A5, A6) = (R (NTAPI *)(A1, A2, A3, A4, A5, A6)) func;
+	ULONG *p1 = args;
+	ULONG *p2 = p1 + syscall_arg_size<A1>::words;
+	ULONG *p3 = p2 + syscall_arg_size<A2>::words;
+	ULONG *p4 = p3 + syscall_arg_size<A3>::words;
+	ULONG *p5 = p4 + syscall_arg_size<A4>::words;
+	ULONG *p6 = p5 + syscall_arg_size<A5>::words;
+	return syscall_result( f( syscall_arg<A1>( p1 ), syscall_arg<A2>( p2 ), syscall_arg<A3>( p3 ), syscall_arg<A4>( p4 ), syscall_arg<A5>( p5 ), syscall_arg<A6>( p6 ) ) );
+}
+
+template<ULONG N, typename R, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6>
+syscall_thunk_t get_syscall_thunk( R (NTAPI *)(A1, A2, A3, A4, A5, A6) )
+{
+	typedef char wrong_number_of_args[ (syscall_arg_size<A1>::words + syscall_arg_size<A2>::words + syscall_arg_size<A3>::words + syscall_arg_size<A4>::words + syscall_arg_size<A5>::words + syscall_arg_size<A6>::words == N) ? 1 : -1 ] __attribute__((unused));
+	return &syscall_call6<R, A1, A2, A3, A4, A5, A6>;
+}
+
+template<typename R, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6, typename A7>
+NTSTATUS syscall_call7( void *func, ULONG *args )
+{
+	R (NTAPI *f)(A1, A2, A3, A4, A5, A6, A7) = (R (NTAPI *)(A1, A2, A3, A4, A5, A6, A7)) func;
+	ULONG *p1 = args;
+	ULONG *p2 = p1 + syscall_arg_size<A1>::words;
+	ULONG *p3 = p2 + syscall_arg_size<A2>::words;
+	ULONG *p4 = p3 + syscall_arg_size<A3>::words;
+	ULONG *p5 = p4 + syscall_arg_size<A4>::words;
+	ULONG *p6 = p5 + syscall_arg_size<A5>::words;
+	ULONG *p7 = p6 + syscall_arg_size<A6>::words;
+	return syscall_result( f( syscall_arg<A1>( p1 ), syscall_arg<A2>( p2 ), syscall_arg<A3>( p3 ), syscall_arg<A4>( p4 ), syscall_arg<A5>( p5 ), syscall_arg<A6>( p6 ), syscall_arg<A7>( p7 ) ) );
+}
+
+template<ULONG N, typename R, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6, typename A7>
+syscall_thunk_t get_syscall_thunk( R (NTAPI *)(A1, A2, A3, A4, A5, A6, A7) )
+{
+	typedef char wrong_number_of_args[ (syscall_arg_size<A1>::words + syscall_arg_size<A2>::words + syscall_arg_size<A3>::words + syscall_arg_size<A4>::words + syscall_arg_size<A5>::words + syscall_arg_size<A6>::words + syscall_arg_size<A7>::words == N) ? 1 : -1 ] __attribute__((unused));
+	return &syscall_call7<R, A1, A2, A3, A4, A5, A6, A7>;
+}
+
+template<typename R, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6, typename A7, typename A8>
+NTSTATUS syscall_call8( void *func, ULONG *args )
+{
+	R (NTAPI *f)(A1, A2, A3, A4, A5, A6, A7, A8) = (R (NTAPI *)(A1, A2, A3, A4, A5, A6, A7, A8)) func;
+	ULONG *p1 = args;
+	ULONG *p2 = p1 + syscall_arg_size<A1>::words;
+	ULONG *p3 = p2 + syscall_arg_size<A2>::words;
+	ULONG *p4 = p3 + syscall_arg_size<A3>::words;
+	ULONG *p5 = p4 + syscall_arg_size<A4>::words;
+	ULONG *p6 = p5 + syscall_arg_size<A5>::words;
+	ULONG *p7 = p6 + syscall_arg_size<A6>::words;
+	ULONG *p8 = p7 + syscall_arg_size<A7>::words;
+	return syscall_result( f( syscall_arg<A1>( p1 ), syscall_arg<A2>( p2 ), syscall_arg<A3>( p3 ), syscall_arg<A4>( p4 ), syscall_arg<A5>( p5 ), syscall_arg<A6>( p6 ), syscall_arg<A7>( p7 ), syscall_arg<A8>( p8 ) ) );
+}
+
+template<ULONG N, typename R, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6, typename A7, typename A8>
+syscall_thunk_t get_syscall_thunk( R (NTAPI *)(A1, A2, A3, A4, A5, A6, A7, A8) )
+{
+	typedef char wrong_number_of_args[ (syscall_arg_size<A1>::words + syscall_arg_size<A2>::words + syscall_arg_size<A3>::words + syscall_arg_size<A4>::words + syscall_arg_size<A5>::words + syscall_arg_size<A6>::words + syscall_arg_size<A7>::words + syscall_arg_size<A8>::words == N) ? 1 : -1 ] __attribute__((unused));
+	return &syscall_call8<R, A1, A2, A3, A4, A5, A6, A7, A8>;
+}
+
+template<typename R, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6, typename A7, typename A8, typename A9>
+NTSTATUS syscall_call9( void *func, ULONG *args )
+{
+	R (NTAPI *f)(A1, A2, A3, A4, A5, A6, A7, A8, A9) = (R (NTAPI *)(A1, A2, A3, A4, A5, A6, A7, A8, A9)) func;
+	ULONG *p1 = args;
+	ULONG *p2 = p1 + syscall_arg_size<A1>::words;
+	ULONG *p3 = p2 + syscall_arg_size<A2>::words;
+	ULONG *p4 = p3 + syscall_arg_size<A3>::words;
+	ULONG *p5 = p4 + syscall_arg_size<A4>::words;
+	ULONG *p6 = p5 + syscall_arg_size<A5>::words;
+	ULONG *p7 = p6 + syscall_arg_size<A6>::words;
+	ULONG *p8 = p7 + syscall_arg_size<A7>::words;
+	ULONG *p9 = p8 + syscall_arg_size<A8>::words;
+	return syscall_result( f( syscall_arg<A1>( p1 ), syscall_arg<A2>( p2 ), syscall_arg<A3>( p3 ), syscall_arg<A4>( p4 ), syscall_arg<A5>( p5 ), syscall_arg<A6>( p6 ), syscall_arg<A7>( p7 ), syscall_arg<A8>( p8 ), syscall_arg<A9>( p9 ) ) );
+}
+
+template<ULONG N, typename R, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6, typename A7, typename A8, typename A9>
+syscall_thunk_t get_syscall_thunk( R (NTAPI *)(A1, A2, A3, A4, A5, A6, A7, A8, A9) )
+{
+	typedef char wrong_number_of_args[ (syscall_arg_size<A1>::words + syscall_arg_size<A2>::words + syscall_arg_size<A3>::words + syscall_arg_size<A4>::words + syscall_arg_size<A5>::words + syscall_arg_size<A6>::words + syscall_arg_size<A7>::words + syscall_arg_size<A8>::words + syscall_arg_size<A9>::words == N) ? 1 : -1 ] __attribute__((unused));
+	return &syscall_call9<R, A1, A2, A3, A4, A5, A6, A7, A8, A9>;
+}
+
+template<typename R, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6, typename A7, typename A8, typename A9, typename A10>
+NTSTATUS syscall_call10( void *func, ULONG *args )
+{
+	R (NTAPI *f)(A1, A2, A3, A4, A5, A6, A7, A8, A9, A10) = (R (NTAPI *)(A1, A2, A3, A4, A5, A6, A7, A8, A9, A10)) func;
+	ULONG *p1 = args;
+	ULONG *p2 = p1 + syscall_arg_size<A1>::words;
+	ULONG *p3 = p2 + syscall_arg_size<A2>::words;
+	ULONG *p4 = p3 + syscall_arg_size<A3>::words;
+	ULONG *p5 = p4 + syscall_arg_size<A4>::words;
+	ULONG *p6 = p5 + syscall_arg_size<A5>::words;
+	ULONG *p7 = p6 + syscall_arg_size<A6>::words;
+	ULONG *p8 = p7 + syscall_arg_size<A7>::words;
+	ULONG *p9 = p8 + syscall_arg_size<A8>::words;
+	ULONG *p10 = p9 + syscall_arg_size<A9>::words;
+	return syscall_result( f( syscall_arg<A1>( p1 ), syscall_arg<A2>( p2 ), syscall_arg<A3>( p3 ), syscall_arg<A4>( p4 ), syscall_arg<A5>( p5 ), syscall_arg<A6>( p6 ), syscall_arg<A7>( p7 ), syscall_arg<A8>( p8 ), syscall_arg<A9>( p9 ), syscall_arg<A10>( p10 ) ) );
+}
+
+template<ULONG N, typename R, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6, typename A7, typename A8, typename A9, typename A10>
+syscall_thunk_t get_syscall_thunk( R (NTAPI *)(A1, A2, A3, A4, A5, A6, A7, A8, A9, A10) )
+{
+	typedef char wrong_number_of_args[ (syscall_arg_size<A1>::words + syscall_arg_size<A2>::words + syscall_arg_size<A3>::words + syscall_arg_size<A4>::words + syscall_arg_size<A5>::words + syscall_arg_size<A6>::words + syscall_arg_size<A7>::words + syscall_arg_size<A8>::words + syscall_arg_size<A9>::words + syscall_arg_size<A10>::words == N) ? 1 : -1 ] __attribute__((unused));
+	return &syscall_call10<R, A1, A2, A3, A4, A5, A6, A7, A8, A9, A10>;
+}
+
+template<typename R, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6, typename A7, typename A8, typename A9, typename A10, typename A11>
+NTSTATUS syscall_call11( void *func, ULONG *args )
+{
+	R (NTAPI *f)(A1, A2, A3, A4, A5, A6, A7, A8, A9, A10, A11) = (R (NTAPI *)(A1, A2, A3, A4, A5, A6, A7, A8, A9, A10, A11)) func;
+	ULONG *p1 = args;
+	ULONG *p2 = p1 + syscall_arg_size<A1>::words;
+	ULONG *p3 = p2 + syscall_arg_size<A2>::words;
+	ULONG *p4 = p3 + syscall_arg_size<A3>::words;
+	ULONG *p5 = p4 + syscall_arg_size<A4>::words;
+	ULONG *p6 = p5 + syscall_arg_size<A5>::words;
+	ULONG *p7 = p6 + syscall_arg_size<A6>::words;
+	ULONG *p8 = p7 + syscall_arg_size<A7>::words;
+	ULONG *p9 = p8 + syscall_arg_size<A8>::words;
+	ULONG *p10 = p9 + syscall_arg_size<A9>::words;
+	ULONG *p11 = p10 + syscall_arg_size<A10>::words;
+	return syscall_result( f( syscall_arg<A1>( p1 ), syscall_arg<A2>( p2 ), syscall_arg<A3>( p3 ), syscall_arg<A4>( p4 ), syscall_arg<A5>( p5 ), syscall_arg<A6>( p6 ), syscall_arg<A7>( p7 ), syscall_arg<A8>( p8 ), syscall_arg<A9>( p9 ), syscall_arg<A10>( p10 ), syscall_arg<A11>( p11 ) ) );
+}
+
+template<ULONG N, typename R, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6, typename A7, typename A8, typename A9, typename A10, typename A11>
+syscall_thunk_t get_syscall_thunk( R (NTAPI *)(A1, A2, A3, A4, A5, A6, A7, A8, A9, A10, A11) )
+{
+	typedef char wrong_number_of_args[ (syscall_arg_size<A1>::words + syscall_arg_size<A2>::words + syscall_arg_size<A3>::words + syscall_arg_size<A4>::words + syscall_arg_size<A5>::words + syscall_arg_size<A6>::words + syscall_arg_size<A7>::words + syscall_arg_size<A8>::words + syscall_arg_size<A9>::words + syscall_arg_size<A10>::words + syscall_arg_size<A11>::words == N) ? 1 : -1 ] __attribute__((unused));
+	return &syscall_call11<R, A1, A2, A3, A4, A5, A6, A7, A8, A9, A10, A11>;
+}
+
+template<typename R, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6, typename A7, typename A8, typename A9, typename A10, typename A11, typename A12>
+NTSTATUS syscall_call12( void *func, ULONG *args )
+{
+	R (NTAPI *f)(A1, A2, A3, A4, A5, A6, A7, A8, A9, A10, A11, A12) = (R (NTAPI *)(A1, A2, A3, A4, A5, A6, A7, A8, A9, A10, A11, A12)) func;
+	ULONG *p1 = args;
+	ULONG *p2 = p1 + syscall_arg_size<A1>::words;
+	ULONG *p3 = p2 + syscall_arg_size<A2>::words;
+	ULONG *p4 = p3 + syscall_arg_size<A3>::words;
+	ULONG *p5 = p4 + syscall_arg_size<A4>::words;
+	ULONG *p6 = p5 + syscall_arg_size<A5>::words;
+	ULONG *p7 = p6 + syscall_arg_size<A6>::words;
+	ULONG *p8 = p7 + syscall_arg_size<A7>::words;
+	ULONG *p9 = p8 + syscall_arg_size<A8>::words;
+	ULONG *p10 = p9 + syscall_arg_size<A9>::words;
+	ULONG *p11 = p10 + syscall_arg_size<A10>::words;
+	ULONG *p12 = p11 + syscall_arg_size<A11>::words;
+	return syscall_result( f( syscall_arg<A1>( p1 ), syscall_arg<A2>( p2 ), syscall_arg<A3>( p3 ), syscall_arg<A4>( p4 ), syscall_arg<A5>( p5 ), syscall_arg<A6>( p6 ), syscall_arg<A7>( p7 ), syscall_arg<A8>( p8 ), syscall_arg<A9>( p9 ), syscall_arg<A10>( p10 ), syscall_arg<A11>( p11 ), syscall_arg<A12>( p12 ) ) );
+}
+
+template<ULONG N, typename R, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6, typename A7, typename A8, typename A9, typename A10, typename A11, typename A12>
+syscall_thunk_t get_syscall_thunk( R (NTAPI *)(A1, A2, A3, A4, A5, A6, A7, A8, A9, A10, A11, A12) )
+{
+	typedef char wrong_number_of_args[ (syscall_arg_size<A1>::words + syscall_arg_size<A2>::words + syscall_arg_size<A3>::words + syscall_arg_size<A4>::words + syscall_arg_size<A5>::words + syscall_arg_size<A6>::words + syscall_arg_size<A7>::words + syscall_arg_size<A8>::words + syscall_arg_size<A9>::words + syscall_arg_size<A10>::words + syscall_arg_size<A11>::words + syscall_arg_size<A12>::words == N) ? 1 : -1 ] __attribute__((unused));
+	return &syscall_call12<R, A1, A2, A3, A4, A5, A6, A7, A8, A9, A10, A11, A12>;
+}
+
+template<typename R, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6, typename A7, typename A8, typename A9, typename A10, typename A11, typename A12, typename A13>
+NTSTATUS syscall_call13( void *func, ULONG *args )
+{
+	R (NTAPI *f)(A1, A2, A3, A4, A5, A6, A7, A8, A9, A10, A11, A12, A13) = (R (NTAPI *)(A1, A2, A3, A4, A5, A6, A7, A8, A9, A10, A11, A12, A13)) func;
+	ULONG *p1 = args;
+	ULONG *p2 = p1 + syscall_arg_size<A1>::words;
+	ULONG *p3 = p2 + syscall_arg_size<A2>::words;
+	ULONG *p4 = p3 + syscall_arg_size<A3>::words;
+	ULONG *p5 = p4 + syscall_arg_size<A4>::words;
+	ULONG *p6 = p5 + syscall_arg_size<A5>::words;
+	ULONG *p7 = p6 + syscall_arg_size<A6>::words;
+	ULONG *p8 = p7 + syscall_arg_size<A7>::words;
+	ULONG *p9 = p8 + syscall_arg_size<A8>::words;
+	ULONG *p10 = p9 + syscall_arg_size<A9>::words;
+	ULONG *p11 = p10 + syscall_arg_size<A10>::words;
+	ULONG *p12 = p11 + syscall_arg_size<A11>::words;
+	ULONG *p13 = p12 + syscall_arg_size<A12>::words;
+	return syscall_result( f( syscall_arg<A1>( p1 ), syscall_arg<A2>( p2 ), syscall_arg<A3>( p3 ), syscall_arg<A4>( p4 ), syscall_arg<A5>( p5 ), syscall_arg<A6>( p6 ), syscall_arg<A7>( p7 ), syscall_arg<A8>( p8 ), syscall_arg<A9>( p9 ), syscall_arg<A10>( p10 ), syscall_arg<A11>( p11 ), syscall_arg<A12>( p12 ), syscall_arg<A13>( p13 ) ) );
+}
+
+template<ULONG N, typename R, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6, typename A7, typename A8, typename A9, typename A10, typename A11, typename A12, typename A13>
+syscall_thunk_t get_syscall_thunk( R (NTAPI *)(A1, A2, A3, A4, A5, A6, A7, A8, A9, A10, A11, A12, A13) )
+{
+	typedef char wrong_number_of_args[ (syscall_arg_size<A1>::words + syscall_arg_size<A2>::words + syscall_arg_size<A3>::words + syscall_arg_size<A4>::words + syscall_arg_size<A5>::words + syscall_arg_size<A6>::words + syscall_arg_size<A7>::words + syscall_arg_size<A8>::words + syscall_arg_size<A9>::words + syscall_arg_size<A10>::words + syscall_arg_size<A11>::words + syscall_arg_size<A12>::words + syscall_arg_size<A13>::words == N) ? 1 : -1 ] __attribute__((unused));
+	return &syscall_call13<R, A1, A2, A3, A4, A5, A6, A7, A8, A9, A10, A11, A12, A13>;
+}
+
+template<typename R, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6, typename A7, typename A8, typename A9, typename A10, typename A11, typename A12, typename A13, typename A14>
+NTSTATUS syscall_call14( void *func, ULONG *args )
+{
+	R (NTAPI *f)(A1, A2, A3, A4, A5, A6, A7, A8, A9, A10, A11, A12, A13, A14) = (R (NTAPI *)(A1, A2, A3, A4, A5, A6, A7, A8, A9, A10, A11, A12, A13, A14)) func;
+	ULONG *p1 = args;
+	ULONG *p2 = p1 + syscall_arg_size<A1>::words;
+	ULONG *p3 = p2 + syscall_arg_size<A2>::words;
+	ULONG *p4 = p3 + syscall_arg_size<A3>::words;
+	ULONG *p5 = p4 + syscall_arg_size<A4>::words;
+	ULONG *p6 = p5 + syscall_arg_size<A5>::words;
+	ULONG *p7 = p6 + syscall_arg_size<A6>::words;
+	ULONG *p8 = p7 + syscall_arg_size<A7>::words;
+	ULONG *p9 = p8 + syscall_arg_size<A8>::words;
+	ULONG *p10 = p9 + syscall_arg_size<A9>::words;
+	ULONG *p11 = p10 + syscall_arg_size<A10>::words;
+	ULONG *p12 = p11 + syscall_arg_size<A11>::words;
+	ULONG *p13 = p12 + syscall_arg_size<A12>::words;
+	ULONG *p14 = p13 + syscall_arg_size<A13>::words;
+	return syscall_result( f( syscall_arg<A1>( p1 ), syscall_arg<A2>( p2 ), syscall_arg<A3>( p3 ), syscall_arg<A4>( p4 ), syscall_arg<A5>( p5 ), syscall_arg<A6>( p6 ), syscall_arg<A7>( p7 ), syscall_arg<A8>( p8 ), syscall_arg<A9>( p9 ), syscall_arg<A10>( p10 ), syscall_arg<A11>( p11 ), syscall_arg<A12>( p12 ), syscall_arg<A13>( p13 ), syscall_arg<A14>( p14 ) ) );
+}
+
+template<ULONG N, typename R, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6, typename A7, typename A8, typename A9, typename A10, typename A11, typename A12, typename A13, typename A14>
+syscall_thunk_t get_syscall_thunk( R (NTAPI *)(A1, A2, A3, A4, A5, A6, A7, A8, A9, A10, A11, A12, A13, A14) )
+{
+	typedef char wrong_number_of_args[ (syscall_arg_size<A1>::words + syscall_arg_size<A2>::words + syscall_arg_size<A3>::words + syscall_arg_size<A4>::words + syscall_arg_size<A5>::words + syscall_arg_size<A6>::words + syscall_arg_size<A7>::words + syscall_arg_size<A8>::words + syscall_arg_size<A9>::words + syscall_arg_size<A10>::words + syscall_arg_size<A11>::words + syscall_arg_size<A12>::words + syscall_arg_size<A13>::words + syscall_arg_size<A14>::words == N) ? 1 : -1 ] __attribute__((unused));
+	return &syscall_call14<R, A1, A2, A3, A4, A5, A6, A7, A8, A9, A10, A11, A12, A13, A14>;
+}
+
+template<typename R, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6, typename A7, typename A8, typename A9, typename A10, typename A11, typename A12, typename A13, typename A14, typename A15>
+NTSTATUS syscall_call15( void *func, ULONG *args )
+{
+	R (NTAPI *f)(A1, A2, A3, A4, A5, A6, A7, A8, A9, A10, A11, A12, A13, A14, A15) = (R (NTAPI *)(A1, A2, A3, A4, A5, A6, A7, A8, A9, A10, A11, A12, A13, A14, A15)) func;
+	ULONG *p1 = args;
+	ULONG *p2 = p1 + syscall_arg_size<A1>::words;
+	ULONG *p3 = p2 + syscall_arg_size<A2>::words;
+	ULONG *p4 = p3 + syscall_arg_size<A3>::words;
+	ULONG *p5 = p4 + syscall_arg_size<A4>::words;
+	ULONG *p6 = p5 + syscall_arg_size<A5>::words;
+	ULONG *p7 = p6 + syscall_arg_size<A6>::words;
+	ULONG *p8 = p7 + syscall_arg_size<A7>::words;
+	ULONG *p9 = p8 + syscall_arg_size<A8>::words;
+	ULONG *p10 = p9 + syscall_arg_size<A9>::words;
+	ULONG *p11 = p10 + syscall_arg_size<A10>::words;
+	ULONG *p12 = p11 + syscall_arg_size<A11>::words;
+	ULONG *p13 = p12 + syscall_arg_size<A12>::words;
+	ULONG *p14 = p13 + syscall_arg_size<A13>::words;
+	ULONG *p15 = p14 + syscall_arg_size<A14>::words;
+	return syscall_result( f( syscall_arg<A1>( p1 ), syscall_arg<A2>( p2 ), syscall_arg<A3>( p3 ), syscall_arg<A4>( p4 ), syscall_arg<A5>( p5 ), syscall_arg<A6>( p6 ), syscall_arg<A7>( p7 ), syscall_arg<A8>( p8 ), syscall_arg<A9>( p9 ), syscall_arg<A10>( p10 ), syscall_arg<A11>( p11 ), syscall_arg<A12>( p12 ), syscall_arg<A13>( p13 ), syscall_arg<A14>( p14 ), syscall_arg<A15>( p15 ) ) );
+}
+
+template<ULONG N, typename R, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6, typename A7, typename A8, typename A9, typename A10, typename A11, typename A12, typename A13, typename A14, typename A15>
+syscall_thunk_t get_syscall_thunk( R (NTAPI *)(A1, A2, A3, A4, A5, A6, A7, A8, A9, A10, A11, A12, A13, A14, A15) )
+{
+	typedef char wrong_number_of_args[ (syscall_arg_size<A1>::words + syscall_arg_size<A2>::words + syscall_arg_size<A3>::words + syscall_arg_size<A4>::words + syscall_arg_size<A5>::words + syscall_arg_size<A6>::words + syscall_arg_size<A7>::words + syscall_arg_size<A8>::words + syscall_arg_size<A9>::words + syscall_arg_size<A10>::words + syscall_arg_size<A11>::words + syscall_arg_size<A12>::words + syscall_arg_size<A13>::words + syscall_arg_size<A14>::words + syscall_arg_size<A15>::words == N) ? 1 : -1 ] __attribute__((unused));
+	return &syscall_call15<R, A1, A2, A3, A4, A5, A6, A7, A8, A9, A10, A11, A12, A13, A14, A15>;
+}
+
+template<typename R, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6, typename A7, typename A8, typename A9, typename A10, typename A11, typename A12, typename A13, typename A14, typename A15, typename A16>
+NTSTATUS syscall_call16( void *func, ULONG *args )
+{
+	R (NTAPI *f)(A1, A2, A3, A4, A5, A6, A7, A8, A9, A10, A11, A12, A13, A14, A15, A16) = (R (NTAPI *)(A1, A2, A3, A4, A5, A6, A7, A8, A9, A10, A11, A12, A13, A14, A15, A16)) func;
+	ULONG *p1 = args;
+	ULONG *p2 = p1 + syscall_arg_size<A1>::words;
+	ULONG *p3 = p2 + syscall_arg_size<A2>::words;
+	ULONG *p4 = p3 + syscall_arg_size<A3>::words;
+	ULONG *p5 = p4 + syscall_arg_size<A4>::words;
+	ULONG *p6 = p5 + syscall_arg_size<A5>::words;
+	ULONG *p7 = p6 + syscall_arg_size<A6>::words;
+	ULONG *p8 = p7 + syscall_arg_size<A7>::words;
+	ULONG *p9 = p8 + syscall_arg_size<A8>::words;
+	ULONG *p10 = p9 + syscall_arg_size<A9>::words;
+	ULONG *p11 = p10 + syscall_arg_size<A10>::words;
+	ULONG *p12 = p11 + syscall_arg_size<A11>::words;
+	ULONG *p13 = p12 + syscall_arg_size<A12>::words;
+	ULONG *p14 = p13 + syscall_arg_size<A13>::words;
+	ULONG *p15 = p14 + syscall_arg_size<A14>::words;
+	ULONG *p16 = p15 + syscall_arg_size<A15>::words;
+	return syscall_result( f( syscall_arg<A1>( p1 ), syscall_arg<A2>( p2 ), syscall_arg<A3>( p3 ), syscall_arg<A4>( p4 ), syscall_arg<A5>( p5 ), syscall_arg<A6>( p6 ), syscall_arg<A7>( p7 ), syscall_arg<A8>( p8 ), syscall_arg<A9>( p9 ), syscall_arg<A10>( p10 ), syscall_arg<A11>( p11 ), syscall_arg<A12>( p12 ), syscall_arg<A13>( p13 ), syscall_arg<A14>( p14 ), syscall_arg<A15>( p15 ), syscall_arg<A16>( p16 ) ) );
+}
+
+template<ULONG N, typename R, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6, typename A7, typename A8, typename A9, typename A10, typename A11, typename A12, typename A13, typename A14, typename A15, typename A16>
+syscall_thunk_t get_syscall_thunk( R (NTAPI *)(A1, A2, A3, A4, A5, A6, A7, A8, A9, A10, A11, A12, A13, A14, A15, A16) )
+{
+	typedef char wrong_number_of_args[ (syscall_arg_size<A1>::words + syscall_arg_size<A2>::words + syscall_arg_size<A3>::words + syscall_arg_size<A4>::words + syscall_arg_size<A5>::words + syscall_arg_size<A6>::words + syscall_arg_size<A7>::words + syscall_arg_size<A8>::words + syscall_arg_size<A9>::words + syscall_arg_size<A10>::words + syscall_arg_size<A11>::words + syscall_arg_size<A12>::words + syscall_arg_size<A13>::words + syscall_arg_size<A14>::words + syscall_arg_size<A15>::words + syscall_arg_size<A16>::words == N) ? 1 : -1 ] __attribute__((unused));
+	return &syscall_call16<R, A1, A2, A3, A4, A5, A6, A7, A8, A9, A10, A11, A12, A13, A14, A15, A16>;
+}
+
+#endif // __SYSCALL_THUNK_H__
@@ -42,18 +42,17 @@
 
 class thread_impl_t;
 
-class thread_obj_wait_t;
-typedef list_anchor<thread_obj_wait_t, 0> thread_obj_wait_list_t;
-typedef list_element<thread_obj_wait_t> thread_obj_wait_element_t;
-typedef list_iter<thread_obj_wait_t, 0> thread_obj_wait_iter_t;
-
+// One of these for each object a thread can wait on.
+// They're embedded in the thread and reused, so waiting doesn't allocate.
 struct thread_obj_wait_t : public watch_t
 {
-	thread_obj_wait_element_t entry[1];
 	sync_object_t *obj;
 	thread_impl_t *thread;
+	ULONG index;
 public:
-	thread_obj_wait_t( thread_impl_t* t, sync_object_t* o);
+	thread_obj_wait_t();
+	void attach( thread_impl_t* t, sync_object_t* o, ULONG i );
+	void detach();
 	virtual void notify();
 	virtual ~thread_obj_wait_t();
 	BOOLEAN is_signalled() { return obj->is_signalled(); }
@@ -114,7 +113,9 @@ class thread_impl_t :
 	BOOLEAN alerted;
 
 	// blocking objects
-	thread_obj_wait_list_t wait_list;
+	thread_obj_wait_t wait_block[MAXIMUM_WAIT_OBJECTS];
+	ULONG wait_count;
+	ULONGLONG wait_signalled;	// bit per wait_block notified
 	BOOLEAN Alertable;
 	WAIT_TYPE WaitType;
 	BOOLEAN in_wait;
@@ -136,6 +137,12 @@ class thread_impl_t :
 	bool trace_step_access;
 	void *trace_accessed_address;
 
+	// scheduling statistics, used to size time slices
+	ULONG slice;		// milliseconds, for the adaptive policy
+	ULONG run_time;		// microseconds per entry to user space, averaged
+	ULONG syscall_count;
+	ULONG fault_count;
+
 public:
 	thread_impl_t( process_t *p );
 	~thread_impl_t();
@@ -172,14 +179,19 @@ public:
 	bool win32k_init_complete();
 
 	virtual int run();
+	void get_slice( LARGE_INTEGER& timeout, int& max_runs );
+	void account_slice( LARGE_INTEGER& timeout, ULONG used );
 
 	// wait related functions
 	NTSTATUS wait_on_handles( ULONG count, PHANDLE handles, WAIT_TYPE type, BOOLEAN alert, PLARGE_INTEGER timeout );
+	NTSTATUS wait_on_object( sync_object_t *obj, BOOLEAN alert, PLARGE_INTEGER timeout );
+	NTSTATUS do_wait( WAIT_TYPE type, BOOLEAN alert, PLARGE_INTEGER timeout );
 	NTSTATUS check_wait();
 	NTSTATUS wait_on( sync_object_t *obj );
 	NTSTATUS check_wait_all();
 	NTSTATUS check_wait_any();
 	void end_wait();
+	void notify_signalled( ULONG index );
 	virtual void signal_timeout(); // timeout_t
 	NTSTATUS delay_execution( LARGE_INTEGER& timeout );
 	void start();
@@ -222,6 +234,67 @@ ULONG runlist_entry_t::num_active_threads()
 	return num_running_threads;
 }
 
+// Threads woken by the thread that created the active handoff_t.
+// Waking a thread puts it on the run list right after the current fiber,
+//  so a waker that blocks already switches to it.
+// The handoff covers the case where the waker keeps running.
+static thread_t *handoff_waker;
+static thread_impl_t *handoff_thread;
+static ULONG handoff_count;
+
+static void handoff_note( thread_impl_t *t )
+{
+	if (!handoff_waker || handoff_waker != current)
+		return;
+	handoff_thread = t;
+	handoff_count++;
+}
+
+static void handoff_forget( thread_t *t )
+{
+	if (handoff_thread == t || handoff_waker == t)
+	{
+		handoff_waker = 0;
+		handoff_thread = 0;
+		handoff_count = 0;
+	}
+}
+
+handoff_t::handoff_t()
+{
+	handoff_waker = current;
+	handoff_thread = 0;
+	handoff_count = 0;
+}
+
+handoff_t::~handoff_t()
+{
+	if (handoff_waker == current)
+		handoff_forget( current );
+}
+
+void handoff_t::switch_to_woken()
+{
+	// another thread took over the handoff while we were blocked
+	if (handoff_waker != current)
+		return;
+
+	thread_impl_t *t = handoff_thread;
+	ULONG count = handoff_count;
+	handoff_forget( current );
+
+	// several threads woken, let the round robin sort them out
+	if (count != 1 || !t)
+		return;
+
+	if (t == current || t->is_terminated() || !t->is_started())
+		return;
+
+	thread_t *self = current;
+	fiber_t::yield_to( t );
+	current = self;
+}
+
 int thread_impl_t::set_initial_regs( void *start, void *stack)
 {
 	process->vm->init_context( ctx );
@@ -360,6 +433,7 @@ BOOLEAN thread_impl_t::software_interrupt( BYTE number )
 
 	ctx.Eip += 2;
 	context_changed = FALSE;
+	syscall_count++;
 
 	NTSTATUS r;
 	switch (number)
@@ -413,6 +487,7 @@ bool thread_impl_t::traced_access()
 
 void thread_impl_t::handle_user_segv( ULONG code )
 {
+	fault_count++;
 	trace("%04lx: exception at %08lx\n", trace_id(), ctx.Eip);
 	if (option_trace)
 	{
@@ -838,6 +913,96 @@ void thread_t::stop()
 	current = this;
 }
 
+struct scheduler_policy_list {
+	const char *name;
+	bool adaptive;
+};
+
+struct scheduler_policy_list scheduler_policies[] = {
+	{ "fixed", false, },
+	{ "adaptive", true, },
+	{ NULL, false, },
+};
+
+static bool adaptive_slices;
+
+// time slices in milliseconds, and the time a thread may keep the
+// processor for in microseconds before others get a turn
+static const ULONG default_slice = 10;
+static const ULONG max_slice = 50;
+static const ULONG max_turn_time = 50000;
+
+bool set_scheduler_policy( const char *policy )
+{
+	for (int i=0; scheduler_policies[i].name; i++)
+	{
+		if (!strcmp(scheduler_policies[i].name, policy))
+		{
+			adaptive_slices = scheduler_policies[i].adaptive;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void list_scheduler_policies()
+{
+	for (int i=0; scheduler_policies[i].name; i++)
+		printf("%s ", scheduler_policies[i].name);
+}
+
+// Decide how long to run user code for (in milliseconds),
+//  and how many times to reenter user space before yielding.
+// The fixed policy always gives 10ms, and up to 11 reentries.
+// The adaptive policy sizes both from how long the thread
+//  has been running each time it entered user space.
+void thread_impl_t::get_slice( LARGE_INTEGER& timeout, int& max_runs )
+{
+	timeout.QuadPart = default_slice;
+	max_runs = 11;
+
+	if (!adaptive_slices)
+		return;
+
+	timeout.QuadPart = slice;
+
+	// keep the thread until it has had about max_turn_time,
+	//  so threads running for long stretches rotate after one
+	// the first run is not a reentry
+	ULONG run = run_time ? run_time : 1;
+	max_runs = max_turn_time / run;
+	if (max_runs > 0)
+		max_runs--;
+	if (max_runs > 10)
+		max_runs = 10;
+
+	// threads taking lots of exceptions rotate quickly
+	if (fault_count > syscall_count/4 + 4)
+		max_runs = min( max_runs, 2 );
+}
+
+// used is in microseconds, timeout is in milliseconds
+void thread_impl_t::account_slice( LARGE_INTEGER& timeout, ULONG used )
+{
+	// weighted average, so a single long run doesn't change things much
+	run_time = (run_time * 3 + used) / 4;
+
+	// threads that run until the timer stops them get longer slices,
+	//  others go back to the default
+	if (used >= timeout.QuadPart * 750)
+		slice = min( slice * 2, max_slice );
+	else if (run_time < slice * 250)
+		slice = max( slice / 2, default_slice );
+
+	// decay the counts so they reflect recent behaviour
+	if (syscall_count + fault_count > 0x100)
+	{
+		syscall_count /= 2;
+		fault_count /= 2;
+	}
+}
+
 int thread_impl_t::run()
 {
 	int i = 0;
@@ -854,12 +1019,24 @@ int thread_impl_t::run()
 			assert (0);
 		}
 
-		// run for 10ms
+		// run for 10ms, or as long as the policy says
 		LARGE_INTEGER timeout;
-		timeout.QuadPart = 10L; // 10ms
+		int max_runs;
+		get_slice( timeout, max_runs );
+
+		LARGE_INTEGER start;
+		start.QuadPart = 0;
+		if (adaptive_slices)
+			start = timeout_t::monotonic_time();
 
 		process->vm->run( TebBaseAddress, &ctx, false, timeout, this );
 
+		if (adaptive_slices)
+		{
+			LARGE_INTEGER end = timeout_t::monotonic_time();
+			account_slice( timeout, (end.QuadPart - start.QuadPart) / 10 );
+		}
+
 		if (trace_step_access)
 		{
 			// enable access to the memory, then single step over the access
@@ -876,7 +1053,7 @@ int thread_impl_t::run()
 		}
 
 		// keep running the same thread for a while
-		if (ThreadState == StateRunning && i<=10)
+		if (ThreadState == StateRunning && i<max_runs)
 		{
 			i++;
 			continue;
@@ -921,6 +1098,12 @@ void thread_impl_t::handle_breakpoint()
 	handle_user_segv( STATUS_BREAKPOINT );
 }
 
+static object_type_t thread_type( "Thread",
+	STANDARD_RIGHTS_READ | THREAD_GET_CONTEXT | THREAD_QUERY_INFORMATION,
+	STANDARD_RIGHTS_WRITE | THREAD_TERMINATE | THREAD_SUSPEND_RESUME | THREAD_SET_INFORMATION | THREAD_SET_CONTEXT,
+	STANDARD_RIGHTS_EXECUTE | SYNCHRONIZE,
+	THREAD_ALL_ACCESS );
+
 thread_t::thread_t(process_t *p) :
 	fiber_t( fiber_default_stack_size ),
 	process( p ),
@@ -928,6 +1111,7 @@ thread_t::thread_t(process_t *p) :
 	port(0),
 	queue(0)
 {
+	set_type( &thread_type );
 	id = allocate_id();
 	addref( process );
 	process->threads.append( this );
@@ -950,6 +1134,8 @@ thread_impl_t::thread_impl_t( process_t *p ) :
 	TebBaseAddress(0),
 	teb(0),
 	alerted(0),
+	wait_count(0),
+	wait_signalled(0),
 	Alertable(0),
 	WaitType(WaitAny),
 	in_wait(0),
@@ -959,7 +1145,11 @@ thread_impl_t::thread_impl_t( process_t *p ) :
 	callback_frame(0),
 	win32k_init_done(false),
 	trace_step_access(false),
-	trace_accessed_address(0)
+	trace_accessed_address(0),
+	slice(default_slice),
+	run_time(0),
+	syscall_count(0),
+	fault_count(0)
 {
 
 	times.CreateTime = timeout_t::current_time();
@@ -997,6 +1187,11 @@ void thread_impl_t::query_information( KERNEL_USER_TIMES& info )
 
 thread_impl_t::~thread_impl_t()
 {
+	handoff_forget( this );
+
+	// stop watching objects if we were terminated while waiting
+	end_wait();
+
 	// delete outstanding APCs
 	while (apc_list.empty())
 	{
@@ -1050,18 +1245,34 @@ NTSTATUS NTAPI NtSuspendThread(
 	return STATUS_NOT_IMPLEMENTED;
 }
 
-thread_obj_wait_t::thread_obj_wait_t( thread_impl_t* t, sync_object_t* o):
-	obj(o),
-	thread(t)
+thread_obj_wait_t::thread_obj_wait_t():
+	obj(0),
+	thread(0),
+	index(0)
 {
+}
+
+void thread_obj_wait_t::attach( thread_impl_t* t, sync_object_t* o, ULONG i )
+{
+	assert( !obj );
+	obj = o;
+	thread = t;
+	index = i;
 	addref(obj);
 	obj->add_watch( this );
 }
 
+void thread_obj_wait_t::detach()
+{
+	obj->remove_watch( this );
+	release(obj);
+	obj = 0;
+}
+
 void thread_obj_wait_t::notify()
 {
 	//trace("waking %p\n", thread);
-	thread->notify();
+	thread->notify_signalled( index );
 }
 
 void thread_impl_t::start()
@@ -1078,6 +1289,8 @@ void thread_t::wait()
 
 void thread_impl_t::wait()
 {
+	// blocking switches to the last thread woken anyway
+	handoff_forget( this );
 	set_state( StateWait );
 	thread_t::wait();
 	set_state( StateRunning );
@@ -1096,83 +1309,83 @@ NTSTATUS thread_impl_t::check_wait()
 
 thread_obj_wait_t::~thread_obj_wait_t()
 {
-	obj->remove_watch( this );
-	release(obj);
+	assert( !obj );
 }
 
 NTSTATUS thread_impl_t::wait_on( sync_object_t *obj )
 {
-	thread_obj_wait_t *wait = new thread_obj_wait_t( this, obj );
-	if (!wait)
-		return STATUS_NO_MEMORY;
+	assert( wait_count < MAXIMUM_WAIT_OBJECTS );
 
-	// Append to list so value in check_wait_any() is right.
-	wait_list.append( wait );
+	// the index of the block is the value check_wait_any() returns
+	wait_block[wait_count].attach( this, obj, wait_count );
+	wait_count++;
 	return STATUS_SUCCESS;
 }
 
 void thread_impl_t::end_wait()
 {
-	thread_obj_wait_iter_t i(wait_list);
-
-	while (i)
-	{
-		thread_obj_wait_t *wait = i;
-		i.next();
-		wait_list.unlink( wait );
-		delete wait;
-	}
+	for (ULONG i=0; i<wait_count; i++)
+		wait_block[i].detach();
+	wait_count = 0;
+	wait_signalled = 0;
 }
 
 NTSTATUS thread_impl_t::check_wait_all()
 {
-	thread_obj_wait_iter_t i(wait_list);
-
-	while (i)
-	{
-		thread_obj_wait_t *wait = i;
+	ULONG i;
 
-		if (!wait->obj->is_signalled())
+	for (i=0; i<wait_count; i++)
+		if (!wait_block[i].is_signalled())
 			return STATUS_PENDING;
-		i.next();
-	}
 
-	i.reset();
-	while (i)
-	{
-		thread_obj_wait_t *wait = i;
-		wait->obj->satisfy();
-		i.next();
-	}
+	for (i=0; i<wait_count; i++)
+		wait_block[i].satisfy();
+
 	return STATUS_SUCCESS;
 }
 
 NTSTATUS thread_impl_t::check_wait_any()
 {
-	thread_obj_wait_iter_t i(wait_list);
-	ULONG ret = 0; // return handle index to thread
+	ULONG i;
 
-	while (i)
+	// try objects that told us they were signalled, lowest index first
+	while (wait_signalled)
 	{
-		thread_obj_wait_t *wait = i;
+		i = __builtin_ctzll( wait_signalled );
+		wait_signalled &= ~(1ULL << i);
+		if (i < wait_count && wait_block[i].is_signalled())
+		{
+			wait_block[i].satisfy();
+			wait_signalled = 0;
+			return i;
+		}
+	}
 
-		i.next();
-		if (wait->is_signalled())
+	// first time through, or somebody else took the object
+	for (i=0; i<wait_count; i++)
+	{
+		if (wait_block[i].is_signalled())
 		{
-			wait->satisfy();
-			return ret;
+			wait_block[i].satisfy();
+			return i;
 		}
-		ret++;
 	}
 	return STATUS_PENDING;
 }
 
+void thread_impl_t::notify_signalled( ULONG index )
+{
+	wait_signalled |= (1ULL << index);
+	notify();
+}
+
 void thread_impl_t::notify()
 {
 	if (!in_wait)
 		return;
 	in_wait = FALSE;
 	start();
+	handoff_note( this );
 }
 
 void thread_impl_t::signal_timeout()
@@ -1189,9 +1402,6 @@ NTSTATUS thread_impl_t::wait_on_handles(
 {
 	NTSTATUS r = STATUS_SUCCESS;
 
-	Alertable = alert;
-	WaitType = type;
-
 	// iterate the array and wait on each handle
 	for (ULONG i=0; i<count; i++)
 	{
@@ -1204,7 +1414,7 @@ NTSTATUS thread_impl_t::wait_on_handles(
 			return r;
 		}
 
-		sync_object_t *obj = dynamic_cast<sync_object_t*>( any );
+		sync_object_t *obj = any->get_sync_object();
 		if (!obj)
 		{
 			end_wait();
@@ -1219,6 +1429,25 @@ NTSTATUS thread_impl_t::wait_on_handles(
 		}
 	}
 
+	return do_wait( type, alert, timeout );
+}
+
+NTSTATUS thread_impl_t::wait_on_object( sync_object_t *obj, BOOLEAN alert, PLARGE_INTEGER timeout )
+{
+	NTSTATUS r = wait_on( obj );
+	if (r < STATUS_SUCCESS)
+		return r;
+	return do_wait( WaitAny, alert, timeout );
+}
+
+// wait for the objects in wait_block
+NTSTATUS thread_impl_t::do_wait( WAIT_TYPE type, BOOLEAN alert, PLARGE_INTEGER timeout )
+{
+	NTSTATUS r;
+
+	Alertable = alert;
+	WaitType = type;
+
 	// make sure we wait for a little bit every time
 	LARGE_INTEGER t;
 	if (timeout && timeout->QuadPart <= 0 && timeout->QuadPart> -100000LL)
@@ -1258,6 +1487,13 @@ NTSTATUS thread_impl_t::wait_on_handles(
 	return r;
 }
 
+NTSTATUS wait_on_object( sync_object_t *obj, BOOLEAN alertable, PLARGE_INTEGER timeout )
+{
+	thread_impl_t *t = dynamic_cast<thread_impl_t*>( current );
+	assert( t );
+	return t->wait_on_object( obj, alertable, timeout );
+}
+
 NTSTATUS thread_impl_t::alert()
 {
 	alerted = TRUE;
@@ -1280,7 +1516,7 @@ NTSTATUS NTAPI NtWaitForSingleObject(
 	if (r < STATUS_SUCCESS)
 		return r;
 
-	sync_object_t *obj = dynamic_cast<sync_object_t*>( any );
+	sync_object_t *obj = any->get_sync_object();
 	if (!obj)
 		return STATUS_INVALID_HANDLE;
 
@@ -1295,7 +1531,7 @@ NTSTATUS NTAPI NtWaitForSingleObject(
 
 	thread_impl_t *t = dynamic_cast<thread_impl_t*>( current );
 	assert( t );
-	return t->wait_on_handles( 1, &Handle, WaitAny, Alertable, Timeout );
+	return t->wait_on_object( obj, Alertable, Timeout );
 }
 
 NTSTATUS NTAPI NtWaitForMultipleObjects(
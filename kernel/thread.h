@@ -132,6 +132,19 @@ int run_thread(fiber_t *arg);
 
 extern thread_t *current;
 
+// Records the threads woken by the current thread while it exists.
+// If exactly one was woken, switch_to_woken() gives it the processor
+//  directly instead of leaving it to wait for the round robin.
+class handoff_t
+{
+public:
+	handoff_t();
+	~handoff_t();
+	void switch_to_woken();
+};
+
+NTSTATUS wait_on_object( sync_object_t *obj, BOOLEAN alertable, PLARGE_INTEGER timeout );
+
 void send_terminate_message( thread_t *thread, object_t *port, LARGE_INTEGER& create_time );
 bool send_exception( thread_t *thread, EXCEPTION_RECORD &rec );
 
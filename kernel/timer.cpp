@@ -20,8 +20,11 @@
 
 
 #include <stdarg.h>
+#include <stdlib.h>
 #include <sys/time.h>
 #include <time.h>
+#include <signal.h>
+#include <pthread.h>
 #include "ntstatus.h"
 #define WIN32_NO_STATUS
 #include "windef.h"
@@ -35,6 +38,7 @@
 
 timeout_list_t timeout_t::g_timeouts;
 static LARGE_INTEGER boot_time;
+static struct timespec boot_monotonic;
 static ULONG tick_count;
 
 bool timeout_t::has_expired()
@@ -63,7 +67,10 @@ bool timeout_t::queue_is_valid()
 // returns false if there were no timers
 bool timeout_t::check_timers(LARGE_INTEGER& ret)
 {
-	LARGE_INTEGER now = current_time();
+	// refreshes the shared user page if the clock thread isn't running
+	current_time();
+
+	LARGE_INTEGER now = monotonic_time();
 	timeout_t *t;
 
 	if (!g_timeouts.head())
@@ -92,7 +99,7 @@ bool timeout_t::check_timers(LARGE_INTEGER& ret)
 //        to avoid conflicting return values
 void timeout_t::time_remaining( LARGE_INTEGER& remaining )
 {
-	LARGE_INTEGER now = current_time();
+	LARGE_INTEGER now = monotonic_time();
 	remaining.QuadPart = expires.QuadPart - now.QuadPart;
 }
 
@@ -110,11 +117,18 @@ void timeout_t::set_timeout(PLARGE_INTEGER t)
 		return;
 	}
 
-	LARGE_INTEGER now = current_time();
+	// expiry times are kept on the monotonic clock, so changing the
+	// host's time only moves timeouts given as an absolute time
+	LARGE_INTEGER now = monotonic_time();
 	if (t->QuadPart <= 0LL)
 		expires.QuadPart = now.QuadPart - t->QuadPart;
 	else
-		expires.QuadPart = t->QuadPart;
+	{
+		LARGE_INTEGER system_now = current_time();
+		expires.QuadPart = now.QuadPart;
+		if (t->QuadPart > system_now.QuadPart)
+			expires.QuadPart += t->QuadPart - system_now.QuadPart;
+	}
 
 	// check there wasn't an overflow
 	if (expires.QuadPart < 0LL)
@@ -159,38 +173,95 @@ const ULONGLONG secsperday = 86400;
 const ULONGLONG secs_1601_to_1970 = (369 * 365 + 89) * secsperday;
 const ULONGLONG ticks_1601_to_1970 = secs_1601_to_1970 * tickspersec;
 
-LARGE_INTEGER timeout_t::current_time()
+#ifndef CLOCK_REALTIME_COARSE
+#define CLOCK_REALTIME_COARSE CLOCK_REALTIME
+#endif
+
+// milliseconds between updates of the time in the shared user page
+// by the clock thread, zero means only update it from the kernel
+static ULONG clock_interval = 10;
+static pthread_t clock_thread;
+static volatile bool clock_thread_running;
+
+static LARGE_INTEGER get_system_time()
 {
-	struct timeval tv;
+	struct timespec ts;
 
-	// timeofday gives seconds and milliseconds since 01-01-1970 00:00:00
+	// the coarse clock is much cheaper than gettimeofday
+	// the epoch is 01-01-1970 00:00:00
 	// windows uses 01-01-1601 00:00:00
-	gettimeofday(&tv, NULL);
+	clock_gettime( CLOCK_REALTIME_COARSE, &ts );
+	LARGE_INTEGER ret;
+	ret.QuadPart = ts.tv_sec * tickspersec + ts.tv_nsec / 100;
+	ret.QuadPart += ticks_1601_to_1970;
+	return ret;
+}
+
+LARGE_INTEGER nt_time_from_unix( long sec, long nsec )
+{
 	LARGE_INTEGER ret;
-	ret.QuadPart = (tv.tv_sec * 1000000LL + tv.tv_usec) * 10LL;
+	ret.QuadPart = sec * tickspersec + nsec / 100;
 	ret.QuadPart += ticks_1601_to_1970;
+	return ret;
+}
 
-	// calculate the tick count
-	tick_count = (ret.QuadPart - boot_time.QuadPart) / 10000LL;
+// milliseconds since boot, unaffected by changes to the system time
+static ULONG get_ms_since_boot()
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (ts.tv_sec - boot_monotonic.tv_sec) * 1000LL +
+		(ts.tv_nsec - boot_monotonic.tv_nsec) / 1000000LL;
+}
+
+static void update_shared_time( LARGE_INTEGER& now, ULONG ticks )
+{
+	KUSER_SHARED_DATA *shm = shared_memory_address;
+	if (!shm)
+		return;
 
 	// update the time in shared memory
 	// High1Time and High2Time need to be the same,
 	// as userspace loops waiting for them to be equal
 	// presumably to avoid a race when the LowPart overflows
-	if (shared_memory_address)
-	{
-		KSYSTEM_TIME& st = shared_memory_address->SystemTime;
-		st.LowPart = ret.LowPart;
-		st.High1Time = ret.HighPart;
-		st.High2Time = ret.HighPart;
-
-		// http://uninformed.org/index.cgi?v=2&a=2&p=18
-		// milliseconds since boot (T)
-		// T = shr(TickCountLow * TickCountMultiplier, 24)
-		shared_memory_address->TickCountMultiplier = 0x100000;
-		shared_memory_address->TickCountLow = ((tick_count * 0x01000000LL)/shared_memory_address->TickCountMultiplier);
-	}
+	// Write them in the same order as Windows does,
+	// as the clock thread may update them while userspace is reading.
+	KSYSTEM_TIME& st = shm->SystemTime;
+	st.High2Time = now.HighPart;
+	__sync_synchronize();
+	st.LowPart = now.LowPart;
+	__sync_synchronize();
+	st.High1Time = now.HighPart;
+
+	// http://uninformed.org/index.cgi?v=2&a=2&p=18
+	// milliseconds since boot (T)
+	// T = shr(TickCountLow * TickCountMultiplier, 24)
+	shm->TickCountMultiplier = 0x100000;
+	shm->TickCountLow = ((ticks * 0x01000000LL)/shm->TickCountMultiplier);
+}
 
+// in 100ns units from an arbitrary start, for measuring intervals
+LARGE_INTEGER timeout_t::monotonic_time()
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	LARGE_INTEGER ret;
+	ret.QuadPart = ts.tv_sec * tickspersec + ts.tv_nsec / 100;
+	return ret;
+}
+
+LARGE_INTEGER timeout_t::current_time()
+{
+	LARGE_INTEGER ret = get_system_time();
+
+	// calculate the tick count
+	tick_count = get_ms_since_boot();
+
+	// the clock thread keeps shared memory up to date if it's running
+	if (!clock_thread_running)
+		update_shared_time( ret, tick_count );
 
 	return ret;
 }
@@ -204,7 +275,10 @@ ULONG timeout_t::get_tick_count()
 void get_system_time_of_day( SYSTEM_TIME_OF_DAY_INFORMATION& time_of_day )
 {
 	if (!boot_time.QuadPart)
+	{
+		clock_gettime( CLOCK_MONOTONIC, &boot_monotonic );
 		boot_time = timeout_t::current_time();
+	}
 
 	time_of_day.CurrentTime = timeout_t::current_time();
 	time_of_day.BootTime = boot_time;
@@ -212,6 +286,64 @@ void get_system_time_of_day( SYSTEM_TIME_OF_DAY_INFORMATION& time_of_day )
 	time_of_day.CurrentTimeZoneId = 0;
 }
 
+// Keeps the time in the shared user page moving while user code runs,
+//  so programs spinning on GetTickCount or GetSystemTimeAsFileTime
+//  don't see a frozen clock until they next enter the kernel.
+// This is the only other thread in the kernel, and it only writes
+//  the time fields of the shared user page.
+static void *clock_thread_proc( void *arg )
+{
+	struct timespec interval;
+	interval.tv_sec = clock_interval / 1000;
+	interval.tv_nsec = (clock_interval % 1000) * 1000000L;
+
+	while (clock_thread_running)
+	{
+		LARGE_INTEGER now = get_system_time();
+		update_shared_time( now, get_ms_since_boot() );
+		nanosleep( &interval, NULL );
+	}
+	return NULL;
+}
+
+bool set_clock_interval( const char *ms )
+{
+	char *end = 0;
+	long val = strtol( ms, &end, 10 );
+	if (!*ms || *end || val < 0 || val > 1000)
+		return false;
+	clock_interval = val;
+	return true;
+}
+
+void start_clock_thread()
+{
+	if (!clock_interval || clock_thread_running)
+		return;
+
+	// leave the signals (SIGALRM in particular) to the main thread
+	sigset_t all, old;
+	sigfillset( &all );
+	pthread_sigmask( SIG_BLOCK, &all, &old );
+
+	clock_thread_running = true;
+	if (0 != pthread_create( &clock_thread, NULL, &clock_thread_proc, NULL ))
+	{
+		trace("failed to start clock thread\n");
+		clock_thread_running = false;
+	}
+
+	pthread_sigmask( SIG_SETMASK, &old, NULL );
+}
+
+void stop_clock_thread()
+{
+	if (!clock_thread_running)
+		return;
+	clock_thread_running = false;
+	pthread_join( clock_thread, NULL );
+}
+
 void timeout_t::do_timeout()
 {
 	// remove first so we can be added again
@@ -242,6 +374,12 @@ public:
 	void cancel( BOOLEAN& prev );
 };
 
+static object_type_t timer_type( "Timer",
+	STANDARD_RIGHTS_READ | TIMER_QUERY_STATE,
+	STANDARD_RIGHTS_WRITE | TIMER_MODIFY_STATE,
+	STANDARD_RIGHTS_EXECUTE | SYNCHRONIZE,
+	TIMER_ALL_ACCESS );
+
 nttimer_t::nttimer_t() :
 	expired(FALSE),
 	interval(0),
@@ -249,6 +387,7 @@ nttimer_t::nttimer_t() :
 	apc_routine(0),
 	apc_context(0)
 {
+	set_type( &timer_type );
 }
 
 nttimer_t::~nttimer_t()
@@ -46,6 +46,7 @@ public:
 	void set(PLARGE_INTEGER t);
 	virtual ~timeout_t();
 	static LARGE_INTEGER current_time();
+	static LARGE_INTEGER monotonic_time();
 	static ULONG get_tick_count();
 	void do_timeout();
 	void set_timeout(PLARGE_INTEGER t);
@@ -58,5 +59,10 @@ public:
 };
 
 void get_system_time_of_day( SYSTEM_TIME_OF_DAY_INFORMATION& time_of_day );
+LARGE_INTEGER nt_time_from_unix( long sec, long nsec );
+
+bool set_clock_interval( const char *ms );
+void start_clock_thread();
+void stop_clock_thread();
 
 #endif // __TIMER_H__
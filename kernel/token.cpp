@@ -664,8 +664,15 @@ public:
 	NTSTATUS add( LUID_AND_ATTRIBUTES& la );
 };
 
+static object_type_t token_type( "Token",
+	TOKEN_READ,
+	TOKEN_WRITE,
+	TOKEN_EXECUTE,
+	TOKEN_ALL_ACCESS );
+
 token_impl_t::token_impl_t()
 {
+	set_type( &token_type );
 	// FIXME: make this a default local computer account with privileges disabled
 	LUID_AND_ATTRIBUTES la;
 
@@ -0,0 +1,358 @@
+/*
+ * Copyright 2006-2008 Mike McCormack
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/*
+ * Decode a binary trace written with ring3k --trace-file into the
+ * same text that --trace writes to stderr.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "bintrace.h"
+
+struct string_def {
+	struct string_def *next;
+	uint32_t id;
+	char text[1];
+};
+
+#define STRING_HASH_SIZE 0x1000
+
+static struct string_def *string_hash[STRING_HASH_SIZE];
+static int show_timestamps;
+
+static void define_string( uint32_t id, const char *text, uint32_t len )
+{
+	struct string_def **p = &string_hash[(id >> 2) % STRING_HASH_SIZE];
+	struct string_def *def;
+
+	// strings are constants in the kernel, so the first definition holds
+	for (def = *p; def; def = def->next)
+		if (def->id == id)
+			return;
+
+	def = malloc( sizeof *def + len );
+	if (!def)
+		return;
+	memcpy( def->text, text, len );
+	def->text[len] = 0;
+	def->id = id;
+	def->next = *p;
+	*p = def;
+}
+
+// unknown is filled in if the string has no definition
+static const char *lookup_string( uint32_t id, char *unknown )
+{
+	struct string_def *def;
+
+	for (def = string_hash[(id >> 2) % STRING_HASH_SIZE]; def; def = def->next)
+		if (def->id == id)
+			return def->text;
+
+	// the definition has been overwritten in the ring
+	sprintf( unknown, "<%08x>", id );
+	return unknown;
+}
+
+struct payload {
+	const uint8_t *data;
+	uint32_t length;
+	uint32_t ofs;
+};
+
+static uint32_t get_word( struct payload *pl )
+{
+	uint32_t w = 0;
+	if (pl->ofs + 4 <= pl->length)
+		memcpy( &w, pl->data + pl->ofs, 4 );
+	pl->ofs += 4;
+	return w;
+}
+
+static uint64_t get_quad( struct payload *pl )
+{
+	uint64_t q = get_word( pl );
+	q |= (uint64_t) get_word( pl ) << 32;
+	return q;
+}
+
+static const char *get_text( struct payload *pl, char *buffer, uint32_t size )
+{
+	uint32_t len = get_word( pl );
+	if (len > size - 1)
+		len = size - 1;
+	if (pl->ofs + len > pl->length)
+		len = pl->ofs < pl->length ? pl->length - pl->ofs : 0;
+	memcpy( buffer, pl->data + pl->ofs, len );
+	buffer[len] = 0;
+	pl->ofs += (len + 3) & ~3;
+	return buffer;
+}
+
+static void dump_syscall_enter( uint32_t id, struct payload *pl )
+{
+	char unknown[16];
+	const char *name = lookup_string( get_word( pl ), unknown );
+	uint32_t retaddr = get_word( pl );
+	uint32_t numargs = get_word( pl );
+	uint32_t i;
+
+	printf("%04x: %s(", id, name );
+	for (i=0; i<numargs; i++)
+		printf(i ? ",%08x" : "%08x", get_word( pl ));
+	printf(") ret=%08x\n", retaddr);
+}
+
+static void dump_syscall_exit( uint32_t id, struct payload *pl )
+{
+	char unknown[16];
+	const char *name = lookup_string( get_word( pl ), unknown );
+	uint32_t r = get_word( pl );
+	uint32_t retaddr = get_word( pl );
+
+	printf("%04x: %s retval=%08x ret=%08x\n", id, name, r, retaddr);
+}
+
+// reformat a trace() message the same way debugprintf does
+static void dump_message( struct payload *pl )
+{
+	char unknown_func[16], unknown_fmt[16];
+	const char *func = lookup_string( get_word( pl ), unknown_func );
+	const char *fmt = lookup_string( get_word( pl ), unknown_fmt );
+	char fstr[16], text[0x101];
+	int i, is_longlong;
+
+	printf("%s ", func);
+
+	while (*fmt)
+	{
+		if (fmt[0] != '%')
+		{
+			putchar( *fmt++ );
+			continue;
+		}
+
+		if (fmt[1] == '%')
+		{
+			putchar( '%' );
+			fmt += 2;
+			continue;
+		}
+
+		i = 0;
+		fstr[i++] = *fmt++;
+
+		if (*fmt == '-')
+			fstr[i++] = *fmt++;
+
+		while (*fmt >= '0' && *fmt <= '9' && i < 10)
+			fstr[i++] = *fmt++;
+
+		is_longlong = 0;
+		if (*fmt == 'l')
+			fmt++;
+		if (*fmt == 'l')
+		{
+			fmt++;
+			is_longlong = 1;
+			fstr[i++] = 'l';
+			fstr[i++] = 'l';
+		}
+
+		fstr[i++] = *fmt;
+		fstr[i++] = 0;
+
+		switch (*fmt)
+		{
+		case 'p':
+			if ((fmt[1] == 'w' || fmt[1] == 'u') && fmt[2] == 's')
+			{
+				fputs( get_text( pl, text, sizeof text ), stdout );
+				fmt += 2;
+			}
+			else
+			{
+				uint32_t ptr = get_word( pl );
+				if (ptr)
+					printf("0x%x", ptr);
+				else
+					printf("(nil)");
+			}
+			break;
+		case 'x':
+		case 'd':
+		case 'u':
+		case 'o':
+			if (is_longlong)
+				printf( fstr, (long long) get_quad( pl ) );
+			else
+				printf( fstr, (int) get_word( pl ) );
+			break;
+		case 's':
+			printf( fstr, get_text( pl, text, sizeof text ) );
+			break;
+		case 'S':
+			fputs( get_text( pl, text, sizeof text ), stdout );
+			break;
+		case 'c':
+			printf( fstr, (int) get_word( pl ) );
+			break;
+		case 0:
+			continue;
+		default:
+			printf("(?%c=%x)", *fmt, get_word( pl ));
+			break;
+		}
+		fmt++;
+	}
+}
+
+static void usage( const char *prog )
+{
+	fprintf(stderr, "Usage: %s [-t] <trace file>\n", prog);
+	fprintf(stderr, "  -t   prefix each line with the time and thread id\n");
+	exit(1);
+}
+
+int main( int argc, char **argv )
+{
+	const bintrace_header *header;
+	const bintrace_record *ring;
+	struct stat st;
+	uint64_t n, start;
+	uint8_t *event;
+	int fd, ch;
+	void *p;
+
+	while ((ch = getopt( argc, argv, "t" )) != -1)
+	{
+		if (ch == 't')
+			show_timestamps = 1;
+		else
+			usage( argv[0] );
+	}
+	if (optind != argc - 1)
+		usage( argv[0] );
+
+	fd = open( argv[optind], O_RDONLY );
+	if (fd < 0 || fstat( fd, &st ) < 0)
+	{
+		perror( argv[optind] );
+		return 1;
+	}
+
+	p = mmap( 0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+	if (p == MAP_FAILED || st.st_size < BINTRACE_HEADER_SIZE)
+	{
+		fprintf(stderr, "%s: not a trace file\n", argv[optind]);
+		return 1;
+	}
+
+	header = p;
+	if (header->magic != BINTRACE_MAGIC ||
+		header->version != BINTRACE_VERSION ||
+		header->record_size != sizeof (bintrace_record) ||
+		st.st_size < BINTRACE_HEADER_SIZE + (off_t) header->num_records * sizeof (bintrace_record))
+	{
+		fprintf(stderr, "%s: bad trace header\n", argv[optind]);
+		return 1;
+	}
+
+	ring = (const bintrace_record*) ((const uint8_t*) p + BINTRACE_HEADER_SIZE);
+	event = malloc( 0x10000 );
+
+	// only the last num_records records are still in the ring
+	start = 0;
+	if (header->next > header->num_records)
+		start = header->next - header->num_records;
+
+	n = start;
+	while (n < header->next)
+	{
+		const bintrace_record *rec = &ring[n % header->num_records];
+		struct payload pl;
+		uint32_t len, ofs;
+
+		n++;
+
+		// the head of this event was overwritten
+		if (rec->event == bintrace_ev_data)
+			continue;
+
+		len = rec->length;
+		ofs = len < BINTRACE_PAYLOAD ? len : BINTRACE_PAYLOAD;
+		memcpy( event, rec->payload, ofs );
+		while (ofs < len && n < header->next)
+		{
+			const bintrace_record *data = &ring[n % header->num_records];
+			uint32_t chunk = len - ofs;
+			if (data->event != bintrace_ev_data)
+				break;
+			if (chunk > BINTRACE_PAYLOAD)
+				chunk = BINTRACE_PAYLOAD;
+			memcpy( event + ofs, data->payload, chunk );
+			ofs += chunk;
+			n++;
+		}
+		if (ofs < len)
+			continue;
+
+		pl.data = event;
+		pl.length = len;
+		pl.ofs = 0;
+
+		if (rec->event == bintrace_ev_string)
+		{
+			uint32_t id = get_word( &pl );
+			define_string( id, (const char*) event + 4, strnlen( (const char*) event + 4, len - 4 ) );
+			continue;
+		}
+
+		if (show_timestamps)
+			printf("%llu.%09llu %04x ", (unsigned long long) rec->timestamp / 1000000000ULL,
+				(unsigned long long) rec->timestamp % 1000000000ULL, rec->thread_id);
+
+		switch (rec->event)
+		{
+		case bintrace_ev_syscall_enter:
+			dump_syscall_enter( rec->thread_id, &pl );
+			break;
+		case bintrace_ev_syscall_exit:
+			dump_syscall_exit( rec->thread_id, &pl );
+			break;
+		case bintrace_ev_message:
+			dump_message( &pl );
+			break;
+		default:
+			printf("unknown event %d\n", rec->event);
+		}
+	}
+
+	free( event );
+	munmap( p, st.st_size );
+
+	return 0;
+}
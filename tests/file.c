@@ -171,6 +171,7 @@ void test_query_directory( void )
 	WCHAR filename[] = L"\\??\\c:\\filetest\\edb.chk";
 	WCHAR edb[] = L"edb<\"*";
 	UNICODE_STRING path, mask, empty;
+	PFILE_BOTH_DIRECTORY_INFORMATION info;
 	OBJECT_ATTRIBUTES oa;
 	HANDLE dir, file;
 	IO_STATUS_BLOCK iosb;
@@ -238,6 +239,26 @@ void test_query_directory( void )
 	r = NtQueryDirectoryFile( dir, 0, 0, 0, &iosb, buffer, sizeof buffer, FileBothDirectoryInformation, TRUE, 0, 0);
 	ok( r == STATUS_NO_MORE_FILES, "failed to query directory %08lx\n", r);
 
+	// as many entries as fit, aligned to 8 bytes
+	r = NtQueryDirectoryFile( dir, 0, 0, 0, &iosb, buffer, sizeof buffer, FileBothDirectoryInformation, FALSE, 0, TRUE);
+	ok( r == STATUS_SUCCESS, "failed to query directory %08lx\n", r);
+	ok( iosb.Status == STATUS_SUCCESS, "status wrong %08lx\n", iosb.Status);
+	ok( iosb.Information == 0xc2, "information wrong %08lx\n", iosb.Information);
+	info = (void*) buffer;
+	ok( info->NextEntryOffset == 0x60, "NextEntryOffset wrong %08lx\n", info->NextEntryOffset );
+	ok( info->FileNameLength == 2, "FileNameLength wrong %ld\n", info->FileNameLength );
+	info = (void*) (buffer + info->NextEntryOffset);
+	ok( info->NextEntryOffset == 0, "NextEntryOffset wrong %08lx\n", info->NextEntryOffset );
+	ok( info->FileNameLength == 4, "FileNameLength wrong %ld\n", info->FileNameLength );
+
+	// the entry that didn't fit comes next
+	r = NtQueryDirectoryFile( dir, 0, 0, 0, &iosb, buffer, sizeof buffer, FileBothDirectoryInformation, FALSE, 0, 0);
+	ok( r == STATUS_SUCCESS, "failed to query directory %08lx\n", r);
+	check_edb(&iosb, buffer);
+
+	r = NtQueryDirectoryFile( dir, 0, 0, 0, &iosb, buffer, sizeof buffer, FileBothDirectoryInformation, FALSE, 0, 0);
+	ok( r == STATUS_NO_MORE_FILES, "failed to query directory %08lx\n", r);
+
 	// try with a mask
 	r = NtQueryDirectoryFile( dir, 0, 0, 0, &iosb, buffer, sizeof buffer, FileBothDirectoryInformation, TRUE, &mask, TRUE);
 	ok( r == STATUS_SUCCESS, "failed to query directory %08lx\n", r);
@@ -311,6 +332,18 @@ void test_query_directory( void )
 	ok( r == STATUS_SUCCESS, "query failed %08lx\n", r);
 	check_edb(&iosb, buffer);
 
+	// star in the middle
+	r = query_one(&oa, L"e*k", buffer, sizeof buffer, &iosb);
+	ok( r == STATUS_SUCCESS, "query failed %08lx\n", r);
+	check_edb(&iosb, buffer);
+	r = query_one(&oa, L"e?b*.c?k", buffer, sizeof buffer, &iosb);
+	ok( r == STATUS_SUCCESS, "query failed %08lx\n", r);
+	check_edb(&iosb, buffer);
+
+	// the rest of the mask still has to match after a star
+	r = query_one(&oa, L"e*.dll", buffer, sizeof buffer, &iosb);
+	ok( r == STATUS_NO_SUCH_FILE, "query failed %08lx\n", r);
+
 	// bad masks
 	r = query_one(&oa, L"|", buffer, sizeof buffer, &iosb);
 	ok( r == STATUS_NO_SUCH_FILE, "query failed %08lx\n", r);
@@ -332,6 +365,615 @@ void test_query_directory( void )
 	ok( r == STATUS_SUCCESS, "failed to delete directory %08lx\n", r);
 }
 
+// count the entries, restarting the scan
+static ULONG count_entries( HANDLE dir )
+{
+	BYTE buffer[0x200];
+	IO_STATUS_BLOCK iosb;
+	BOOLEAN restart = TRUE;
+	ULONG n = 0;
+	NTSTATUS r;
+
+	while (1)
+	{
+		r = NtQueryDirectoryFile( dir, 0, 0, 0, &iosb, buffer, sizeof buffer,
+				FileBothDirectoryInformation, TRUE, 0, restart );
+		if (r != STATUS_SUCCESS)
+			break;
+		restart = FALSE;
+		n++;
+	}
+	ok( r == STATUS_NO_MORE_FILES, "query failed %08lx\n", r);
+	return n;
+}
+
+static void big_dir_filename( WCHAR *name, ULONG n )
+{
+	WCHAR prefix[] = L"\\??\\c:\\filetest\\a_fairly_long_file_name_";
+	ULONG i;
+
+	for (i=0; prefix[i]; i++)
+		name[i] = prefix[i];
+	name[i++] = '0' + (n/100)%10;
+	name[i++] = '0' + (n/10)%10;
+	name[i++] = '0' + n%10;
+	name[i] = 0;
+}
+
+void test_big_directory( void )
+{
+	WCHAR dirname[] = L"\\??\\c:\\filetest";
+	WCHAR filename[0x40];
+	const ULONG num_files = 300;
+	UNICODE_STRING path;
+	OBJECT_ATTRIBUTES oa;
+	IO_STATUS_BLOCK iosb;
+	HANDLE dir, file;
+	NTSTATUS r;
+	ULONG i, n;
+
+	init_oa( &oa, &path, dirname );
+	NtDeleteFile( &oa );
+
+	r = NtCreateFile( &dir, GENERIC_READ | GENERIC_WRITE | FILE_LIST_DIRECTORY, &oa, &iosb,
+			0, FILE_ATTRIBUTE_DIRECTORY, FILE_SHARE_READ, FILE_CREATE, FILE_DIRECTORY_FILE, 0, 0 );
+	ok( r == STATUS_SUCCESS, "failed to create dir %08lx\n", r);
+
+	// more names than fit in one read of the host directory
+	for (i=0; i<num_files; i++)
+	{
+		big_dir_filename( filename, i );
+		init_oa( &oa, &path, filename );
+		r = NtCreateFile( &file, GENERIC_READ | GENERIC_WRITE, &oa, &iosb,
+				0, FILE_ATTRIBUTE_NORMAL, FILE_SHARE_READ, FILE_CREATE, 0, 0, 0 );
+		ok( r == STATUS_SUCCESS, "failed to create file %08lx\n", r);
+		NtClose( file );
+	}
+
+	n = count_entries( dir );
+	ok( n == num_files + 2, "wrong number of entries %ld\n", n);
+
+	// a new file shows up in the next scan
+	big_dir_filename( filename, num_files );
+	init_oa( &oa, &path, filename );
+	r = NtCreateFile( &file, GENERIC_READ | GENERIC_WRITE, &oa, &iosb,
+			0, FILE_ATTRIBUTE_NORMAL, FILE_SHARE_READ, FILE_CREATE, 0, 0, 0 );
+	ok( r == STATUS_SUCCESS, "failed to create file %08lx\n", r);
+	NtClose( file );
+
+	n = count_entries( dir );
+	ok( n == num_files + 3, "wrong number of entries %ld\n", n);
+
+	for (i=0; i<=num_files; i++)
+	{
+		big_dir_filename( filename, i );
+		init_oa( &oa, &path, filename );
+		r = NtDeleteFile( &oa );
+		ok( r == STATUS_SUCCESS, "failed to delete file %08lx\n", r);
+	}
+
+	// and a deleted one goes away
+	n = count_entries( dir );
+	ok( n == 2, "wrong number of entries %ld\n", n);
+
+	NtClose( dir );
+
+	init_oa( &oa, &path, dirname );
+	r = NtDeleteFile( &oa );
+	ok( r == STATUS_SUCCESS, "failed to delete directory %08lx\n", r);
+}
+
+void test_open_missing( void )
+{
+	WCHAR dirname[] = L"\\??\\c:\\filetest";
+	WCHAR filename[] = L"\\??\\c:\\filetest\\probe.dll";
+	WCHAR subdir[] = L"\\??\\c:\\filetest\\subdir";
+	WCHAR subfile[] = L"\\??\\c:\\filetest\\subdir\\probe.dll";
+	UNICODE_STRING path;
+	OBJECT_ATTRIBUTES oa;
+	IO_STATUS_BLOCK iosb;
+	HANDLE dir, file;
+	NTSTATUS r;
+
+	init_oa( &oa, &path, dirname );
+	r = NtCreateFile( &dir, GENERIC_READ | GENERIC_WRITE | FILE_LIST_DIRECTORY, &oa, &iosb,
+			0, FILE_ATTRIBUTE_DIRECTORY, FILE_SHARE_READ, FILE_CREATE, FILE_DIRECTORY_FILE, 0, 0 );
+	ok( r == STATUS_SUCCESS, "failed to create dir %08lx\n", r);
+	NtClose( dir );
+
+	// probe for a file twice, then create it
+	init_oa( &oa, &path, filename );
+	r = NtOpenFile( &file, GENERIC_READ, &oa, &iosb, FILE_SHARE_READ, 0 );
+	ok( r == STATUS_OBJECT_NAME_NOT_FOUND, "open wrong %08lx\n", r);
+	r = NtOpenFile( &file, GENERIC_READ, &oa, &iosb, FILE_SHARE_READ, 0 );
+	ok( r == STATUS_OBJECT_NAME_NOT_FOUND, "open wrong %08lx\n", r);
+
+	r = NtCreateFile( &file, GENERIC_READ | GENERIC_WRITE, &oa, &iosb,
+			0, FILE_ATTRIBUTE_NORMAL, FILE_SHARE_READ, FILE_CREATE, 0, 0, 0 );
+	ok( r == STATUS_SUCCESS, "failed to create file %08lx\n", r);
+	NtClose( file );
+
+	r = NtOpenFile( &file, GENERIC_READ, &oa, &iosb, FILE_SHARE_READ, 0 );
+	ok( r == STATUS_SUCCESS, "open failed %08lx\n", r);
+	NtClose( file );
+
+	// a missing directory on the way is a missing path
+	init_oa( &oa, &path, subfile );
+	r = NtOpenFile( &file, GENERIC_READ, &oa, &iosb, FILE_SHARE_READ, 0 );
+	ok( r == STATUS_OBJECT_PATH_NOT_FOUND, "open wrong %08lx\n", r);
+
+	// and a missing directory as the leaf is a missing name
+	init_oa( &oa, &path, subdir );
+	r = NtOpenFile( &dir, GENERIC_READ | FILE_LIST_DIRECTORY, &oa, &iosb,
+			FILE_SHARE_READ, FILE_DIRECTORY_FILE );
+	ok( r == STATUS_OBJECT_NAME_NOT_FOUND, "open wrong %08lx\n", r);
+
+	init_oa( &oa, &path, subdir );
+	r = NtCreateFile( &dir, GENERIC_READ | GENERIC_WRITE | FILE_LIST_DIRECTORY, &oa, &iosb,
+			0, FILE_ATTRIBUTE_DIRECTORY, FILE_SHARE_READ, FILE_CREATE, FILE_DIRECTORY_FILE, 0, 0 );
+	ok( r == STATUS_SUCCESS, "failed to create dir %08lx\n", r);
+	NtClose( dir );
+
+	init_oa( &oa, &path, subfile );
+	r = NtCreateFile( &file, GENERIC_READ | GENERIC_WRITE, &oa, &iosb,
+			0, FILE_ATTRIBUTE_NORMAL, FILE_SHARE_READ, FILE_CREATE, 0, 0, 0 );
+	ok( r == STATUS_SUCCESS, "failed to create file %08lx\n", r);
+	NtClose( file );
+
+	r = NtDeleteFile( &oa );
+	ok( r == STATUS_SUCCESS, "failed to delete file %08lx\n", r);
+	init_oa( &oa, &path, subdir );
+	r = NtDeleteFile( &oa );
+	ok( r == STATUS_SUCCESS, "failed to delete directory %08lx\n", r);
+
+	// the deleted directory is gone
+	init_oa( &oa, &path, subfile );
+	r = NtOpenFile( &file, GENERIC_READ, &oa, &iosb, FILE_SHARE_READ, 0 );
+	ok( r == STATUS_OBJECT_PATH_NOT_FOUND, "open wrong %08lx\n", r);
+
+	init_oa( &oa, &path, filename );
+	r = NtDeleteFile( &oa );
+	ok( r == STATUS_SUCCESS, "failed to delete file %08lx\n", r);
+	init_oa( &oa, &path, dirname );
+	r = NtDeleteFile( &oa );
+	ok( r == STATUS_SUCCESS, "failed to delete directory %08lx\n", r);
+}
+
+void test_file_read_write( void )
+{
+	WCHAR filename[] = L"\\??\\c:\\filetest.dat";
+	FILE_POSITION_INFORMATION info;
+	UNICODE_STRING path;
+	OBJECT_ATTRIBUTES oa;
+	IO_STATUS_BLOCK iosb;
+	LARGE_INTEGER pos;
+	HANDLE file, file2;
+	char buffer[0x20];
+	NTSTATUS r;
+
+	init_oa( &oa, &path, filename );
+	NtDeleteFile( &oa );
+
+	r = NtCreateFile( &file, GENERIC_READ | GENERIC_WRITE | SYNCHRONIZE, &oa, &iosb,
+			0, FILE_ATTRIBUTE_NORMAL, FILE_SHARE_READ, FILE_CREATE,
+			FILE_SYNCHRONOUS_IO_NONALERT, 0, 0 );
+	ok( r == STATUS_SUCCESS, "failed to create file %08lx\n", r);
+
+	pos.QuadPart = 0;
+	r = NtWriteFile( file, 0, 0, 0, &iosb, "0123456789", 10, &pos, 0 );
+	ok( r == STATUS_SUCCESS, "write failed %08lx\n", r);
+	ok( iosb.Information == 10, "information wrong %08lx\n", iosb.Information);
+
+	// overwrite in the middle
+	pos.QuadPart = 4;
+	r = NtWriteFile( file, 0, 0, 0, &iosb, "ab", 2, &pos, 0 );
+	ok( r == STATUS_SUCCESS, "write failed %08lx\n", r);
+	ok( iosb.Information == 2, "information wrong %08lx\n", iosb.Information);
+
+	// append
+	pos.HighPart = -1;
+	pos.LowPart = 0xffffffff;  // FILE_WRITE_TO_END_OF_FILE
+	r = NtWriteFile( file, 0, 0, 0, &iosb, "xy", 2, &pos, 0 );
+	ok( r == STATUS_SUCCESS, "write failed %08lx\n", r);
+	ok( iosb.Information == 2, "information wrong %08lx\n", iosb.Information);
+
+	memset( buffer, 0, sizeof buffer );
+	pos.QuadPart = 3;
+	r = NtReadFile( file, 0, 0, 0, &iosb, buffer, 4, &pos, 0 );
+	ok( r == STATUS_SUCCESS, "read failed %08lx\n", r);
+	ok( iosb.Information == 4, "information wrong %08lx\n", iosb.Information);
+	ok( !memcmp( buffer, "3ab6", 4 ), "data wrong %s\n", buffer);
+
+	// short read at the end of the file
+	memset( buffer, 0, sizeof buffer );
+	pos.QuadPart = 8;
+	r = NtReadFile( file, 0, 0, 0, &iosb, buffer, sizeof buffer, &pos, 0 );
+	ok( r == STATUS_SUCCESS, "read failed %08lx\n", r);
+	ok( iosb.Information == 4, "information wrong %08lx\n", iosb.Information);
+	ok( !memcmp( buffer, "89xy", 4 ), "data wrong %s\n", buffer);
+
+	// small reads at the file pointer
+	info.CurrentByteOffset.QuadPart = 2;
+	r = NtSetInformationFile( file, &iosb, &info, sizeof info, FilePositionInformation );
+	ok( r == STATUS_SUCCESS, "set position failed %08lx\n", r);
+
+	memset( buffer, 0, sizeof buffer );
+	r = NtReadFile( file, 0, 0, 0, &iosb, buffer, 3, 0, 0 );
+	ok( r == STATUS_SUCCESS, "read failed %08lx\n", r);
+	ok( iosb.Information == 3, "information wrong %08lx\n", iosb.Information);
+	ok( !memcmp( buffer, "23a", 3 ), "data wrong %s\n", buffer);
+
+	// a write through another handle is seen by the next read
+	r = NtOpenFile( &file2, GENERIC_READ | GENERIC_WRITE | SYNCHRONIZE, &oa, &iosb,
+			FILE_SHARE_READ | FILE_SHARE_WRITE, FILE_SYNCHRONOUS_IO_NONALERT );
+	ok( r == STATUS_SUCCESS, "open failed %08lx\n", r);
+	pos.QuadPart = 5;
+	r = NtWriteFile( file2, 0, 0, 0, &iosb, "BC", 2, &pos, 0 );
+	ok( r == STATUS_SUCCESS, "write failed %08lx\n", r);
+	r = NtClose( file2 );
+	ok( r == STATUS_SUCCESS, "close failed %08lx\n", r);
+
+	memset( buffer, 0, sizeof buffer );
+	r = NtReadFile( file, 0, 0, 0, &iosb, buffer, 3, 0, 0 );
+	ok( r == STATUS_SUCCESS, "read failed %08lx\n", r);
+	ok( iosb.Information == 3, "information wrong %08lx\n", iosb.Information);
+	ok( !memcmp( buffer, "BC7", 3 ), "data wrong %s\n", buffer);
+
+	// reading on past the end
+	memset( buffer, 0, sizeof buffer );
+	r = NtReadFile( file, 0, 0, 0, &iosb, buffer, sizeof buffer, 0, 0 );
+	ok( r == STATUS_SUCCESS, "read failed %08lx\n", r);
+	ok( iosb.Information == 4, "information wrong %08lx\n", iosb.Information);
+	ok( !memcmp( buffer, "89xy", 4 ), "data wrong %s\n", buffer);
+
+	// nothing left to read
+	iosb.Status = -1;
+	iosb.Information = -1;
+	r = NtReadFile( file, 0, 0, 0, &iosb, buffer, sizeof buffer, 0, 0 );
+	ok( r == STATUS_END_OF_FILE, "read wrong %08lx\n", r);
+	ok( iosb.Status == STATUS_END_OF_FILE, "status wrong %08lx\n", iosb.Status);
+	ok( iosb.Information == 0, "information wrong %08lx\n", iosb.Information);
+
+	// reading at an offset moves the file pointer on from there
+	memset( buffer, 0, sizeof buffer );
+	pos.QuadPart = 1;
+	r = NtReadFile( file, 0, 0, 0, &iosb, buffer, 2, &pos, 0 );
+	ok( r == STATUS_SUCCESS, "read failed %08lx\n", r);
+	ok( !memcmp( buffer, "12", 2 ), "data wrong %s\n", buffer);
+
+	memset( buffer, 0, sizeof buffer );
+	r = NtReadFile( file, 0, 0, 0, &iosb, buffer, 2, 0, 0 );
+	ok( r == STATUS_SUCCESS, "read failed %08lx\n", r);
+	ok( !memcmp( buffer, "3a", 2 ), "data wrong %s\n", buffer);
+
+	// and so does writing at an offset
+	pos.QuadPart = 8;
+	r = NtWriteFile( file, 0, 0, 0, &iosb, "pq", 2, &pos, 0 );
+	ok( r == STATUS_SUCCESS, "write failed %08lx\n", r);
+
+	memset( buffer, 0, sizeof buffer );
+	r = NtReadFile( file, 0, 0, 0, &iosb, buffer, 2, 0, 0 );
+	ok( r == STATUS_SUCCESS, "read failed %08lx\n", r);
+	ok( !memcmp( buffer, "xy", 2 ), "data wrong %s\n", buffer);
+
+	r = NtClose( file );
+	ok( r == STATUS_SUCCESS, "close failed %08lx\n", r);
+
+	r = NtDeleteFile( &oa );
+	ok( r == STATUS_SUCCESS, "failed to delete file %08lx\n", r);
+}
+
+void test_file_async( void )
+{
+	WCHAR filename[] = L"\\??\\c:\\asynctest.dat";
+	FILE_COMPLETION_INFORMATION info;
+	UNICODE_STRING path;
+	OBJECT_ATTRIBUTES oa;
+	IO_STATUS_BLOCK iosb, iosb2;
+	LARGE_INTEGER pos, timeout;
+	HANDLE file, event, event2, port;
+	ULONG key, val;
+	char buffer[0x20];
+	NTSTATUS r;
+
+	init_oa( &oa, &path, filename );
+	NtDeleteFile( &oa );
+
+	// no FILE_SYNCHRONOUS_IO_* option, so I/O is asynchronous
+	r = NtCreateFile( &file, GENERIC_READ | GENERIC_WRITE | SYNCHRONIZE, &oa, &iosb,
+			0, FILE_ATTRIBUTE_NORMAL, FILE_SHARE_READ, FILE_CREATE, 0, 0, 0 );
+	ok( r == STATUS_SUCCESS, "failed to create file %08lx\n", r);
+
+	r = NtCreateEvent( &event, EVENT_ALL_ACCESS, NULL, NotificationEvent, 0 );
+	ok( r == STATUS_SUCCESS, "failed to create event %08lx\n", r);
+
+	r = NtCreateIoCompletion( &port, GENERIC_READ | GENERIC_WRITE | SYNCHRONIZE, 0, 0 );
+	ok( r == STATUS_SUCCESS, "failed to create completion port %08lx\n", r);
+
+	info.CompletionPort = port;
+	info.CompletionKey = 0x1234;
+	r = NtSetInformationFile( file, &iosb, &info, sizeof info, FileCompletionInformation );
+	ok( r == STATUS_SUCCESS, "failed to set completion port %08lx\n", r);
+
+	// asynchronous requests need an offset
+	r = NtWriteFile( file, event, 0, 0, &iosb, "0123456789", 10, 0, 0 );
+	ok( r == STATUS_INVALID_PARAMETER, "write wrong %08lx\n", r);
+
+	pos.QuadPart = 0;
+	iosb.Status = -1;
+	iosb.Information = -1;
+	r = NtWriteFile( file, event, 0, (PVOID) 0x55, &iosb, "0123456789", 10, &pos, 0 );
+	ok( r == STATUS_PENDING, "write wrong %08lx\n", r);
+
+	r = NtWaitForSingleObject( event, FALSE, NULL );
+	ok( r == STATUS_SUCCESS, "wait failed %08lx\n", r);
+	ok( iosb.Status == STATUS_SUCCESS, "status wrong %08lx\n", iosb.Status);
+	ok( iosb.Information == 10, "information wrong %08lx\n", iosb.Information);
+
+	timeout.QuadPart = 0;
+	r = NtRemoveIoCompletion( port, &key, &val, &iosb, &timeout );
+	ok( r == STATUS_SUCCESS, "remove failed %08lx\n", r);
+	ok( key == 0x1234, "key wrong %08lx\n", key);
+	ok( val == 0x55, "value wrong %08lx\n", val);
+	ok( iosb.Information == 10, "information wrong %08lx\n", iosb.Information);
+
+	// the file is signalled too
+	memset( buffer, 0, sizeof buffer );
+	pos.QuadPart = 2;
+	r = NtReadFile( file, 0, 0, 0, &iosb, buffer, sizeof buffer, &pos, 0 );
+	ok( r == STATUS_PENDING, "read wrong %08lx\n", r);
+
+	r = NtWaitForSingleObject( file, FALSE, NULL );
+	ok( r == STATUS_SUCCESS, "wait failed %08lx\n", r);
+	ok( iosb.Status == STATUS_SUCCESS, "status wrong %08lx\n", iosb.Status);
+	ok( iosb.Information == 8, "information wrong %08lx\n", iosb.Information);
+	ok( !memcmp( buffer, "23456789", 8 ), "data wrong %s\n", buffer);
+
+	// reading past the end
+	pos.QuadPart = 100;
+	r = NtReadFile( file, event, 0, 0, &iosb, buffer, sizeof buffer, &pos, 0 );
+	ok( r == STATUS_PENDING, "read wrong %08lx\n", r);
+
+	r = NtWaitForSingleObject( event, FALSE, NULL );
+	ok( r == STATUS_SUCCESS, "wait failed %08lx\n", r);
+	ok( iosb.Status == STATUS_END_OF_FILE, "status wrong %08lx\n", iosb.Status);
+	ok( iosb.Information == 0, "information wrong %08lx\n", iosb.Information);
+
+	// appends queued together both go at the end
+	r = NtCreateEvent( &event2, EVENT_ALL_ACCESS, NULL, NotificationEvent, 0 );
+	ok( r == STATUS_SUCCESS, "failed to create event %08lx\n", r);
+
+	pos.HighPart = -1;
+	pos.LowPart = 0xffffffff;  // FILE_WRITE_TO_END_OF_FILE
+	r = NtWriteFile( file, event, 0, 0, &iosb, "ab", 2, &pos, 0 );
+	ok( r == STATUS_PENDING, "write wrong %08lx\n", r);
+	r = NtWriteFile( file, event2, 0, 0, &iosb2, "cd", 2, &pos, 0 );
+	ok( r == STATUS_PENDING, "write wrong %08lx\n", r);
+
+	r = NtWaitForSingleObject( event, FALSE, NULL );
+	ok( r == STATUS_SUCCESS, "wait failed %08lx\n", r);
+	ok( iosb.Status == STATUS_SUCCESS, "status wrong %08lx\n", iosb.Status);
+	r = NtWaitForSingleObject( event2, FALSE, NULL );
+	ok( r == STATUS_SUCCESS, "wait failed %08lx\n", r);
+	ok( iosb2.Status == STATUS_SUCCESS, "status wrong %08lx\n", iosb2.Status);
+
+	memset( buffer, 0, sizeof buffer );
+	pos.QuadPart = 10;
+	r = NtReadFile( file, event, 0, 0, &iosb, buffer, sizeof buffer, &pos, 0 );
+	ok( r == STATUS_PENDING, "read wrong %08lx\n", r);
+
+	r = NtWaitForSingleObject( event, FALSE, NULL );
+	ok( r == STATUS_SUCCESS, "wait failed %08lx\n", r);
+	ok( iosb.Information == 4, "information wrong %08lx\n", iosb.Information);
+	ok( !memcmp( buffer, "abcd", 4 ) || !memcmp( buffer, "cdab", 4 ), "data wrong %s\n", buffer);
+
+	NtClose( event2 );
+	NtClose( port );
+	NtClose( event );
+
+	r = NtClose( file );
+	ok( r == STATUS_SUCCESS, "close failed %08lx\n", r);
+
+	r = NtDeleteFile( &oa );
+	ok( r == STATUS_SUCCESS, "failed to delete file %08lx\n", r);
+}
+
+void test_query_attributes( void )
+{
+	WCHAR filename[] = L"\\??\\c:\\attrtest.dat";
+	WCHAR missing[] = L"\\??\\c:\\attrtest.missing";
+	WCHAR missing_dir[] = L"\\??\\c:\\attrtest.missing\\file";
+	FILE_NETWORK_OPEN_INFORMATION info;
+	UNICODE_STRING path;
+	OBJECT_ATTRIBUTES oa;
+	IO_STATUS_BLOCK iosb;
+	LARGE_INTEGER pos;
+	HANDLE file;
+	NTSTATUS r;
+
+	init_oa( &oa, &path, missing );
+	r = NtQueryFullAttributesFile( &oa, &info );
+	ok( r == STATUS_OBJECT_NAME_NOT_FOUND, "query wrong %08lx\n", r);
+
+	init_oa( &oa, &path, missing_dir );
+	r = NtQueryFullAttributesFile( &oa, &info );
+	ok( r == STATUS_OBJECT_PATH_NOT_FOUND, "query wrong %08lx\n", r);
+
+	init_oa( &oa, &path, filename );
+	NtDeleteFile( &oa );
+
+	r = NtCreateFile( &file, GENERIC_READ | GENERIC_WRITE | SYNCHRONIZE, &oa, &iosb,
+			0, FILE_ATTRIBUTE_NORMAL, FILE_SHARE_READ, FILE_CREATE,
+			FILE_SYNCHRONOUS_IO_NONALERT, 0, 0 );
+	ok( r == STATUS_SUCCESS, "failed to create file %08lx\n", r);
+
+	memset( &info, 0xff, sizeof info );
+	r = NtQueryFullAttributesFile( &oa, &info );
+	ok( r == STATUS_SUCCESS, "query failed %08lx\n", r);
+	ok( info.EndOfFile.QuadPart == 0, "size wrong %08lx\n", info.EndOfFile.LowPart);
+	ok( info.FileAttributes == FILE_ATTRIBUTE_ARCHIVE, "attributes wrong %08lx\n", info.FileAttributes);
+	ok( info.LastWriteTime.QuadPart != 0, "no write time\n");
+
+	// a write is seen straight away
+	pos.QuadPart = 0;
+	r = NtWriteFile( file, 0, 0, 0, &iosb, "0123456789", 10, &pos, 0 );
+	ok( r == STATUS_SUCCESS, "write failed %08lx\n", r);
+
+	r = NtQueryFullAttributesFile( &oa, &info );
+	ok( r == STATUS_SUCCESS, "query failed %08lx\n", r);
+	ok( info.EndOfFile.QuadPart == 10, "size wrong %08lx\n", info.EndOfFile.LowPart);
+
+	r = NtQueryInformationFile( file, &iosb, &info, sizeof info, FileNetworkOpenInformation );
+	ok( r == STATUS_SUCCESS, "query failed %08lx\n", r);
+	ok( info.EndOfFile.QuadPart == 10, "size wrong %08lx\n", info.EndOfFile.LowPart);
+
+	r = NtClose( file );
+	ok( r == STATUS_SUCCESS, "close failed %08lx\n", r);
+
+	// and so is a delete
+	r = NtDeleteFile( &oa );
+	ok( r == STATUS_SUCCESS, "failed to delete file %08lx\n", r);
+
+	r = NtQueryFullAttributesFile( &oa, &info );
+	ok( r == STATUS_OBJECT_NAME_NOT_FOUND, "query wrong %08lx\n", r);
+}
+
+void test_file_access( void )
+{
+	WCHAR filename[] = L"\\??\\c:\\accesstest.dat";
+	UNICODE_STRING path;
+	OBJECT_ATTRIBUTES oa;
+	IO_STATUS_BLOCK iosb;
+	LARGE_INTEGER pos;
+	HANDLE file;
+	char buffer[0x10];
+	NTSTATUS r;
+
+	init_oa( &oa, &path, filename );
+	NtDeleteFile( &oa );
+
+	r = NtCreateFile( &file, GENERIC_WRITE | SYNCHRONIZE, &oa, &iosb,
+			0, FILE_ATTRIBUTE_NORMAL, FILE_SHARE_READ, FILE_CREATE,
+			FILE_SYNCHRONOUS_IO_NONALERT, 0, 0 );
+	ok( r == STATUS_SUCCESS, "failed to create file %08lx\n", r);
+
+	pos.QuadPart = 0;
+	r = NtWriteFile( file, 0, 0, 0, &iosb, "0123456789", 10, &pos, 0 );
+	ok( r == STATUS_SUCCESS, "write failed %08lx\n", r);
+
+	// the handle was not opened for reading
+	r = NtReadFile( file, 0, 0, 0, &iosb, buffer, sizeof buffer, &pos, 0 );
+	ok( r == STATUS_ACCESS_DENIED, "read wrong %08lx\n", r);
+
+	r = NtClose( file );
+	ok( r == STATUS_SUCCESS, "close failed %08lx\n", r);
+
+	r = NtOpenFile( &file, GENERIC_READ | SYNCHRONIZE, &oa, &iosb,
+			FILE_SHARE_READ, FILE_SYNCHRONOUS_IO_NONALERT );
+	ok( r == STATUS_SUCCESS, "failed to open file %08lx\n", r);
+
+	// nor this one for writing
+	r = NtWriteFile( file, 0, 0, 0, &iosb, "ab", 2, &pos, 0 );
+	ok( r == STATUS_ACCESS_DENIED, "write wrong %08lx\n", r);
+
+	memset( buffer, 0, sizeof buffer );
+	r = NtReadFile( file, 0, 0, 0, &iosb, buffer, sizeof buffer, &pos, 0 );
+	ok( r == STATUS_SUCCESS, "read failed %08lx\n", r);
+	ok( iosb.Information == 10, "information wrong %08lx\n", iosb.Information);
+	ok( !memcmp( buffer, "0123456789", 10 ), "data wrong %s\n", buffer);
+
+	r = NtClose( file );
+	ok( r == STATUS_SUCCESS, "close failed %08lx\n", r);
+
+	r = NtDeleteFile( &oa );
+	ok( r == STATUS_SUCCESS, "failed to delete file %08lx\n", r);
+}
+
+static NTSTATUS rename_file( HANDLE file, WCHAR *name, BOOLEAN replace )
+{
+	BYTE buffer[sizeof (FILE_RENAME_INFORMATION) + MAX_PATH * sizeof (WCHAR)];
+	PFILE_RENAME_INFORMATION info = (void*) buffer;
+	IO_STATUS_BLOCK iosb;
+	ULONG len = 0;
+
+	while (name[len])
+		len++;
+	info->Replace = replace;
+	info->RootDir = 0;
+	info->FileNameLength = len * sizeof (WCHAR);
+	memcpy( info->FileName, name, info->FileNameLength );
+
+	return NtSetInformationFile( file, &iosb, info, sizeof buffer, FileRenameInformation );
+}
+
+void test_file_rename( void )
+{
+	WCHAR from[] = L"\\??\\c:\\renametest.dat";
+	WCHAR to[] = L"\\??\\c:\\renametest.new";
+	WCHAR other[] = L"\\??\\c:\\renametest.other";
+	FILE_NETWORK_OPEN_INFORMATION info;
+	UNICODE_STRING path;
+	OBJECT_ATTRIBUTES oa;
+	IO_STATUS_BLOCK iosb;
+	HANDLE file, file2;
+	NTSTATUS r;
+
+	init_oa( &oa, &path, to );
+	NtDeleteFile( &oa );
+	init_oa( &oa, &path, other );
+	NtDeleteFile( &oa );
+	init_oa( &oa, &path, from );
+	NtDeleteFile( &oa );
+
+	r = NtCreateFile( &file, GENERIC_READ | GENERIC_WRITE | DELETE | SYNCHRONIZE, &oa, &iosb,
+			0, FILE_ATTRIBUTE_NORMAL, FILE_SHARE_READ, FILE_CREATE,
+			FILE_SYNCHRONOUS_IO_NONALERT, 0, 0 );
+	ok( r == STATUS_SUCCESS, "failed to create file %08lx\n", r);
+
+	// remember that the new name is missing
+	init_oa( &oa, &path, to );
+	r = NtQueryFullAttributesFile( &oa, &info );
+	ok( r == STATUS_OBJECT_NAME_NOT_FOUND, "query wrong %08lx\n", r);
+
+	r = rename_file( file, to, FALSE );
+	ok( r == STATUS_SUCCESS, "rename failed %08lx\n", r);
+
+	// both names are seen straight away
+	r = NtQueryFullAttributesFile( &oa, &info );
+	ok( r == STATUS_SUCCESS, "query failed %08lx\n", r);
+
+	init_oa( &oa, &path, from );
+	r = NtQueryFullAttributesFile( &oa, &info );
+	ok( r == STATUS_OBJECT_NAME_NOT_FOUND, "query wrong %08lx\n", r);
+
+	// only replace an existing file when asked to
+	init_oa( &oa, &path, other );
+	r = NtCreateFile( &file2, GENERIC_READ | SYNCHRONIZE, &oa, &iosb,
+			0, FILE_ATTRIBUTE_NORMAL, FILE_SHARE_READ, FILE_CREATE,
+			FILE_SYNCHRONOUS_IO_NONALERT, 0, 0 );
+	ok( r == STATUS_SUCCESS, "failed to create file %08lx\n", r);
+
+	r = NtClose( file2 );
+	ok( r == STATUS_SUCCESS, "close failed %08lx\n", r);
+
+	r = rename_file( file, other, FALSE );
+	ok( r == STATUS_OBJECT_NAME_COLLISION, "rename wrong %08lx\n", r);
+
+	r = rename_file( file, other, TRUE );
+	ok( r == STATUS_SUCCESS, "rename failed %08lx\n", r);
+
+	r = NtClose( file );
+	ok( r == STATUS_SUCCESS, "close failed %08lx\n", r);
+
+	init_oa( &oa, &path, to );
+	r = NtQueryFullAttributesFile( &oa, &info );
+	ok( r == STATUS_OBJECT_NAME_NOT_FOUND, "query wrong %08lx\n", r);
+
+	init_oa( &oa, &path, other );
+	r = NtDeleteFile( &oa );
+	ok( r == STATUS_SUCCESS, "failed to delete file %08lx\n", r);
+}
+
 void NtProcessStartup( void )
 {
 	log_init();
@@ -339,6 +981,13 @@ void NtProcessStartup( void )
 	test_rtl_path();
 	test_file_open();
 	test_query_directory();
+	test_big_directory();
+	test_open_missing();
+	test_file_read_write();
+	test_file_async();
+	test_query_attributes();
+	test_file_access();
+	test_file_rename();
 
 	log_fini();
 }
@@ -64,6 +64,7 @@
 #define STATUS_INVALID_PARAMETER_4       ((NTSTATUS) 0xC00000F2)
 #define STATUS_INVALID_PARAMETER_5       ((NTSTATUS) 0xC00000F3)
 #define STATUS_INVALID_PARAMETER_6       ((NTSTATUS) 0xC00000F4)
+#define STATUS_NOT_REGISTRY_FILE         ((NTSTATUS) 0xC000015C)
 #define STATUS_REPLY_MESSAGE_MISMATCH    ((NTSTATUS) 0xC000021F)
 
 #define FSCTL_IS_VOLUME_MOUNTED 0x00090028
@@ -694,6 +695,32 @@ typedef struct _FILE_END_OF_FILE_INFORMATION {
     LARGE_INTEGER EndOfFile;
 } FILE_END_OF_FILE_INFORMATION, *PFILE_END_OF_FILE_INFORMATION;
 
+typedef struct _FILE_NETWORK_OPEN_INFORMATION {
+    LARGE_INTEGER CreationTime;
+    LARGE_INTEGER LastAccessTime;
+    LARGE_INTEGER LastWriteTime;
+    LARGE_INTEGER ChangeTime;
+    LARGE_INTEGER AllocationSize;
+    LARGE_INTEGER EndOfFile;
+    ULONG FileAttributes;
+} FILE_NETWORK_OPEN_INFORMATION, *PFILE_NETWORK_OPEN_INFORMATION;
+
+typedef struct _FILE_COMPLETION_INFORMATION {
+    HANDLE CompletionPort;
+    ULONG CompletionKey;
+} FILE_COMPLETION_INFORMATION, *PFILE_COMPLETION_INFORMATION;
+
+typedef struct _FILE_POSITION_INFORMATION {
+    LARGE_INTEGER CurrentByteOffset;
+} FILE_POSITION_INFORMATION, *PFILE_POSITION_INFORMATION;
+
+typedef struct _FILE_RENAME_INFORMATION {
+    BOOLEAN Replace;
+    HANDLE RootDir;
+    ULONG FileNameLength;
+    WCHAR FileName[1];
+} FILE_RENAME_INFORMATION, *PFILE_RENAME_INFORMATION;
+
 #define FILE_SUPERSEDED     0
 #define FILE_OPENED         1
 #define FILE_CREATED        2
@@ -712,6 +739,39 @@ typedef struct _TIMER_BASIC_INFORMATION {
 	BOOLEAN SignalState;
 } TIMER_BASIC_INFORMATION;
 
+typedef enum _OBJECT_INFORMATION_CLASS {
+	ObjectBasicInformation,
+	ObjectNameInformation,
+	ObjectTypeInformation,
+	ObjectAllTypesInformation,
+	ObjectHandleInformation,
+} OBJECT_INFORMATION_CLASS;
+
+typedef struct _OBJECT_TYPE_INFORMATION {
+	UNICODE_STRING TypeName;
+	ULONG TotalNumberOfObjects;
+	ULONG TotalNumberOfHandles;
+	ULONG TotalPagedPoolUsage;
+	ULONG TotalNonPagedPoolUsage;
+	ULONG TotalNamePoolUsage;
+	ULONG TotalHandleTableUsage;
+	ULONG HighWaterNumberOfObjects;
+	ULONG HighWaterNumberOfHandles;
+	ULONG HighWaterPagedPoolUsage;
+	ULONG HighWaterNonPagedPoolUsage;
+	ULONG HighWaterNamePoolUsage;
+	ULONG HighWaterHandleTableUsage;
+	ULONG InvalidAttributes;
+	GENERIC_MAPPING GenericMapping;
+	ULONG ValidAccessMask;
+	BOOLEAN SecurityRequired;
+	BOOLEAN MaintainHandleCount;
+	USHORT MaintainTypeList;
+	ULONG PoolType;
+	ULONG DefaultPagedPoolCharge;
+	ULONG DefaultNonPagedPoolCharge;
+} OBJECT_TYPE_INFORMATION, *POBJECT_TYPE_INFORMATION;
+
 #define	SECURITY_DESCRIPTOR_REVISION	1
 #define	SECURITY_DESCRIPTOR_REVISION1	1
 
@@ -746,6 +806,13 @@ typedef struct _KEY_FULL_INFORMATION {
 	WCHAR Class[ANYSIZE_ARRAY];
 } KEY_FULL_INFORMATION, *PKEY_FULL_INFORMATION;
 
+typedef struct _KEY_BASIC_INFORMATION {
+	LARGE_INTEGER LastWriteTime;
+	ULONG TitleIndex;
+	ULONG NameLength;
+	WCHAR Name[1];
+} KEY_BASIC_INFORMATION, *PKEY_BASIC_INFORMATION;
+
 #define REG_CREATED_NEW_KEY 1
 #define REG_OPENED_EXISTING_KEY 2
 
@@ -802,12 +869,14 @@ NTSTATUS NTAPI NtDeleteFile(POBJECT_ATTRIBUTES);
 NTSTATUS NTAPI NtDeleteKey(HANDLE);
 NTSTATUS NTAPI NtDeleteValueKey(HANDLE,PUNICODE_STRING);
 NTSTATUS NTAPI NtDisplayString(PUNICODE_STRING);
+NTSTATUS NTAPI NtEnumerateKey(HANDLE,ULONG,KEY_INFORMATION_CLASS,PVOID,ULONG,PULONG);
 NTSTATUS NTAPI NtEnumerateValueKey(HANDLE,ULONG,KEY_VALUE_INFORMATION_CLASS,PVOID,ULONG,PULONG);
 NTSTATUS NTAPI NtFsControlFile(HANDLE,HANDLE,PIO_APC_ROUTINE,PVOID,PIO_STATUS_BLOCK,ULONG,PVOID,ULONG,PVOID,ULONG);
 NTSTATUS NTAPI NtFindAtom(PWSTR,ULONG,PUSHORT);
 NTSTATUS NTAPI NtFreeVirtualMemory(HANDLE,PVOID*,PULONG,ULONG);
 NTSTATUS NTAPI NtGetContextThread(HANDLE,PCONTEXT);
 NTSTATUS NTAPI NtListenPort(HANDLE,PLPC_MESSAGE);
+NTSTATUS NTAPI NtLoadKey(POBJECT_ATTRIBUTES,POBJECT_ATTRIBUTES);
 NTSTATUS NTAPI NtMapViewOfSection(HANDLE,HANDLE,PVOID*,ULONG,SIZE_T,LARGE_INTEGER*,SIZE_T*,SECTION_INHERIT,ULONG,ULONG);
 NTSTATUS NTAPI NtOpenDirectoryObject(PHANDLE,ACCESS_MASK,POBJECT_ATTRIBUTES);
 NTSTATUS NTAPI NtOpenEvent(PHANDLE,ACCESS_MASK,POBJECT_ATTRIBUTES);
@@ -827,13 +896,18 @@ NTSTATUS NTAPI NtQueryInformationJobObject(HANDLE,JOBOBJECTINFOCLASS,PVOID,ULONG
 NTSTATUS NTAPI NtQueryInformationProcess(HANDLE,PROCESS_INFORMATION_CLASS,PVOID,ULONG,PULONG);
 NTSTATUS NTAPI NtQueryInformationThread(HANDLE,THREADINFOCLASS,PVOID,ULONG,PULONG);
 NTSTATUS NTAPI NtQueryTimer(HANDLE,TIMER_INFORMATION_CLASS,PVOID,ULONG,PULONG);
+NTSTATUS NTAPI NtQueryFullAttributesFile(POBJECT_ATTRIBUTES,PFILE_NETWORK_OPEN_INFORMATION);
+NTSTATUS NTAPI NtQueryInformationFile(HANDLE,PIO_STATUS_BLOCK,PVOID,ULONG,FILE_INFORMATION_CLASS);
 NTSTATUS NTAPI NtQueryInformationToken(HANDLE,TOKEN_INFORMATION_CLASS,PVOID,ULONG,PULONG);
 NTSTATUS NTAPI NtQueryKey(HANDLE,KEY_INFORMATION_CLASS,PVOID,ULONG,PULONG);
 NTSTATUS NTAPI NtQueryValueKey(HANDLE,PUNICODE_STRING,KEY_VALUE_INFORMATION_CLASS,PVOID,ULONG,PULONG);
+NTSTATUS NTAPI NtQueryObject(HANDLE,OBJECT_INFORMATION_CLASS,PVOID,ULONG,PULONG);
+NTSTATUS NTAPI NtQueryPerformanceCounter(PLARGE_INTEGER,PLARGE_INTEGER);
 NTSTATUS NTAPI NtQuerySecurityObject(HANDLE,SECURITY_INFORMATION,PSECURITY_DESCRIPTOR,ULONG,PULONG);
 NTSTATUS NTAPI NtQuerySection(HANDLE,SECTION_INFORMATION_CLASS,PVOID,ULONG,PULONG);
 NTSTATUS NTAPI NtQuerySymbolicLinkObject(HANDLE,PUNICODE_STRING,PULONG);
 NTSTATUS NTAPI NtQuerySystemInformation(SYSTEM_INFORMATION_CLASS,PVOID,ULONG,PULONG);
+NTSTATUS NTAPI NtQuerySystemTime(PLARGE_INTEGER);
 NTSTATUS NTAPI NtQueryVirtualMemory(HANDLE,PVOID,MEMORY_INFORMATION_CLASS,PVOID,ULONG,PULONG);
 NTSTATUS NTAPI NtQueueApcThread(HANDLE,PKNORMAL_ROUTINE,PVOID,PVOID,PVOID);
 NTSTATUS NTAPI NtQueryDefaultLocale(BOOLEAN,PLCID);
@@ -849,6 +923,7 @@ NTSTATUS NTAPI NtReleaseMutant(HANDLE,PULONG);
 NTSTATUS NTAPI NtReleaseSemaphore(HANDLE,ULONG,PULONG);
 NTSTATUS NTAPI NtReadFile(HANDLE,HANDLE,PIO_APC_ROUTINE,PVOID,PIO_STATUS_BLOCK,PVOID,ULONG,PLARGE_INTEGER,PULONG);
 NTSTATUS NTAPI NtResetEvent(HANDLE,PULONG);
+NTSTATUS NTAPI NtRestoreKey(HANDLE,HANDLE,ULONG);
 NTSTATUS NTAPI NtResumeThread(HANDLE,PULONG);
 NTSTATUS NTAPI NtSecureConnectPort(PHANDLE,PUNICODE_STRING,PSECURITY_QUALITY_OF_SERVICE,PLPC_SECTION_WRITE,PSID,PLPC_SECTION_READ,PULONG,PVOID,PULONG);
 NTSTATUS NTAPI NtSetEvent(HANDLE,PULONG);
@@ -866,6 +941,7 @@ NTSTATUS NTAPI NtSetValueKey(HANDLE,PUNICODE_STRING,ULONG,ULONG,PVOID,ULONG);
 NTSTATUS NTAPI NtTerminateProcess(HANDLE,NTSTATUS);
 NTSTATUS NTAPI NtTerminateThread(HANDLE,NTSTATUS);
 NTSTATUS NTAPI NtTestAlert();
+NTSTATUS NTAPI NtUnloadKey(POBJECT_ATTRIBUTES);
 NTSTATUS NTAPI NtUnmapViewOfSection(HANDLE,PVOID);
 NTSTATUS NTAPI NtWaitForSingleObject(HANDLE,BOOLEAN,PLARGE_INTEGER);
 NTSTATUS NTAPI NtWaitForMultipleObjects(ULONG,PHANDLE,WAIT_TYPE,BOOLEAN,PLARGE_INTEGER);
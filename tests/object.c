@@ -616,6 +616,91 @@ void test_symbolic_open_target( void )
 	ok( r == STATUS_SUCCESS, "return wrong %08lx\n", r);
 }
 
+static void check_type_name( HANDLE handle, const WCHAR *name )
+{
+	BYTE buffer[0x100];
+	OBJECT_TYPE_INFORMATION *info = (void*) buffer;
+	ULONG len = 0, n = 0;
+	NTSTATUS r;
+
+	while (name[n])
+		n++;
+
+	// too small for the name
+	r = NtQueryObject( handle, ObjectTypeInformation, buffer, sizeof *info, &len );
+	ok( r == STATUS_INFO_LENGTH_MISMATCH, "return wrong %08lx\n", r);
+	ok( len == sizeof *info + (n + 1) * sizeof (WCHAR), "length wrong %ld\n", len);
+
+	memset( buffer, 0, sizeof buffer );
+	len = 0;
+	r = NtQueryObject( handle, ObjectTypeInformation, buffer, sizeof buffer, &len );
+	ok( r == STATUS_SUCCESS, "return wrong %08lx\n", r);
+	if (r != STATUS_SUCCESS)
+		return;
+
+	ok( len == sizeof *info + (n + 1) * sizeof (WCHAR), "length wrong %ld\n", len);
+	ok( info->TypeName.Length == n * sizeof (WCHAR), "name length wrong %d\n", info->TypeName.Length);
+	ok( info->TypeName.Buffer == (WCHAR*) (info + 1), "name buffer wrong %p\n", info->TypeName.Buffer);
+	ok( !memcmp( info->TypeName.Buffer, name, n * sizeof (WCHAR) ), "name wrong\n");
+	ok( info->TypeName.Buffer[n] == 0, "name not terminated\n");
+	ok( info->TotalNumberOfObjects >= 1, "object count wrong %ld\n", info->TotalNumberOfObjects);
+}
+
+void test_query_object_type( void )
+{
+	WCHAR keyname[] = L"\\Registry\\Machine";
+	OBJECT_ATTRIBUTES oa;
+	UNICODE_STRING us;
+	HANDLE handle;
+	NTSTATUS r;
+
+	r = NtCreateEvent( &handle, EVENT_ALL_ACCESS, NULL, NotificationEvent, 0 );
+	ok( r == STATUS_SUCCESS, "return wrong %08lx\n", r);
+	check_type_name( handle, L"Event" );
+	NtClose( handle );
+
+	r = NtCreateEventPair( &handle, STANDARD_RIGHTS_ALL, NULL );
+	ok( r == STATUS_SUCCESS, "return wrong %08lx\n", r);
+	check_type_name( handle, L"EventPair" );
+	NtClose( handle );
+
+	r = NtCreateSemaphore( &handle, SEMAPHORE_ALL_ACCESS, NULL, 0, 1 );
+	ok( r == STATUS_SUCCESS, "return wrong %08lx\n", r);
+	check_type_name( handle, L"Semaphore" );
+	NtClose( handle );
+
+	r = NtCreateTimer( &handle, TIMER_ALL_ACCESS, NULL, NotificationTimer );
+	ok( r == STATUS_SUCCESS, "return wrong %08lx\n", r);
+	check_type_name( handle, L"Timer" );
+	NtClose( handle );
+
+	r = NtCreateIoCompletion( &handle, GENERIC_READ | GENERIC_WRITE, 0, 0 );
+	ok( r == STATUS_SUCCESS, "return wrong %08lx\n", r);
+	check_type_name( handle, L"IoCompletion" );
+	NtClose( handle );
+
+	handle = get_root();
+	check_type_name( handle, L"Directory" );
+	NtClose( handle );
+
+	us.Buffer = keyname;
+	us.Length = sizeof keyname - 2;
+	us.MaximumLength = 0;
+	oa.Length = sizeof oa;
+	oa.RootDirectory = 0;
+	oa.ObjectName = &us;
+	oa.Attributes = OBJ_CASE_INSENSITIVE;
+	oa.SecurityDescriptor = 0;
+	oa.SecurityQualityOfService = 0;
+	r = NtOpenKey( &handle, KEY_READ, &oa );
+	ok( r == STATUS_SUCCESS, "return wrong %08lx\n", r);
+	check_type_name( handle, L"Key" );
+	NtClose( handle );
+
+	check_type_name( NtCurrentProcess(), L"Process" );
+	check_type_name( NtCurrentThread(), L"Thread" );
+}
+
 void NtProcessStartup( void )
 {
 	log_init();
@@ -627,5 +712,6 @@ void NtProcessStartup( void )
 	test_symbolic_link();
 	test_symbolic_open_link();
 	test_symbolic_open_target();
+	test_query_object_type();
 	log_fini();
 }
@@ -211,6 +211,47 @@ void test_terminate_process( void )
 	ok( info.ExitStatus == STATUS_PENDING, "Exit code wrong %08lx\n", info.ExitStatus );
 }
 
+void test_handle_count( void )
+{
+	static HANDLE handles[2000];
+	ULONG before = 0, count = 0, len = 0;
+	NTSTATUS r;
+	int i;
+
+	r = NtQueryInformationProcess( NtCurrentProcess(), ProcessHandleCount, &before, sizeof before, &len );
+	ok( r == STATUS_SUCCESS, "wrong return %08lx\n", r );
+	ok( len == sizeof before, "wrong length %ld\n", len );
+
+	// more handles than would fit in one page of the handle table
+	for (i=0; i<sizeof handles/sizeof handles[0]; i++)
+	{
+		r = NtCreateEvent( &handles[i], EVENT_ALL_ACCESS, 0, NotificationEvent, 0 );
+		ok( r == STATUS_SUCCESS, "wrong return %08lx\n", r );
+		if (r != STATUS_SUCCESS)
+			break;
+	}
+
+	r = NtQueryInformationProcess( NtCurrentProcess(), ProcessHandleCount, &count, sizeof count, 0 );
+	ok( r == STATUS_SUCCESS, "wrong return %08lx\n", r );
+	ok( count == before + i, "wrong count %ld %ld\n", count, before );
+
+	r = NtClose( handles[0] );
+	ok( r == STATUS_SUCCESS, "wrong return %08lx\n", r );
+
+	r = NtClose( handles[0] );
+	ok( r == STATUS_INVALID_HANDLE, "wrong return %08lx\n", r );
+
+	while (--i > 0)
+	{
+		r = NtClose( handles[i] );
+		ok( r == STATUS_SUCCESS, "wrong return %08lx\n", r );
+	}
+
+	r = NtQueryInformationProcess( NtCurrentProcess(), ProcessHandleCount, &count, sizeof count, 0 );
+	ok( r == STATUS_SUCCESS, "wrong return %08lx\n", r );
+	ok( count == before, "wrong count %ld %ld\n", count, before );
+}
+
 void NtProcessStartup( void )
 {
 	log_init();
@@ -218,5 +259,6 @@ void NtProcessStartup( void )
 	test_open_process_param_size();
 	test_read_exception_port();
 	test_terminate_process();
+	test_handle_count();
 	log_fini();
 }
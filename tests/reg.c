@@ -633,6 +633,343 @@ void test_reg_missing_val( void )
 	NtClose( key );
 }
 
+void test_many_subkeys( void )
+{
+	OBJECT_ATTRIBUTES oa;
+	UNICODE_STRING us;
+	WCHAR keyname[] = L"\\REGISTRY\\Machine\\SOFTWARE\\ntregtest";
+	WCHAR subname[] = L"sub00";
+	KEY_BASIC_INFORMATION *info;
+	BYTE buffer[0x100];
+	HANDLE key, subkey[20];
+	ULONG dispos, sz, i;
+	NTSTATUS r;
+
+	init_oa( &oa, &us, keyname );
+	oa.Attributes = OBJ_CASE_INSENSITIVE;
+	r = NtCreateKey( &key, KEY_ALL_ACCESS, &oa, 0, NULL, 0, &dispos );
+	ok( r == STATUS_SUCCESS, "wrong return %08lx\n", r);
+
+	// enough subkeys for the names to be hashed
+	oa.RootDirectory = key;
+	for (i=0; i<20; i++)
+	{
+		subname[3] = '0' + i/10;
+		subname[4] = '0' + i%10;
+		init_us( &us, subname );
+		r = NtCreateKey( &subkey[i], KEY_ALL_ACCESS, &oa, 0, NULL, 0, &dispos );
+		ok( r == STATUS_SUCCESS, "wrong return %08lx\n", r);
+		ok( dispos == REG_CREATED_NEW_KEY, "wrong disposition %ld\n", dispos);
+	}
+
+	// open in a different case
+	init_us( &us, L"SUB17" );
+	r = NtOpenKey( &subkey[17], KEY_ALL_ACCESS, &oa );
+	ok( r == STATUS_SUCCESS, "wrong return %08lx\n", r);
+	NtClose( subkey[17] );
+
+	r = NtDeleteKey( subkey[5] );
+	ok( r == STATUS_SUCCESS, "wrong return %08lx\n", r);
+
+	init_us( &us, L"sub05" );
+	r = NtOpenKey( &subkey[5], KEY_ALL_ACCESS, &oa );
+	ok( r == STATUS_OBJECT_NAME_NOT_FOUND, "wrong return %08lx\n", r);
+
+	// enumeration keeps the order the keys were created in
+	info = (void*) buffer;
+	r = NtEnumerateKey( key, 5, KeyBasicInformation, buffer, sizeof buffer, &sz );
+	ok( r == STATUS_SUCCESS, "wrong return %08lx\n", r);
+	ok( info->NameLength == 10, "wrong length %ld\n", info->NameLength);
+	ok( !memcmp( info->Name, L"sub06", 10 ), "wrong name\n");
+
+	r = NtEnumerateKey( key, 19, KeyBasicInformation, buffer, sizeof buffer, &sz );
+	ok( r == STATUS_NO_MORE_ENTRIES, "wrong return %08lx\n", r);
+
+	for (i=0; i<20; i++)
+	{
+		if (i != 5)
+			NtDeleteKey( subkey[i] );
+		NtClose( subkey[i] );
+	}
+
+	r = NtDeleteKey( key );
+	ok( r == STATUS_SUCCESS, "wrong return %08lx\n", r);
+	NtClose( key );
+}
+
+void test_load_key( void )
+{
+	OBJECT_ATTRIBUTES key_oa, file_oa;
+	UNICODE_STRING key_us, file_us;
+	WCHAR keyname[] = L"\\REGISTRY\\Machine\\ntloadtest";
+	WCHAR filename[] = L"\\??\\c:\\winnt\\system32\\ntdll.dll";
+	WCHAR software[] = L"\\REGISTRY\\Machine\\SOFTWARE";
+	HANDLE key;
+	NTSTATUS r;
+
+	init_oa( &key_oa, &key_us, keyname );
+	key_oa.Attributes = OBJ_CASE_INSENSITIVE;
+	init_oa( &file_oa, &file_us, filename );
+	file_oa.Attributes = OBJ_CASE_INSENSITIVE;
+
+	// not a hive
+	r = NtLoadKey( &key_oa, &file_oa );
+	ok( r == STATUS_NOT_REGISTRY_FILE, "wrong return %08lx\n", r);
+
+	r = NtOpenKey( &key, KEY_READ, &key_oa );
+	ok( r == STATUS_OBJECT_NAME_NOT_FOUND, "wrong return %08lx\n", r);
+
+	// only keys with a hive loaded on them can be unloaded
+	init_us( &key_us, software );
+	r = NtUnloadKey( &key_oa );
+	ok( r == STATUS_INVALID_PARAMETER, "wrong return %08lx\n", r);
+}
+
+// A small hive: a root key with one subkey "sub", a REG_DWORD "val" kept
+// in its value cell, and a REG_SZ "str" with its data in a cell of its own.
+// Cell offsets count from the first hbin.
+#define HIVE_SIZE 0x2000
+#define HIVE_BIN 0x1000
+#define CELL_ROOT 0x20
+#define CELL_SUB 0x78
+#define CELL_LF 0xd0
+#define CELL_VALUES 0xe0
+#define CELL_VAL 0xf0
+#define CELL_STR 0x110
+#define CELL_STR_DATA 0x130
+#define CELL_FREE 0x140
+
+static void hive_put16( BYTE *hive, ULONG ofs, USHORT x )
+{
+	memcpy( hive + ofs, &x, sizeof x );
+}
+
+static void hive_put32( BYTE *hive, ULONG ofs, ULONG x )
+{
+	memcpy( hive + ofs, &x, sizeof x );
+}
+
+// marks a cell allocated, returning where its data is in the file
+static ULONG hive_cell( BYTE *hive, ULONG cell, ULONG size )
+{
+	hive_put32( hive, HIVE_BIN + cell, -size );
+	return HIVE_BIN + cell + 4;
+}
+
+static void hive_key( BYTE *hive, ULONG cell, const char *name, ULONG len,
+	USHORT type, ULONG parent, ULONG lf, ULONG num_subkeys, ULONG vallist, ULONG num_values )
+{
+	ULONG p = hive_cell( hive, cell, 0x58 );
+	hive_put16( hive, p, 0x6b6e );		// "nk"
+	hive_put16( hive, p + 0x02, type );
+	hive_put32( hive, p + 0x10, parent );
+	hive_put32( hive, p + 0x14, num_subkeys );
+	hive_put32( hive, p + 0x1c, lf );
+	hive_put32( hive, p + 0x24, num_values );
+	hive_put32( hive, p + 0x28, vallist );
+	hive_put32( hive, p + 0x2c, -1 );	// no security
+	hive_put32( hive, p + 0x30, -1 );	// no class
+	hive_put16( hive, p + 0x48, len );
+	memcpy( hive + p + 0x4c, name, len );
+}
+
+static void hive_value( BYTE *hive, ULONG cell, const char *name, ULONG len,
+	ULONG type, ULONG data_len, ULONG data )
+{
+	ULONG p = hive_cell( hive, cell, 0x20 );
+	hive_put16( hive, p, 0x6b76 );		// "vk"
+	hive_put16( hive, p + 0x02, len );
+	hive_put32( hive, p + 0x04, data_len );
+	hive_put32( hive, p + 0x08, data );
+	hive_put32( hive, p + 0x0c, type );
+	hive_put16( hive, p + 0x10, 1 );	// compressed name
+	memcpy( hive + p + 0x14, name, len );
+}
+
+static void build_test_hive( BYTE *hive )
+{
+	WCHAR str[] = L"hello";
+	ULONG i, p, sum;
+
+	memset( hive, 0, HIVE_SIZE );
+
+	hive_put32( hive, 0x00, 0x66676572 );	// "regf"
+	hive_put32( hive, 0x04, 1 );
+	hive_put32( hive, 0x08, 1 );
+	hive_put32( hive, 0x14, 1 );
+	hive_put32( hive, 0x18, 3 );
+	hive_put32( hive, 0x20, 1 );
+	hive_put32( hive, 0x24, CELL_ROOT );
+	hive_put32( hive, 0x28, HIVE_SIZE - HIVE_BIN );
+	hive_put32( hive, 0x2c, 1 );
+	for (sum = 0, i = 0; i < 0x1fc; i += 4)
+		sum ^= *(ULONG*) (hive + i);
+	hive_put32( hive, 0x1fc, sum );
+
+	hive_put32( hive, HIVE_BIN, 0x6e696268 );	// "hbin"
+	hive_put32( hive, HIVE_BIN + 0x08, HIVE_SIZE - HIVE_BIN );
+	hive_put32( hive, HIVE_BIN + 0x1c, HIVE_SIZE - HIVE_BIN );
+
+	hive_key( hive, CELL_ROOT, "root", 4, 0x2c, 0, CELL_LF, 1, CELL_VALUES, 2 );
+	hive_key( hive, CELL_SUB, "sub", 3, 0x20, CELL_ROOT, -1, 0, -1, 0 );
+
+	p = hive_cell( hive, CELL_LF, 0x10 );
+	hive_put16( hive, p, 0x666c );		// "lf"
+	hive_put16( hive, p + 0x02, 1 );
+	hive_put32( hive, p + 0x04, CELL_SUB );
+	memcpy( hive + p + 0x08, "sub", 3 );
+
+	p = hive_cell( hive, CELL_VALUES, 0x10 );
+	hive_put32( hive, p, CELL_VAL );
+	hive_put32( hive, p + 0x04, CELL_STR );
+
+	// up to four bytes of data are kept in the value itself
+	hive_value( hive, CELL_VAL, "val", 3, REG_DWORD, 0x80000004, 0x12345678 );
+	hive_value( hive, CELL_STR, "str", 3, REG_SZ, sizeof str, CELL_STR_DATA );
+	p = hive_cell( hive, CELL_STR_DATA, 0x10 );
+	memcpy( hive + p, str, sizeof str );
+
+	// the rest of the bin is free
+	hive_put32( hive, HIVE_BIN + CELL_FREE, HIVE_SIZE - HIVE_BIN - CELL_FREE );
+}
+
+static NTSTATUS write_test_hive( OBJECT_ATTRIBUTES *oa )
+{
+	static BYTE hive[HIVE_SIZE];
+	IO_STATUS_BLOCK iosb;
+	LARGE_INTEGER pos;
+	HANDLE file;
+	NTSTATUS r;
+
+	build_test_hive( hive );
+
+	r = NtCreateFile( &file, GENERIC_WRITE | SYNCHRONIZE, oa, &iosb,
+			0, FILE_ATTRIBUTE_NORMAL, 0, FILE_OPEN_IF,
+			FILE_SYNCHRONOUS_IO_NONALERT, 0, 0 );
+	if (r != STATUS_SUCCESS)
+		return r;
+
+	pos.QuadPart = 0;
+	r = NtWriteFile( file, 0, 0, 0, &iosb, hive, sizeof hive, &pos, 0 );
+	NtClose( file );
+	return r;
+}
+
+// checks a key has the contents of the test hive
+static void check_test_hive( HANDLE key )
+{
+	WCHAR valname[] = L"val";
+	WCHAR strname[] = L"str";
+	BYTE buffer[0x100];
+	KEY_BASIC_INFORMATION *basic = (void*) buffer;
+	KEY_VALUE_PARTIAL_INFORMATION *partial = (void*) buffer;
+	UNICODE_STRING us;
+	ULONG sz = 0;
+	NTSTATUS r;
+
+	memset( buffer, 0, sizeof buffer );
+	r = NtEnumerateKey( key, 0, KeyBasicInformation, buffer, sizeof buffer, &sz );
+	ok( r == STATUS_SUCCESS, "wrong return %08lx\n", r);
+	ok( basic->NameLength == 6, "wrong length %ld\n", basic->NameLength);
+	ok( !memcmp( basic->Name, L"sub", 6 ), "wrong name\n");
+
+	r = NtEnumerateKey( key, 1, KeyBasicInformation, buffer, sizeof buffer, &sz );
+	ok( r == STATUS_NO_MORE_ENTRIES, "wrong return %08lx\n", r);
+
+	init_us( &us, valname );
+	memset( buffer, 0, sizeof buffer );
+	r = NtQueryValueKey( key, &us, KeyValuePartialInformation, buffer, sizeof buffer, &sz );
+	ok( r == STATUS_SUCCESS, "wrong return %08lx\n", r);
+	ok( partial->Type == REG_DWORD, "wrong type %ld\n", partial->Type);
+	ok( partial->DataLength == 4, "wrong length %ld\n", partial->DataLength);
+	ok( *(ULONG*) partial->Data == 0x12345678, "wrong data %08lx\n", *(ULONG*) partial->Data);
+
+	init_us( &us, strname );
+	memset( buffer, 0, sizeof buffer );
+	r = NtQueryValueKey( key, &us, KeyValuePartialInformation, buffer, sizeof buffer, &sz );
+	ok( r == STATUS_SUCCESS, "wrong return %08lx\n", r);
+	ok( partial->Type == REG_SZ, "wrong type %ld\n", partial->Type);
+	ok( partial->DataLength == 12, "wrong length %ld\n", partial->DataLength);
+	ok( !memcmp( partial->Data, L"hello", 12 ), "wrong data\n");
+}
+
+void test_load_hive( void )
+{
+	OBJECT_ATTRIBUTES key_oa, file_oa;
+	UNICODE_STRING key_us, file_us;
+	WCHAR keyname[] = L"\\REGISTRY\\Machine\\ntloadtest";
+	WCHAR restorename[] = L"\\REGISTRY\\Machine\\ntrestoretest";
+	WCHAR subname[] = L"sub";
+	WCHAR filename[] = L"\\??\\c:\\hivetest.dat";
+	IO_STATUS_BLOCK iosb;
+	HANDLE key, subkey, file;
+	ULONG dispos;
+	NTSTATUS r;
+
+	init_oa( &file_oa, &file_us, filename );
+	file_oa.Attributes = OBJ_CASE_INSENSITIVE;
+	r = write_test_hive( &file_oa );
+	ok( r == STATUS_SUCCESS, "failed to write hive %08lx\n", r);
+
+	init_oa( &key_oa, &key_us, keyname );
+	key_oa.Attributes = OBJ_CASE_INSENSITIVE;
+	r = NtLoadKey( &key_oa, &file_oa );
+	ok( r == STATUS_SUCCESS, "wrong return %08lx\n", r);
+
+	// loading twice on the same key fails
+	r = NtLoadKey( &key_oa, &file_oa );
+	ok( r == STATUS_OBJECT_NAME_COLLISION, "wrong return %08lx\n", r);
+
+	r = NtOpenKey( &key, KEY_READ, &key_oa );
+	ok( r == STATUS_SUCCESS, "wrong return %08lx\n", r);
+
+	check_test_hive( key );
+
+	r = NtClose( key );
+	ok( r == STATUS_SUCCESS, "wrong return %08lx\n", r);
+
+	r = NtUnloadKey( &key_oa );
+	ok( r == STATUS_SUCCESS, "wrong return %08lx\n", r);
+
+	r = NtOpenKey( &key, KEY_READ, &key_oa );
+	ok( r == STATUS_OBJECT_NAME_NOT_FOUND, "wrong return %08lx\n", r);
+
+	// restoring replaces what was in the key
+	init_oa( &key_oa, &key_us, restorename );
+	key_oa.Attributes = OBJ_CASE_INSENSITIVE;
+	r = NtCreateKey( &key, KEY_ALL_ACCESS, &key_oa, 0, 0, 0, &dispos );
+	ok( r == STATUS_SUCCESS, "wrong return %08lx\n", r);
+
+	r = NtOpenFile( &file, GENERIC_READ | SYNCHRONIZE, &file_oa, &iosb,
+			FILE_SHARE_READ, FILE_SYNCHRONOUS_IO_NONALERT );
+	ok( r == STATUS_SUCCESS, "failed to open file %08lx\n", r);
+
+	r = NtRestoreKey( key, file, 0 );
+	ok( r == STATUS_SUCCESS, "wrong return %08lx\n", r);
+
+	r = NtClose( file );
+	ok( r == STATUS_SUCCESS, "close failed %08lx\n", r);
+
+	check_test_hive( key );
+
+	init_oa( &key_oa, &key_us, subname );
+	key_oa.RootDirectory = key;
+	key_oa.Attributes = OBJ_CASE_INSENSITIVE;
+	r = NtOpenKey( &subkey, KEY_ALL_ACCESS, &key_oa );
+	ok( r == STATUS_SUCCESS, "wrong return %08lx\n", r);
+
+	r = NtDeleteKey( subkey );
+	ok( r == STATUS_SUCCESS, "wrong return %08lx\n", r);
+	NtClose( subkey );
+
+	r = NtDeleteKey( key );
+	ok( r == STATUS_SUCCESS, "wrong return %08lx\n", r);
+	NtClose( key );
+
+	r = NtDeleteFile( &file_oa );
+	ok( r == STATUS_SUCCESS, "failed to delete file %08lx\n", r);
+}
+
 void NtProcessStartup( void )
 {
 	log_init();
@@ -642,6 +979,9 @@ void NtProcessStartup( void )
 	test_queue_reg_val();
 	test_reg_query_val();
 	test_reg_missing_val();
+	test_many_subkeys();
+	test_load_key();
+	test_load_hive();
 
 	log_fini();
 }